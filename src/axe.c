@@ -22,8 +22,10 @@
  * ============================================================================
  */
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "axe.h"
-#include "gsl_combination.h"
 
 /* Holds the current timestamp, so we don't have to free the returned string
  * from now(). */
@@ -130,6 +132,7 @@ axe_config_destroy_(struct axe_config *config)
     qes_free(config->out_prefixes[1]);
     qes_free(config->infiles[0]);
     qes_free(config->infiles[1]);
+    qes_free(config->index_dir);
     /* outputs */
     if (config->outputs != NULL) {
         for (iii = 0; iii < config->n_barcode_pairs; iii ++) {
@@ -146,15 +149,14 @@ axe_config_destroy_(struct axe_config *config)
     }
     qes_free(config->barcodes);
     /* barcode lookup */
-    if (config->barcode_lookup != NULL) {
-        for (iii = 0; iii < config->n_barcodes_1; iii++) {
-            qes_free(config->barcode_lookup[iii]);
-        }
-    }
-    qes_free(config->barcode_lookup);
+    axe_pair_map_destroy(config->barcode_lookup);
     /* Tries */
     axe_trie_destroy(config->fwd_trie);
     axe_trie_destroy(config->rev_trie);
+    /* Only once nothing points into it */
+    if (config->index_map != NULL) {
+        munmap(config->index_map, config->index_size);
+    }
     /* Logger */
     qes_logger_destroy(config->logger);
     /* config stuct */
@@ -413,12 +415,13 @@ setup_barcode_lookup_single(struct axe_config *config)
     }
     config->n_barcodes_1 = config->n_barcode_pairs;
     config->n_barcodes_2 = 0;
-    config->barcode_lookup = qes_malloc(config->n_barcodes_1 *
-                                        sizeof(*config->barcode_lookup));
+    config->barcode_lookup = axe_pair_map_create(config->n_barcodes_1, 1,
+                                                 config->n_barcode_pairs);
+    if (config->barcode_lookup == NULL) {
+        return -1;
+    }
     for (iii = 0; iii < config->n_barcode_pairs; iii++) {
-        config->barcode_lookup[iii] = qes_malloc(
-                                          sizeof(**config->barcode_lookup));
-        config->barcode_lookup[iii][0] = iii;
+        axe_pair_map_add(config->barcode_lookup, iii, 0, iii);
     }
     return 0;
 }
@@ -464,14 +467,19 @@ setup_barcode_lookup_combo(struct axe_config *config)
     }
     config->n_barcodes_1 = n_barcodes_1;
     config->n_barcodes_2 = n_barcodes_2;
-    /* Make barcode lookup */
-    config->barcode_lookup = qes_malloc(n_barcodes_1 *
-                                        sizeof(*config->barcode_lookup));
-    for (bcd1 = 0; bcd1 < config->n_barcodes_1; bcd1++) {
-        config->barcode_lookup[bcd1] = qes_calloc(n_barcodes_2,
-                                       sizeof(**config->barcode_lookup));
-        memset(config->barcode_lookup[bcd1], -1,
-               n_barcodes_2 * sizeof(**config->barcode_lookup));
+    /* Make barcode lookup: a table, or a hash if few pairs are used */
+    config->barcode_lookup = axe_pair_map_create(n_barcodes_1, n_barcodes_2,
+                                                 config->n_barcode_pairs);
+    if (config->barcode_lookup == NULL) {
+        qes_log_message_fatal(config->logger,
+                              "setup_lookup -- Too many barcode pairs\n");
+        goto error;
+    }
+    if (config->verbosity > 0) {
+        qes_log_format_info(config->logger,
+                "setup_lookup -- Barcode pairs are in a %s of %zu bytes\n",
+                config->barcode_lookup->table != NULL ? "table" : "hash",
+                config->barcode_lookup->bytes);
     }
     /* Setup barcode lookup */
     for (iii = 0; iii < config->n_barcode_pairs; iii++) {
@@ -483,7 +491,9 @@ setup_barcode_lookup_combo(struct axe_config *config)
         res = axe_trie_get(seq2_trie, this_barcode->seq2,
                             (intptr_t *)(&bcd2));
         if (!res) goto error;
-        config->barcode_lookup[bcd1][bcd2] = iii;
+        if (axe_pair_map_add(config->barcode_lookup, bcd1, bcd2, iii) != 0) {
+            goto error;
+        }
     }
     ret = 0;
 
@@ -566,167 +576,390 @@ axe_make_zmode(const struct axe_config *config)
     return strdup("wT");
 }
 
-static inline int
-load_tries_combo(struct axe_config *config)
+/* Keys that expanding n barcodes to every mutant would make */
+static double
+count_mutants(size_t n, size_t len, size_t mismatches)
 {
-    int bcd1 = -1;
-    int bcd2 = -1;
-    int retval = 0;
-    char **mutated = NULL;
-    size_t num_mutated = 0;
-    int ret = 0;
+    double per_dist = 1.0;
+    double total = 0.0;
+    size_t dist = 0;
+
+    for (dist = 1; dist <= mismatches && dist <= len; dist++) {
+        per_dist = per_dist * (len - dist + 1) / dist * 3;
+        total += per_dist;
+    }
+    return total * n;
+}
+
+/* Small barcode sets at high mismatch levels are matched by comparing each
+ * read against every barcode, rather than expanding every mutant into the
+ * trie. Returns 1 if this trie will match that way, having loaded just the
+ * exact barcodes, 0 if the mutants must be loaded as usual, or -1 on error. */
+static int
+setup_hamming_engine(struct axe_config *config, struct axe_trie *trie,
+                     char **seqs, intptr_t *values, size_t n)
+{
+    size_t iii = 0;
+
+    /* The window automaton is built from the mutants */
+    if (n == 0 || n > AXE_HAMMING_MAX_BARCODES || config->window > 0) {
+        return 0;
+    }
+    /* A pinned engine decides whether the trie holds mutants or barcodes */
+    if (config->pin_engine) {
+        if (config->engine != AXE_ENGINE_HAMMING &&
+                config->engine != AXE_ENGINE_SEARCH &&
+                config->engine != AXE_ENGINE_SEED) {
+            return 0;
+        }
+    } else if (count_mutants(n, strlen(seqs[0]), config->mismatches) <
+            AXE_HAMMING_MIN_MUTANTS) {
+        return 0;
+    }
+    trie->hamming = axe_hamming_create(seqs, values, n, config->mismatches);
+    if (trie->hamming == NULL) {
+        return 0;
+    }
+    /* For the searches axe_tune_engines may race it against */
+    trie->mismatch_level = config->mismatches;
+    for (iii = 0; iii < n; iii++) {
+        if (axe_trie_add(trie, seqs[iii], values[iii]) != 0) {
+            qes_log_format_fatal(config->logger,
+                    "load_tries -- Could not load barcode %s into trie\n",
+                    seqs[iii]);
+            return -1;
+        }
+    }
+    if (config->verbosity > 0) {
+        qes_log_format_info(config->logger,
+                "load_tries -- Matching %zu barcodes without mutants\n", n);
+    }
+    return 1;
+}
+
+/* The distinct barcodes of one read of each pair, numbered as
+ * load_tries_combo numbers them. Returns how many, or 0 if more than max. */
+static size_t
+distinct_barcodes(const struct axe_config *config, int second, char **seqs,
+                  intptr_t *values, size_t max)
+{
+    size_t n = 0;
     size_t iii = 0;
     size_t jjj = 0;
-    size_t mmm = 0;
-    struct axe_barcode *this_bcd = NULL;
-    intptr_t tmp = 0;
 
-    if (!axe_config_ok(config)) {
-        fprintf(stderr, "[load_tries] Bad config\n");
-        ret = -1;
+    for (iii = 0; iii < config->n_barcode_pairs; iii++) {
+        char *seq = second ? config->barcodes[iii]->seq2
+                           : config->barcodes[iii]->seq1;
+
+        if (!axe_barcode_ok(config->barcodes[iii])) {
+            return 0;
+        }
+        /* The trie ignores case, and so must we */
+        for (jjj = 0; jjj < n; jjj++) {
+            if (strcasecmp(seqs[jjj], seq) == 0) break;
+        }
+        if (jjj < n) continue;
+        if (n == max) {
+            return 0;
+        }
+        seqs[n] = seq;
+        values[n] = n;
+        n++;
+    }
+    return n;
+}
+
+/* Load just the exact barcodes, which are matched by a bounded search of
+ * the trie. Only sets of barcodes that mutant expansion would load are
+ * taken, unless we are permissive. Expansion knows nothing of indels, so
+ * edit distance searches take any set, leaving close calls unmatched. */
+static int
+load_trie_search(struct axe_config *config, struct axe_trie *trie,
+                 char **seqs, intptr_t *values, size_t n)
+{
+    size_t iii = 0;
+    size_t jjj = 0;
+    size_t len = 0;
+
+    if (config->edit && config->mismatches > AXE_EDIT_MAX_MISMATCHES) {
+        qes_log_format_fatal(config->logger,
+                "load_tries -- Can't search for %zu edits, only %d\n",
+                config->mismatches, AXE_EDIT_MAX_MISMATCHES);
+        return 1;
+    }
+    for (iii = 0; iii < n; iii++) {
+        len = strlen(seqs[iii]);
+        if (len > AXE_SEARCH_MAX_LEN) {
+            qes_log_format_fatal(config->logger,
+                    "load_tries -- Barcode %s is too long to search\n",
+                    seqs[iii]);
+            return 1;
+        }
+        if (config->permissive || config->edit) continue;
+        for (jjj = 0; jjj < iii; jjj++) {
+            if (strlen(seqs[jjj]) == len &&
+                    axe_hamming_could_conflict(seqs[iii], seqs[jjj], len,
+                                               config->mismatches)) {
+                qes_log_format_fatal(config->logger,
+                        "load_tries -- Barcodes %s and %s are too similar "
+                        "for %zu mismatches\n", seqs[jjj], seqs[iii],
+                        config->mismatches);
+                return 1;
+            }
+        }
+    }
+    for (iii = 0; iii < n; iii++) {
+        if (axe_trie_add(trie, seqs[iii], values[iii]) != 0) {
+            qes_log_format_fatal(config->logger,
+                    "load_tries -- Duplicate barcode %s\n", seqs[iii]);
+            return 1;
+        }
+    }
+    trie->search = 1;
+    trie->edit = config->edit;
+    trie->mismatch_level = config->mismatches;
+    return 0;
+}
+
+/* Search each read's distinct barcodes, numbered as load_tries_combo
+ * numbers them */
+static int
+load_tries_combo_search(struct axe_config *config)
+{
+    char **seqs = NULL;
+    intptr_t *values = NULL;
+    size_t n = 0;
+    int ret = 1;
+
+    seqs = qes_calloc(config->n_barcode_pairs, sizeof(*seqs));
+    values = qes_calloc(config->n_barcode_pairs, sizeof(*values));
+    n = distinct_barcodes(config, 0, seqs, values, config->n_barcode_pairs);
+    if (n == 0 || load_trie_search(config, config->fwd_trie, seqs, values,
+                                   n) != 0) {
+        goto exit;
+    }
+    n = distinct_barcodes(config, 1, seqs, values, config->n_barcode_pairs);
+    if (n == 0 || load_trie_search(config, config->rev_trie, seqs, values,
+                                   n) != 0) {
         goto exit;
     }
-    /* Make mutated barcodes and add to trie */
+    ret = 0;
+
+exit:
+    qes_free(seqs);
+    qes_free(values);
+    return ret;
+}
+
+/* Add the distinct barcodes of one read to its trie, numbered in order, to
+ * be expanded with their mutants. pairs is set to the pair each came from
+ * first. */
+static int
+load_exact_combo(struct axe_config *config, int read,
+                 struct axe_expansion *exp, size_t *pairs)
+{
+    struct axe_barcode *this_bcd = NULL;
+    const char *seq = NULL;
+    intptr_t tmp = 0;
+    size_t iii = 0;
+
     for (iii = 0; iii < config->n_barcode_pairs; iii++) {
         this_bcd = config->barcodes[iii];
         if (!axe_barcode_ok(this_bcd)) {
             qes_log_format_fatal(config->logger,
                     "load_tries -- Bad R1 barcode at %zu\n", iii);
-            ret = -1;
-            goto exit;
+            return -1;
         }
+        seq = read == 0 ? this_bcd->seq1 : this_bcd->seq2;
         /* Either lookup the index of the first read in the barcode table, or
          * insert this barcode into the table, storing its index.
          * Note the NOT here. */
-        if (!axe_trie_get(config->fwd_trie, this_bcd->seq1, &tmp)) {
-            ret = axe_trie_add(config->fwd_trie, this_bcd->seq1, ++bcd1);
-            if (ret != 0) {
-                qes_log_format_fatal(config->logger,
-                        "load_tries -- Could not load barcode %s into trie %zu\n",
-                        this_bcd->seq1, iii);
-                ret = 1;
-                goto exit;
-            }
-        } else {
+        if (axe_trie_get(exp->trie, seq, &tmp)) {
             continue;
         }
-        for (jjj = 1; jjj <= config->mismatches; jjj++) {
-            /* Do the forwards read barcode */
-            mutated = hamming_mutate_dna(&num_mutated, this_bcd->seq1,
-                                         this_bcd->len1, jjj, 0);
-            if (mutated == NULL) {
-                ret = 1;
-                goto exit;
-            }
-            for (mmm = 0; mmm < num_mutated; mmm++) {
-                ret = axe_trie_add(config->fwd_trie, mutated[mmm], bcd1);
-                if (ret != 0) {
-                    if (config->permissive) {
-                        if (config->verbosity >= 0) {
-                            qes_log_format_warning(config->logger,
-                                "load_tries -- warning: Will only match to %dmm\n",
-                                 (int)jjj - 1);
-                        }
-                        axe_trie_delete(config->fwd_trie, mutated[mmm]);
-                        qes_free(mutated[mmm]);
-                        continue;
-                    }
-                    qes_log_format_fatal(config->logger,
-                            "load_tries -- Barcode %s already in fwd trie (%dmm) %s\n",
-                            mutated[mmm], (int)jjj, this_bcd->seq1);
-                    retval = 1;
-                    goto exit;
-                }
-                qes_free(mutated[mmm]);
-            }
-            qes_free(mutated);
+        if (axe_trie_add(exp->trie, seq, exp->n_seqs) != 0) {
+            qes_log_format_fatal(config->logger,
+                    "load_tries -- Could not load barcode %s into trie %zu\n",
+                    seq, iii);
+            return 1;
         }
+        exp->seqs[exp->n_seqs] = (char *)seq;
+        exp->values[exp->n_seqs] = exp->n_seqs;
+        pairs[exp->n_seqs] = iii;
+        exp->n_seqs++;
     }
-    /* Ditto for the reverse read */
-    for (iii = 0; iii < config->n_barcode_pairs; iii++) {
-        this_bcd = config->barcodes[iii];
-        /* Likewise for the reverse read index */
-        if (!axe_trie_get(config->rev_trie, this_bcd->seq2, &tmp)) {
-            ret = axe_trie_add(config->rev_trie, this_bcd->seq2, ++bcd2);
-            if (ret != 0) {
-                qes_log_format_fatal(config->logger,
-                        "load_tries -- Could not load barcode %s into trie %zu\n",
-                        this_bcd->seq2, iii);
-                retval = 1;
-                goto exit;
-            }
-        } else {
+    return 0;
+}
+
+static inline int
+load_tries_combo(struct axe_config *config)
+{
+    int retval = 1;
+    int ret = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    struct axe_expansion exps[2];
+    size_t *pairs[2] = {NULL, NULL};
+    int reads[2] = {0, 1};
+    size_t n_exps = 0;
+    int read = 0;
+    char *seqs[AXE_HAMMING_MAX_BARCODES];
+    intptr_t values[AXE_HAMMING_MAX_BARCODES];
+    size_t n_distinct = 0;
+
+    if (!axe_config_ok(config)) {
+        fprintf(stderr, "[load_tries] Bad config\n");
+        return -1;
+    }
+    if (config->search || config->edit) {
+        return load_tries_combo_search(config);
+    }
+    memset(exps, 0, sizeof(exps));
+    for (read = 0; read < 2; read++) {
+        struct axe_expansion *exp = &exps[n_exps];
+
+        n_distinct = distinct_barcodes(config, read, seqs, values,
+                                       AXE_HAMMING_MAX_BARCODES);
+        ret = setup_hamming_engine(config, read == 0 ? config->fwd_trie
+                                                     : config->rev_trie,
+                                   seqs, values, n_distinct);
+        if (ret < 0) {
+            goto exit;
+        } else if (ret == 1) {
             continue;
         }
-        for (jjj = 1; jjj <= config->mismatches; jjj++) {
-            num_mutated = 0;
-            mutated = hamming_mutate_dna(&num_mutated, this_bcd->seq2,
-                                         this_bcd->len2, jjj, 0);
-            if (mutated == NULL) {
-                ret = 1;
+        exp->trie = read == 0 ? config->fwd_trie : config->rev_trie;
+        exp->seqs = qes_calloc(config->n_barcode_pairs, sizeof(*exp->seqs));
+        exp->values = qes_calloc(config->n_barcode_pairs,
+                                 sizeof(*exp->values));
+        pairs[n_exps] = qes_calloc(config->n_barcode_pairs,
+                                   sizeof(*pairs[n_exps]));
+        reads[n_exps] = read;
+        n_exps++;
+        if (load_exact_combo(config, read, exp, pairs[n_exps - 1]) != 0) {
+            goto exit;
+        }
+    }
+    if (n_exps == 0) {
+        retval = 0;
+        goto exit;
+    }
+    /* Make mutated barcodes of both reads and build them into the tries */
+    ret = axe_expand(exps, n_exps, config->mismatches, config->permissive,
+                     config->threads);
+    if (ret < 0) {
+        goto exit;
+    }
+    for (iii = 0; iii < n_exps; iii++) {
+        for (jjj = 0; jjj < exps[iii].n_clashes; jjj++) {
+            const struct axe_clash *clash = &exps[iii].clashes[jjj];
+            const struct axe_barcode *this_bcd =
+                    config->barcodes[pairs[iii][clash->barcode]];
+
+            if (!config->permissive) {
+                qes_log_format_fatal(config->logger,
+                        "load_tries -- Barcode %s already in %s trie (%dmm) %s\n",
+                        clash->key, reads[iii] == 0 ? "fwd" : "rev",
+                        (int)clash->dist, this_bcd->seq1);
                 goto exit;
             }
-            for (mmm = 0; mmm < num_mutated; mmm++) {
-                ret = axe_trie_add(config->rev_trie, mutated[mmm], bcd2);
-                if (ret != 0) {
-                    if (config->permissive) {
-                        if (config->verbosity >= 0) {
-                            qes_log_format_warning(config->logger,
-                                "load_tries -- Will only match %s to %dmm\n",
-                                this_bcd->id, (int)jjj - 1);
-                        }
-                        trie_delete(config->rev_trie->trie,
-                                    mutated[mmm]);
-                        qes_free(mutated[mmm]);
-                        continue;
-                    }
-                    qes_log_format_fatal(config->logger,
-                            "load_tries -- Barcode %s already in rev trie (%dmm) %s\n",
-                            mutated[mmm], (int)jjj, this_bcd->seq1);
-                    retval = 1;
-                    goto exit;
-                }
-                qes_free(mutated[mmm]);
+            if (config->verbosity < 0) {
+                continue;
+            }
+            if (reads[iii] == 0) {
+                qes_log_format_warning(config->logger,
+                    "load_tries -- warning: Will only match to %dmm\n",
+                     (int)clash->dist - 1);
+            } else {
+                qes_log_format_warning(config->logger,
+                    "load_tries -- Will only match %s to %dmm\n",
+                    this_bcd->id, (int)clash->dist - 1);
             }
-            qes_free(mutated);
         }
     }
     /* we got here, so we succeeded. set retval accordingly */
     retval = 0;
 
 exit:
-    if (mutated != NULL) {
-        for (mmm = 0; mmm < num_mutated; mmm++) {
-            qes_free(mutated[mmm]);
-        }
-        qes_free(mutated);
+    for (iii = 0; iii < n_exps; iii++) {
+        axe_expansion_clear(&exps[iii]);
+        qes_free(exps[iii].seqs);
+        qes_free(exps[iii].values);
+        qes_free(pairs[iii]);
     }
     return retval;
 }
 
+static int
+load_tries_single_search(struct axe_config *config)
+{
+    char **seqs = NULL;
+    intptr_t *values = NULL;
+    size_t iii = 0;
+    int ret = 1;
+
+    seqs = qes_calloc(config->n_barcode_pairs, sizeof(*seqs));
+    values = qes_calloc(config->n_barcode_pairs, sizeof(*values));
+    for (iii = 0; iii < config->n_barcode_pairs; iii++) {
+        if (!axe_barcode_ok(config->barcodes[iii])) {
+            fprintf(stderr, "[load_tries] Bad barcode at %zu\n", iii);
+            ret = -1;
+            goto exit;
+        }
+        seqs[iii] = config->barcodes[iii]->seq1;
+        values[iii] = iii;
+    }
+    ret = load_trie_search(config, config->fwd_trie, seqs, values,
+                           config->n_barcode_pairs);
+
+exit:
+    qes_free(seqs);
+    qes_free(values);
+    return ret;
+}
+
 static inline int
 load_tries_single(struct axe_config *config)
 {
-    char **mutated = NULL;
-    size_t num_mutated = 0;
+    struct axe_expansion exp;
     int ret = 0;
     size_t iii = 0;
-    size_t jjj = 0;
-    size_t mmm = 0;
     intptr_t tmp = 0;
     int retval = -1;
     struct axe_barcode *this_bcd = NULL;
+    char *seqs[AXE_HAMMING_MAX_BARCODES];
+    intptr_t values[AXE_HAMMING_MAX_BARCODES];
 
     if (!axe_config_ok(config)) {
         fprintf(stderr, "[load_tries] Bad config\n");
         return -1;
     }
-    /* Make mutated barcodes and add to trie */
+    if (config->search || config->edit) {
+        return load_tries_single_search(config);
+    }
+    if (config->n_barcode_pairs <= AXE_HAMMING_MAX_BARCODES) {
+        for (iii = 0; iii < config->n_barcode_pairs; iii++) {
+            if (!axe_barcode_ok(config->barcodes[iii])) break;
+            seqs[iii] = config->barcodes[iii]->seq1;
+            values[iii] = iii;
+        }
+        if (iii == config->n_barcode_pairs) {
+            ret = setup_hamming_engine(config, config->fwd_trie, seqs, values,
+                                       config->n_barcode_pairs);
+            if (ret != 0) {
+                return ret < 0 ? 1 : 0;
+            }
+        }
+    }
+    memset(&exp, 0, sizeof(exp));
+    exp.trie = config->fwd_trie;
+    exp.seqs = qes_calloc(config->n_barcode_pairs, sizeof(*exp.seqs));
+    exp.values = qes_calloc(config->n_barcode_pairs, sizeof(*exp.values));
     for (iii = 0; iii < config->n_barcode_pairs; iii++) {
         this_bcd = config->barcodes[iii];
         if (!axe_barcode_ok(this_bcd)) {
             fprintf(stderr, "[load_tries] Bad barcode at %zu\n", iii);
-            return -1;
+            goto exit;
         }
         /* Either lookup the index of the first read in the barcode table, or
          * insert this barcode into the table, storing its index.
@@ -737,55 +970,46 @@ load_tries_single(struct axe_config *config)
                 fprintf(stderr,
                         "ERROR: Could not load barcode %s into trie %zu\n",
                         this_bcd->seq1, iii);
-                return 1;
+                retval = 1;
+                goto exit;
             }
         } else {
             fprintf(stderr, "ERROR: Duplicate barcode %s\n", this_bcd->seq1);
-            return 1;
+            retval = 1;
+            goto exit;
         }
-        for (jjj = 1; jjj <= config->mismatches; jjj++) {
-            mutated = hamming_mutate_dna(&num_mutated, this_bcd->seq1,
-                                         this_bcd->len1, jjj, 0);
-            if (mutated == NULL) {
-                ret = 1;
-                goto exit;
-            }
-            for (mmm = 0; mmm < num_mutated; mmm++) {
-                ret = axe_trie_add(config->fwd_trie, mutated[mmm], iii);
-                if (ret != 0) {
-                    if (config->permissive) {
-                        if (config->verbosity >= 0) {
-                            fprintf(stderr,
-                                    "[%s] warning: Will only match to %dmm\n",
-                                    __func__, (int)jjj - 1);
-                        }
-                        trie_delete(config->fwd_trie->trie,
-                                    mutated[mmm]);
-                        qes_free(mutated[mmm]);
-                        continue;
-                    }
-                    fprintf(stderr,
-                            "[%s] ERROR: Barcode %s already in trie (%dmm)\n",
-                            __func__, mutated[mmm], (int)jjj);
-                    retval = 1;
-                    goto exit;
-                }
-                qes_free(mutated[mmm]);
-            }
-            qes_free(mutated);
-            num_mutated = 0;
+        exp.seqs[exp.n_seqs] = this_bcd->seq1;
+        exp.values[exp.n_seqs] = iii;
+        exp.n_seqs++;
+    }
+    /* Make mutated barcodes and build them into the trie */
+    ret = axe_expand(&exp, 1, config->mismatches, config->permissive,
+                     config->threads);
+    if (ret < 0) {
+        retval = 1;
+        goto exit;
+    }
+    for (iii = 0; iii < exp.n_clashes; iii++) {
+        if (!config->permissive) {
+            fprintf(stderr,
+                    "[%s] ERROR: Barcode %s already in trie (%dmm)\n",
+                    __func__, exp.clashes[iii].key,
+                    (int)exp.clashes[iii].dist);
+            retval = 1;
+            goto exit;
+        }
+        if (config->verbosity >= 0) {
+            fprintf(stderr, "[%s] warning: Will only match to %dmm\n",
+                    __func__, (int)exp.clashes[iii].dist - 1);
         }
     }
     /* we got here, so we succeeded */
     retval = 0;
 
 exit:
-    if (mutated != NULL) {
-        for (mmm = 0; mmm < num_mutated; mmm++) {
-            qes_free(mutated[mmm]);
-        }
-        qes_free(mutated);
-    }
+    axe_expansion_clear(&exp);
+    qes_free(exp.seqs);
+    qes_free(exp.values);
     return retval;
 }
 
@@ -888,6 +1112,119 @@ error:
     return 1;
 }
 
+static struct axe_filter *
+make_filter(const struct axe_trie *trie)
+{
+    size_t mismatches = 0;
+
+    /* Indels and offsets shift the bases a filter looks at */
+    if (trie->edit || trie->window != NULL) {
+        return NULL;
+    }
+    /* Unless the trie holds every mutant, the filter must mark them */
+    if (trie->hamming != NULL) {
+        mismatches = trie->hamming->mismatches;
+    } else if (trie->search) {
+        mismatches = trie->mismatch_level;
+    }
+    return axe_filter_create(trie->trie, mismatches);
+}
+
+/* The exact barcodes of one read of each pair, as numbered in the tries.
+ * seqs and values must have room for every pair. Returns how many. */
+static size_t
+trie_barcodes(const struct axe_config *config, int second, char **seqs,
+              intptr_t *values)
+{
+    size_t n = 0;
+
+    if (config->match_combo) {
+        return distinct_barcodes(config, second, seqs, values,
+                                 config->n_barcode_pairs);
+    }
+    for (n = 0; n < config->n_barcode_pairs; n++) {
+        seqs[n] = config->barcodes[n]->seq1;
+        values[n] = n;
+    }
+    return n;
+}
+
+/* Mutants carry only ACGT, so reads with Ns are searched for among the
+ * exact barcodes, as numbered in the tries */
+static int
+load_exact(struct axe_config *config)
+{
+    char **seqs = NULL;
+    intptr_t *values = NULL;
+    size_t n = 0;
+    int ret = 1;
+
+    seqs = qes_calloc(config->n_barcode_pairs, sizeof(*seqs));
+    values = qes_calloc(config->n_barcode_pairs, sizeof(*values));
+    n = trie_barcodes(config, 0, seqs, values);
+    if (config->fwd_trie->hamming == NULL &&
+            axe_trie_set_exact(config->fwd_trie, seqs, values, n,
+                               config->mismatches) != 0) {
+        goto exit;
+    }
+    if (config->match_combo) {
+        n = trie_barcodes(config, 1, seqs, values);
+        if (config->rev_trie->hamming == NULL &&
+                axe_trie_set_exact(config->rev_trie, seqs, values, n,
+                                   config->mismatches) != 0) {
+            goto exit;
+        }
+    }
+    ret = 0;
+
+exit:
+    qes_free(seqs);
+    qes_free(values);
+    return ret;
+}
+
+/* Barcodes that may start anywhere in the first bases of reads are found
+ * by automata of the mutants in the frozen tries */
+static int
+load_window(struct axe_config *config)
+{
+    struct axe_trie *trie = config->fwd_trie;
+    char **seqs = NULL;
+    intptr_t *values = NULL;
+    size_t n = 0;
+    int ret = 1;
+
+    seqs = qes_calloc(config->n_barcode_pairs, sizeof(*seqs));
+    values = qes_calloc(config->n_barcode_pairs, sizeof(*values));
+    n = trie_barcodes(config, 0, seqs, values);
+    trie->window = axe_window_create(trie->trie, trie->frozen, seqs, values,
+                                     n, config->mismatches, config->window);
+    if (trie->window == NULL) {
+        goto exit;
+    }
+    if (config->match_combo) {
+        trie = config->rev_trie;
+        n = trie_barcodes(config, 1, seqs, values);
+        trie->window = axe_window_create(trie->trie, trie->frozen, seqs,
+                                         values, n, config->mismatches,
+                                         config->window);
+        if (trie->window == NULL) {
+            goto exit;
+        }
+    }
+    ret = 0;
+
+exit:
+    if (ret != 0) {
+        qes_log_format_fatal(config->logger,
+                "load_tries -- Can't search the first %zu bases for barcodes\n",
+                config->window);
+    }
+    qes_free(seqs);
+    qes_free(values);
+    return ret;
+}
+
 int
 axe_load_tries(struct axe_config *config)
 {
@@ -895,21 +1232,67 @@ axe_load_tries(struct axe_config *config)
     if (!axe_config_ok(config)) {
         return -1;
     }
+    /* Tries saved by an earlier run are used as they lie on disk */
+    if (config->index_dir != NULL) {
+        ret = axe_load_index(config);
+        if (ret <= 0) {
+            return ret;
+        }
+    }
     if (config->match_combo) {
         ret = load_tries_combo(config);
     } else {
         ret = load_tries_single(config);
     }
-    if (config->verbosity > 0) {
-        fprintf(stderr, "[load_tries] (%s) Barcode tries loaded\n",
-                nowstr());
+    if (ret == 0 && config->mismatches > 0 && !config->search &&
+            !config->edit && config->window == 0) {
+        ret = load_exact(config);
     }
-    return ret;
-}
-
-static inline int
-write_barcoded_read_combo(struct axe_output *out, struct qes_seq *seq1,
-                          struct qes_seq *seq2, size_t bcd1_len,
+    /* The tries are never changed after this, so swap them for read-only
+     * images for the lookups */
+    if (ret == 0) {
+        ret = axe_trie_freeze(config->fwd_trie);
+        if (ret == 0 && config->rev_trie != NULL) {
+            ret = axe_trie_freeze(config->rev_trie);
+        }
+    }
+    if (ret == 0 && config->window > 0) {
+        ret = load_window(config);
+    }
+    /* Unbarcoded reads are common, and mostly rejected at a glance */
+    if (ret == 0) {
+        config->fwd_trie->filter = make_filter(config->fwd_trie);
+        if (config->rev_trie != NULL) {
+            config->rev_trie->filter = make_filter(config->rev_trie);
+        }
+    }
+    /* Nor can indels or offset barcodes be cached by a fixed-length prefix */
+    if (ret == 0 && config->cache_bytes > 0 && !config->edit &&
+            config->window == 0) {
+        config->fwd_trie->cache = axe_cache_create(config->fwd_trie->trie,
+                                                   config->cache_bytes);
+        if (config->rev_trie != NULL) {
+            config->rev_trie->cache = axe_cache_create(
+                    config->rev_trie->trie, config->cache_bytes);
+        }
+        if (config->fwd_trie->cache == NULL && config->verbosity >= 0) {
+            qes_log_message_warning(config->logger,
+                    "load_tries -- Not caching matches of these barcodes\n");
+        }
+    }
+    if (config->verbosity > 0) {
+        qes_log_format_info(config->logger,
+                "load_tries -- Using %s kernels for this CPU\n",
+                axe_simd_name(axe_simd_level()));
+        fprintf(stderr, "[load_tries] (%s) Barcode tries loaded\n",
+                nowstr());
+    }
+    return ret;
+}
+
+static inline int
+write_barcoded_read_combo(struct axe_output *out, struct qes_seq *seq1,
+                          struct qes_seq *seq2, size_t bcd1_len,
                           size_t bcd2_len)
 {
     int ret = 0;
@@ -1000,19 +1383,18 @@ increment_reads_print_progress(struct axe_config *config)
     }
 }
 
+/* end is how much of seq1 the barcode spans, or 0 for its length */
 static inline int
 process_read_pair_single(struct axe_config *config, struct qes_seq *seq1,
-                        struct qes_seq *seq2)
+                        struct qes_seq *seq2, ssize_t bcd, size_t end)
 {
     int ret = 0;
-    ssize_t bcd = -1;
     size_t barcode_pair_index = 0;
     struct axe_output *outfile = NULL;
     size_t bcd_len = 0;
 
-    ret = axe_match_read(config, &bcd, config->fwd_trie, seq1);
     increment_reads_print_progress(config);
-    if (ret != 0) {
+    if (bcd < 0) {
         /* No match */
         qes_seqfile_write(config->unknown_output->fwd_file, seq1);
         if (seq2 != NULL) {
@@ -1028,9 +1410,9 @@ process_read_pair_single(struct axe_config *config, struct qes_seq *seq1,
     /* Found a match */
     config->reads_demultiplexed++;
     /* FIXME: we need to check bcd doesn't cause segfault */
-    barcode_pair_index = config->barcode_lookup[bcd][0];
+    barcode_pair_index = axe_pair_map_get(config->barcode_lookup, bcd, 0);
     outfile = config->outputs[barcode_pair_index];
-    bcd_len = config->barcodes[barcode_pair_index]->len1;
+    bcd_len = end > 0 ? end : config->barcodes[barcode_pair_index]->len1;
     config->barcodes[bcd]->count++;
     if (seq1->seq.len <= bcd_len) {
         /* Don't write out seqs shorter than the barcode */
@@ -1099,11 +1481,94 @@ process_read_pair_single(struct axe_config *config, struct qes_seq *seq1,
 }
 
 
+/* Reads are matched a batch at a time, so their lookups overlap */
+struct read_batch {
+    struct qes_seq *seq1[AXE_BATCH_SIZE];
+    struct qes_seq *seq2[AXE_BATCH_SIZE];
+    ssize_t bcd1[AXE_BATCH_SIZE];
+    ssize_t bcd2[AXE_BATCH_SIZE];
+    size_t end1[AXE_BATCH_SIZE];
+    size_t end2[AXE_BATCH_SIZE];
+};
+
+static struct read_batch *
+read_batch_create(void)
+{
+    struct read_batch *batch = qes_calloc(1, sizeof(*batch));
+    size_t iii = 0;
+
+    if (batch == NULL) {
+        return NULL;
+    }
+    for (iii = 0; iii < AXE_BATCH_SIZE; iii++) {
+        batch->seq1[iii] = qes_seq_create();
+        batch->seq2[iii] = qes_seq_create();
+    }
+    return batch;
+}
+
+static void
+read_batch_destroy_(struct read_batch *batch)
+{
+    size_t iii = 0;
+
+    if (batch != NULL) {
+        for (iii = 0; iii < AXE_BATCH_SIZE; iii++) {
+            qes_seq_destroy(batch->seq1[iii]);
+            qes_seq_destroy(batch->seq2[iii]);
+        }
+        qes_free(batch);
+    }
+}
+#define read_batch_destroy(batch) STMT_BEGIN                                \
+    read_batch_destroy_(batch);                                             \
+    batch = NULL;                                                           \
+    STMT_END
+
+/* Read up to max reads or pairs into seq1 and seq2, returning how many were
+ * read. seq2 is left alone for single-end reads. */
+static size_t
+read_pairs(struct qes_seq **seq1, struct qes_seq **seq2, size_t max,
+           struct qes_seqfile *fwdsf, struct qes_seqfile *revsf,
+           enum read_mode mode)
+{
+    size_t n = 0;
+    ssize_t len1 = 0;
+    ssize_t len2 = 0;
+
+    for (n = 0; n < max; n++) {
+        len1 = qes_seqfile_read(fwdsf, seq1[n]);
+        if (mode == READS_SINGLE) {
+            len2 = 1;
+        } else if (mode == READS_INTERLEAVED) {
+            len2 = qes_seqfile_read(fwdsf, seq2[n]);
+        } else {
+            len2 = qes_seqfile_read(revsf, seq2[n]);
+        }
+        if (len1 < 1 || len2 < 1) {
+            break;
+        }
+    }
+    return n;
+}
+
+/* Read up to AXE_BATCH_SIZE reads or pairs, returning how many were read */
+static size_t
+read_batch_fill(struct read_batch *batch, struct qes_seqfile *fwdsf,
+                struct qes_seqfile *revsf, enum read_mode mode)
+{
+    return read_pairs(batch->seq1, batch->seq2, AXE_BATCH_SIZE, fwdsf, revsf,
+                      mode);
+}
+
 static int
 process_file_single(struct axe_config *config)
 {
     struct qes_seqfile *fwdsf = NULL;
     struct qes_seqfile *revsf = NULL;
+    struct read_batch *batch = NULL;
+    size_t n_reads = 0;
+    size_t iii = 0;
     int ret = 0;
     int retval = -1;
 
@@ -1119,10 +1584,7 @@ process_file_single(struct axe_config *config)
     }
     switch(config->in_mode) {
     case READS_SINGLE:
-        goto single;
-        break;
     case READS_INTERLEAVED:
-        goto interleaved;
         break;
     case READS_PAIRED:
         revsf = qes_seqfile_create(config->infiles[1], "r");
@@ -1132,7 +1594,6 @@ process_file_single(struct axe_config *config)
                                  config->infiles[1]);
             goto exit;
         }
-        goto paired;
         break;
     case READS_UNKNOWN:
     default:
@@ -1142,54 +1603,46 @@ process_file_single(struct axe_config *config)
         goto exit;
         break;
     }
-
-single:
-    QES_SEQFILE_ITER_SINGLE_BEGIN(fwdsf, seq, seqlen) {
-        ret = process_read_pair_single(config, seq, NULL);
-    }
-    QES_SEQFILE_ITER_SINGLE_END(seq);
-    retval = ret == 0 ? 0 : 1;
-    goto exit;
-
-interleaved:
-    QES_SEQFILE_ITER_INTERLEAVED_BEGIN(fwdsf, seq1, seq2, seqlen1, seqlen2) {
-        ret = process_read_pair_single(config, seq1, seq2);
+    batch = read_batch_create();
+    if (batch == NULL) {
+        goto exit;
     }
-    QES_SEQFILE_ITER_INTERLEAVED_END(seq1, seq2);
-    retval = ret == 0 ? 0 : 1;
-    goto exit;
-
-paired:
-    QES_SEQFILE_ITER_PAIRED_BEGIN(fwdsf, revsf, seq1, seq2, seqlen1, seqlen2) {
-        ret = process_read_pair_single(config, seq1, seq2);
+    while ((n_reads = read_batch_fill(batch, fwdsf, revsf,
+                                      config->in_mode)) > 0) {
+        axe_match_batch_ends(config->fwd_trie, batch->seq1, n_reads,
+                             batch->bcd1, batch->end1);
+        for (iii = 0; iii < n_reads; iii++) {
+            ret = process_read_pair_single(config, batch->seq1[iii],
+                    config->in_mode == READS_SINGLE ? NULL : batch->seq2[iii],
+                    batch->bcd1[iii], batch->end1[iii]);
+            if (ret != 0) {
+                retval = 1;
+                goto exit;
+            }
+        }
     }
-    QES_SEQFILE_ITER_PAIRED_END(seq1, seq2);
-    retval = ret == 0 ? 0 : 1;
-    goto exit;
+    retval = 0;
 exit:
+    read_batch_destroy(batch);
     qes_seqfile_destroy(fwdsf);
     qes_seqfile_destroy(revsf);
     return retval;
 }
 
 
+/* end1 and end2 are as process_read_pair_single's end */
 static int
 process_read_pair_combo(struct axe_config *config, struct qes_seq *seq1,
-                        struct qes_seq *seq2)
+                        struct qes_seq *seq2, ssize_t bcd1, ssize_t bcd2,
+                        size_t end1, size_t end2)
 {
     ssize_t barcode_pair_index = 0;
-    intptr_t bcd1 = -1;
-    intptr_t bcd2 = -1;
-    int r1_ret = 0;
-    int r2_ret = 0;
     size_t bcd1_len = 0;
     size_t bcd2_len = 0;
     struct axe_output *outfile = NULL;
 
-    r1_ret = axe_match_read(config, &bcd1, config->fwd_trie, seq1);
-    r2_ret = axe_match_read(config, &bcd2, config->rev_trie, seq2);
     increment_reads_print_progress(config);
-    if (r1_ret != 0 || r2_ret != 0) {
+    if (bcd1 < 0 || bcd2 < 0) {
         /* No match */
         qes_seqfile_write(config->unknown_output->fwd_file, seq1);
         if (config->out_mode == READS_INTERLEAVED) {
@@ -1201,7 +1654,7 @@ process_read_pair_combo(struct axe_config *config, struct qes_seq *seq1,
         return 0;
     }
     /* Found a match */
-    barcode_pair_index = config->barcode_lookup[bcd1][bcd2];
+    barcode_pair_index = axe_pair_map_get(config->barcode_lookup, bcd1, bcd2);
     if (barcode_pair_index < 0) {
         /* Invalid match */
         qes_seqfile_write(config->unknown_output->fwd_file, seq1);
@@ -1215,8 +1668,8 @@ process_read_pair_combo(struct axe_config *config, struct qes_seq *seq1,
     }
     config->reads_demultiplexed++;
     outfile = config->outputs[barcode_pair_index];
-    bcd1_len = config->barcodes[barcode_pair_index]->len1;
-    bcd2_len = config->barcodes[barcode_pair_index]->len2;
+    bcd1_len = end1 > 0 ? end1 : config->barcodes[barcode_pair_index]->len1;
+    bcd2_len = end2 > 0 ? end2 : config->barcodes[barcode_pair_index]->len2;
     config->barcodes[barcode_pair_index]->count++;
     return write_barcoded_read_combo(outfile, seq1, seq2, bcd1_len,
                                      bcd2_len);
@@ -1228,7 +1681,9 @@ process_file_combo(struct axe_config *config)
 {
     struct qes_seqfile *fwdsf = NULL;
     struct qes_seqfile *revsf = NULL;
-    int have_error = 0;
+    struct read_batch *batch = NULL;
+    size_t n_reads = 0;
+    size_t iii = 0;
 
     if (!axe_config_ok(config)) {
         return -1;
@@ -1242,7 +1697,6 @@ process_file_combo(struct axe_config *config)
     }
     switch(config->in_mode) {
     case READS_INTERLEAVED:
-        goto interleaved;
         break;
     case READS_PAIRED:
         revsf = qes_seqfile_create(config->infiles[1], "r");
@@ -1252,7 +1706,6 @@ process_file_combo(struct axe_config *config)
                                  config->infiles[0]);
             goto error;
         }
-        goto paired;
         break;
     case READS_SINGLE:
     case READS_UNKNOWN:
@@ -1263,38 +1716,230 @@ process_file_combo(struct axe_config *config)
         goto error;
         break;
     }
-
-interleaved:
-    QES_SEQFILE_ITER_INTERLEAVED_BEGIN(fwdsf, seq1, seq2, seqlen1, seqlen2)
-    if (process_read_pair_combo(config, seq1, seq2)) {
-        have_error = 1;
-        break;
+    batch = read_batch_create();
+    if (batch == NULL) {
+        goto error;
     }
-    QES_SEQFILE_ITER_INTERLEAVED_END(seq1, seq2)
-    if (!have_error) goto clean_exit;
-    else goto error;
-
-paired:
-    QES_SEQFILE_ITER_PAIRED_BEGIN(fwdsf, revsf, seq1, seq2, seqlen1, seqlen2)
-    if (process_read_pair_combo(config, seq1, seq2)) {
-        have_error = 1;
-        break;
+    while ((n_reads = read_batch_fill(batch, fwdsf, revsf,
+                                      config->in_mode)) > 0) {
+        axe_match_batch_pairs(config->fwd_trie, config->rev_trie,
+                              batch->seq1, batch->seq2, n_reads, batch->bcd1,
+                              batch->bcd2, batch->end1, batch->end2);
+        for (iii = 0; iii < n_reads; iii++) {
+            if (process_read_pair_combo(config, batch->seq1[iii],
+                                        batch->seq2[iii], batch->bcd1[iii],
+                                        batch->bcd2[iii], batch->end1[iii],
+                                        batch->end2[iii])) {
+                goto error;
+            }
+        }
     }
-    QES_SEQFILE_ITER_PAIRED_END(seq1, seq2)
-    if (!have_error) goto clean_exit;
-    else goto error;
 
-clean_exit:
+    read_batch_destroy(batch);
     qes_seqfile_destroy(fwdsf);
     qes_seqfile_destroy(revsf);
     return 0;
 error:
+    read_batch_destroy(batch);
     qes_seqfile_destroy(fwdsf);
     qes_seqfile_destroy(revsf);
     return 1;
 }
 
 
+/* Log how fast each engine matched a trie's reads, and use the fastest.
+ * Should they disagree, which they never ought to, some engine is wrong, and
+ * which can't be told from speed, so the simplest engine is used instead. */
+static int
+tune_pick_engine(const struct axe_config *config, struct axe_trie *trie,
+                 const struct axe_tune *tune, const char *name)
+{
+    enum axe_engine best = trie->engine;
+    char rates[256] = "";
+    size_t used = 0;
+    size_t iii = 0;
+    int measured = tune->reads >= AXE_TUNE_MIN_READS;
+
+    if (tune->disagreed > 0) {
+        best = axe_trie_reference_engine(trie);
+        if (config->verbosity >= 0) {
+            qes_log_format_warning(config->logger,
+                    "tune_engines -- Engines disagree on %" PRIu64 " of %"
+                    PRIu64 " %s reads, using the %s engine\n",
+                    tune->disagreed, tune->reads, name,
+                    axe_engine_name(best));
+        }
+        return axe_trie_set_engine(trie, best) != 0 ? 1 : 0;
+    }
+    for (iii = 0; iii < AXE_ENGINE_COUNT; iii++) {
+        if (!(tune->engines & (1u << iii))) continue;
+        if (tune->seconds[iii] < AXE_TUNE_MIN_SECONDS) {
+            measured = 0;
+        }
+        if (!(tune->engines & (1u << best)) ||
+                tune->seconds[iii] < tune->seconds[best]) {
+            best = (enum axe_engine)iii;
+        }
+        if (used >= sizeof(rates)) continue;
+        if (tune->seconds[iii] > 0.0) {
+            used += snprintf(rates + used, sizeof(rates) - used,
+                             "%s%s %.2fM/s", used > 0 ? ", " : "",
+                             axe_engine_name((enum axe_engine)iii),
+                             tune->reads / tune->seconds[iii] / 1e6);
+        } else {
+            used += snprintf(rates + used, sizeof(rates) - used,
+                             "%s%s unmeasured", used > 0 ? ", " : "",
+                             axe_engine_name((enum axe_engine)iii));
+        }
+    }
+    /* Too few reads, or too quickly matched, to tell the engines apart */
+    if (!measured) {
+        best = trie->engine;
+    }
+    if (axe_trie_set_engine(trie, best) != 0) {
+        return 1;
+    }
+    if (config->verbosity >= 0) {
+        qes_log_format_info(config->logger,
+                "tune_engines -- %s reads: %s. Using the %s engine%s\n",
+                name, rates, axe_engine_name(best),
+                measured ? "" : ", as too few reads were timed");
+    }
+    return 0;
+}
+
+int
+axe_tune_engines(struct axe_config *config)
+{
+    struct axe_trie *tries[2] = {NULL, NULL};
+    const char *names[2] = {"R1", "R2"};
+    struct axe_tune tunes[2];
+    struct qes_seq *seq1[AXE_TUNE_CHUNK];
+    struct qes_seq *seq2[AXE_TUNE_CHUNK];
+    struct qes_seqfile *fwdsf = NULL;
+    struct qes_seqfile *revsf = NULL;
+    enum read_mode mode = READS_SINGLE;
+    struct stat st;
+    size_t n_reads = 0;
+    size_t total = 0;
+    size_t iii = 0;
+    int ret = 1;
+
+    if (!axe_config_ok(config) || config->fwd_trie == NULL) {
+        return -1;
+    }
+    tries[0] = config->fwd_trie;
+    if (config->match_combo) {
+        tries[1] = config->rev_trie;
+    }
+    if (config->pin_engine) {
+        for (iii = 0; iii < 2; iii++) {
+            if (tries[iii] != NULL &&
+                    axe_trie_set_engine(tries[iii], config->engine) != 0) {
+                qes_log_format_fatal(config->logger,
+                        "tune_engines -- Can't match %s reads with the %s "
+                        "engine\n", names[iii],
+                        axe_engine_name(config->engine));
+                return 1;
+            }
+        }
+        return 0;
+    }
+    /* Only tries with a choice of engines are tuned */
+    for (iii = 0; iii < 2; iii++) {
+        unsigned int engines = axe_trie_engines(tries[iii]);
+
+        if ((engines & (engines - 1)) == 0) {
+            tries[iii] = NULL;
+        }
+    }
+    if (config->tune_reads == 0 || (tries[0] == NULL && tries[1] == NULL)) {
+        return 0;
+    }
+    /* The sample is read again by axe_process_file, which pipes can't do */
+    for (iii = 0; iii < 2; iii++) {
+        if (config->infiles[iii] != NULL &&
+                (stat(config->infiles[iii], &st) != 0 ||
+                 !S_ISREG(st.st_mode))) {
+            if (config->verbosity > 0) {
+                qes_log_format_info(config->logger,
+                        "tune_engines -- Not timing engines on %s, as it "
+                        "isn't a file\n", config->infiles[iii]);
+            }
+            return 0;
+        }
+    }
+    /* Single-end matching needs only the first read of each pair */
+    if (config->match_combo || config->in_mode == READS_INTERLEAVED) {
+        mode = config->in_mode;
+    }
+    fwdsf = qes_seqfile_create(config->infiles[0], "r");
+    if (fwdsf == NULL) {
+        qes_log_format_fatal(config->logger,
+                             "tune_engines -- Couldn't open seqfile %s\n",
+                             config->infiles[0]);
+        return 1;
+    }
+    if (mode == READS_PAIRED) {
+        revsf = qes_seqfile_create(config->infiles[1], "r");
+        if (revsf == NULL) {
+            qes_log_format_fatal(config->logger,
+                                 "tune_engines -- Couldn't open seqfile %s\n",
+                                 config->infiles[1]);
+            qes_seqfile_destroy(fwdsf);
+            return 1;
+        }
+    }
+    memset(tunes, 0, sizeof(tunes));
+    for (iii = 0; iii < AXE_TUNE_CHUNK; iii++) {
+        seq1[iii] = qes_seq_create();
+        seq2[iii] = qes_seq_create();
+    }
+    while (total < config->tune_reads) {
+        size_t max = config->tune_reads - total;
+
+        n_reads = read_pairs(seq1, seq2,
+                             max < AXE_TUNE_CHUNK ? max : AXE_TUNE_CHUNK,
+                             fwdsf, revsf, mode);
+        if (n_reads == 0) {
+            break;
+        }
+        for (iii = 0; iii < 2; iii++) {
+            unsigned int engines = 0;
+
+            if (tries[iii] == NULL) continue;
+            axe_trie_tune(tries[iii], iii == 0 ? seq1 : seq2, n_reads,
+                          &tunes[iii]);
+            /* The keys may suit just one engine after all */
+            engines = tunes[iii].engines;
+            if ((engines & (engines - 1)) == 0) {
+                tries[iii] = NULL;
+            }
+        }
+        if (tries[0] == NULL && tries[1] == NULL) {
+            break;
+        }
+        total += n_reads;
+    }
+    for (iii = 0; iii < 2; iii++) {
+        if (tries[iii] != NULL && tunes[iii].reads > 0 &&
+                tune_pick_engine(config, tries[iii], &tunes[iii],
+                                 names[iii]) != 0) {
+            goto exit;
+        }
+    }
+    ret = 0;
+
+exit:
+    for (iii = 0; iii < AXE_TUNE_CHUNK; iii++) {
+        qes_seq_destroy(seq1[iii]);
+        qes_seq_destroy(seq2[iii]);
+    }
+    qes_seqfile_destroy(fwdsf);
+    qes_seqfile_destroy(revsf);
+    return ret;
+}
+
 int
 axe_process_file(struct axe_config *config)
 {
@@ -1364,51 +2009,26 @@ char **
 hamming_mutate_dna(size_t *n_results_o, const char *str, size_t len,
                    unsigned int dist, int keep_original)
 {
-    const char alphabet[] = "ACGT";
-    const size_t n_letters = 4;
-    char *tmp = NULL;
+    struct axe_mutator *mut = NULL;
+    const char *mutant = NULL;
     char **result = NULL;
     size_t results = 0;
     size_t results_alloced = 64;
-    size_t iii;
-    uintptr_t *alphabet_indicies;
-    int alpha_ret = 0;
-    gsl_combination *mut_idx_comb;
 
-    if (str == NULL || len < 1 || dist < 1) {
+    mut = axe_mutator_create();
+    if (axe_mutator_start(mut, str, len, dist, keep_original) != 0) {
+        axe_mutator_destroy(mut);
         return NULL;
     }
     result = qes_malloc(results_alloced * sizeof(*result));
-    alphabet_indicies = qes_calloc(dist, sizeof(*alphabet_indicies));
-    mut_idx_comb = gsl_combination_calloc(len, dist);
-    do {
-        while ((alpha_ret = product(n_letters, dist, alphabet_indicies,
-                                    !alpha_ret)) == 1) {
-            tmp = strndup(str, len+1);
-            for (iii = 0; iii < dist; iii++) {
-                char replacement = alphabet[alphabet_indicies[iii]];
-                size_t mut_idx = gsl_combination_get(mut_idx_comb, iii);
-                if (tmp[mut_idx] == replacement) {
-                    continue;
-                }
-                tmp[mut_idx] = replacement;
-            }
-            if (strncmp(str, tmp, len) == 0 && !keep_original) {
-                qes_free(tmp);
-                continue;
-            } else {
-                if (results + 1 > results_alloced) {
-                    results_alloced = qes_roundupz(results_alloced);
-                    result = qes_realloc(result,
-                                         results_alloced * sizeof(*result));
-                }
-                result[results++] = strndup(tmp, len);
-                qes_free(tmp);
-            }
+    while ((mutant = axe_mutator_next(mut)) != NULL) {
+        if (results + 1 > results_alloced) {
+            results_alloced = qes_roundupz(results_alloced);
+            result = qes_realloc(result, results_alloced * sizeof(*result));
         }
-    } while (gsl_combination_next(mut_idx_comb) == GSL_SUCCESS);
-    gsl_combination_free(mut_idx_comb);
-    qes_free(alphabet_indicies);
+        result[results++] = strndup(mutant, len);
+    }
+    axe_mutator_destroy(mut);
     *n_results_o = results;
     return result;
 }
@@ -1438,6 +2058,43 @@ axe_trie_create(void)
     _AM_ADD('T')
     _AM_ADD('N')
 #undef _AM_ADD
+    /* Soft-masked (lower case) bases are the same bases as far as we care */
+#define _AM_ALIAS(alias, chr)                                                \
+    ret = alpha_map_add_alias(map, alias, chr);                             \
+    if (ret != 0) {                                                         \
+        fprintf(stderr, "[trie_create] Failed to add alias %c to alphamap\n",\
+                alias);                                                     \
+        alpha_map_free(map);                                                \
+        return NULL;                                                        \
+    }
+    _AM_ALIAS('a', 'A')
+    _AM_ALIAS('c', 'C')
+    _AM_ALIAS('g', 'G')
+    _AM_ALIAS('t', 'T')
+    _AM_ALIAS('n', 'N')
+    /* Degenerate bases in barcodes match any base, but spend a mismatch on
+     * it, just as N does */
+    _AM_ALIAS('B', 'N')
+    _AM_ALIAS('D', 'N')
+    _AM_ALIAS('H', 'N')
+    _AM_ALIAS('K', 'N')
+    _AM_ALIAS('M', 'N')
+    _AM_ALIAS('R', 'N')
+    _AM_ALIAS('S', 'N')
+    _AM_ALIAS('V', 'N')
+    _AM_ALIAS('W', 'N')
+    _AM_ALIAS('Y', 'N')
+    _AM_ALIAS('b', 'N')
+    _AM_ALIAS('d', 'N')
+    _AM_ALIAS('h', 'N')
+    _AM_ALIAS('k', 'N')
+    _AM_ALIAS('m', 'N')
+    _AM_ALIAS('r', 'N')
+    _AM_ALIAS('s', 'N')
+    _AM_ALIAS('v', 'N')
+    _AM_ALIAS('w', 'N')
+    _AM_ALIAS('y', 'N')
+#undef _AM_ALIAS
     trie = qes_calloc(1, sizeof(*trie));
     trie->trie = trie_new(map);
     if (trie->trie == NULL) {
@@ -1445,7 +2102,7 @@ axe_trie_create(void)
         alpha_map_free(map);
         return NULL;
     }
-    alpha_map_free(map);
+    trie->alpha_map = map;
     return trie;
 }
 
@@ -1457,42 +2114,346 @@ axe_trie_destroy_(struct axe_trie *trie)
         if (trie->trie != NULL) {
             trie_free(trie->trie);
         }
+        if (trie->staged != NULL) {
+            trie_builder_free(trie->staged);
+        }
+        if (trie->alpha_map != NULL) {
+            alpha_map_free(trie->alpha_map);
+        }
+        if (trie->frozen != NULL && !trie->mapped) {
+            frozen_trie_free(trie->frozen);
+        }
+        if (trie->exact != NULL && !trie->mapped) {
+            frozen_trie_free(trie->exact);
+        }
+        axe_kmer_destroy(trie->kmer);
+        axe_hash_destroy(trie->hash);
+        axe_top_destroy(trie->top);
+        axe_cache_destroy(trie->cache);
+        axe_filter_destroy(trie->filter);
+        axe_hamming_destroy(trie->hamming);
+        axe_seed_destroy(trie->seed);
+        axe_dawg_destroy(trie->dawg);
+        axe_window_destroy(trie->window);
         qes_free(trie);
     }
 }
 
+/* Drop a stale frozen image before the trie is changed */
+static inline void
+axe_trie_thaw(struct axe_trie *trie)
+{
+    if (trie->frozen != NULL) {
+        frozen_trie_free(trie->frozen);
+        trie->frozen = NULL;
+    }
+    axe_kmer_destroy(trie->kmer);
+    axe_hash_destroy(trie->hash);
+    axe_top_destroy(trie->top);
+    axe_seed_destroy(trie->seed);
+    axe_dawg_destroy(trie->dawg);
+    axe_window_destroy(trie->window);
+    /* Matches may change with the trie */
+    axe_cache_destroy(trie->cache);
+    axe_filter_destroy(trie->filter);
+    trie->engine = AXE_ENGINE_TRIE;
+}
+
+static bool
+stage_key(const AlphaChar *key, TrieData data, void *user_data)
+{
+    return trie_builder_store_if_absent(user_data, key, data);
+}
+
+int
+axe_trie_stage(struct axe_trie *trie)
+{
+    if (!axe_trie_ok(trie) || trie->mapped) return -1;
+    if (trie->staged != NULL) return 0;
+    trie->staged = trie_builder_new(trie->alpha_map);
+    if (trie->staged == NULL) {
+        return 1;
+    }
+    if (!trie_enumerate(trie->trie, stage_key, trie->staged)) {
+        trie_builder_free(trie->staged);
+        trie->staged = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+void
+axe_trie_replace(struct axe_trie *trie, Trie *built)
+{
+    axe_trie_thaw(trie);
+    trie_free(trie->trie);
+    trie->trie = built;
+    if (trie->staged != NULL) {
+        trie_builder_free(trie->staged);
+        trie->staged = NULL;
+    }
+}
+
+int
+axe_trie_build(struct axe_trie *trie)
+{
+    Trie *built = NULL;
+
+    if (!axe_trie_ok(trie) || trie->mapped) return -1;
+    if (trie->staged == NULL) return 0;
+    built = trie_builder_build(trie->staged);
+    if (built == NULL) {
+        return 1;
+    }
+    axe_trie_replace(trie, built);
+    return 0;
+}
+
+int
+axe_trie_freeze(struct axe_trie *trie)
+{
+    if (!axe_trie_ok(trie) || trie->mapped) return -1;
+    if (axe_trie_build(trie) != 0) return 1;
+    axe_trie_thaw(trie);
+    trie->frozen = trie_freeze(trie->trie);
+    if (trie->frozen == NULL) {
+        return 1;
+    }
+    /* The trie lacks the mutants, so nothing can be derived from it */
+    if (trie->hamming != NULL) {
+        trie->engine = AXE_ENGINE_HAMMING;
+        return 0;
+    }
+    if (trie->edit) {
+        trie->engine = AXE_ENGINE_EDIT;
+        return 0;
+    }
+    if (trie->search) {
+        /* Long barcodes of one length are best found by their seeds */
+        trie->seed = axe_seed_create(trie->trie, trie->mismatch_level);
+        trie->engine = trie->seed != NULL ? AXE_ENGINE_SEED
+                                          : AXE_ENGINE_SEARCH;
+        return 0;
+    }
+    /* Pick the fastest engine the keys suit. Small k-mer tables take one
+     * memory access per read. Failing that, barcodes of one length hash
+     * well, and larger k-mer tables still beat the trie. The frozen trie is
+     * kept regardless, for reads with Ns. */
+    trie->kmer = axe_kmer_create(trie->trie, AXE_KMER_MAX_BYTES);
+    if (trie->kmer != NULL && trie->kmer->bytes <= AXE_KMER_PREFER_BYTES) {
+        trie->engine = AXE_ENGINE_KMER;
+        return 0;
+    }
+    trie->hash = axe_hash_create(trie->trie);
+    if (trie->hash != NULL) {
+        axe_kmer_destroy(trie->kmer);
+        trie->engine = AXE_ENGINE_HASH;
+    } else if (trie->kmer != NULL) {
+        trie->engine = AXE_ENGINE_KMER;
+    } else {
+        /* Only the trie will do, so speed up its first levels */
+        trie->top = axe_top_create(trie->trie, trie->frozen,
+                                   AXE_TOP_MAX_BYTES);
+    }
+    return 0;
+}
+
+int
+axe_trie_set_exact(struct axe_trie *trie, char *const *seqs,
+                   const intptr_t *values, size_t n, size_t mismatches)
+{
+    struct axe_trie *exact = NULL;
+    size_t max_len = 0;
+    size_t iii = 0;
+
+    if (!axe_trie_ok(trie) || trie->mapped || seqs == NULL ||
+            values == NULL) {
+        return -1;
+    }
+    for (iii = 0; iii < n; iii++) {
+        if (strlen(seqs[iii]) > max_len) {
+            max_len = strlen(seqs[iii]);
+        }
+    }
+    /* Too long to search, so reads with Ns there go unmatched, as ever */
+    if (max_len > AXE_SEARCH_MAX_LEN) {
+        return 0;
+    }
+    exact = axe_trie_create();
+    if (exact == NULL) {
+        return 1;
+    }
+    for (iii = 0; iii < n; iii++) {
+        if (axe_trie_add(exact, seqs[iii], values[iii]) != 0) {
+            axe_trie_destroy(exact);
+            return 1;
+        }
+    }
+    if (trie->exact != NULL) {
+        frozen_trie_free(trie->exact);
+    }
+    trie->exact = trie_freeze(exact->trie);
+    trie->exact_len = max_len;
+    trie->mismatch_level = mismatches;
+    axe_trie_destroy(exact);
+    return trie->exact != NULL ? 0 : 1;
+}
+
+/* Is there a base the mutants can't hold, so that the read must be searched
+ * for among the exact barcodes? */
+static inline int
+needs_exact(const struct axe_trie *trie, const char *seq, size_t len)
+{
+    if (trie->exact == NULL) return 0;
+    if (len > trie->exact_len) {
+        len = trie->exact_len;
+    }
+    return axe_acgt_span(seq, len) < len;
+}
+
 inline int
 axe_trie_get(struct axe_trie *trie, const char *str, intptr_t *data)
 {
     if (!axe_trie_ok(trie) || str == NULL) return -1;
+    if (trie->staged != NULL) {
+        return trie_builder_retrieve(trie->staged, str, data);
+    }
     return trie_retrieve(trie->trie, str, data);
 }
 
 inline int
 axe_trie_delete(struct axe_trie *trie, const char *str)
 {
-    if (!axe_trie_ok(trie) || str == NULL) return -1;
+    if (!axe_trie_ok(trie) || trie->mapped || str == NULL) return -1;
+    axe_trie_thaw(trie);
+    if (trie->staged != NULL) {
+        return trie_builder_delete(trie->staged, str);
+    }
     return trie_delete(trie->trie, str);
 }
 
 inline int
 axe_trie_add(struct axe_trie *trie, const char *str, intptr_t data)
 {
-    if (!axe_trie_ok(trie) || str == NULL) return -1;
+    if (!axe_trie_ok(trie) || trie->mapped || str == NULL) return -1;
+    axe_trie_thaw(trie);
+    if (trie->staged != NULL) {
+        return trie_builder_store_if_absent(trie->staged, str, data) ? 0 : 1;
+    }
     if (trie_store_if_absent(trie->trie, str, data)) {
         return 0;
     }
     return 1;
 }
 
+/* Match a read with the trie's engine, bypassing the cache. value must
+ * already be -1. If end is not NULL, it is set as axe_edit_match sets it,
+ * when the engine aligns with indels or searches a window. */
+static inline int
+match_read_engine(struct axe_trie *trie, const struct qes_seq *seq,
+                  ssize_t *value, size_t *end)
+{
+    /* Both states live on the stack, so a lookup makes no heap allocations.
+     * This matters, as we are called once or twice per read. */
+    TrieState trie_iter;
+    TrieState last_good_state;
+    int have_good_state = 0;
+    size_t seq_pos = 0;
+
+    if (trie->window != NULL) {
+        intptr_t data;
+
+        if (axe_window_match(trie->window, trie->frozen, seq->seq.str,
+                             seq->seq.len, &data, end) != 0) {
+            return 1;
+        }
+        *value = (ssize_t) data;
+        return 0;
+    }
+    if (needs_exact(trie, seq->seq.str, seq->seq.len)) {
+        intptr_t data;
+
+        if (axe_search_match(trie->exact, seq->seq.str, seq->seq.len,
+                             trie->mismatch_level, &data) != 0) {
+            return 1;
+        }
+        *value = (ssize_t) data;
+        return 0;
+    }
+    if (trie->engine != AXE_ENGINE_TRIE) {
+        intptr_t data;
+        int ret = -1;
+
+        if (trie->engine == AXE_ENGINE_KMER) {
+            ret = axe_kmer_match(trie->kmer, seq->seq.str, seq->seq.len,
+                                 &data);
+        } else if (trie->engine == AXE_ENGINE_HASH) {
+            ret = axe_hash_match(trie->hash, seq->seq.str, seq->seq.len,
+                                 &data);
+        } else if (trie->engine == AXE_ENGINE_HAMMING) {
+            ret = axe_hamming_match(trie->hamming, seq->seq.str, seq->seq.len,
+                                    &data);
+        } else if (trie->engine == AXE_ENGINE_SEARCH) {
+            ret = axe_search_match(trie->frozen, seq->seq.str, seq->seq.len,
+                                   trie->mismatch_level, &data);
+        } else if (trie->engine == AXE_ENGINE_EDIT) {
+            ret = axe_edit_match(trie->frozen, seq->seq.str, seq->seq.len,
+                                 trie->mismatch_level, &data, end);
+        } else if (trie->engine == AXE_ENGINE_SEED) {
+            ret = axe_seed_match(trie->seed, seq->seq.str, seq->seq.len,
+                                 &data);
+            if (ret < 0) {
+                ret = axe_search_match(trie->frozen, seq->seq.str,
+                                       seq->seq.len, trie->mismatch_level,
+                                       &data);
+            }
+        } else if (trie->engine == AXE_ENGINE_DAWG) {
+            ret = axe_dawg_match(trie->dawg, seq->seq.str, seq->seq.len,
+                                 &data);
+        }
+        if (ret >= 0) {
+            if (ret == 0) {
+                *value = (ssize_t) data;
+            }
+            return ret;
+        }
+        /* Ns in the barcode region; only the trie knows those */
+    }
+    if (trie->frozen != NULL) {
+        TrieData data;
+
+        if (!axe_top_longest_prefix(trie->top, trie->frozen, seq->seq.str,
+                                    seq->seq.len, &data)) {
+            return 1;
+        }
+        *value = (ssize_t) data;
+        return 0;
+    }
+    trie_root_init(trie->trie, &trie_iter);
+    /* Consume seq until we can't, remembering the longest barcode seen */
+    for (seq_pos = 0; seq_pos < seq->seq.len; seq_pos++) {
+        if (!trie_state_walk(&trie_iter, seq->seq.str[seq_pos])) {
+            break;
+        }
+        if (trie_state_is_terminal(&trie_iter)) {
+            trie_state_copy(&last_good_state, &trie_iter);
+            have_good_state = 1;
+        }
+    }
+    if (!have_good_state) {
+        return 1;
+    }
+    /* Step onto the terminator, where the data is stored */
+    trie_state_walk(&last_good_state, '\0');
+    *value = (ssize_t) trie_state_get_data(&last_good_state);
+    return 0;
+}
+
 inline int
 axe_match_read (struct axe_config *config, ssize_t *value,
                 struct axe_trie *trie, const struct qes_seq *seq)
 {
-    TrieState *trie_iter = NULL;
-    TrieState *last_good_state = NULL;
-    size_t seq_pos = 0;
-
+    (void) config;
     /* value is set to -1 on anything bad happening including failed lookup */
     if (value == NULL || !axe_trie_ok(trie) || !qes_seq_ok(seq)) {
         return -1;
@@ -1502,43 +2463,354 @@ axe_match_read (struct axe_config *config, ssize_t *value,
     if (seq->seq.len < trie->min_len) {
         return 1;
     }
-    /* Only look until the maximum of the largest barcode, or seq len */
-    /* Grab tree root iter, and check it. */
-    trie_iter = trie_root(trie->trie);
-    if (trie_iter == NULL) {
-        qes_log_message_fatal(config->logger,
-                              "match_read -- trie_root() returned NULL!\n");
-        return -1;
+    if (trie->filter != NULL) {
+        int pass = axe_filter_check(trie->filter, seq->seq.str, seq->seq.len);
+
+        if (pass >= 0) {
+            trie->filter->checked++;
+            if (!pass) {
+                trie->filter->rejected++;
+                return 1;
+            }
+        }
     }
-    /* Consume seq until we can't */
-    do {
-        trie_state_walk(trie_iter, seq->seq.str[seq_pos]);
-        if (trie_state_is_terminal(trie_iter)) {
-            if (last_good_state != NULL) {
-                trie_state_free(last_good_state);
+    if (trie->cache != NULL) {
+        struct axe_cache_entry *entry = NULL;
+        uint64_t key = 0;
+        int ret = 0;
+
+        entry = axe_cache_slot(trie->cache, seq->seq.str, seq->seq.len, &key);
+        if (entry != NULL) {
+            if (entry->filled && entry->key == key) {
+                trie->cache->hits++;
+                *value = entry->value;
+                return entry->value < 0 ? 1 : 0;
             }
-            last_good_state = trie_state_clone(trie_iter);
-        }
-    } while (trie_state_is_walkable(trie_iter, seq->seq.str[++seq_pos]));
-    /* If we get to a terminal state, then great! */
-    if (trie_state_is_terminal(trie_iter)) {
-        trie_state_walk(trie_iter, '\0');
-        trie_state_free(last_good_state);
-        *value =  (ssize_t) trie_state_get_data(trie_iter);
-        trie_state_free(trie_iter);
-        return 0;
-    } else if (last_good_state != NULL) {
-        trie_state_free(trie_iter);
-        trie_state_walk(last_good_state, '\0');
-        *value =  (ssize_t) trie_state_get_data(last_good_state);
-        trie_state_free(last_good_state);
-        return 0;
+            trie->cache->misses++;
+            ret = match_read_engine(trie, seq, value, NULL);
+            entry->key = key;
+            entry->value = (int32_t) *value;
+            entry->filled = 1;
+            return ret;
+        }
+    }
+    return match_read_engine(trie, seq, value, NULL);
+}
+
+/* Walk reads through a frozen trie in lockstep, one base of each read per
+ * round, prefetching the cell each read needs next. Only reads flagged in
+ * todo are walked. */
+static void
+match_batch_frozen(const FrozenTrie *ft, const struct axe_top *top,
+                   struct qes_seq *const *seqs, size_t n, ssize_t *results,
+                   const int *todo)
+{
+    FrozenTrieState state[AXE_BATCH_SIZE];
+    size_t pos[AXE_BATCH_SIZE];
+    size_t active[AXE_BATCH_SIZE];
+    size_t n_active = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii < n; iii++) {
+        const struct qes_seq *seq = seqs[iii];
+        const struct axe_top_entry *entry = NULL;
+
+        if (!todo[iii] || seq->seq.len == 0) {
+            continue;
+        }
+        state[iii] = FROZEN_TRIE_STATE_ROOT;
+        pos[iii] = 0;
+        /* Skip the tabulated levels, where they can be */
+        if (top != NULL && seq->seq.len >= top->depth &&
+                (entry = axe_top_entry(top, ft, seq->seq.str)) != NULL) {
+            if (entry->value >= 0) {
+                results[iii] = entry->value;
+            }
+            if (entry->state == FROZEN_TRIE_STATE_FAIL ||
+                    seq->seq.len == top->depth) {
+                continue;
+            }
+            state[iii] = entry->state;
+            pos[iii] = top->depth;
+        }
+        active[n_active++] = iii;
+    }
+    while (n_active > 0) {
+        size_t n_keep = 0;
+        size_t aaa = 0;
+
+        for (aaa = 0; aaa < n_active; aaa++) {
+            const struct qes_seq *seq = NULL;
+            FrozenTrieState next;
+            TrieData data;
+            TrieIndex tc;
+
+            iii = active[aaa];
+            seq = seqs[iii];
+            next = frozen_trie_walk(ft, state[iii], seq->seq.str[pos[iii]]);
+            if (next == FROZEN_TRIE_STATE_FAIL) {
+                continue;
+            }
+            if (frozen_trie_get_terminal_data(ft, next, &data)) {
+                results[iii] = (ssize_t) data;
+            }
+            if (++pos[iii] >= seq->seq.len) {
+                continue;
+            }
+            if (next & FROZEN_TRIE_TAIL_BIT) {
+                /* Tails are contiguous, and already in cache: finish here */
+                while (pos[iii] < seq->seq.len) {
+                    next = frozen_trie_walk(ft, next, seq->seq.str[pos[iii]++]);
+                    if (next == FROZEN_TRIE_STATE_FAIL) {
+                        break;
+                    }
+                    if (frozen_trie_get_terminal_data(ft, next, &data)) {
+                        results[iii] = (ssize_t) data;
+                    }
+                }
+                continue;
+            }
+            state[iii] = next;
+            tc = frozen_trie_char_to_trie(ft, seq->seq.str[pos[iii]]);
+            frozen_trie_prefetch(ft, next,
+                                 tc == TRIE_INDEX_MAX ? 0 : (TrieChar) tc);
+            active[n_keep++] = iii;
+        }
+        n_active = n_keep;
     }
-    trie_state_free(trie_iter);
-    if (last_good_state != NULL) {
-        trie_state_free(last_good_state);
+}
+
+/* Match the reads flagged in todo with the trie's engine, bypassing the
+ * cache. ends may be NULL. */
+static void
+match_batch_engine(struct axe_trie *trie, struct qes_seq *const *seqs,
+                   size_t n, ssize_t *results, size_t *ends, int *todo)
+{
+    uint64_t packed[AXE_BATCH_SIZE];
+    size_t plen[AXE_BATCH_SIZE];
+    size_t iii = 0;
+
+    /* Brute force and searches each go their own way */
+    if (trie->frozen == NULL || trie->window != NULL ||
+            trie->engine == AXE_ENGINE_HAMMING ||
+            trie->engine == AXE_ENGINE_SEARCH ||
+            trie->engine == AXE_ENGINE_SEED ||
+            trie->engine == AXE_ENGINE_EDIT ||
+            trie->engine == AXE_ENGINE_DAWG) {
+        for (iii = 0; iii < n; iii++) {
+            if (todo[iii]) {
+                match_read_engine(trie, seqs[iii], &results[iii],
+                                  ends != NULL ? &ends[iii] : NULL);
+            }
+        }
+        return;
+    }
+    /* Reads with Ns are searched for among the exact barcodes */
+    if (trie->exact != NULL) {
+        for (iii = 0; iii < n; iii++) {
+            if (todo[iii] && needs_exact(trie, seqs[iii]->seq.str,
+                                         seqs[iii]->seq.len)) {
+                match_read_engine(trie, seqs[iii], &results[iii], NULL);
+                todo[iii] = 0;
+            }
+        }
+    }
+    /* Table engines: pack every read and prefetch its slot, then probe.
+     * Reads with Ns stay flagged for the trie. Reads with nothing to probe
+     * keep a plen of 0. */
+    memset(plen, 0, sizeof(plen));
+    if (trie->engine == AXE_ENGINE_KMER) {
+        const struct axe_kmer *kmer = trie->kmer;
+
+        for (iii = 0; iii < n; iii++) {
+            if (!todo[iii]) continue;
+            plen[iii] = axe_kmer_pack_len(kmer, seqs[iii]->seq.len);
+            if (axe_pack_2bit(seqs[iii]->seq.str, plen[iii],
+                              &packed[iii]) == 0) {
+                todo[iii] = 0;
+                if (plen[iii] == kmer->max_len) {
+                    AXE_PREFETCH(&kmer->tables[plen[iii]][packed[iii]]);
+                }
+            } else {
+                plen[iii] = 0;
+            }
+        }
+        for (iii = 0; iii < n; iii++) {
+            intptr_t data;
+
+            if (!todo[iii] && plen[iii] > 0 &&
+                    axe_kmer_probe(kmer, packed[iii], plen[iii], &data) == 0) {
+                results[iii] = (ssize_t) data;
+            }
+        }
+    } else if (trie->engine == AXE_ENGINE_HASH) {
+        const struct axe_hash *hash = trie->hash;
+
+        for (iii = 0; iii < n; iii++) {
+            if (!todo[iii]) continue;
+            if (seqs[iii]->seq.len < hash->len) {
+                todo[iii] = 0;
+                plen[iii] = 0;
+            } else if (axe_pack_2bit(seqs[iii]->seq.str, hash->len,
+                                     &packed[iii]) == 0) {
+                todo[iii] = 0;
+                plen[iii] = hash->len;
+                AXE_PREFETCH(&hash->table[axe_hash_slot(hash, packed[iii])]);
+            } else {
+                plen[iii] = 0;
+            }
+        }
+        for (iii = 0; iii < n; iii++) {
+            intptr_t data;
+
+            if (!todo[iii] && plen[iii] > 0 &&
+                    axe_hash_probe(hash, packed[iii], &data) == 0) {
+                results[iii] = (ssize_t) data;
+            }
+        }
+    }
+    match_batch_frozen(trie->frozen, trie->top, seqs, n, results, todo);
+}
+
+/* Reads the filter rejects or found in the cache skip the engine, and the
+ * matches of the rest are cached after */
+static void
+match_batch_chunk(struct axe_trie *trie, struct qes_seq *const *seqs,
+                  size_t n, ssize_t *results, size_t *ends)
+{
+    struct axe_cache_entry *entries[AXE_BATCH_SIZE];
+    uint64_t keys[AXE_BATCH_SIZE];
+    int todo[AXE_BATCH_SIZE];
+    size_t iii = 0;
+
+    for (iii = 0; iii < n; iii++) {
+        const struct qes_seq *seq = seqs[iii];
+
+        results[iii] = -1;
+        if (ends != NULL) {
+            ends[iii] = 0;
+        }
+        todo[iii] = qes_seq_ok(seq) && seq->seq.len >= trie->min_len;
+        entries[iii] = NULL;
+    }
+    if (trie->filter != NULL) {
+        for (iii = 0; iii < n; iii++) {
+            int pass = 0;
+
+            if (!todo[iii]) continue;
+            pass = axe_filter_check(trie->filter, seqs[iii]->seq.str,
+                                    seqs[iii]->seq.len);
+            if (pass >= 0) {
+                trie->filter->checked++;
+                if (!pass) {
+                    trie->filter->rejected++;
+                    todo[iii] = 0;
+                }
+            }
+        }
+    }
+    if (trie->cache != NULL) {
+        for (iii = 0; iii < n; iii++) {
+            struct axe_cache_entry *entry = NULL;
+
+            if (!todo[iii]) continue;
+            entry = axe_cache_slot(trie->cache, seqs[iii]->seq.str,
+                                   seqs[iii]->seq.len, &keys[iii]);
+            if (entry == NULL) continue;
+            if (entry->filled && entry->key == keys[iii]) {
+                trie->cache->hits++;
+                results[iii] = entry->value;
+                todo[iii] = 0;
+            } else {
+                trie->cache->misses++;
+                entries[iii] = entry;
+            }
+        }
+    }
+    match_batch_engine(trie, seqs, n, results, ends, todo);
+    for (iii = 0; iii < n; iii++) {
+        if (entries[iii] != NULL) {
+            entries[iii]->key = keys[iii];
+            entries[iii]->value = (int32_t) results[iii];
+            entries[iii]->filled = 1;
+        }
     }
-    return 1;
+}
+
+int
+axe_match_batch_ends(struct axe_trie *trie, struct qes_seq *const *seqs,
+                     size_t n, ssize_t *results, size_t *ends)
+{
+    size_t start = 0;
+
+    if (seqs == NULL || results == NULL || !axe_trie_ok(trie)) {
+        return -1;
+    }
+    for (start = 0; start < n; start += AXE_BATCH_SIZE) {
+        size_t len = n - start < AXE_BATCH_SIZE ? n - start : AXE_BATCH_SIZE;
+
+        match_batch_chunk(trie, seqs + start, len, results + start,
+                          ends != NULL ? ends + start : NULL);
+    }
+    return 0;
+}
+
+int
+axe_match_batch(struct axe_trie *trie, struct qes_seq *const *seqs,
+                size_t n, ssize_t *results)
+{
+    return axe_match_batch_ends(trie, seqs, n, results, NULL);
+}
+
+int
+axe_match_batch_pairs(struct axe_trie *fwd, struct axe_trie *rev,
+                      struct qes_seq *const *seqs1,
+                      struct qes_seq *const *seqs2, size_t n,
+                      ssize_t *results1, ssize_t *results2, size_t *ends1,
+                      size_t *ends2)
+{
+    struct qes_seq *hits[AXE_BATCH_SIZE];
+    ssize_t hit_results[AXE_BATCH_SIZE];
+    size_t hit_ends[AXE_BATCH_SIZE];
+    size_t which[AXE_BATCH_SIZE];
+    size_t start = 0;
+    size_t iii = 0;
+
+    if (seqs1 == NULL || seqs2 == NULL || results1 == NULL ||
+            results2 == NULL || !axe_trie_ok(fwd) || !axe_trie_ok(rev)) {
+        return -1;
+    }
+    for (start = 0; start < n; start += AXE_BATCH_SIZE) {
+        size_t len = n - start < AXE_BATCH_SIZE ? n - start : AXE_BATCH_SIZE;
+        size_t n_hits = 0;
+
+        match_batch_chunk(fwd, seqs1 + start, len, results1 + start,
+                          ends1 != NULL ? ends1 + start : NULL);
+        /* Only the second reads of pairs still in the running are walked,
+         * packed together so that none of the batch is wasted */
+        for (iii = 0; iii < len; iii++) {
+            results2[start + iii] = -1;
+            if (ends2 != NULL) {
+                ends2[start + iii] = 0;
+            }
+            if (results1[start + iii] >= 0) {
+                which[n_hits] = start + iii;
+                hits[n_hits++] = seqs2[start + iii];
+            }
+        }
+        if (n_hits == 0) {
+            continue;
+        }
+        match_batch_chunk(rev, hits, n_hits, hit_results,
+                          ends2 != NULL ? hit_ends : NULL);
+        for (iii = 0; iii < n_hits; iii++) {
+            results2[which[iii]] = hit_results[iii];
+            if (ends2 != NULL) {
+                ends2[which[iii]] = hit_ends[iii];
+            }
+        }
+    }
+    return 0;
 }
 
 int
@@ -1594,6 +2866,34 @@ axe_write_table(const struct axe_config *config)
     return 0;
 }
 
+static void
+print_trie_summary(const struct axe_config *config,
+                   const struct axe_trie *trie, const char *name)
+{
+    uint64_t lookups = 0;
+
+    if (trie == NULL) {
+        return;
+    }
+    if (trie->filter != NULL) {
+        axe_format_bold(config->logger,
+                "%s prefix filter: %.2fM of %.2fM reads rejected (%0.1f%%)\n",
+                name, trie->filter->rejected / 1000000.0,
+                trie->filter->checked / 1000000.0,
+                trie->filter->checked > 0 ? (float)trie->filter->rejected /
+                        trie->filter->checked * 100.0 : 0.0);
+    }
+    if (trie->cache != NULL) {
+        lookups = trie->cache->hits + trie->cache->misses;
+        axe_format_bold(config->logger,
+                "%s match cache: %.2fM hits, %.2fM misses (%0.1f%% hit)\n",
+                name, trie->cache->hits / 1000000.0,
+                trie->cache->misses / 1000000.0,
+                lookups > 0 ? (float)trie->cache->hits / lookups * 100.0
+                            : 0.0);
+    }
+}
+
 int
 axe_print_summary(const struct axe_config *config)
 {
@@ -1624,5 +2924,7 @@ axe_print_summary(const struct axe_config *config)
             "%.2fM %s could not be demultiplexed (%0.1f%%)\n",
             million(config->reads_failed), tmp,
             ((float)config->reads_failed/(float)(config->reads_processed)*100.0));
+    print_trie_summary(config, config->fwd_trie, "R1");
+    print_trie_summary(config, config->rev_trie, "R2");
     return 0;
 }
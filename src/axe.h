@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <time.h>
 
 #include <qes_util.h>
@@ -38,8 +39,16 @@
 
 #include "datrie/trie.h"
 #include "datrie/alpha-map.h"
+#include "datrie/trie-frozen.h"
+#include "datrie/trie-build.h"
 #include "axe_config.h"
 
+#if defined(__GNUC__)
+#  define AXE_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#  define AXE_PREFETCH(addr) ((void)(addr))
+#endif
+
 /* General rules:
  *  Most functions are declared as `int X(...);`. These functions return:
  *   -1 on parameter error (NULLs, bad values etc)
@@ -62,9 +71,377 @@ struct axe_output {
     enum read_mode mode;
 };
 
+/* Lookup structures that axe_match_read may use. All give identical results,
+ * they differ only in speed and memory use. */
+enum axe_engine {
+    AXE_ENGINE_TRIE = 0,    /* datrie, or its frozen image */
+    AXE_ENGINE_KMER = 1,    /* direct-indexed 2-bit k-mer tables */
+    AXE_ENGINE_HASH = 2,    /* hash of 2-bit packed keys, one key length */
+    AXE_ENGINE_HAMMING = 3, /* compare reads against every barcode */
+    AXE_ENGINE_SEARCH = 4,  /* bounded search of a trie of exact barcodes */
+    AXE_ENGINE_SEED = 5,    /* pigeonhole seeds of exact barcodes */
+    AXE_ENGINE_EDIT = 6,    /* edit distance search of exact barcodes */
+    AXE_ENGINE_DAWG = 7,    /* minimal automaton of the trie's keys */
+};
+#define AXE_ENGINE_COUNT 8
+
+/* Reads axe_tune_engines times the engines on, and how many of those each
+ * engine is timed on in turn, so that clock() has something to measure */
+#define AXE_TUNE_READS 200000
+#define AXE_TUNE_CHUNK 1024
+/* Fewest reads, and least time per engine, for timings to overrule the
+ * engine axe_trie_freeze picked. Below these, they are mostly noise. */
+#define AXE_TUNE_MIN_READS 10000
+#define AXE_TUNE_MIN_SECONDS 0.001
+
+/* Engines axe_trie_tune tried, as bits 1 << engine, and the time each took
+ * over the same reads */
+struct axe_tune {
+    unsigned int engines;
+    double seconds[AXE_ENGINE_COUNT];
+    uint64_t reads;
+    uint64_t disagreed; /* Reads the engines didn't all match alike */
+    size_t rounds;
+};
+
+/* Longest key, and total bytes of tables, the k-mer engine will take on */
+#define AXE_KMER_MAX_LEN 12
+#define AXE_KMER_MAX_BYTES ((size_t)64 << 20)
+/* k-mer tables at most this big beat any other engine */
+#define AXE_KMER_PREFER_BYTES ((size_t)1 << 20)
+
+/* One table per key length, indexed by the 2-bit packed key (A=0, C=1, G=2,
+ * T=3, first base most significant). Entries are the key's data, or -1. */
+struct axe_kmer {
+    int32_t *tables[AXE_KMER_MAX_LEN + 1];
+    size_t lens[AXE_KMER_MAX_LEN]; /* Key lengths, longest first */
+    size_t n_lens;
+    size_t max_len;
+    size_t bytes;
+    int mapped; /* tables lie in a mapped index, and aren't freed */
+};
+
+/* Longest key the hash engine will take on, as keys are packed in 64 bits */
+#define AXE_HASH_MAX_LEN 32
+
+struct axe_hash_entry {
+    uint64_t key;
+    int32_t value; /* -1 for empty slots */
+};
+
+/* Linear-probing hash of 2-bit packed keys, all of length len */
+struct axe_hash {
+    struct axe_hash_entry *table;
+    size_t mask;
+    unsigned int shift;
+    size_t len;
+    size_t n_keys;
+    int mapped; /* table lies in a mapped index, and isn't freed */
+};
+
+/* Limits of the brute-force Hamming engine. It is used in place of mutant
+ * expansion when that would make at least AXE_HAMMING_MIN_MUTANTS keys. */
+#define AXE_HAMMING_MAX_BARCODES 48
+#define AXE_HAMMING_MAX_LEN 16
+#define AXE_HAMMING_MIN_MUTANTS 10000
+
+/* Upper-cased barcodes with degenerate bases as N, all of length len, zero
+ * padded to 16 bytes */
+struct axe_hamming {
+    uint8_t (*seqs)[AXE_HAMMING_MAX_LEN];
+    int32_t *values;
+    size_t n;
+    size_t len;
+    size_t mismatches;
+    uint32_t len_mask;
+};
+
+/* Instruction sets the vector kernels are built for, each a superset of
+ * the last. AXE_SIMD_AVX512 needs AVX-512BW. */
+enum axe_simd {
+    AXE_SIMD_SCALAR = 0,
+    AXE_SIMD_SSE2 = 1,
+    AXE_SIMD_AVX2 = 2,
+    AXE_SIMD_AVX512 = 3,
+};
+#define AXE_SIMD_COUNT 4
+
+/* The kernels of one level. All levels give identical results. */
+struct axe_simd_kernels {
+    /* As axe_pack_2bit, for n of at most 32 */
+    int (*pack_2bit)(const char *seq, size_t n, uint64_t *packed);
+    /* Bases of seq before the first that isn't ACGT, at most n */
+    size_t (*acgt_span)(const char *seq, size_t n);
+    /* Barcodes tied at the fewest mismatches from read, within the
+     * mismatch level, setting best to one of them. read is as ham->seqs. */
+    size_t (*hamming_best)(const struct axe_hamming *ham, const uint8_t *read,
+                           size_t *best);
+};
+
+/* Memory for the table of the first levels of the frozen trie, and the
+ * fewest levels worth a table */
+#define AXE_TOP_MAX_BYTES (1 << 20)
+#define AXE_TOP_MIN_DEPTH 3
+
+/* Where a walk of the first bases of a read ends up, and the data of the
+ * longest key among those bases, or -1 */
+struct axe_top_entry {
+    FrozenTrieState state;
+    int32_t value;
+};
+
+/* Entries for every read prefix of depth bases, in trie codes, read as
+ * digits of base radix */
+struct axe_top {
+    struct axe_top_entry *table;
+    size_t depth;
+    size_t radix;
+    size_t bytes;
+    int mapped; /* table lies in a mapped index, and isn't freed */
+};
+
+/* Lengths of read prefix the filter may be built on. 4^10 bits is 128KiB,
+ * which stays in cache. */
+#define AXE_FILTER_MIN_K 6
+#define AXE_FILTER_MAX_K 10
+
+/* One bit for every prefix of k bases, set if some barcode or mutant starts
+ * with it */
+struct axe_filter {
+    uint64_t *bits;
+    size_t k;
+    size_t bytes;
+    uint64_t checked;
+    uint64_t rejected;
+    int mapped; /* bits lie in a mapped index, and aren't freed */
+};
+
+/* Longest read prefix the match cache keys on */
+#define AXE_CACHE_MAX_LEN 32
+/* Most slots of a match cache, as bits of the slot number: 1GiB of them */
+#define AXE_CACHE_MAX_BITS 26
+#define AXE_CACHE_MAX_MB 1024
+
+/* A read prefix, 2-bit packed, and its match. Slots not yet filled have
+ * filled set to 0. */
+struct axe_cache_entry {
+    uint64_t key;
+    int32_t value;
+    uint32_t filled;
+};
+
+/* Direct-mapped: each prefix has one slot, and evicts whatever was there */
+struct axe_cache {
+    struct axe_cache_entry *table;
+    size_t mask;
+    unsigned int shift;
+    size_t len;     /* of the prefixes; that of the longest key */
+    size_t bytes;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+/* A barcode pair present in a sparse design, keyed by the numbers of its R1
+ * and R2 barcodes. Empty slots have value 0; values are stored plus one. */
+struct axe_pair_slot {
+    uint64_t key;
+    uint32_t value;
+};
+
+/* Barcode pair numbers by the numbers of their R1 and R2 barcodes. Dense
+ * designs use one row-major table, with entries as narrow as the number of
+ * pairs allows; sparse ones, where the table would be mostly empty, hash the
+ * pairs present instead. Either way, entries are the pair's number plus one,
+ * or 0 for no pair. */
+struct axe_pair_map {
+    void *table;
+    unsigned int width; /* bytes per table entry: 1, 2 or 4 */
+    struct axe_pair_slot *slots;
+    size_t n_filled;
+    size_t mask;
+    unsigned int shift;
+    size_t n_barcodes_1;
+    size_t n_barcodes_2;
+    size_t bytes;
+};
+
+/* Where the mutants of barcodes of one length at one distance differ from
+ * them: every set of positions, and every choice of other letters to put
+ * there */
+struct axe_mutant_patterns {
+    size_t len;
+    unsigned int dist;
+    unsigned int radix; /* letters to choose from at each position */
+    uint32_t *sites;    /* n_sites sets of dist positions, in order */
+    size_t n_sites;
+    uint8_t *choices;   /* n_choices sets of dist indices into subst */
+    size_t n_choices;
+};
+
+/* Lists the mutants of one barcode at a time, into one reusable buffer */
+struct axe_mutator {
+    struct axe_mutant_patterns *patterns; /* By length and distance */
+    size_t n_patterns;
+    /* The letters other than each, in order, ending in NULs */
+    char subst[UCHAR_MAX + 1][4];
+    const struct axe_mutant_patterns *cur;
+    const char *str;
+    char *buf;
+    size_t buf_size;
+    size_t site;
+    size_t choice;
+    const uint32_t *last; /* Positions of buf that differ from str */
+    int original; /* str itself is yet to be listed */
+};
+
+/* A key lost by one barcode to another, when their mutants were expanded */
+struct axe_clash {
+    size_t barcode;    /* Index into the expansion's seqs */
+    unsigned int dist; /* Mismatches of key from the barcode */
+    uint32_t order;    /* Where the mutator lists key among the barcode's */
+    char *key;
+};
+
+/* The barcodes to load into one trie with their mutants, and the keys they
+ * clashed on */
+struct axe_expansion {
+    struct axe_trie *trie;
+    char **seqs; /* Distinct barcodes */
+    intptr_t *values;
+    size_t n_seqs;
+    struct axe_clash *clashes; /* By barcode, in mutator order */
+    size_t n_clashes;
+};
+
+/* Longest barcode the search engine takes */
+#define AXE_SEARCH_MAX_LEN 64
+
+/* Barcode lengths the seed engine takes, and its shortest segment. Shorter
+ * segments would find too many barcodes to compare. */
+#define AXE_SEED_MIN_LEN 16
+#define AXE_SEED_MAX_LEN 32
+#define AXE_SEED_MIN_SEGMENT 4
+
+/* Barcodes sharing one segment's sequence. count is 0 for empty slots. */
+struct axe_seed_slot {
+    uint64_t key;
+    const uint32_t *postings;
+    size_t count;
+};
+
+/* Hash of one segment of every barcode, by its 2-bit packed sequence */
+struct axe_seed_segment {
+    struct axe_seed_slot *table;
+    size_t mask;
+    unsigned int shift;
+    unsigned int shift_bits;    /* of the segment, within a packed barcode */
+    uint64_t key_mask;
+};
+
+/* 2-bit packed barcodes, all of length len, with mismatches + 1 segments */
+struct axe_seed {
+    uint64_t *barcodes;
+    int32_t *values;
+    size_t n;
+    size_t len;
+    size_t mismatches;
+    struct axe_seed_segment *segments;
+    size_t n_segments;
+    uint32_t *postings;
+};
+
+/* Longest key, and most trie codes, the DAWG engine takes */
+#define AXE_DAWG_MAX_LEN 64
+#define AXE_DAWG_MAX_RADIX 8
+/* A node's first edge is in the low bits of next, above them is a bit for
+ * each trie code it has an edge for */
+#define AXE_DAWG_EDGE_BITS 24
+#define AXE_DAWG_EDGE_MASK ((UINT32_C(1) << AXE_DAWG_EDGE_BITS) - 1)
+
+/* A key ends at the node if value isn't -1 */
+struct axe_dawg_node {
+    uint32_t next;
+    int32_t value;
+};
+
+/* The trie's keys as a minimal acyclic automaton. Node 0 is the root. Each
+ * node's edges are consecutive in edges, in order of trie code. */
+struct axe_dawg {
+    struct axe_dawg_node *nodes;
+    uint32_t *edges;
+    size_t n_nodes;
+    size_t n_edges;
+    uint8_t codes[256]; /* Trie code of each char, or 0 if none */
+    size_t bytes;
+};
+
+/* Most bases of a read the window automaton searches */
+#define AXE_WINDOW_MAX_WIDTH 256
+
+/* A barcode or mutant ends here, with value -1 if none does. out is the
+ * next state down the failure links where one does, or 0. */
+struct axe_window_state {
+    int32_t value;
+    uint8_t len;
+    uint8_t dist;   /* from its exact barcode */
+    uint32_t out;
+};
+
+/* An exact barcode, in trie codes */
+struct axe_window_barcode {
+    TrieIndex codes[AXE_SEARCH_MAX_LEN];
+    size_t len;
+    int32_t value;
+};
+
+/* Aho-Corasick automaton of every key of a trie, as a DFA of radix
+ * transitions per state. State 0 is the root. */
+struct axe_window {
+    uint32_t *next;
+    struct axe_window_state *states;
+    size_t n_states;
+    size_t radix;
+    size_t width;       /* Bases of each read searched */
+    size_t max_len;
+    size_t mismatches;
+    struct axe_window_barcode *barcodes;
+    size_t n_barcodes;
+    size_t bytes;
+};
+
 struct axe_trie {
     Trie *trie; /* From datrie.h */
-    int mismatch_level;
+    /* If set, keys are added here rather than to trie, which is rebuilt from
+     * them in one pass by axe_trie_build */
+    TrieBuilder *staged;
+    AlphaMap *alpha_map; /* That of trie */
+    FrozenTrie *frozen; /* Read-only image of trie, for lookups */
+    struct axe_kmer *kmer; /* Used instead of frozen, when memory allows */
+    struct axe_hash *hash; /* Used instead of frozen, for uniform lengths */
+    struct axe_top *top; /* First levels of frozen, for the trie engine */
+    struct axe_filter *filter; /* Rejects reads no barcode could match */
+    struct axe_cache *cache; /* Matches of recent read prefixes, if set */
+    /* If set, matches reads by itself, and trie holds only exact barcodes */
+    struct axe_hamming *hamming;
+    struct axe_seed *seed; /* Used instead of searching, for long barcodes */
+    struct axe_dawg *dawg; /* Used instead of frozen, in less memory */
+    /* If set, finds keys anywhere in the first bases of reads, in place of
+     * any engine */
+    struct axe_window *window;
+    /* Exact barcodes alone, searched for reads with Ns. Kept across changes
+     * to trie, as it doesn't hold the mutants. */
+    FrozenTrie *exact;
+    size_t exact_len;
+    enum axe_engine engine;
+    /* If set, frozen, exact and the engine's tables lie in an index mapped
+     * by axe_load_index, and the trie can't be changed */
+    int mapped;
+    /* If search is set, the trie holds only exact barcodes, and reads are
+     * matched by searching it with up to mismatch_level mismatches. Searches
+     * of exact allow as many. If edit is also set, indels count too. */
+    int search;
+    int edit;
+    size_t mismatch_level;
     size_t max_len;
     size_t min_len;
 };
@@ -86,10 +463,10 @@ struct axe_config {
     char *out_prefixes[2];
     struct axe_barcode **barcodes;
     struct axe_output **outputs;
-    /* Array of output files. Access by bcd_lookup[1st_bcd_idx][2nd_bcd_idx]
-       Values will be 0 <= x < n_barcode_pairs. barcodes or outputs can then
-       be indexed w/ this number */
-    ssize_t **barcode_lookup;
+    /* Barcode pair numbers. Access with axe_pair_map_get(barcode_lookup,
+       1st_bcd_idx, 2nd_bcd_idx). Values will be 0 <= x < n_barcode_pairs, or
+       -1. barcodes or outputs can then be indexed w/ this number */
+    struct axe_pair_map *barcode_lookup;
     size_t *mismatch_counts;
     size_t n_barcodes_1; /* Number of first read barcodes */
     size_t n_barcodes_2; /* Number of second read barcodes */
@@ -105,6 +482,14 @@ struct axe_config {
     uint64_t reads_processed;
     uint64_t reads_demultiplexed;
     uint64_t reads_failed;
+    size_t cache_bytes; /* Memory for each trie's match cache, or 0 */
+    size_t window;  /* Bases searched for barcodes, or 0 for the start only */
+    size_t tune_reads; /* Reads to time the engines on, or 0 for none */
+    unsigned int threads; /* Threads to load tries with, or 0 for all cores */
+    char *index_dir; /* Where finished tries are indexed, or NULL for nowhere */
+    void *index_map; /* The index the tries were loaded from, if any */
+    size_t index_size;
+    enum axe_engine engine; /* Used for every trie, if pin_engine is set */
     float time_taken;
     int verbosity;
     int have_cli_opts           :1; /* Set to 1 once CLI is parsed */
@@ -112,6 +497,9 @@ struct axe_config {
     int permissive              :1; /* Don't error on mutated bcd confict */
     int trim_rev                :1; /* Trim rev read same as fwd read */
     int debug                   :1; /* Enable debug mode */
+    int search                  :1; /* Search tries, not load mutants */
+    int edit                    :1; /* Search, allowing indels */
+    int pin_engine              :1; /* Use engine, rather than tuning */
 };
 
 extern unsigned int format_call_number;
@@ -236,6 +624,111 @@ extern int axe_trie_add(struct axe_trie *trie, const char *str,
                         intptr_t data);
 extern int axe_trie_delete(struct axe_trie *trie, const char *str);
 /*===  FUNCTION  ============================================================*
+Name:           axe_trie_stage
+Parameters:     struct axe_trie *: trie to load many keys into.
+Description:    Collect keys added to, looked up in, and deleted from the trie
+                in a hash table until axe_trie_build is called, rather than
+                changing the trie for each. Keys already in the trie are kept.
+Returns:        int: 0 on success, 1 on failure, -1 on bad parameters.
+ *===========================================================================*/
+extern int axe_trie_stage(struct axe_trie *trie);
+/*===  FUNCTION  ============================================================*
+Name:           axe_trie_build
+Parameters:     struct axe_trie *: trie whose keys are staged.
+Description:    Replace the trie with one laid out in a single pass from the
+                keys staged since axe_trie_stage, and stop staging. Does
+                nothing if no keys are staged. axe_trie_freeze calls this.
+Returns:        int: 0 on success, 1 on failure, -1 on bad parameters.
+ *===========================================================================*/
+extern int axe_trie_build(struct axe_trie *trie);
+/*===  FUNCTION  ============================================================*
+Name:           axe_trie_replace
+Parameters:     struct axe_trie *: trie to change.
+                Trie *built: trie of the new keys, under the trie's alpha map.
+Description:    Replace the trie's keys with those of ``built``, which the
+                trie then owns. Any staged keys are dropped.
+ *===========================================================================*/
+extern void axe_trie_replace(struct axe_trie *trie, Trie *built);
+/*===  FUNCTION  ============================================================*
+Name:           axe_trie_freeze
+Parameters:     struct axe_trie *: trie to freeze.
+Description:    Build a compact, read-only image of the trie, and any faster
+                engine the trie suits, which axe_match_read will use from then
+                on. Any later change to the trie discards them.
+Returns:        int: 0 on success, 1 on failure, -1 on bad parameters.
+ *===========================================================================*/
+extern int axe_trie_freeze(struct axe_trie *trie);
+/*===  FUNCTION  ============================================================*
+Name:           axe_trie_engines
+Parameters:     const struct axe_trie *: a frozen trie.
+Description:    The engines that give the matches of the trie's own engine,
+                which depends on what the trie holds: mutants, or exact
+                barcodes to search. Engines may still be unable to take the
+                keys, which axe_trie_set_engine finds out.
+Returns:        unsigned int: The engines, as bits 1 << engine, or 0 if the
+                trie isn't frozen or is searched by a window automaton.
+ *===========================================================================*/
+extern unsigned int axe_trie_engines(const struct axe_trie *trie);
+/*===  FUNCTION  ============================================================*
+Name:           axe_trie_reference_engine
+Parameters:     const struct axe_trie *: a frozen trie.
+Description:    The simplest of the trie's engines, whose matches are taken as
+                right should the others disagree: the trie itself for mutants,
+                or a search for exact barcodes.
+Returns:        enum axe_engine: The engine, or AXE_ENGINE_COUNT if ``trie``
+                is NULL.
+ *===========================================================================*/
+extern enum axe_engine axe_trie_reference_engine(const struct axe_trie *trie);
+/*===  FUNCTION  ============================================================*
+Name:           axe_trie_set_engine
+Parameters:     struct axe_trie *: a frozen trie.
+                enum axe_engine engine: the engine to match reads with.
+Description:    Build what ``engine`` needs, if it isn't already, and free
+                the tables of any other engine.
+Returns:        int: 0 on success, 1 if the engine can't give this trie's
+                matches or take its keys, -1 on bad parameters.
+ *===========================================================================*/
+extern int axe_trie_set_engine(struct axe_trie *trie, enum axe_engine engine);
+/*===  FUNCTION  ============================================================*
+Name:           axe_trie_tune
+Parameters:     struct axe_trie *: a frozen trie.
+                struct qes_seq *const *seqs: reads to time the engines on.
+                size_t n: number of reads in ``seqs``.
+                struct axe_tune *tune: times so far, zeroed before the
+                    first call.
+Description:    Match the reads with each engine the trie could use, adding
+                the time each takes to ``tune``, and counting reads that any
+                engine matches differently to the others. The tables of each
+                engine are built on the first call; the trie's engine is
+                left as it was, so axe_trie_set_engine should be called with
+                the chosen one after.
+Returns:        int: 0 if the engines agreed, 1 if not, -1 on bad
+                parameters.
+ *===========================================================================*/
+extern int axe_trie_tune(struct axe_trie *trie, struct qes_seq *const *seqs,
+                         size_t n, struct axe_tune *tune);
+/* The name of an engine, as axe_engine_parse takes it */
+extern const char *axe_engine_name(enum axe_engine engine);
+/* Returns 0 and sets engine if name is an engine's name, or 1 if not */
+extern int axe_engine_parse(const char *name, enum axe_engine *engine);
+/*===  FUNCTION  ============================================================*
+Name:           axe_trie_set_exact
+Parameters:     struct axe_trie *: trie of barcodes and their mutants.
+                char *const *seqs: the exact barcodes.
+                const intptr_t *values: value of each barcode, as in the trie.
+                size_t n: number of barcodes.
+                size_t mismatches: mismatches the mutants allow.
+Description:    Keep a frozen trie of just the exact barcodes. Mutants carry
+                only ACGT, so reads with an N (or another base) within the
+                longest barcode are instead matched by searching it, each
+                such base costing one mismatch. Barcodes too long to search
+                are left without one.
+Returns:        int: 0 on success, 1 on failure, -1 on bad parameters.
+ *===========================================================================*/
+extern int axe_trie_set_exact(struct axe_trie *trie, char *const *seqs,
+                              const intptr_t *values, size_t n,
+                              size_t mismatches);
+/*===  FUNCTION  ============================================================*
 Name:           axe_trie_destroy
 Parameters:     struct axe_trie *: trie struct on heap to destroy.
 Description:    Destroy a ``struct axe_trie`` on the heap, and set its
@@ -263,6 +756,7 @@ int axe_read_barcodes(struct axe_config *config);
 int axe_setup_barcode_lookup(struct axe_config *config);
 int axe_make_tries(struct axe_config *config);
 int axe_load_tries(struct axe_config *config);
+int axe_tune_engines(struct axe_config *config);
 int axe_make_outputs(struct axe_config *config);
 int axe_process_file(struct axe_config *config);
 int axe_write_table(const struct axe_config *config);
@@ -271,7 +765,731 @@ int axe_print_summary(const struct axe_config *config);
 /* Libraries or inner functions */
 extern int axe_match_read(struct axe_config *config, intptr_t *value,
                           struct axe_trie *trie, const struct qes_seq *seq);
+
+/* Reads matched together by axe_match_batch. Enough to hide memory latency,
+ * few enough that the walk states stay in registers and L1. */
+#define AXE_BATCH_SIZE 16
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_match_batch
+Parameters:     struct axe_trie *trie: trie to match against.
+                struct qes_seq *const *seqs: reads to match.
+                size_t n: number of reads in ``seqs``.
+                ssize_t *results: set to the value axe_match_read would give
+                    for each read, -1 for no match.
+Description:    Match many reads at once. The lookups of up to AXE_BATCH_SIZE
+                reads are interleaved, with the memory each read needs next
+                prefetched, so that cache misses overlap rather than stall.
+Returns:        int: 0 on success, -1 on bad parameters.
+ *===========================================================================*/
+extern int axe_match_batch(struct axe_trie *trie, struct qes_seq *const *seqs,
+                           size_t n, ssize_t *results);
+/* As axe_match_batch, also setting ends to the read bases each matched
+ * barcode aligned to, which differs from its length after an indel. An end
+ * of 0 means the barcode's own length. */
+extern int axe_match_batch_ends(struct axe_trie *trie,
+                                struct qes_seq *const *seqs, size_t n,
+                                ssize_t *results, size_t *ends);
+/*===  FUNCTION  ============================================================*
+Name:           axe_match_batch_pairs
+Parameters:     struct axe_trie *fwd: trie to match the first reads against.
+                struct axe_trie *rev: trie to match the second reads against.
+                struct qes_seq *const *seqs1: first read of each pair.
+                struct qes_seq *const *seqs2: second read of each pair.
+                size_t n: number of pairs.
+                ssize_t *results1, *results2: set as axe_match_batch sets
+                    results, for each read.
+                size_t *ends1, *ends2: as axe_match_batch_ends, or NULL.
+Description:    Match pairs for combinatorial barcodes. A pair whose first
+                read matches no barcode can't be demultiplexed, so its second
+                read is not looked up, and its result is -1. The second reads
+                that are looked up are batched together.
+Returns:        int: 0 on success, -1 on bad parameters.
+ *===========================================================================*/
+extern int axe_match_batch_pairs(struct axe_trie *fwd, struct axe_trie *rev,
+                                 struct qes_seq *const *seqs1,
+                                 struct qes_seq *const *seqs2, size_t n,
+                                 ssize_t *results1, ssize_t *results2,
+                                 size_t *ends1, size_t *ends2);
 int product(int64_t len, int64_t elem, uintptr_t *choices, int at_start);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_kmer_create
+Parameters:     const Trie *trie: trie whose keys to index.
+                size_t max_bytes: memory budget for the tables.
+Description:    Build k-mer tables holding every key in ``trie``. Keys
+                containing bases other than ACGT are left to the trie.
+Returns:        struct axe_kmer *: The tables, or NULL if the keys are too
+                long, would exceed ``max_bytes``, or on any error.
+ *===========================================================================*/
+struct axe_kmer *axe_kmer_create(const Trie *trie, size_t max_bytes);
+void axe_kmer_destroy_(struct axe_kmer *kmer);
+#define axe_kmer_destroy(kmer) STMT_BEGIN                                   \
+    axe_kmer_destroy_(kmer);                                                \
+    kmer = NULL;                                                            \
+    STMT_END
+
+/* 2-bit code plus one for each base, zero for anything else */
+extern const uint8_t axe_kmer_codes[256];
+
+/* The kernels of the best level the CPU has, chosen on first use, or as
+ * set by axe_simd_set */
+extern struct axe_simd_kernels axe_simd;
+
+/* The best level this CPU runs */
+enum axe_simd axe_simd_detect(void);
+/* Use the kernels of level. Returns 0, 1 if the CPU lacks it, or -1 if it
+ * is unknown. */
+int axe_simd_set(enum axe_simd level);
+enum axe_simd axe_simd_level(void);
+const char *axe_simd_name(enum axe_simd level);
+
+/* Runs of bases up to this long are quicker done inline than by calling a
+ * kernel */
+#define AXE_SIMD_MIN_BASES 16
+
+/* Pack the first n bases of seq, at most 32, into 2 bits each, first base
+ * most significant. Returns 0, or -1 if there is a base other than ACGT. */
+static inline int
+axe_pack_2bit(const char *seq, size_t n, uint64_t *packed)
+{
+    uint64_t val = 0;
+    size_t iii = 0;
+
+    if (n > AXE_SIMD_MIN_BASES) {
+        return axe_simd.pack_2bit(seq, n, packed);
+    }
+    for (iii = 0; iii < n; iii++) {
+        uint8_t code = axe_kmer_codes[(unsigned char)seq[iii]];
+
+        if (code == 0) {
+            return -1;
+        }
+        val = (val << 2) | (code - 1);
+    }
+    *packed = val;
+    return 0;
+}
+
+/* Bases of seq before the first that isn't ACGT, at most n */
+static inline size_t
+axe_acgt_span(const char *seq, size_t n)
+{
+    size_t iii = 0;
+
+    if (n > AXE_SIMD_MIN_BASES) {
+        return axe_simd.acgt_span(seq, n);
+    }
+    for (iii = 0; iii < n; iii++) {
+        if (axe_kmer_codes[(unsigned char)seq[iii]] == 0) {
+            break;
+        }
+    }
+    return iii;
+}
+
+/* Number of bases of a read of length len that axe_kmer_probe expects */
+static inline size_t
+axe_kmer_pack_len(const struct axe_kmer *kmer, size_t len)
+{
+    return len < kmer->max_len ? len : kmer->max_len;
+}
+
+/* Look up the packed first n bases of a read, longest key first */
+static inline int
+axe_kmer_probe(const struct axe_kmer *kmer, uint64_t packed, size_t n,
+               intptr_t *value)
+{
+    size_t iii = 0;
+
+    for (iii = 0; iii < kmer->n_lens; iii++) {
+        size_t klen = kmer->lens[iii];
+        int32_t hit;
+
+        if (klen > n) {
+            continue;
+        }
+        hit = kmer->tables[klen][packed >> (2 * (n - klen))];
+        if (hit >= 0) {
+            *value = hit;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_kmer_match
+Parameters:     const struct axe_kmer *kmer: k-mer tables.
+                const char *seq: read sequence.
+                size_t len: length of ``seq``.
+                intptr_t *value: set to the data of the longest key that
+                    prefixes ``seq``.
+Returns:        int: 0 if a key matched, 1 if none did, -1 if ``seq`` has a
+                non-ACGT base within the longest key length, and the trie must
+                be used instead.
+ *===========================================================================*/
+static inline int
+axe_kmer_match(const struct axe_kmer *kmer, const char *seq, size_t len,
+               intptr_t *value)
+{
+    uint64_t packed = 0;
+    size_t n = axe_kmer_pack_len(kmer, len);
+
+    if (axe_pack_2bit(seq, n, &packed) != 0) {
+        return -1;
+    }
+    return axe_kmer_probe(kmer, packed, n, value);
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_hash_create
+Parameters:     const Trie *trie: trie whose keys to index.
+Description:    Build a hash table holding every key in ``trie``. Keys
+                containing bases other than ACGT are left to the trie.
+Returns:        struct axe_hash *: The table, or NULL if the keys are not all
+                of one length, are too long, or on any error.
+ *===========================================================================*/
+struct axe_hash *axe_hash_create(const Trie *trie);
+void axe_hash_destroy_(struct axe_hash *hash);
+#define axe_hash_destroy(hash) STMT_BEGIN                                   \
+    axe_hash_destroy_(hash);                                                \
+    hash = NULL;                                                            \
+    STMT_END
+
+static inline size_t
+axe_hash_slot(const struct axe_hash *hash, uint64_t key)
+{
+    /* Fibonacci hashing: the top bits of the product are well mixed */
+    return (size_t)((key * UINT64_C(0x9E3779B97F4A7C15)) >> hash->shift);
+}
+
+/* Look up a packed key of length hash->len */
+static inline int
+axe_hash_probe(const struct axe_hash *hash, uint64_t packed, intptr_t *value)
+{
+    size_t slot = 0;
+
+    for (slot = axe_hash_slot(hash, packed); hash->table[slot].value >= 0;
+            slot = (slot + 1) & hash->mask) {
+        if (hash->table[slot].key == packed) {
+            *value = hash->table[slot].value;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_hash_match
+Parameters:     const struct axe_hash *hash: hash table.
+                const char *seq: read sequence.
+                size_t len: length of ``seq``.
+                intptr_t *value: set to the data of the key that prefixes
+                    ``seq``.
+Returns:        int: 0 if a key matched, 1 if none did, -1 if ``seq`` has a
+                non-ACGT base within the key length, and the trie must be used
+                instead.
+ *===========================================================================*/
+static inline int
+axe_hash_match(const struct axe_hash *hash, const char *seq, size_t len,
+               intptr_t *value)
+{
+    uint64_t packed = 0;
+
+    if (len < hash->len) {
+        return 1;
+    }
+    if (axe_pack_2bit(seq, hash->len, &packed) != 0) {
+        return -1;
+    }
+    return axe_hash_probe(hash, packed, value);
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_top_create
+Parameters:     const Trie *trie: trie that ``ft`` was frozen from.
+                const FrozenTrie *ft: frozen trie to put the table before.
+                size_t max_bytes: memory budget for the table.
+Description:    Tabulate the walk of ``ft`` for every possible first few
+                bases of a read. Those levels of a mutant trie are nearly
+                full, and are where walks take their cache misses. As many
+                levels are taken as ``max_bytes`` allows, up to the length of
+                the shortest key.
+Returns:        struct axe_top *: The table, or NULL if it would be too
+                shallow to help, or on any error.
+ *===========================================================================*/
+struct axe_top *axe_top_create(const Trie *trie, const FrozenTrie *ft,
+                               size_t max_bytes);
+void axe_top_destroy_(struct axe_top *top);
+#define axe_top_destroy(top) STMT_BEGIN                                     \
+    axe_top_destroy_(top);                                                  \
+    top = NULL;                                                             \
+    STMT_END
+
+/* The table entry for the first top->depth bases of seq, which must be that
+ * long, or NULL if one of them is outside the trie's alphabet */
+static inline const struct axe_top_entry *
+axe_top_entry(const struct axe_top *top, const FrozenTrie *ft,
+              const char *seq)
+{
+    size_t idx = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii < top->depth; iii++) {
+        TrieIndex tc = frozen_trie_char_to_trie(ft, seq[iii]);
+
+        if (tc == TRIE_INDEX_MAX) {
+            return NULL;
+        }
+        idx = idx * top->radix + (tc - 1);
+    }
+    return &top->table[idx];
+}
+
+/* As frozen_trie_longest_prefix, but jumping straight past the tabulated
+ * levels. top may be NULL. */
+static inline bool
+axe_top_longest_prefix(const struct axe_top *top, const FrozenTrie *ft,
+                       const char *seq, size_t len, TrieData *value)
+{
+    const struct axe_top_entry *entry = NULL;
+    FrozenTrieState state;
+    TrieData data;
+    bool found = false;
+    size_t iii = 0;
+
+    if (top == NULL || len < top->depth ||
+            (entry = axe_top_entry(top, ft, seq)) == NULL) {
+        return frozen_trie_longest_prefix(ft, seq, len, value, NULL);
+    }
+    if (entry->value >= 0) {
+        *value = entry->value;
+        found = true;
+    }
+    state = entry->state;
+    if (state == FROZEN_TRIE_STATE_FAIL) {
+        return found;
+    }
+    for (iii = top->depth; iii < len; iii++) {
+        state = frozen_trie_walk(ft, state, seq[iii]);
+        if (state == FROZEN_TRIE_STATE_FAIL) {
+            break;
+        }
+        if (frozen_trie_get_terminal_data(ft, state, &data)) {
+            *value = data;
+            found = true;
+        }
+    }
+    return found;
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_filter_create
+Parameters:     const Trie *trie: trie whose keys to filter for.
+                size_t mismatches: mismatches each key may have, when the
+                    trie holds only exact barcodes, otherwise 0.
+Description:    Mark every read prefix of k bases that a key, or a key with
+                up to ``mismatches`` mismatches, starts with. k is as long as
+                AXE_FILTER_MAX_K, but no longer than the shortest key.
+Returns:        struct axe_filter *: The filter, or NULL if keys are too
+                short, would pass most reads anyway, or on any error.
+ *===========================================================================*/
+struct axe_filter *axe_filter_create(const Trie *trie, size_t mismatches);
+void axe_filter_destroy_(struct axe_filter *filter);
+#define axe_filter_destroy(filter) STMT_BEGIN                               \
+    axe_filter_destroy_(filter);                                            \
+    filter = NULL;                                                          \
+    STMT_END
+
+/* Could any key match seq? Returns 1 if so, 0 if not, or -1 if seq is too
+ * short or its first k bases aren't all ACGT, so the filter can't tell. */
+static inline int
+axe_filter_check(const struct axe_filter *filter, const char *seq,
+                 size_t len)
+{
+    uint64_t packed = 0;
+
+    if (len < filter->k || axe_pack_2bit(seq, filter->k, &packed) != 0) {
+        return -1;
+    }
+    return (filter->bits[packed >> 6] >> (packed & 63)) & 1;
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_cache_create
+Parameters:     const Trie *trie: trie whose matches to cache.
+                size_t max_bytes: memory budget for the cache.
+Description:    Create an empty cache of matches, keyed by the first bases of
+                reads, as many as the longest key in ``trie``. Every engine
+                matches on no more than those, so the cache may be put in
+                front of any of them.
+Returns:        struct axe_cache *: The cache, or NULL if keys are too long,
+                ``max_bytes`` is too small, or on any error.
+ *===========================================================================*/
+struct axe_cache *axe_cache_create(const Trie *trie, size_t max_bytes);
+/*===  FUNCTION  ============================================================*
+Name:           axe_cache_key_len
+Parameters:     const Trie *trie: trie whose matches to cache.
+Description:    The bases of reads a cache of ``trie``'s matches keys on.
+Returns:        size_t: The length of the longest key, or 0 if some key is too
+                long or its data doesn't fit an entry.
+ *===========================================================================*/
+size_t axe_cache_key_len(const Trie *trie);
+/*===  FUNCTION  ============================================================*
+Name:           axe_cache_create_len
+Parameters:     size_t len: bases of reads to key on, as axe_cache_key_len
+                    gives them.
+                size_t max_bytes: memory budget for the cache.
+Description:    As axe_cache_create, for tries whose key length is known.
+Returns:        struct axe_cache *: The cache, or NULL if ``len`` is 0 or too
+                long, ``max_bytes`` is too small, or on any error.
+ *===========================================================================*/
+struct axe_cache *axe_cache_create_len(size_t len, size_t max_bytes);
+void axe_cache_destroy_(struct axe_cache *cache);
+#define axe_cache_destroy(cache) STMT_BEGIN                                 \
+    axe_cache_destroy_(cache);                                              \
+    cache = NULL;                                                           \
+    STMT_END
+
+/* The slot for the prefix of seq, with the prefix packed into key, or NULL
+ * if seq is too short or has bases other than ACGT there */
+static inline struct axe_cache_entry *
+axe_cache_slot(struct axe_cache *cache, const char *seq, size_t len,
+               uint64_t *key)
+{
+    if (len < cache->len || axe_pack_2bit(seq, cache->len, key) != 0) {
+        return NULL;
+    }
+    return &cache->table[(size_t)((*key * UINT64_C(0x9E3779B97F4A7C15))
+                                  >> cache->shift)];
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_pair_map_create
+Parameters:     size_t n_barcodes_1: number of R1 barcodes.
+                size_t n_barcodes_2: number of R2 barcodes, or 1 in single
+                                     barcode mode.
+                size_t n_pairs: number of barcode pairs to be added.
+Description:    Create an empty map of barcode pairs, as a table if most of the
+                ``n_barcodes_1`` by ``n_barcodes_2`` pairs could be present,
+                or as a hash of up to ``n_pairs`` pairs if the table would be
+                several times larger.
+Returns:        struct axe_pair_map *: The map, or NULL if there are too many
+                pairs, or on any error.
+ *===========================================================================*/
+struct axe_pair_map *axe_pair_map_create(size_t n_barcodes_1,
+                                         size_t n_barcodes_2, size_t n_pairs);
+void axe_pair_map_destroy_(struct axe_pair_map *map);
+#define axe_pair_map_destroy(map) STMT_BEGIN                                \
+    axe_pair_map_destroy_(map);                                             \
+    map = NULL;                                                             \
+    STMT_END
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_pair_map_add
+Parameters:     struct axe_pair_map *map: map to add to.
+                size_t bcd1, bcd2: numbers of the pair's R1 and R2 barcodes.
+                size_t pair: the pair's number.
+Description:    Map the pair of barcodes to ``pair``, replacing any number
+                they were given before.
+Returns:        int: 0 on success, or -1 if a barcode number or ``pair`` is
+                out of range, or the map is full.
+ *===========================================================================*/
+int axe_pair_map_add(struct axe_pair_map *map, size_t bcd1, size_t bcd2,
+                     size_t pair);
+
+static inline uint64_t
+axe_pair_map_key(const struct axe_pair_map *map, size_t bcd1, size_t bcd2)
+{
+    return (uint64_t)bcd1 * map->n_barcodes_2 + bcd2;
+}
+
+/* The number of the pair of barcodes bcd1 and bcd2, or -1 if none */
+static inline ssize_t
+axe_pair_map_get(const struct axe_pair_map *map, size_t bcd1, size_t bcd2)
+{
+    uint64_t key = axe_pair_map_key(map, bcd1, bcd2);
+    size_t slot = 0;
+
+    switch (map->width) {
+    case 1:
+        return (ssize_t)((const uint8_t *)map->table)[key] - 1;
+    case 2:
+        return (ssize_t)((const uint16_t *)map->table)[key] - 1;
+    case 4:
+        return (ssize_t)((const uint32_t *)map->table)[key] - 1;
+    }
+    for (slot = (key * UINT64_C(0x9E3779B97F4A7C15)) >> map->shift;
+            map->slots[slot].value != 0; slot = (slot + 1) & map->mask) {
+        if (map->slots[slot].key == key) {
+            return (ssize_t)map->slots[slot].value - 1;
+        }
+    }
+    return -1;
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_hamming_create
+Parameters:     char *const *seqs: barcodes.
+                const intptr_t *values: value to give for each barcode.
+                size_t n: number of barcodes.
+                size_t mismatches: mismatches to allow.
+Description:    Set up brute-force Hamming matching against ``seqs``, which
+                needs no mutant expansion. Matches are exactly those that
+                loading every mutant into a trie would give, with reads with
+                Ns searched as axe_trie_set_exact has them.
+Returns:        struct axe_hamming *: The engine, or NULL if there are too
+                many barcodes, they are too long or of mixed length, or the
+                mutants of any two barcodes could collide.
+ *===========================================================================*/
+struct axe_hamming *axe_hamming_create(char *const *seqs,
+                                       const intptr_t *values, size_t n,
+                                       size_t mismatches);
+void axe_hamming_destroy_(struct axe_hamming *ham);
+#define axe_hamming_destroy(ham) STMT_BEGIN                                 \
+    axe_hamming_destroy_(ham);                                              \
+    ham = NULL;                                                             \
+    STMT_END
+/* Returns 0 and sets value on a match, or 1 for no match. Of barcodes within
+ * the mismatch level, the closest wins; a tie means no match. */
+int axe_hamming_match(const struct axe_hamming *ham, const char *seq,
+                      size_t len, intptr_t *value);
+
+/* Could one sequence be within mismatches of both a and b, each of length
+ * len, as mutant expansion counts mismatches? */
+int axe_hamming_could_conflict(const char *a, const char *b, size_t len,
+                               size_t mismatches);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_search_match
+Parameters:     const FrozenTrie *ft: frozen trie of exact barcodes.
+                const char *seq: read sequence.
+                size_t len: length of ``seq``.
+                size_t mismatches: mismatches to allow.
+                intptr_t *value: set to the data of the matching barcode.
+Description:    Find barcodes within ``mismatches`` of a prefix of ``seq`` by
+                a depth-first walk of the trie, abandoning each branch once
+                its mismatches are spent. Any read base that differs from
+                the barcode's costs one mismatch, so Ns in either are
+                wildcards with a cost. As with mutant expansion, the longest
+                barcode wins. Of barcodes of that length, the closest wins;
+                if several are equally close, shorter barcodes are tried.
+Returns:        int: 0 if a barcode matched, 1 if none did.
+ *===========================================================================*/
+int axe_search_match(const FrozenTrie *ft, const char *seq, size_t len,
+                     size_t mismatches, intptr_t *value);
+
+/* Most mismatches the edit distance search takes */
+#define AXE_EDIT_MAX_MISMATCHES 4
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_edit_match
+Parameters:     const FrozenTrie *ft: frozen trie of exact barcodes.
+                const char *seq: read sequence.
+                size_t len: length of ``seq``.
+                size_t mismatches: edits to allow, at most
+                    AXE_EDIT_MAX_MISMATCHES.
+                intptr_t *value: set to the data of the matching barcode.
+                size_t *end: if not NULL, set to the length of the read prefix
+                    the barcode aligned to.
+Description:    As axe_search_match, but substitutions, insertions and
+                deletions each cost one. The trie is walked with a band of
+                the edit distance table, so nothing is precomputed. With
+                indels a barcode may align to a prefix of any length, so the
+                closest barcodes win, and of those the longest if it is
+                alone. Where a barcode aligns equally well to several
+                prefixes, the one without indels is taken, else the
+                shortest.
+Returns:        int: 0 if a barcode matched, 1 if none did, -1 if
+                ``mismatches`` is too many.
+ *===========================================================================*/
+int axe_edit_match(const FrozenTrie *ft, const char *seq, size_t len,
+                   size_t mismatches, intptr_t *value, size_t *end);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_seed_create
+Parameters:     const Trie *trie: trie of exact barcodes.
+                size_t mismatches: mismatches to allow.
+Description:    Index mismatches + 1 segments of every barcode in ``trie``.
+                Memory is linear in the number of barcodes, whatever the
+                mismatch level.
+Returns:        struct axe_seed *: The index, or NULL if the barcodes are not
+                all of one length, are too short or too long, contain bases
+                other than ACGT, or on any error.
+ *===========================================================================*/
+struct axe_seed *axe_seed_create(const Trie *trie, size_t mismatches);
+void axe_seed_destroy_(struct axe_seed *seed);
+#define axe_seed_destroy(seed) STMT_BEGIN                                   \
+    axe_seed_destroy_(seed);                                                \
+    seed = NULL;                                                            \
+    STMT_END
+/* Returns 0 and sets value on a match, or 1 for no match, as
+ * axe_search_match does. Returns -1 if the read has bases other than ACGT
+ * within the barcode length, which must be searched for instead. */
+int axe_seed_match(const struct axe_seed *seed, const char *seq, size_t len,
+                   intptr_t *value);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_dawg_create
+Parameters:     const Trie *trie: trie of barcodes and their mutants.
+                const FrozenTrie *ft: ``trie``, frozen.
+Description:    Build the minimal acyclic automaton of the keys of ``trie``,
+                merging states that end the same keys with the same values.
+                The mutants of a barcode then share the states after their
+                last mismatch.
+Returns:        struct axe_dawg *: The automaton, or NULL if a key is over
+                AXE_DAWG_MAX_LEN, the trie is empty, or on any error.
+ *===========================================================================*/
+struct axe_dawg *axe_dawg_create(const Trie *trie, const FrozenTrie *ft);
+void axe_dawg_destroy_(struct axe_dawg *dawg);
+#define axe_dawg_destroy(dawg) STMT_BEGIN                                   \
+    axe_dawg_destroy_(dawg);                                                \
+    dawg = NULL;                                                            \
+    STMT_END
+/* Returns 0 and sets value to that of the longest key prefixing seq, or 1 if
+ * none does, as frozen_trie_longest_prefix does */
+int axe_dawg_match(const struct axe_dawg *dawg, const char *seq, size_t len,
+                   intptr_t *value);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_window_create
+Parameters:     const Trie *trie: trie of barcodes and their mutants.
+                const FrozenTrie *ft: ``trie``, frozen.
+                char *const *seqs: the exact barcodes.
+                const intptr_t *values: the value of each barcode in ``trie``.
+                size_t n: number of barcodes.
+                size_t mismatches: the mismatch level of the mutants.
+                size_t width: bases of each read to search.
+Description:    Build an Aho-Corasick automaton of every key in ``trie``,
+                recording how far each is from its exact barcode.
+Returns:        struct axe_window *: The automaton, or NULL if ``width`` is
+                over AXE_WINDOW_MAX_WIDTH, a key has no barcode in ``seqs``,
+                or on any error.
+ *===========================================================================*/
+struct axe_window *axe_window_create(const Trie *trie, const FrozenTrie *ft,
+                                     char *const *seqs, const intptr_t *values,
+                                     size_t n, size_t mismatches,
+                                     size_t width);
+void axe_window_destroy_(struct axe_window *window);
+#define axe_window_destroy(window) STMT_BEGIN                               \
+    axe_window_destroy_(window);                                            \
+    window = NULL;                                                          \
+    STMT_END
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_window_match
+Parameters:     const struct axe_window *window: the automaton.
+                const FrozenTrie *ft: the frozen trie it was built from.
+                const char *seq: read sequence.
+                size_t len: length of ``seq``.
+                intptr_t *value: set to the data of the matching barcode.
+                size_t *end: if not NULL, set to where the barcode ends in
+                    the read.
+Description:    Find barcodes lying anywhere in the first ``window->width``
+                bases of ``seq``, in one pass. The closest barcode wins, and
+                of those the leftmost, and then the longest. Reads with bases
+                the mutants lack, such as N, are compared to each barcode at
+                each offset instead.
+Returns:        int: 0 if a barcode matched, 1 if none did.
+ *===========================================================================*/
+int axe_window_match(const struct axe_window *window, const FrozenTrie *ft,
+                     const char *seq, size_t len, intptr_t *value,
+                     size_t *end);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_mutator_create
+Description:    Create a mutant enumerator. Its position and letter patterns
+                are kept for each barcode length and distance it is started
+                with, so it is best reused across barcodes.
+Returns:        struct axe_mutator *: The enumerator.
+ *===========================================================================*/
+struct axe_mutator *axe_mutator_create(void);
+void axe_mutator_destroy_(struct axe_mutator *mut);
+#define axe_mutator_destroy(mut) STMT_BEGIN                                 \
+    axe_mutator_destroy_(mut);                                              \
+    mut = NULL;                                                             \
+    STMT_END
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_mutator_start
+Parameters:     struct axe_mutator *mut: the enumerator.
+                const char *str: barcode to mutate, which must outlive the
+                    enumeration.
+                size_t len: length of ``str``.
+                unsigned int dist: number of positions to substitute.
+                int keep_original: if nonzero, list ``str`` itself first.
+Description:    Start listing the mutants of ``str`` with axe_mutator_next,
+                in the order hamming_mutate_dna returns them. Each differs
+                from ``str`` at exactly ``dist`` positions, and is listed
+                once.
+Returns:        int: 0 on success, -1 on bad parameters.
+ *===========================================================================*/
+int axe_mutator_start(struct axe_mutator *mut, const char *str, size_t len,
+                      unsigned int dist, int keep_original);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_mutator_next
+Parameters:     struct axe_mutator *mut: a started enumerator.
+Description:    The next mutant. It is overwritten by the next call, so must
+                be copied to be kept. No memory is allocated.
+Returns:        const char *: The mutant, or NULL when none are left.
+ *===========================================================================*/
+const char *axe_mutator_next(struct axe_mutator *mut);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_expand
+Parameters:     struct axe_expansion *exps: barcodes of each trie to load.
+                size_t n_exps: number of ``exps``.
+                size_t mismatches: substitutions to load mutants for.
+                int permissive: if nonzero, load the tries despite clashes.
+                unsigned int n_threads: threads to use, or 0 for one per
+                    online core.
+Description:    Replace each trie with its barcodes and their mutants up to
+                ``mismatches``, listing, sorting and building them across
+                threads. A barcode keeps its exact key, and a mutant is kept
+                only if one barcode alone has it. Each key another barcode
+                lost is recorded in its expansion's clashes, which must be
+                freed with axe_expansion_clear.
+Returns:        int: 0 on success, 1 if keys clashed and ``permissive`` is
+                unset, in which case no trie is changed, or -1 on error.
+ *===========================================================================*/
+int axe_expand(struct axe_expansion *exps, size_t n_exps, size_t mismatches,
+               int permissive, unsigned int n_threads);
+void axe_expansion_clear(struct axe_expansion *exp);
+
+/* Bumped whenever the layout of the barcode index, or of anything in it,
+ * changes */
+#define AXE_INDEX_VERSION 1
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_load_index
+Parameters:     struct axe_config *config: config with its tries made, but
+                    not loaded.
+Description:    Map the index of ``config``'s barcode file and options from
+                ``index_dir`` read-only, and match with the tries and tables
+                in it in place. Processes using the same index share one copy
+                of it. An index that is missing, or fails its checks, is
+                ignored, and the tries are left empty.
+Returns:        int: 0 if the tries were loaded from the index, 1 if there
+                was none to use, or -1 on bad parameters.
+ *===========================================================================*/
+int axe_load_index(struct axe_config *config);
+
+/*===  FUNCTION  ============================================================*
+Name:           axe_save_index
+Parameters:     struct axe_config *config: config with its tries loaded and
+                    tuned.
+Description:    Write the tries of ``config`` to an index in ``index_dir``,
+                for axe_load_index to map in later runs. It is written to a
+                temporary file, then renamed, so it is never seen half
+                written. Nothing is written if ``index_dir`` is unset, the
+                tries came from an index, or their engines can't be indexed.
+                Failure to write is only warned of.
+Returns:        int: 0 on success, or -1 on bad parameters.
+ *===========================================================================*/
+int axe_save_index(struct axe_config *config);
+
 char **hamming_mutate_dna(size_t *n_results_o, const char *str, size_t len,
                           unsigned int dist, int keep_original);
 
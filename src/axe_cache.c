@@ -0,0 +1,108 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_cache.c
+ *    Description:  Direct-mapped cache of matched read prefixes
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+/* Longest key, and whether all data fit an entry */
+struct cache_scan {
+    size_t max_len;
+    int ok;
+};
+
+static bool
+cache_scan_key(const AlphaChar *key, TrieData data, void *user_data)
+{
+    struct cache_scan *scan = user_data;
+    size_t len = strlen(key);
+
+    if (len > AXE_CACHE_MAX_LEN || data < 0 || data > INT32_MAX) {
+        scan->ok = 0;
+        return false;
+    }
+    if (len > scan->max_len) {
+        scan->max_len = len;
+    }
+    return true;
+}
+
+size_t
+axe_cache_key_len(const Trie *trie)
+{
+    struct cache_scan scan;
+
+    if (trie == NULL) return 0;
+    memset(&scan, 0, sizeof(scan));
+    scan.ok = 1;
+    trie_enumerate(trie, cache_scan_key, &scan);
+    return scan.ok ? scan.max_len : 0;
+}
+
+struct axe_cache *
+axe_cache_create(const Trie *trie, size_t max_bytes)
+{
+    return axe_cache_create_len(axe_cache_key_len(trie), max_bytes);
+}
+
+struct axe_cache *
+axe_cache_create_len(size_t len, size_t max_bytes)
+{
+    struct axe_cache *cache = NULL;
+    size_t n_slots = 1;
+    unsigned int bits = 0;
+
+    if (len == 0 || len > AXE_CACHE_MAX_LEN) {
+        return NULL;
+    }
+    /* The largest power of two that fits the budget */
+    while (2 * n_slots * sizeof(struct axe_cache_entry) <= max_bytes &&
+            bits < AXE_CACHE_MAX_BITS) {
+        n_slots <<= 1;
+        bits++;
+    }
+    if (bits < 4) {
+        return NULL;
+    }
+    cache = qes_calloc(1, sizeof(*cache));
+    /* Not qes_calloc, which exits on failure: without memory for it, reads
+     * are matched uncached */
+    cache->table = calloc(n_slots, sizeof(*cache->table));
+    if (cache->table == NULL) {
+        axe_cache_destroy(cache);
+        return NULL;
+    }
+    cache->mask = n_slots - 1;
+    cache->shift = 64 - bits;
+    cache->len = len;
+    cache->bytes = n_slots * sizeof(*cache->table);
+    return cache;
+}
+
+void
+axe_cache_destroy_(struct axe_cache *cache)
+{
+    if (cache != NULL) {
+        qes_free(cache->table);
+        qes_free(cache);
+    }
+}
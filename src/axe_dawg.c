@@ -0,0 +1,351 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_dawg.c
+ *    Description:  Minimal acyclic automaton of a trie's keys
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+/* The mutants of a barcode differ from it at a few bases. Past its last
+ * mismatch, a mutant's suffix is the barcode's, yet the trie stores it once
+ * per mutant. Here, states with the same value and the same transitions are
+ * merged as keys arrive in order (Daciuk et al. 2000), so each suffix is
+ * stored once per barcode and number of mismatches left. */
+
+#define DAWG_NONE UINT32_MAX
+
+/* A state while building, with a transition for each trie code */
+struct dawg_state {
+    uint32_t next[AXE_DAWG_MAX_RADIX];
+    int32_t value;
+};
+
+struct dawg_build {
+    struct dawg_state *states;
+    size_t n_states;
+    size_t cap;
+    /* States merged away, for reuse */
+    uint32_t *free;
+    size_t n_free;
+    /* Hash of the states already minimal, by their contents */
+    uint32_t *slots;
+    size_t mask;
+    size_t n_registered;
+    /* The states along the last key, and its codes */
+    uint32_t path[AXE_DAWG_MAX_LEN + 1];
+    TrieIndex key[AXE_DAWG_MAX_LEN];
+    size_t key_len;
+    const FrozenTrie *ft;
+    size_t radix;
+    int ok;
+};
+
+static uint32_t
+dawg_new_state(struct dawg_build *build)
+{
+    uint32_t idx = 0;
+
+    if (build->n_free > 0) {
+        idx = build->free[--build->n_free];
+    } else {
+        if (build->n_states == build->cap) {
+            build->cap *= 2;
+            build->states = qes_realloc(build->states,
+                                        build->cap * sizeof(*build->states));
+            build->free = qes_realloc(build->free,
+                                      build->cap * sizeof(*build->free));
+        }
+        idx = build->n_states++;
+    }
+    memset(build->states[idx].next, 0xff, sizeof(build->states[idx].next));
+    build->states[idx].value = -1;
+    return idx;
+}
+
+static inline uint64_t
+dawg_hash(const struct dawg_build *build, uint32_t idx)
+{
+    const struct dawg_state *state = &build->states[idx];
+    uint64_t hash = (uint32_t)state->value;
+    size_t iii = 0;
+
+    for (iii = 0; iii < build->radix; iii++) {
+        hash = (hash ^ state->next[iii]) * UINT64_C(0x9E3779B97F4A7C15);
+    }
+    return hash ^ (hash >> 29);
+}
+
+static inline int
+dawg_equal(const struct dawg_build *build, uint32_t a, uint32_t b)
+{
+    const struct dawg_state *sa = &build->states[a];
+    const struct dawg_state *sb = &build->states[b];
+
+    return sa->value == sb->value &&
+           memcmp(sa->next, sb->next, build->radix * sizeof(*sa->next)) == 0;
+}
+
+static void
+dawg_grow_register(struct dawg_build *build)
+{
+    uint32_t *old = build->slots;
+    size_t n_old = build->mask + 1;
+    size_t iii = 0;
+
+    build->mask = 2 * n_old - 1;
+    build->slots = qes_malloc((build->mask + 1) * sizeof(*build->slots));
+    memset(build->slots, 0xff, (build->mask + 1) * sizeof(*build->slots));
+    for (iii = 0; iii < n_old; iii++) {
+        size_t slot = 0;
+
+        if (old[iii] == DAWG_NONE) continue;
+        slot = dawg_hash(build, old[iii]) & build->mask;
+        while (build->slots[slot] != DAWG_NONE) {
+            slot = (slot + 1) & build->mask;
+        }
+        build->slots[slot] = old[iii];
+    }
+    qes_free(old);
+}
+
+/* The registered state equal to idx, which is registered if there is none */
+static uint32_t
+dawg_register(struct dawg_build *build, uint32_t idx)
+{
+    size_t slot = 0;
+
+    if (2 * (build->n_registered + 1) > build->mask + 1) {
+        dawg_grow_register(build);
+    }
+    for (slot = dawg_hash(build, idx) & build->mask;
+            build->slots[slot] != DAWG_NONE;
+            slot = (slot + 1) & build->mask) {
+        if (dawg_equal(build, build->slots[slot], idx)) {
+            build->free[build->n_free++] = idx;
+            return build->slots[slot];
+        }
+    }
+    build->slots[slot] = idx;
+    build->n_registered++;
+    return idx;
+}
+
+/* Below depth, the last key's states will never change again, so merge or
+ * register them, deepest first */
+static void
+dawg_minimise(struct dawg_build *build, size_t depth)
+{
+    size_t iii = 0;
+
+    for (iii = build->key_len; iii > depth; iii--) {
+        uint32_t parent = build->path[iii - 1];
+
+        build->states[parent].next[build->key[iii - 1] - 1] =
+                dawg_register(build, build->path[iii]);
+    }
+}
+
+static bool
+dawg_add_key(const AlphaChar *key, TrieData data, void *user_data)
+{
+    struct dawg_build *build = user_data;
+    TrieIndex codes[AXE_DAWG_MAX_LEN];
+    size_t len = strlen(key);
+    size_t common = 0;
+    size_t iii = 0;
+
+    if (len == 0 || len > AXE_DAWG_MAX_LEN || data < 0 ||
+            data > INT32_MAX) {
+        build->ok = 0;
+        return false;
+    }
+    for (iii = 0; iii < len; iii++) {
+        codes[iii] = frozen_trie_char_to_trie(build->ft, key[iii]);
+        if (codes[iii] == TRIE_INDEX_MAX) {
+            build->ok = 0;
+            return false;
+        }
+    }
+    while (common < len && common < build->key_len &&
+            codes[common] == build->key[common]) {
+        common++;
+    }
+    /* Keys must come in order, so that no state left behind is revisited */
+    if (common < build->key_len &&
+            (common == len || codes[common] < build->key[common])) {
+        build->ok = 0;
+        return false;
+    }
+    dawg_minimise(build, common);
+    for (iii = common; iii < len; iii++) {
+        uint32_t added = dawg_new_state(build);
+
+        build->states[build->path[iii]].next[codes[iii] - 1] = added;
+        build->path[iii + 1] = added;
+    }
+    build->states[build->path[len]].value = (int32_t)data;
+    memcpy(build->key, codes, len * sizeof(*codes));
+    build->key_len = len;
+    return true;
+}
+
+/* Lay out the states depth first from the root, so that a walk mostly moves
+ * forwards through memory. Returns the state's new number. */
+static uint32_t
+dawg_layout(struct axe_dawg *dawg, const struct dawg_build *build,
+            uint32_t *placed, uint32_t idx)
+{
+    const struct dawg_state *state = &build->states[idx];
+    uint32_t node = 0;
+    uint32_t first = 0;
+    uint32_t mask = 0;
+    size_t n_edges = 0;
+    size_t iii = 0;
+
+    if (placed[idx] != DAWG_NONE) {
+        return placed[idx];
+    }
+    node = dawg->n_nodes++;
+    placed[idx] = node;
+    for (iii = 0; iii < build->radix; iii++) {
+        if (state->next[iii] != DAWG_NONE) {
+            mask |= 1u << iii;
+            n_edges++;
+        }
+    }
+    first = dawg->n_edges;
+    dawg->n_edges += n_edges;
+    dawg->nodes[node].next = (mask << AXE_DAWG_EDGE_BITS) | first;
+    dawg->nodes[node].value = state->value;
+    for (n_edges = 0, iii = 0; iii < build->radix; iii++) {
+        if (state->next[iii] != DAWG_NONE) {
+            uint32_t child = dawg_layout(dawg, build, placed, state->next[iii]);
+
+            dawg->edges[first + n_edges++] = child;
+        }
+    }
+    return node;
+}
+
+struct axe_dawg *
+axe_dawg_create(const Trie *trie, const FrozenTrie *ft)
+{
+    struct axe_dawg *dawg = NULL;
+    struct dawg_build build;
+    uint32_t *placed = NULL;
+    size_t n_edges = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    if (trie == NULL || ft == NULL) return NULL;
+    memset(&build, 0, sizeof(build));
+    build.ft = ft;
+    build.ok = 1;
+    for (iii = 0; iii <= UCHAR_MAX; iii++) {
+        TrieIndex tc = ft->alpha_to_trie[iii];
+
+        if (tc != TRIE_INDEX_MAX && (size_t)tc > build.radix) {
+            build.radix = tc;
+        }
+    }
+    if (build.radix > AXE_DAWG_MAX_RADIX) {
+        return NULL;
+    }
+    build.cap = 1024;
+    build.states = qes_malloc(build.cap * sizeof(*build.states));
+    build.free = qes_malloc(build.cap * sizeof(*build.free));
+    build.mask = 1023;
+    build.slots = qes_malloc((build.mask + 1) * sizeof(*build.slots));
+    memset(build.slots, 0xff, (build.mask + 1) * sizeof(*build.slots));
+    build.path[0] = dawg_new_state(&build);
+    trie_enumerate(trie, dawg_add_key, &build);
+    if (!build.ok || build.key_len == 0) {
+        goto exit;
+    }
+    dawg_minimise(&build, 0);
+    /* Every state left is the root or reachable from it */
+    for (iii = 0; iii < build.n_states; iii++) {
+        for (jjj = 0; jjj < build.radix; jjj++) {
+            n_edges += build.states[iii].next[jjj] != DAWG_NONE;
+        }
+    }
+    if (n_edges >= (size_t)1 << AXE_DAWG_EDGE_BITS) {
+        goto exit;
+    }
+    dawg = qes_calloc(1, sizeof(*dawg));
+    dawg->nodes = qes_calloc(build.n_states, sizeof(*dawg->nodes));
+    dawg->edges = qes_calloc(n_edges > 0 ? n_edges : 1, sizeof(*dawg->edges));
+    placed = qes_malloc(build.n_states * sizeof(*placed));
+    memset(placed, 0xff, build.n_states * sizeof(*placed));
+    for (iii = 0; iii <= UCHAR_MAX; iii++) {
+        TrieIndex tc = ft->alpha_to_trie[iii];
+
+        dawg->codes[iii] = tc == TRIE_INDEX_MAX ? 0 : (uint8_t)tc;
+    }
+    dawg_layout(dawg, &build, placed, build.path[0]);
+    dawg->bytes = dawg->n_nodes * sizeof(*dawg->nodes) +
+                  dawg->n_edges * sizeof(*dawg->edges);
+
+exit:
+    qes_free(placed);
+    qes_free(build.states);
+    qes_free(build.free);
+    qes_free(build.slots);
+    return dawg;
+}
+
+void
+axe_dawg_destroy_(struct axe_dawg *dawg)
+{
+    if (dawg != NULL) {
+        qes_free(dawg->nodes);
+        qes_free(dawg->edges);
+        qes_free(dawg);
+    }
+}
+
+int
+axe_dawg_match(const struct axe_dawg *dawg, const char *seq, size_t len,
+               intptr_t *value)
+{
+    uint32_t node = 0;
+    int ret = 1;
+    size_t iii = 0;
+
+    for (iii = 0; iii < len; iii++) {
+        uint32_t next = dawg->nodes[node].next;
+        uint32_t mask = next >> AXE_DAWG_EDGE_BITS;
+        uint32_t bit = 0;
+        uint8_t tc = dawg->codes[(unsigned char)seq[iii]];
+
+        if (tc == 0 || !(mask & (bit = 1u << (tc - 1)))) {
+            break;
+        }
+        /* Edges are stored for the codes present, in order */
+        node = dawg->edges[(next & AXE_DAWG_EDGE_MASK) +
+                           __builtin_popcount(mask & (bit - 1))];
+        if (dawg->nodes[node].value >= 0) {
+            *value = dawg->nodes[node].value;
+            ret = 0;
+        }
+    }
+    return ret;
+}
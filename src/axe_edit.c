@@ -0,0 +1,336 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_edit.c
+ *    Description:  Bounded edit distance search of a trie of exact barcodes
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+/* Each trie node at depth i holds a band of the edit distance table: the
+ * distances between the node's i barcode bases and read prefixes of length
+ * i - m to i + m. Cells beyond the mismatch level are clamped to m + 1, and
+ * a branch is abandoned once its whole band is. */
+
+#define EDIT_WIDTH (2 * AXE_EDIT_MAX_MISMATCHES + 1)
+#define EDIT_READ_LEN (AXE_SEARCH_MAX_LEN + AXE_EDIT_MAX_MISMATCHES)
+
+/* Closest barcodes found of one length */
+struct edit_hits {
+    size_t len;
+    size_t n;
+    size_t dist;
+    intptr_t value;
+    size_t end;
+};
+
+struct edit {
+    const FrozenTrie *ft;
+    uint8_t mismatches;
+    size_t width;       /* of the band */
+    size_t read_len;    /* Read bases that may be aligned */
+    /* Trie codes of the read, from read[1]. read[0] matches nothing. */
+    TrieIndex read[EDIT_READ_LEN + 1];
+    /* Trie codes barcode bases may take. Degenerate bases are N. */
+    TrieIndex codes[5];
+    /* With a last cell that is always out of range */
+    uint8_t rows[AXE_SEARCH_MAX_LEN + 1][EDIT_WIDTH + 1];
+    struct edit_hits hits[AXE_SEARCH_MAX_LEN + 1];
+    size_t n_hits;      /* Lengths with barcodes found */
+};
+
+/* Read prefix length of band cell d at depth i, which may be out of range */
+static inline ssize_t
+edit_read_pos(const struct edit *ed, size_t depth, size_t d)
+{
+    return (ssize_t)depth + (ssize_t)d - (ssize_t)ed->mismatches;
+}
+
+/* The barcode ends here. Of the read prefixes it aligns to, take the
+ * closest, and of those the one without indels, else the shortest. */
+static void
+edit_hit(struct edit *ed, size_t depth, intptr_t value)
+{
+    const uint8_t *row = ed->rows[depth];
+    struct edit_hits *hits = NULL;
+    size_t best = ed->width;
+    size_t d = 0;
+
+    for (d = 0; d < ed->width; d++) {
+        if (row[d] > ed->mismatches) continue;
+        if (best == ed->width || row[d] < row[best] ||
+                (row[d] == row[best] && d == ed->mismatches)) {
+            best = d;
+        }
+    }
+    if (best == ed->width) {
+        return;
+    }
+    for (d = 0; d < ed->n_hits && ed->hits[d].len != depth; d++);
+    hits = &ed->hits[d];
+    if (d == ed->n_hits) {
+        ed->n_hits++;
+        hits->len = depth;
+        hits->n = 0;
+    }
+    if (hits->n == 0 || row[best] < hits->dist) {
+        hits->n = 1;
+        hits->dist = row[best];
+        hits->value = value;
+        hits->end = (size_t)edit_read_pos(ed, depth, best);
+    } else if (row[best] == hits->dist) {
+        hits->n++;
+    }
+}
+
+/* With its mismatches spent, a branch can only go on by matching the read
+ * base after one of its cheapest cells, so it follows those cells, alive,
+ * down the diagonals without filling in rows. */
+static void
+edit_walk_spent(struct edit *ed, FrozenTrieState state, size_t depth,
+                unsigned int alive)
+{
+    const size_t m = ed->mismatches;
+
+    for (;;) {
+        TrieIndex codes[EDIT_WIDTH];
+        unsigned int masks[EDIT_WIDTH];
+        size_t n_codes = 0;
+        TrieData data;
+        size_t iii = 0;
+        size_t d = 0;
+
+        if (frozen_trie_get_terminal_data(ed->ft, state, &data)) {
+            for (d = 0; d < ed->width; d++) {
+                ed->rows[depth][d] = alive & (1u << d) ? m : m + 1;
+            }
+            edit_hit(ed, depth, data);
+        }
+        if (depth == AXE_SEARCH_MAX_LEN) {
+            return;
+        }
+        for (d = 0; d < ed->width; d++) {
+            /* Read base after the cell, from read[1] */
+            size_t idx = depth + d + 1 - m;
+            TrieIndex code;
+
+            if (!(alive & (1u << d)) || idx > ed->read_len) continue;
+            code = ed->read[idx];
+            if (code == TRIE_INDEX_MAX) continue;
+            for (iii = 0; iii < n_codes && codes[iii] != code; iii++);
+            if (iii == n_codes) {
+                codes[n_codes] = code;
+                masks[n_codes++] = 0;
+            }
+            masks[iii] |= 1u << d;
+        }
+        if (n_codes == 0) {
+            return;
+        }
+        for (iii = 1; iii < n_codes; iii++) {
+            FrozenTrieState next = frozen_trie_walk_tc(ed->ft, state,
+                                                       (TrieChar)codes[iii]);
+
+            if (next != FROZEN_TRIE_STATE_FAIL) {
+                edit_walk_spent(ed, next, depth + 1, masks[iii]);
+            }
+        }
+        /* Usually the only way on */
+        state = frozen_trie_walk_tc(ed->ft, state, (TrieChar)codes[0]);
+        if (state == FROZEN_TRIE_STATE_FAIL) {
+            return;
+        }
+        depth++;
+        alive = masks[0];
+    }
+}
+
+static void
+edit_walk(struct edit *ed, FrozenTrieState state, size_t depth)
+{
+    const uint8_t *row = ed->rows[depth];
+    uint8_t *next_row = NULL;
+    const uint8_t inf = ed->mismatches + 1;
+    const ssize_t m = ed->mismatches;
+    /* The cells of the next row within the read */
+    const size_t lo = depth + 1 < ed->mismatches ? m - depth - 1 : 0;
+    const ssize_t hi_pos = (ssize_t)ed->read_len + m - (ssize_t)depth;
+    const size_t hi = hi_pos < (ssize_t)ed->width
+            ? (hi_pos > 0 ? (size_t)hi_pos : 0) : ed->width;
+    uint8_t row_min = inf;
+    unsigned int alive = 0;
+    TrieData data;
+    size_t iii = 0;
+    size_t d = 0;
+
+    for (d = 0; d < ed->width; d++) {
+        if (row[d] < row_min) row_min = row[d];
+        if (row[d] == ed->mismatches) alive |= 1u << d;
+    }
+    if (row_min == ed->mismatches) {
+        edit_walk_spent(ed, state, depth, alive);
+        return;
+    }
+    if (frozen_trie_get_terminal_data(ed->ft, state, &data)) {
+        edit_hit(ed, depth, data);
+    }
+    if (depth == AXE_SEARCH_MAX_LEN) {
+        return;
+    }
+    next_row = ed->rows[depth + 1];
+    memset(next_row, inf, ed->width + 1);
+    for (iii = 0; iii < 5; iii++) {
+        TrieIndex code = ed->codes[iii];
+        FrozenTrieState next;
+        uint8_t best = inf;
+
+        if (code == TRIE_INDEX_MAX) continue;
+        next = frozen_trie_walk_tc(ed->ft, state, (TrieChar)code);
+        if (next == FROZEN_TRIE_STATE_FAIL) continue;
+        for (d = lo; d < hi; d++) {
+            /* Match or substitute the read base before this cell */
+            unsigned int cell = row[d] + (code != ed->read[depth + d + 1 - m]);
+
+            /* Barcode base missing from the read */
+            if (row[d + 1] + 1u < cell) cell = row[d + 1] + 1u;
+            /* Read base inserted into the barcode */
+            if (d > 0 && next_row[d - 1] + 1u < cell) {
+                cell = next_row[d - 1] + 1u;
+            }
+            if (cell > inf) cell = inf;
+            next_row[d] = (uint8_t)cell;
+            if (cell < best) best = (uint8_t)cell;
+        }
+        /* Prune once every alignment has spent its mismatches */
+        if (best <= ed->mismatches) {
+            edit_walk(ed, next, depth + 1);
+        }
+    }
+}
+
+/* Of the lengths with the closest barcodes, the longest with only one, or
+ * NULL */
+static const struct edit_hits *
+edit_best(const struct edit *ed)
+{
+    const struct edit_hits *best = NULL;
+    size_t dist = ed->mismatches + 1;
+    size_t iii = 0;
+
+    for (iii = 0; iii < ed->n_hits; iii++) {
+        if (ed->hits[iii].dist < dist) dist = ed->hits[iii].dist;
+    }
+    for (iii = 0; iii < ed->n_hits; iii++) {
+        const struct edit_hits *hits = &ed->hits[iii];
+
+        if (hits->dist == dist && hits->n == 1 &&
+                (best == NULL || hits->len > best->len)) {
+            best = hits;
+        }
+    }
+    return best;
+}
+
+/* Without edits, the search is a walk down the read */
+static void
+edit_exact(struct edit *ed)
+{
+    FrozenTrieState state = FROZEN_TRIE_STATE_ROOT;
+    TrieData data;
+    size_t iii = 0;
+
+    ed->mismatches = 0;
+    ed->n_hits = 0;
+    for (iii = 0; iii <= ed->read_len && iii <= AXE_SEARCH_MAX_LEN; iii++) {
+        if (frozen_trie_get_terminal_data(ed->ft, state, &data)) {
+            struct edit_hits *hits = &ed->hits[ed->n_hits++];
+
+            hits->len = iii;
+            hits->n = 1;
+            hits->dist = 0;
+            hits->value = data;
+            hits->end = iii;
+        }
+        if (iii == ed->read_len || ed->read[iii + 1] == TRIE_INDEX_MAX) break;
+        state = frozen_trie_walk_tc(ed->ft, state,
+                                    (TrieChar)ed->read[iii + 1]);
+        if (state == FROZEN_TRIE_STATE_FAIL) break;
+    }
+}
+
+/* Search with up to mismatches edits */
+static void
+edit_search(struct edit *ed, size_t mismatches)
+{
+    size_t iii = 0;
+
+    ed->mismatches = (uint8_t)mismatches;
+    ed->width = 2 * mismatches + 1;
+    /* Before any barcode base, each read base is an insertion */
+    for (iii = 0; iii < ed->width; iii++) {
+        ssize_t pos = edit_read_pos(ed, 0, iii);
+
+        ed->rows[0][iii] = pos < 0 || pos > (ssize_t)ed->read_len
+                ? ed->mismatches + 1 : (uint8_t)pos;
+    }
+    ed->rows[0][ed->width] = ed->mismatches + 1;
+    ed->n_hits = 0;
+    edit_walk(ed, FROZEN_TRIE_STATE_ROOT, 0);
+}
+
+int
+axe_edit_match(const FrozenTrie *ft, const char *seq, size_t len,
+               size_t mismatches, intptr_t *value, size_t *end)
+{
+    struct edit ed;
+    const struct edit_hits *best = NULL;
+    size_t iii = 0;
+    size_t level = 0;
+
+    if (mismatches > AXE_EDIT_MAX_MISMATCHES) {
+        return -1;
+    }
+    ed.ft = ft;
+    ed.read_len = len < EDIT_READ_LEN ? len : EDIT_READ_LEN;
+    ed.codes[0] = frozen_trie_char_to_trie(ft, 'A');
+    ed.codes[1] = frozen_trie_char_to_trie(ft, 'C');
+    ed.codes[2] = frozen_trie_char_to_trie(ft, 'G');
+    ed.codes[3] = frozen_trie_char_to_trie(ft, 'T');
+    ed.codes[4] = frozen_trie_char_to_trie(ft, 'N');
+    ed.read[0] = TRIE_CHAR_TERM;
+    for (iii = 0; iii < ed.read_len; iii++) {
+        ed.read[iii + 1] = frozen_trie_char_to_trie(ft, seq[iii]);
+    }
+    /* The search grows quickly with the edits allowed, and most reads are
+     * few from a barcode, so allow one more at a time until one is found */
+    edit_exact(&ed);
+    for (level = 1; level <= mismatches && ed.n_hits == 0; level++) {
+        edit_search(&ed, level);
+    }
+    best = edit_best(&ed);
+    if (best == NULL) {
+        return 1;
+    }
+    *value = best->value;
+    if (end != NULL) {
+        *end = best->end;
+    }
+    return 0;
+}
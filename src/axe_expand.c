@@ -0,0 +1,547 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_expand.c
+ *    Description:  Build mutant tries of many barcodes across threads
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+/* Each worker takes a few barcodes at a time, lists every key of each into
+ * its own arena, and sorts its keys. The sorted lists of each trie are then
+ * merged, so that the barcodes sharing a key meet, and the winners built
+ * into the trie in one pass. Each trie is merged and built by a thread of
+ * its own. Nothing is shared between workers but the next barcode to take,
+ * so startup scales with the cores given. */
+
+/* Barcodes taken by a worker at a time */
+#define EXPAND_CHUNK 16
+/* Bytes of keys in each arena block, at least */
+#define EXPAND_ARENA_BYTES (1<<16)
+
+struct expand_key {
+    const char *key;
+    uint32_t bcd;
+    uint32_t order; /* In the order the mutator lists the barcode's keys */
+    unsigned int dist;
+};
+
+struct expand_list {
+    struct expand_key *keys;
+    size_t n;
+    size_t size;
+};
+
+struct expand_arena {
+    struct expand_arena *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+struct expand_job;
+
+struct expand_worker {
+    struct expand_job *job;
+    struct axe_mutator *mut;
+    struct expand_arena *arena;
+    struct expand_list *lists; /* One per expansion */
+    char *canon;
+    size_t canon_size;
+    int ret;
+};
+
+struct expand_job {
+    struct axe_expansion *exps;
+    size_t n_exps;
+    size_t n_barcodes; /* Across all expansions */
+    size_t mismatches;
+    struct expand_worker *workers;
+    size_t n_workers;
+    size_t next; /* Next barcode to take, atomically */
+};
+
+/* The merge of one expansion */
+struct expand_merge {
+    struct expand_job *job;
+    size_t exp;
+    Trie *built;
+    size_t n_clashes;
+    int ret;
+};
+
+static int
+expand_key_cmp(const void *a, const void *b)
+{
+    const struct expand_key *ka = a;
+    const struct expand_key *kb = b;
+    int cmp = strcmp(ka->key, kb->key);
+
+    if (cmp != 0) return cmp;
+    if (ka->bcd != kb->bcd) return ka->bcd < kb->bcd ? -1 : 1;
+    if (ka->order != kb->order) return ka->order < kb->order ? -1 : 1;
+    return 0;
+}
+
+static int
+clash_cmp(const void *a, const void *b)
+{
+    const struct axe_clash *ca = a;
+    const struct axe_clash *cb = b;
+
+    if (ca->barcode != cb->barcode) return ca->barcode < cb->barcode ? -1 : 1;
+    if (ca->order != cb->order) return ca->order < cb->order ? -1 : 1;
+    return 0;
+}
+
+static const char *
+arena_store(struct expand_arena **arena, const char *key, size_t len)
+{
+    struct expand_arena *block = *arena;
+    char *dest = NULL;
+
+    if (block == NULL || block->used + len + 1 > block->size) {
+        size_t size = EXPAND_ARENA_BYTES;
+
+        if (len + 1 > size) {
+            size = len + 1;
+        }
+        block = qes_malloc(sizeof(*block) + size);
+        block->next = *arena;
+        block->used = 0;
+        block->size = size;
+        *arena = block;
+    }
+    dest = block->data + block->used;
+    memcpy(dest, key, len);
+    dest[len] = '\0';
+    block->used += len + 1;
+    return dest;
+}
+
+static void
+arena_free(struct expand_arena *arena)
+{
+    struct expand_arena *next = NULL;
+
+    while (arena != NULL) {
+        next = arena->next;
+        qes_free(arena);
+        arena = next;
+    }
+}
+
+static void
+list_push(struct expand_list *list, const char *key, size_t bcd,
+          uint32_t order, unsigned int dist)
+{
+    if (list->n == list->size) {
+        list->size = list->size > 0 ? list->size * 2 : 1024;
+        list->keys = qes_realloc(list->keys,
+                                 list->size * sizeof(*list->keys));
+    }
+    list->keys[list->n].key = key;
+    list->keys[list->n].bcd = bcd;
+    list->keys[list->n].order = order;
+    list->keys[list->n].dist = dist;
+    list->n++;
+}
+
+/* List the barcode and its mutants, spelt as the trie spells them, so that
+ * aliases of one key sort together */
+static int
+expand_barcode(struct expand_worker *worker, size_t exp, size_t bcd)
+{
+    const struct axe_expansion *expansion = &worker->job->exps[exp];
+    struct expand_list *list = &worker->lists[exp];
+    const char *seq = expansion->seqs[bcd];
+    size_t len = strlen(seq);
+    const char *mutant = NULL;
+    uint32_t order = 0;
+    unsigned int dist = 0;
+    size_t iii = 0;
+
+    if (len + 1 > worker->canon_size) {
+        worker->canon_size = len + 1;
+        worker->canon = qes_realloc(worker->canon, worker->canon_size);
+    }
+    for (iii = 0; iii < len; iii++) {
+        worker->canon[iii] = alpha_map_canonical(expansion->trie->alpha_map,
+                                                 seq[iii]);
+        if (worker->canon[iii] == ALPHA_CHAR_ERROR) {
+            return -1;
+        }
+    }
+    worker->canon[len] = '\0';
+    list_push(list, arena_store(&worker->arena, worker->canon, len), bcd,
+              order++, 0);
+    for (dist = 1; dist <= worker->job->mismatches && dist <= len; dist++) {
+        if (axe_mutator_start(worker->mut, worker->canon, len, dist,
+                              0) != 0) {
+            return -1;
+        }
+        while ((mutant = axe_mutator_next(worker->mut)) != NULL) {
+            list_push(list, arena_store(&worker->arena, mutant, len), bcd,
+                      order++, dist);
+        }
+    }
+    return 0;
+}
+
+static void *
+expand_worker_run(void *arg)
+{
+    struct expand_worker *worker = arg;
+    struct expand_job *job = worker->job;
+    size_t start = 0;
+    size_t end = 0;
+    size_t exp = 0;
+    size_t offset = 0;
+    size_t iii = 0;
+
+    worker->mut = axe_mutator_create();
+    while (worker->ret == 0) {
+        start = __sync_fetch_and_add(&job->next, EXPAND_CHUNK);
+        if (start >= job->n_barcodes) break;
+        end = start + EXPAND_CHUNK;
+        if (end > job->n_barcodes) {
+            end = job->n_barcodes;
+        }
+        for (iii = start; iii < end && worker->ret == 0; iii++) {
+            /* Which expansion this barcode is of */
+            for (exp = 0, offset = 0;
+                    iii - offset >= job->exps[exp].n_seqs; exp++) {
+                offset += job->exps[exp].n_seqs;
+            }
+            worker->ret = expand_barcode(worker, exp, iii - offset);
+        }
+    }
+    for (exp = 0; exp < job->n_exps; exp++) {
+        if (worker->lists[exp].n == 0) continue;
+        qsort(worker->lists[exp].keys, worker->lists[exp].n,
+              sizeof(*worker->lists[exp].keys), expand_key_cmp);
+    }
+    axe_mutator_destroy(worker->mut);
+    return NULL;
+}
+
+/* Keep heap[at] below its parents, and above its children */
+static void
+heap_sift_down(const struct expand_key **heap, size_t *from, size_t n,
+               size_t at)
+{
+    size_t child = 0;
+    const struct expand_key *key = NULL;
+    size_t src = 0;
+
+    while ((child = 2 * at + 1) < n) {
+        if (child + 1 < n &&
+                expand_key_cmp(heap[child + 1], heap[child]) < 0) {
+            child++;
+        }
+        if (expand_key_cmp(heap[at], heap[child]) <= 0) break;
+        key = heap[at];
+        heap[at] = heap[child];
+        heap[child] = key;
+        src = from[at];
+        from[at] = from[child];
+        from[child] = src;
+        at = child;
+    }
+}
+
+static void
+add_clash(struct axe_expansion *expansion, size_t *size,
+          const struct expand_key *key)
+{
+    struct axe_clash *clash = NULL;
+
+    if (expansion->n_clashes == *size) {
+        *size = *size > 0 ? *size * 2 : 16;
+        expansion->clashes = qes_realloc(expansion->clashes,
+                                         *size * sizeof(*clash));
+    }
+    clash = &expansion->clashes[expansion->n_clashes++];
+    clash->barcode = key->bcd;
+    clash->dist = key->dist;
+    clash->order = key->order;
+    clash->key = strdup(key->key);
+}
+
+/* Settle the barcodes sharing a key. An exact barcode keeps its key, and a
+ * mutant of one barcode alone keeps it. Otherwise none may match it. Every
+ * other record clashes, as adding it after the first would have failed. */
+static void
+settle_group(struct axe_expansion *expansion, size_t *clash_size,
+             const struct expand_key **group, size_t n,
+             const char **keys, intptr_t *values, size_t *n_keys)
+{
+    const struct expand_key *winner = NULL;
+    size_t iii = 0;
+
+    for (iii = 0; iii < n; iii++) {
+        if (group[iii]->dist == 0) {
+            winner = group[iii];
+            break;
+        }
+    }
+    if (winner == NULL && group[0]->bcd == group[n - 1]->bcd) {
+        winner = group[0];
+    }
+    if (winner != NULL) {
+        keys[*n_keys] = winner->key;
+        values[*n_keys] = expansion->values[winner->bcd];
+        (*n_keys)++;
+    }
+    for (iii = 0; iii < n; iii++) {
+        if (group[iii] == winner) continue;
+        if (winner == NULL && iii == 0) continue;
+        if (winner != NULL && group[iii]->bcd == winner->bcd) continue;
+        add_clash(expansion, clash_size, group[iii]);
+    }
+}
+
+static void *
+expand_merge_run(void *arg)
+{
+    struct expand_merge *merge = arg;
+    struct expand_job *job = merge->job;
+    struct axe_expansion *expansion = &job->exps[merge->exp];
+    const size_t n_workers = job->n_workers;
+    const struct expand_key **heap = NULL;
+    size_t *from = NULL;
+    size_t *pos = NULL;
+    const struct expand_key **group = NULL;
+    size_t group_size = 0;
+    size_t n_group = 0;
+    const char **keys = NULL;
+    intptr_t *values = NULL;
+    size_t n_keys = 0;
+    size_t total = 0;
+    size_t clash_size = 0;
+    size_t n_heap = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii < n_workers; iii++) {
+        total += job->workers[iii].lists[merge->exp].n;
+    }
+    heap = qes_calloc(n_workers, sizeof(*heap));
+    from = qes_calloc(n_workers, sizeof(*from));
+    pos = qes_calloc(n_workers, sizeof(*pos));
+    keys = qes_calloc(total + 1, sizeof(*keys));
+    values = qes_calloc(total + 1, sizeof(*values));
+    for (iii = 0; iii < n_workers; iii++) {
+        const struct expand_list *list = &job->workers[iii].lists[merge->exp];
+
+        if (list->n > 0) {
+            heap[n_heap] = &list->keys[0];
+            from[n_heap] = iii;
+            pos[iii] = 1;
+            n_heap++;
+        }
+    }
+    for (iii = n_heap; iii-- > 0;) {
+        heap_sift_down(heap, from, n_heap, iii);
+    }
+    while (n_heap > 0) {
+        const struct expand_key *key = heap[0];
+        const struct expand_list *list =
+                &job->workers[from[0]].lists[merge->exp];
+
+        if (n_group > 0 && strcmp(group[0]->key, key->key) != 0) {
+            settle_group(expansion, &clash_size, group, n_group, keys, values,
+                         &n_keys);
+            n_group = 0;
+        }
+        if (n_group == group_size) {
+            group_size = group_size > 0 ? group_size * 2 : 8;
+            group = qes_realloc(group, group_size * sizeof(*group));
+        }
+        group[n_group++] = key;
+        /* Take the next key of the same list, if any */
+        if (pos[from[0]] < list->n) {
+            heap[0] = &list->keys[pos[from[0]]++];
+        } else {
+            n_heap--;
+            heap[0] = heap[n_heap];
+            from[0] = from[n_heap];
+        }
+        heap_sift_down(heap, from, n_heap, 0);
+    }
+    if (n_group > 0) {
+        settle_group(expansion, &clash_size, group, n_group, keys, values,
+                     &n_keys);
+    }
+    if (expansion->n_clashes > 0) {
+        qsort(expansion->clashes, expansion->n_clashes,
+              sizeof(*expansion->clashes), clash_cmp);
+    }
+    merge->n_clashes = expansion->n_clashes;
+    merge->built = trie_new_sorted(expansion->trie->alpha_map,
+                                   (const AlphaChar *const *)keys, values,
+                                   n_keys);
+    merge->ret = merge->built != NULL ? 0 : -1;
+    qes_free(heap);
+    qes_free(from);
+    qes_free(pos);
+    qes_free(group);
+    qes_free(keys);
+    qes_free(values);
+    return NULL;
+}
+
+/* Start run on each arg but the first in a thread of its own, and run it on
+ * the first here. Those no thread could be made for are run here too. */
+static void
+run_threads(void *(*run)(void *), void *args, size_t arg_size, size_t n,
+            int threaded)
+{
+    pthread_t *threads = NULL;
+    int *started = NULL;
+    size_t iii = 0;
+
+    threads = qes_calloc(n, sizeof(*threads));
+    started = qes_calloc(n, sizeof(*started));
+    for (iii = 1; threaded && iii < n; iii++) {
+        started[iii] = pthread_create(&threads[iii], NULL, run,
+                                      (char *)args + iii * arg_size) == 0;
+    }
+    for (iii = 0; iii < n; iii++) {
+        if (!started[iii]) {
+            run((char *)args + iii * arg_size);
+        }
+    }
+    for (iii = 1; iii < n; iii++) {
+        if (started[iii]) {
+            pthread_join(threads[iii], NULL);
+        }
+    }
+    qes_free(threads);
+    qes_free(started);
+}
+
+int
+axe_expand(struct axe_expansion *exps, size_t n_exps, size_t mismatches,
+           int permissive, unsigned int n_threads)
+{
+    struct expand_job job;
+    struct expand_merge *merges = NULL;
+    size_t n_clashes = 0;
+    size_t iii = 0;
+    int ret = 0;
+
+    if (exps == NULL || n_exps < 1) return -1;
+    memset(&job, 0, sizeof(job));
+    for (iii = 0; iii < n_exps; iii++) {
+        if (!axe_trie_ok(exps[iii].trie) || exps[iii].trie->mapped ||
+                exps[iii].seqs == NULL ||
+                exps[iii].values == NULL ||
+                exps[iii].n_seqs > UINT32_MAX) {
+            return -1;
+        }
+        axe_expansion_clear(&exps[iii]);
+        job.n_barcodes += exps[iii].n_seqs;
+    }
+    if (n_threads == 0) {
+        long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        n_threads = n_cpus > 0 ? (unsigned int)n_cpus : 1;
+    }
+    job.exps = exps;
+    job.n_exps = n_exps;
+    job.mismatches = mismatches;
+    /* No more workers than there are chunks of barcodes for */
+    job.n_workers = (job.n_barcodes + EXPAND_CHUNK - 1) / EXPAND_CHUNK;
+    if (job.n_workers > n_threads) {
+        job.n_workers = n_threads;
+    }
+    if (job.n_workers < 1) {
+        job.n_workers = 1;
+    }
+    job.workers = qes_calloc(job.n_workers, sizeof(*job.workers));
+    for (iii = 0; iii < job.n_workers; iii++) {
+        job.workers[iii].job = &job;
+        job.workers[iii].lists = qes_calloc(n_exps,
+                                            sizeof(*job.workers[iii].lists));
+    }
+    run_threads(expand_worker_run, job.workers, sizeof(*job.workers),
+                job.n_workers, n_threads > 1);
+    for (iii = 0; iii < job.n_workers; iii++) {
+        if (job.workers[iii].ret != 0) {
+            ret = -1;
+            goto exit;
+        }
+    }
+    merges = qes_calloc(n_exps, sizeof(*merges));
+    for (iii = 0; iii < n_exps; iii++) {
+        merges[iii].job = &job;
+        merges[iii].exp = iii;
+    }
+    run_threads(expand_merge_run, merges, sizeof(*merges), n_exps,
+                n_threads > 1);
+    for (iii = 0; iii < n_exps; iii++) {
+        if (merges[iii].ret != 0) {
+            ret = -1;
+        }
+        n_clashes += merges[iii].n_clashes;
+    }
+    /* The tries are changed all or not at all */
+    if (ret == 0 && n_clashes > 0 && !permissive) {
+        ret = 1;
+    }
+    for (iii = 0; iii < n_exps; iii++) {
+        if (ret == 0) {
+            axe_trie_replace(exps[iii].trie, merges[iii].built);
+        } else if (merges[iii].built != NULL) {
+            trie_free(merges[iii].built);
+        }
+    }
+
+exit:
+    for (iii = 0; iii < job.n_workers; iii++) {
+        size_t jjj = 0;
+
+        for (jjj = 0; jjj < n_exps; jjj++) {
+            qes_free(job.workers[iii].lists[jjj].keys);
+        }
+        qes_free(job.workers[iii].lists);
+        qes_free(job.workers[iii].canon);
+        arena_free(job.workers[iii].arena);
+    }
+    qes_free(job.workers);
+    qes_free(merges);
+    return ret;
+}
+
+void
+axe_expansion_clear(struct axe_expansion *exp)
+{
+    size_t iii = 0;
+
+    if (exp == NULL) return;
+    for (iii = 0; iii < exp->n_clashes; iii++) {
+        free(exp->clashes[iii].key);
+    }
+    qes_free(exp->clashes);
+    exp->n_clashes = 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_filter.c
+ *    Description:  Bitset of read prefixes that could match a barcode
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+struct filter_scan {
+    struct axe_filter *filter;
+    size_t min_len;
+    size_t n_keys;
+    size_t mismatches;
+};
+
+static bool
+filter_scan_key(const AlphaChar *key, TrieData data, void *user_data)
+{
+    struct filter_scan *scan = user_data;
+    size_t len = strlen(key);
+
+    (void) data;
+    if (scan->min_len == 0 || len < scan->min_len) {
+        scan->min_len = len;
+    }
+    scan->n_keys++;
+    return true;
+}
+
+/* Set the bit of every prefix within mismatches of key's first k bases.
+ * Mismatched bases are only ever ACGT, so N always counts as one. */
+static void
+filter_set(struct axe_filter *filter, const char *key, size_t pos,
+           uint64_t packed, size_t mismatches)
+{
+    uint8_t code = 0;
+    uint64_t iii = 0;
+
+    if (pos == filter->k) {
+        filter->bits[packed >> 6] |= UINT64_C(1) << (packed & 63);
+        return;
+    }
+    code = axe_kmer_codes[(unsigned char)key[pos]];
+    if (mismatches == 0) {
+        /* Reads with other bases here skip the filter */
+        if (code > 0) {
+            filter_set(filter, key, pos + 1, (packed << 2) | (code - 1), 0);
+        }
+        return;
+    }
+    for (iii = 0; iii < 4; iii++) {
+        size_t cost = code != iii + 1;
+
+        filter_set(filter, key, pos + 1, (packed << 2) | iii,
+                   mismatches - cost);
+    }
+}
+
+static bool
+filter_add_key(const AlphaChar *key, TrieData data, void *user_data)
+{
+    struct filter_scan *scan = user_data;
+
+    (void) data;
+    filter_set(scan->filter, key, 0, 0, scan->mismatches);
+    return true;
+}
+
+struct axe_filter *
+axe_filter_create(const Trie *trie, size_t mismatches)
+{
+    struct axe_filter *filter = NULL;
+    struct filter_scan scan;
+    double per_key = 1.0;
+    double n_set = 1.0;
+    size_t n_prefixes = 0;
+    size_t n_words = 0;
+    size_t iii = 0;
+
+    if (trie == NULL) return NULL;
+    memset(&scan, 0, sizeof(scan));
+    trie_enumerate(trie, filter_scan_key, &scan);
+    /* Keys shorter than k would each pass every read that starts with them,
+     * so k is no longer than the shortest */
+    if (scan.min_len < AXE_FILTER_MIN_K) {
+        return NULL;
+    }
+    filter = qes_calloc(1, sizeof(*filter));
+    filter->k = scan.min_len < AXE_FILTER_MAX_K ? scan.min_len
+                                                : AXE_FILTER_MAX_K;
+    n_prefixes = (size_t)1 << (2 * filter->k);
+    /* If mismatched keys would cover most prefixes, we'd reject nothing */
+    for (iii = 1; iii <= mismatches && iii <= filter->k; iii++) {
+        per_key = per_key * (filter->k - iii + 1) / iii * 3;
+        n_set += per_key;
+    }
+    if (n_set * scan.n_keys > n_prefixes / 2) {
+        axe_filter_destroy(filter);
+        return NULL;
+    }
+    n_words = n_prefixes / 64 > 0 ? n_prefixes / 64 : 1;
+    filter->bits = qes_calloc(n_words, sizeof(*filter->bits));
+    if (filter->bits == NULL) {
+        axe_filter_destroy(filter);
+        return NULL;
+    }
+    filter->bytes = n_words * sizeof(*filter->bits);
+    scan.filter = filter;
+    scan.mismatches = mismatches;
+    trie_enumerate(trie, filter_add_key, &scan);
+    return filter;
+}
+
+void
+axe_filter_destroy_(struct axe_filter *filter)
+{
+    if (filter != NULL) {
+        if (!filter->mapped) {
+            qes_free(filter->bits);
+        }
+        qes_free(filter);
+    }
+}
@@ -0,0 +1,160 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_hamming.c
+ *    Description:  Brute-force Hamming matching against small barcode sets
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+/* Bases as the trie sees them: ACGT in either case, N for N and the
+ * degenerate IUPAC codes, and 0 for anything else, which matches nothing */
+static const uint8_t ham_bases[256] = {
+    ['A'] = 'A', ['C'] = 'C', ['G'] = 'G', ['T'] = 'T',
+    ['a'] = 'A', ['c'] = 'C', ['g'] = 'G', ['t'] = 'T',
+    ['N'] = 'N', ['B'] = 'N', ['D'] = 'N', ['H'] = 'N', ['K'] = 'N',
+    ['M'] = 'N', ['R'] = 'N', ['S'] = 'N', ['V'] = 'N', ['W'] = 'N',
+    ['Y'] = 'N',
+    ['n'] = 'N', ['b'] = 'N', ['d'] = 'N', ['h'] = 'N', ['k'] = 'N',
+    ['m'] = 'N', ['r'] = 'N', ['s'] = 'N', ['v'] = 'N', ['w'] = 'N',
+    ['y'] = 'N',
+};
+
+static inline int
+ham_is_acgt(uint8_t c)
+{
+    return c == 'A' || c == 'C' || c == 'G' || c == 'T';
+}
+
+/* Mutants only ever carry ACGT at mutated positions, so where a has some
+ * other base, a mutant that differs there counts against a. */
+int
+axe_hamming_could_conflict(const char *a, const char *b, size_t len,
+                           size_t mismatches)
+{
+    size_t n_diff = 0;
+    size_t a_only = 0;
+    size_t b_only = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii < len; iii++) {
+        uint8_t ac = ham_bases[(unsigned char)a[iii]];
+        uint8_t bc = ham_bases[(unsigned char)b[iii]];
+
+        if (ac == bc) continue;
+        n_diff++;
+        if (!ham_is_acgt(ac)) a_only++;
+        if (!ham_is_acgt(bc)) b_only++;
+    }
+    return n_diff <= 2 * mismatches && a_only <= mismatches &&
+           b_only <= mismatches;
+}
+
+struct axe_hamming *
+axe_hamming_create(char *const *seqs, const intptr_t *values, size_t n,
+                   size_t mismatches)
+{
+    struct axe_hamming *ham = NULL;
+    size_t len = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    if (seqs == NULL || values == NULL || n == 0 ||
+            n > AXE_HAMMING_MAX_BARCODES) {
+        return NULL;
+    }
+    len = strlen(seqs[0]);
+    if (len == 0 || len > AXE_HAMMING_MAX_LEN) {
+        return NULL;
+    }
+    ham = qes_calloc(1, sizeof(*ham));
+    ham->seqs = qes_calloc(n, sizeof(*ham->seqs));
+    ham->values = qes_calloc(n, sizeof(*ham->values));
+    ham->n = n;
+    ham->len = len;
+    ham->mismatches = mismatches;
+    ham->len_mask = (1u << len) - 1;
+    for (iii = 0; iii < n; iii++) {
+        if (strlen(seqs[iii]) != len || values[iii] < 0 ||
+                values[iii] > INT32_MAX) {
+            goto ineligible;
+        }
+        for (jjj = 0; jjj < len; jjj++) {
+            uint8_t c = ham_bases[(unsigned char)seqs[iii][jjj]];
+
+            /* The trie takes nothing else, and loading will say so */
+            if (c == 0) {
+                goto ineligible;
+            }
+            ham->seqs[iii][jjj] = c;
+        }
+        ham->values[iii] = (int32_t)values[iii];
+    }
+    /* Only sets whose mutants never collide are matched identically to the
+     * trie, which errors on or drops the colliding mutants */
+    for (iii = 0; iii < n; iii++) {
+        for (jjj = iii + 1; jjj < n; jjj++) {
+            if (axe_hamming_could_conflict((const char *)ham->seqs[iii],
+                                           (const char *)ham->seqs[jjj], len,
+                                           mismatches)) {
+                goto ineligible;
+            }
+        }
+    }
+    return ham;
+
+ineligible:
+    axe_hamming_destroy(ham);
+    return NULL;
+}
+
+void
+axe_hamming_destroy_(struct axe_hamming *ham)
+{
+    if (ham != NULL) {
+        qes_free(ham->seqs);
+        qes_free(ham->values);
+        qes_free(ham);
+    }
+}
+
+int
+axe_hamming_match(const struct axe_hamming *ham, const char *seq, size_t len,
+                  intptr_t *value)
+{
+    uint8_t read[AXE_HAMMING_MAX_LEN] = {0};
+    size_t best = 0;
+    size_t iii = 0;
+
+    if (len < ham->len) {
+        return 1;
+    }
+    /* Any base that differs costs a mismatch, Ns included, so an N in the
+     * read is a wildcard with a cost, and one in a barcode matches only N */
+    for (iii = 0; iii < ham->len; iii++) {
+        read[iii] = ham_bases[(unsigned char)seq[iii]];
+    }
+    /* Lowest distance wins; a tie is ambiguous, so unknown */
+    if (axe_simd.hamming_best(ham, read, &best) != 1) {
+        return 1;
+    }
+    *value = ham->values[best];
+    return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_hash.c
+ *    Description:  Open-addressing hash of barcodes of one length
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+/* Key length and count seen by the first pass over the trie */
+struct hash_scan {
+    size_t len;
+    size_t n_keys;
+    int ok;
+};
+
+static bool
+hash_scan_key(const AlphaChar *key, TrieData data, void *user_data)
+{
+    struct hash_scan *scan = user_data;
+    size_t len = strlen(key);
+
+    if (scan->n_keys == 0) {
+        scan->len = len;
+    }
+    if (len != scan->len || len == 0 || len > AXE_HASH_MAX_LEN ||
+            data < 0 || data > INT32_MAX) {
+        scan->ok = 0;
+        return false;
+    }
+    scan->n_keys++;
+    return true;
+}
+
+static bool
+hash_add_key(const AlphaChar *key, TrieData data, void *user_data)
+{
+    struct axe_hash *hash = user_data;
+    uint64_t packed = 0;
+    size_t slot = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii < hash->len; iii++) {
+        uint8_t code = axe_kmer_codes[(unsigned char)key[iii]];
+
+        if (code == 0) {
+            /* Reads with this base are given to the trie */
+            return true;
+        }
+        packed = (packed << 2) | (code - 1);
+    }
+    /* Trie keys are unique, so there is no need to check for this key */
+    slot = axe_hash_slot(hash, packed);
+    while (hash->table[slot].value >= 0) {
+        slot = (slot + 1) & hash->mask;
+    }
+    hash->table[slot].key = packed;
+    hash->table[slot].value = (int32_t)data;
+    hash->n_keys++;
+    return true;
+}
+
+struct axe_hash *
+axe_hash_create(const Trie *trie)
+{
+    struct axe_hash *hash = NULL;
+    struct hash_scan scan;
+    size_t n_slots = 16;
+    unsigned int bits = 4;
+    size_t iii = 0;
+
+    if (trie == NULL) return NULL;
+    memset(&scan, 0, sizeof(scan));
+    scan.ok = 1;
+    trie_enumerate(trie, hash_scan_key, &scan);
+    if (!scan.ok || scan.n_keys == 0) {
+        return NULL;
+    }
+    /* Keep the load factor at or below one half, so probes are short */
+    while (n_slots < 2 * scan.n_keys) {
+        n_slots <<= 1;
+        bits++;
+    }
+    hash = qes_calloc(1, sizeof(*hash));
+    if (hash == NULL) {
+        return NULL;
+    }
+    /* Zeroed padding and all, as the table may be written to an index */
+    hash->table = qes_calloc(n_slots, sizeof(*hash->table));
+    if (hash->table == NULL) {
+        axe_hash_destroy(hash);
+        return NULL;
+    }
+    for (iii = 0; iii < n_slots; iii++) {
+        hash->table[iii].value = -1;
+    }
+    hash->mask = n_slots - 1;
+    hash->shift = 64 - bits;
+    hash->len = scan.len;
+    trie_enumerate(trie, hash_add_key, hash);
+    return hash;
+}
+
+void
+axe_hash_destroy_(struct axe_hash *hash)
+{
+    if (hash != NULL) {
+        if (!hash->mapped) {
+            qes_free(hash->table);
+        }
+        qes_free(hash);
+    }
+}
@@ -0,0 +1,638 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_index.c
+ *    Description:  Save loaded tries to an index, and map them back from it
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Listing, freezing and building tables for every mutant can take longer than
+ * matching a small run of reads. The frozen tries and the engines' tables
+ * hold offsets rather than pointers, so they are written as they lie in
+ * memory to an index named for the barcode file and the options it was
+ * loaded with. Later runs map the index read-only and match with it in
+ * place, and runs at once share its pages. The mutable Trie holds pointers,
+ * so isn't kept; nothing after loading needs it. */
+
+#define INDEX_MAGIC "AXEINDEX"
+#define INDEX_BYTE_ORDER UINT32_C(0x01020304)
+/* Each table starts at this alignment, as frozen tries must */
+#define INDEX_ALIGN ((uint64_t)FROZEN_TRIE_ALIGNMENT)
+#define INDEX_MAX_BLOBS (5 + AXE_KMER_MAX_LEN + 1)
+#define INDEX_BUF_SIZE (1 << 16)
+
+/* Where a table lies in the index, or no bytes if it is absent */
+struct index_blob {
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+/* All fields are of fixed width and naturally aligned, so the layout has no
+ * padding */
+struct index_trie {
+    uint32_t engine;
+    uint32_t filter_k;
+    uint64_t mismatch_level;
+    uint64_t exact_len;
+    uint64_t cache_len; /* As axe_cache_key_len, for the match cache */
+    uint64_t top_depth;
+    uint64_t top_radix;
+    uint64_t hash_mask;
+    uint64_t hash_shift;
+    uint64_t hash_len;
+    uint64_t hash_n_keys;
+    struct index_blob frozen;
+    struct index_blob exact;
+    struct index_blob filter;
+    struct index_blob top;
+    struct index_blob hash;
+    struct index_blob kmer[AXE_KMER_MAX_LEN + 1]; /* By key length */
+};
+
+struct index_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; /* INDEX_BYTE_ORDER, as written by this machine */
+    uint32_t pointer_size;
+    uint32_t n_tries;
+    uint64_t key; /* Of the barcode file and options, as index_key */
+    uint64_t size; /* Of the whole file */
+    uint32_t checksum; /* crc32 of the whole file, with this zeroed */
+    uint32_t reserved;
+    struct index_trie tries[2];
+};
+
+/* A table to write, and where it goes */
+struct index_piece {
+    const void *data;
+    struct index_blob *blob;
+};
+
+static const char index_zeros[FROZEN_TRIE_ALIGNMENT];
+
+static inline uint64_t
+index_align(uint64_t offset)
+{
+    return (offset + INDEX_ALIGN - 1) & ~(INDEX_ALIGN - 1);
+}
+
+/* FNV-1a */
+static inline uint64_t
+index_hash(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *bytes = data;
+    size_t iii = 0;
+
+    for (iii = 0; iii < len; iii++) {
+        hash = (hash ^ bytes[iii]) * UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+static inline uint64_t
+index_hash_u64(uint64_t hash, uint64_t value)
+{
+    unsigned char bytes[8];
+    size_t iii = 0;
+
+    for (iii = 0; iii < 8; iii++) {
+        bytes[iii] = (unsigned char)(value >> (8 * iii));
+    }
+    return index_hash(hash, bytes, sizeof(bytes));
+}
+
+static uLong
+index_crc(uLong crc, const void *data, uint64_t len)
+{
+    const Bytef *bytes = data;
+    uInt chunk = 0;
+
+    while (len > 0) {
+        chunk = len > UINT_MAX ? UINT_MAX : (uInt)len;
+        crc = crc32(crc, bytes, chunk);
+        bytes += chunk;
+        len -= chunk;
+    }
+    return crc;
+}
+
+/* The key of an index: the barcode file's bytes, and every option that
+ * changes what is loaded from them. Returns 0, or 1 if the file can't be
+ * read. */
+static int
+index_key(const struct axe_config *config, uint64_t *key)
+{
+    FILE *fp = NULL;
+    char *buf = NULL;
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    size_t len = 0;
+    int ret = 0;
+
+    fp = fopen(config->barcode_file, "rb");
+    if (fp == NULL) {
+        return 1;
+    }
+    buf = qes_malloc(INDEX_BUF_SIZE);
+    while ((len = fread(buf, 1, INDEX_BUF_SIZE, fp)) > 0) {
+        hash = index_hash(hash, buf, len);
+    }
+    ret = ferror(fp) ? 1 : 0;
+    qes_free(buf);
+    fclose(fp);
+    hash = index_hash_u64(hash, AXE_INDEX_VERSION);
+    hash = index_hash_u64(hash, config->mismatches);
+    hash = index_hash_u64(hash, config->match_combo);
+    hash = index_hash_u64(hash, config->permissive);
+    hash = index_hash_u64(hash, config->search);
+    hash = index_hash_u64(hash, config->edit);
+    hash = index_hash_u64(hash, config->window);
+    hash = index_hash_u64(hash, config->pin_engine);
+    hash = index_hash_u64(hash, config->pin_engine ? config->engine : 0);
+    *key = hash;
+    return ret;
+}
+
+static char *
+index_path(const struct axe_config *config, uint64_t key)
+{
+    char *path = NULL;
+    size_t len = strlen(config->index_dir) + 32;
+
+    path = qes_malloc(len);
+    snprintf(path, len, "%s/axe-%016llx.idx", config->index_dir,
+             (unsigned long long)key);
+    return path;
+}
+
+/* Can the trie be written as it is? Its engine's tables must all be flat. */
+static int
+index_trie_ok(const struct axe_trie *trie)
+{
+    if (trie->frozen == NULL || trie->hamming != NULL ||
+            trie->seed != NULL || trie->dawg != NULL ||
+            trie->window != NULL || trie->search || trie->edit) {
+        return 0;
+    }
+    return trie->engine == AXE_ENGINE_TRIE ||
+           (trie->engine == AXE_ENGINE_KMER && trie->kmer != NULL) ||
+           (trie->engine == AXE_ENGINE_HASH && trie->hash != NULL);
+}
+
+/* Describe a trie's tables in rec, and list them in pieces. Returns how many
+ * were listed. */
+static size_t
+index_describe(const struct axe_trie *trie, struct index_trie *rec,
+               struct index_piece *pieces)
+{
+    size_t n = 0;
+    size_t iii = 0;
+
+#define _INDEX_ADD(field, ptr, len)                                         \
+    pieces[n].data = (ptr);                                                 \
+    pieces[n].blob = &rec->field;                                           \
+    rec->field.bytes = (len);                                               \
+    n++;
+    rec->engine = trie->engine;
+    rec->mismatch_level = trie->mismatch_level;
+    rec->exact_len = trie->exact_len;
+    rec->cache_len = axe_cache_key_len(trie->trie);
+    _INDEX_ADD(frozen, trie->frozen, frozen_trie_size(trie->frozen))
+    if (trie->exact != NULL) {
+        _INDEX_ADD(exact, trie->exact, frozen_trie_size(trie->exact))
+    }
+    if (trie->filter != NULL) {
+        rec->filter_k = trie->filter->k;
+        _INDEX_ADD(filter, trie->filter->bits, trie->filter->bytes)
+    }
+    if (trie->engine == AXE_ENGINE_TRIE && trie->top != NULL) {
+        rec->top_depth = trie->top->depth;
+        rec->top_radix = trie->top->radix;
+        _INDEX_ADD(top, trie->top->table, trie->top->bytes)
+    }
+    if (trie->engine == AXE_ENGINE_HASH) {
+        rec->hash_mask = trie->hash->mask;
+        rec->hash_shift = trie->hash->shift;
+        rec->hash_len = trie->hash->len;
+        rec->hash_n_keys = trie->hash->n_keys;
+        _INDEX_ADD(hash, trie->hash->table,
+                   (trie->hash->mask + 1) * sizeof(*trie->hash->table))
+    }
+    if (trie->engine == AXE_ENGINE_KMER) {
+        for (iii = 0; iii < trie->kmer->n_lens; iii++) {
+            size_t len = trie->kmer->lens[iii];
+
+            _INDEX_ADD(kmer[len], trie->kmer->tables[len],
+                       ((size_t)1 << (2 * len)) * sizeof(int32_t))
+        }
+    }
+#undef _INDEX_ADD
+    return n;
+}
+
+/* Is the blob wholly within the index, and aligned? */
+static inline int
+index_blob_ok(const struct index_blob *blob, uint64_t size)
+{
+    return blob->offset >= sizeof(struct index_header) &&
+           blob->offset % INDEX_ALIGN == 0 &&
+           blob->offset <= size && blob->bytes <= size - blob->offset;
+}
+
+/* Are the tables of rec whole, and of the sizes their fields say? */
+static int
+index_check_trie(const struct index_trie *rec, const char *map, uint64_t size)
+{
+    const struct index_blob *blobs[] = {
+        &rec->frozen, &rec->exact, &rec->filter, &rec->top, &rec->hash,
+    };
+    uint64_t n_entries = 1;
+    size_t n_lens = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii < sizeof(blobs) / sizeof(*blobs); iii++) {
+        if (blobs[iii]->bytes > 0 && !index_blob_ok(blobs[iii], size)) {
+            return 0;
+        }
+    }
+    for (iii = 0; iii <= AXE_KMER_MAX_LEN; iii++) {
+        if (rec->kmer[iii].bytes == 0) continue;
+        if (iii == 0 || !index_blob_ok(&rec->kmer[iii], size) ||
+                rec->kmer[iii].bytes !=
+                    ((uint64_t)1 << (2 * iii)) * sizeof(int32_t)) {
+            return 0;
+        }
+        n_lens++;
+    }
+    if (rec->frozen.bytes == 0 ||
+            frozen_trie_from_image((void *)(map + rec->frozen.offset),
+                                   rec->frozen.bytes) == NULL) {
+        return 0;
+    }
+    if (rec->exact.bytes > 0 &&
+            frozen_trie_from_image((void *)(map + rec->exact.offset),
+                                   rec->exact.bytes) == NULL) {
+        return 0;
+    }
+    if (rec->filter.bytes > 0) {
+        if (rec->filter_k < AXE_FILTER_MIN_K ||
+                rec->filter_k > AXE_FILTER_MAX_K) {
+            return 0;
+        }
+        n_entries = ((uint64_t)1 << (2 * rec->filter_k)) / 64;
+        if (rec->filter.bytes != n_entries * sizeof(uint64_t)) {
+            return 0;
+        }
+    }
+    if (rec->top.bytes > 0) {
+        if (rec->top_radix < 2 || rec->top_radix > TRIE_CHAR_MAX ||
+                rec->top_depth < AXE_TOP_MIN_DEPTH) {
+            return 0;
+        }
+        n_entries = 1;
+        for (iii = 0; iii < rec->top_depth; iii++) {
+            n_entries *= rec->top_radix;
+            if (n_entries > size) return 0;
+        }
+        if (rec->top.bytes != n_entries * sizeof(struct axe_top_entry)) {
+            return 0;
+        }
+    }
+    switch (rec->engine) {
+        case AXE_ENGINE_TRIE:
+            return 1;
+        case AXE_ENGINE_KMER:
+            return n_lens > 0;
+        case AXE_ENGINE_HASH:
+            return rec->hash.bytes > 0 && rec->hash_shift >= 4 &&
+                   rec->hash_shift < 64 &&
+                   rec->hash_mask == (UINT64_MAX >> rec->hash_shift) &&
+                   rec->hash.bytes == (rec->hash_mask + 1) *
+                                      sizeof(struct axe_hash_entry) &&
+                   rec->hash_len > 0 && rec->hash_len <= AXE_HASH_MAX_LEN;
+        default:
+            return 0;
+    }
+}
+
+/* Point the empty trie at the tables of rec, which index_check_trie passed */
+static void
+index_install(struct axe_trie *trie, const struct index_trie *rec, char *map,
+              size_t cache_bytes)
+{
+    size_t iii = 0;
+
+    trie->frozen = frozen_trie_from_image(map + rec->frozen.offset,
+                                          rec->frozen.bytes);
+    if (rec->exact.bytes > 0) {
+        trie->exact = frozen_trie_from_image(map + rec->exact.offset,
+                                             rec->exact.bytes);
+    }
+    trie->exact_len = rec->exact_len;
+    trie->mismatch_level = rec->mismatch_level;
+    trie->engine = (enum axe_engine)rec->engine;
+    trie->mapped = 1;
+    if (rec->filter.bytes > 0) {
+        trie->filter = qes_calloc(1, sizeof(*trie->filter));
+        trie->filter->bits = (uint64_t *)(map + rec->filter.offset);
+        trie->filter->k = rec->filter_k;
+        trie->filter->bytes = rec->filter.bytes;
+        trie->filter->mapped = 1;
+    }
+    if (rec->top.bytes > 0) {
+        trie->top = qes_calloc(1, sizeof(*trie->top));
+        trie->top->table = (struct axe_top_entry *)(map + rec->top.offset);
+        trie->top->depth = rec->top_depth;
+        trie->top->radix = rec->top_radix;
+        trie->top->bytes = rec->top.bytes;
+        trie->top->mapped = 1;
+    }
+    if (trie->engine == AXE_ENGINE_HASH) {
+        trie->hash = qes_calloc(1, sizeof(*trie->hash));
+        trie->hash->table = (struct axe_hash_entry *)(map + rec->hash.offset);
+        trie->hash->mask = rec->hash_mask;
+        trie->hash->shift = rec->hash_shift;
+        trie->hash->len = rec->hash_len;
+        trie->hash->n_keys = rec->hash_n_keys;
+        trie->hash->mapped = 1;
+    }
+    if (trie->engine == AXE_ENGINE_KMER) {
+        trie->kmer = qes_calloc(1, sizeof(*trie->kmer));
+        /* Longest first, as axe_kmer_create lists them */
+        for (iii = AXE_KMER_MAX_LEN; iii > 0; iii--) {
+            if (rec->kmer[iii].bytes == 0) continue;
+            trie->kmer->tables[iii] = (int32_t *)(map + rec->kmer[iii].offset);
+            if (trie->kmer->n_lens == 0) {
+                trie->kmer->max_len = iii;
+            }
+            trie->kmer->lens[trie->kmer->n_lens++] = iii;
+            trie->kmer->bytes += rec->kmer[iii].bytes;
+        }
+        trie->kmer->mapped = 1;
+    }
+    if (cache_bytes > 0) {
+        trie->cache = axe_cache_create_len(rec->cache_len, cache_bytes);
+    }
+}
+
+int
+axe_load_index(struct axe_config *config)
+{
+    struct index_header head;
+    struct axe_trie *tries[2] = {NULL, NULL};
+    struct stat st;
+    char *path = NULL;
+    char *map = NULL;
+    const char *why = NULL;
+    uint64_t key = 0;
+    uLong crc = 0;
+    size_t n_tries = 1;
+    size_t iii = 0;
+    int fd = -1;
+
+    if (!axe_config_ok(config) || config->fwd_trie == NULL ||
+            config->barcode_file == NULL || config->index_map != NULL) {
+        return -1;
+    }
+    tries[0] = config->fwd_trie;
+    if (config->match_combo) {
+        if (config->rev_trie == NULL) return -1;
+        tries[1] = config->rev_trie;
+        n_tries = 2;
+    }
+    for (iii = 0; iii < n_tries; iii++) {
+        if (tries[iii]->frozen != NULL || tries[iii]->mapped) return -1;
+    }
+    if (config->index_dir == NULL || index_key(config, &key) != 0) {
+        return 1;
+    }
+    path = index_path(config, key);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            why = strerror(errno);
+        } else if (config->verbosity > 0) {
+            qes_log_format_info(config->logger,
+                    "load_index -- No barcode index at %s yet\n", path);
+        }
+        goto miss;
+    }
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(head) ||
+            (uint64_t)st.st_size > SIZE_MAX) {
+        why = "it is truncated";
+        goto miss;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        why = strerror(errno);
+        goto miss;
+    }
+    memcpy(&head, map, sizeof(head));
+    if (memcmp(head.magic, INDEX_MAGIC, sizeof(head.magic)) != 0 ||
+            head.version != AXE_INDEX_VERSION ||
+            head.byte_order != INDEX_BYTE_ORDER ||
+            head.pointer_size != sizeof(void *)) {
+        why = "it was written by another version or machine";
+        goto miss;
+    }
+    if (head.key != key || head.n_tries != n_tries) {
+        why = "it is of other barcodes";
+        goto miss;
+    }
+    if (head.size != (uint64_t)st.st_size) {
+        why = "it is truncated";
+        goto miss;
+    }
+    /* Reading the whole index once also brings it into the page cache */
+    head.checksum = 0;
+    crc = index_crc(crc32(0L, Z_NULL, 0), &head, sizeof(head));
+    crc = index_crc(crc, map + sizeof(head), head.size - sizeof(head));
+    memcpy(&head, map, sizeof(head));
+    if ((uint32_t)crc != head.checksum) {
+        why = "it is corrupt";
+        goto miss;
+    }
+    for (iii = 0; iii < n_tries; iii++) {
+        if (!index_check_trie(&head.tries[iii], map, head.size)) {
+            why = "it is corrupt";
+            goto miss;
+        }
+    }
+    close(fd);
+    for (iii = 0; iii < n_tries; iii++) {
+        index_install(tries[iii], &head.tries[iii], map, config->cache_bytes);
+    }
+    config->index_map = map;
+    config->index_size = head.size;
+    if (config->cache_bytes > 0 && config->fwd_trie->cache == NULL &&
+            config->verbosity >= 0) {
+        qes_log_message_warning(config->logger,
+                "load_index -- Not caching matches of these barcodes\n");
+    }
+    if (config->verbosity > 0) {
+        qes_log_format_info(config->logger,
+                "load_index -- Mapped %llu bytes of barcode tries from %s\n",
+                (unsigned long long)head.size, path);
+        fprintf(stderr, "[load_index] (%s) Barcode tries loaded\n",
+                nowstr());
+    }
+    qes_free(path);
+    return 0;
+
+miss:
+    if (why != NULL && config->verbosity >= 0) {
+        qes_log_format_warning(config->logger,
+                "load_index -- Ignoring barcode index %s, as %s\n", path,
+                why);
+    }
+    if (map != NULL) {
+        munmap(map, (size_t)st.st_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    qes_free(path);
+    return 1;
+}
+
+int
+axe_save_index(struct axe_config *config)
+{
+    struct index_header head;
+    struct index_piece pieces[2 * INDEX_MAX_BLOBS];
+    struct axe_trie *tries[2] = {NULL, NULL};
+    FILE *fp = NULL;
+    char *path = NULL;
+    char *tmp = NULL;
+    uint64_t offset = 0;
+    uLong crc = 0;
+    size_t n_pieces = 0;
+    size_t n_tries = 1;
+    size_t tmp_len = 0;
+    size_t iii = 0;
+    int ok = 1;
+
+    if (!axe_config_ok(config) || config->fwd_trie == NULL) {
+        return -1;
+    }
+    if (config->index_dir == NULL || config->index_map != NULL) {
+        return 0;
+    }
+    tries[0] = config->fwd_trie;
+    if (config->match_combo) {
+        tries[1] = config->rev_trie;
+        n_tries = 2;
+    }
+    for (iii = 0; iii < n_tries; iii++) {
+        if (tries[iii] == NULL || !index_trie_ok(tries[iii])) {
+            if (config->verbosity > 0) {
+                qes_log_message_info(config->logger,
+                        "save_index -- Not indexing barcodes matched by "
+                        "searching, or with the Hamming, seed or dawg "
+                        "engines\n");
+            }
+            return 0;
+        }
+    }
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, INDEX_MAGIC, sizeof(head.magic));
+    head.version = AXE_INDEX_VERSION;
+    head.byte_order = INDEX_BYTE_ORDER;
+    head.pointer_size = sizeof(void *);
+    head.n_tries = n_tries;
+    if (index_key(config, &head.key) != 0) {
+        ok = 0;
+        goto exit;
+    }
+    for (iii = 0; iii < n_tries; iii++) {
+        n_pieces += index_describe(tries[iii], &head.tries[iii],
+                                   &pieces[n_pieces]);
+    }
+    /* Lay the tables out in order, each aligned */
+    offset = sizeof(head);
+    for (iii = 0; iii < n_pieces; iii++) {
+        offset = index_align(offset);
+        pieces[iii].blob->offset = offset;
+        offset += pieces[iii].blob->bytes;
+    }
+    head.size = offset;
+    crc = index_crc(crc32(0L, Z_NULL, 0), &head, sizeof(head));
+    offset = sizeof(head);
+    for (iii = 0; iii < n_pieces; iii++) {
+        crc = index_crc(crc, index_zeros,
+                        pieces[iii].blob->offset - offset);
+        crc = index_crc(crc, pieces[iii].data, pieces[iii].blob->bytes);
+        offset = pieces[iii].blob->offset + pieces[iii].blob->bytes;
+    }
+    head.checksum = (uint32_t)crc;
+    /* Written aside and renamed into place, so that other runs see all of
+     * an index or none of it */
+    path = index_path(config, head.key);
+    tmp_len = strlen(path) + 32;
+    tmp = qes_malloc(tmp_len);
+    snprintf(tmp, tmp_len, "%s.%ld.tmp", path, (long)getpid());
+    fp = fopen(tmp, "wb");
+    if (fp == NULL) {
+        ok = 0;
+        goto exit;
+    }
+    ok = fwrite(&head, sizeof(head), 1, fp) == 1;
+    offset = sizeof(head);
+    for (iii = 0; ok && iii < n_pieces; iii++) {
+        const struct index_blob *blob = pieces[iii].blob;
+
+        if (blob->offset > offset) {
+            ok = fwrite(index_zeros, blob->offset - offset, 1, fp) == 1;
+        }
+        if (ok && blob->bytes > 0) {
+            ok = fwrite(pieces[iii].data, blob->bytes, 1, fp) == 1;
+        }
+        offset = blob->offset + blob->bytes;
+    }
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    if (ok && rename(tmp, path) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        unlink(tmp);
+    }
+exit:
+    if (!ok && config->verbosity >= 0) {
+        qes_log_format_warning(config->logger,
+                "save_index -- Couldn't write barcode index to %s\n",
+                config->index_dir);
+    } else if (config->verbosity > 0) {
+        qes_log_format_info(config->logger,
+                "save_index -- Wrote %llu bytes of barcode tries to %s\n",
+                (unsigned long long)head.size, path);
+    }
+    qes_free(path);
+    qes_free(tmp);
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_kmer.c
+ *    Description:  Direct-indexed k-mer tables for short barcode sets
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+const uint8_t axe_kmer_codes[256] = {
+    ['A'] = 1, ['C'] = 2, ['G'] = 3, ['T'] = 4,
+    ['a'] = 1, ['c'] = 2, ['g'] = 3, ['t'] = 4,
+};
+
+/* Key lengths seen by the first pass over the trie */
+struct kmer_scan {
+    size_t counts[AXE_KMER_MAX_LEN + 1];
+    int ok;
+};
+
+static bool
+kmer_scan_key(const AlphaChar *key, TrieData data, void *user_data)
+{
+    struct kmer_scan *scan = user_data;
+    size_t len = strlen(key);
+
+    if (len == 0 || len > AXE_KMER_MAX_LEN || data < 0 || data > INT32_MAX) {
+        scan->ok = 0;
+        return false;
+    }
+    scan->counts[len]++;
+    return true;
+}
+
+static bool
+kmer_add_key(const AlphaChar *key, TrieData data, void *user_data)
+{
+    struct axe_kmer *kmer = user_data;
+    uint64_t packed = 0;
+    size_t len = strlen(key);
+    size_t iii = 0;
+
+    for (iii = 0; iii < len; iii++) {
+        uint8_t code = axe_kmer_codes[(unsigned char)key[iii]];
+
+        if (code == 0) {
+            /* Only reads with the same odd base can hit this key, and those
+             * are given to the trie */
+            return true;
+        }
+        packed = (packed << 2) | (code - 1);
+    }
+    kmer->tables[len][packed] = (int32_t)data;
+    return true;
+}
+
+struct axe_kmer *
+axe_kmer_create(const Trie *trie, size_t max_bytes)
+{
+    struct axe_kmer *kmer = NULL;
+    struct kmer_scan scan;
+    size_t bytes = 0;
+    ssize_t len = 0;
+
+    if (trie == NULL) return NULL;
+    memset(&scan, 0, sizeof(scan));
+    scan.ok = 1;
+    trie_enumerate(trie, kmer_scan_key, &scan);
+    if (!scan.ok) {
+        return NULL;
+    }
+    for (len = AXE_KMER_MAX_LEN; len > 0; len--) {
+        if (scan.counts[len] > 0) {
+            bytes += ((size_t)1 << (2 * len)) * sizeof(int32_t);
+        }
+    }
+    if (bytes == 0 || bytes > max_bytes) {
+        return NULL;
+    }
+    kmer = qes_calloc(1, sizeof(*kmer));
+    if (kmer == NULL) {
+        return NULL;
+    }
+    /* Longest first, as the longest matching barcode wins */
+    for (len = AXE_KMER_MAX_LEN; len > 0; len--) {
+        size_t n_entries = (size_t)1 << (2 * len);
+
+        if (scan.counts[len] == 0) {
+            continue;
+        }
+        kmer->tables[len] = qes_malloc(n_entries * sizeof(int32_t));
+        if (kmer->tables[len] == NULL) {
+            axe_kmer_destroy(kmer);
+            return NULL;
+        }
+        memset(kmer->tables[len], 0xff, n_entries * sizeof(int32_t));
+        if (kmer->n_lens == 0) {
+            kmer->max_len = len;
+        }
+        kmer->lens[kmer->n_lens++] = len;
+    }
+    kmer->bytes = bytes;
+    trie_enumerate(trie, kmer_add_key, kmer);
+    return kmer;
+}
+
+void
+axe_kmer_destroy_(struct axe_kmer *kmer)
+{
+    size_t len = 0;
+
+    if (kmer != NULL) {
+        for (len = 0; len <= AXE_KMER_MAX_LEN && !kmer->mapped; len++) {
+            qes_free(kmer->tables[len]);
+        }
+        qes_free(kmer);
+    }
+}
@@ -0,0 +1,206 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_mutate.c
+ *    Description:  Streaming enumeration of barcode mutants
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+#include "gsl_combination.h"
+
+/* The mutants of a barcode at some distance are the same sets of positions,
+ * each given the same choices of other letters, whatever the barcode. So
+ * these are listed once per length and distance, and each mutant is written
+ * over a copy of the barcode in place. Each position takes only letters other
+ * than the barcode's, so each mutant differs at exactly dist positions, and
+ * is listed once. */
+
+static const char mutate_alphabet[] = "ACGT";
+#define MUTATE_N_LETTERS 4
+
+static struct axe_mutant_patterns *
+mutator_patterns(struct axe_mutator *mut, size_t len, unsigned int dist,
+                 unsigned int radix)
+{
+    struct axe_mutant_patterns *pat = NULL;
+    gsl_combination *comb = NULL;
+    uintptr_t *choices = NULL;
+    size_t n_sites = 1;
+    size_t n_choices = 1;
+    size_t iii = 0;
+    size_t jjj = 0;
+    int ret = 0;
+
+    for (iii = 0; iii < mut->n_patterns; iii++) {
+        pat = &mut->patterns[iii];
+        if (pat->len == len && pat->dist == dist && pat->radix == radix) {
+            return pat;
+        }
+    }
+    /* len choose dist sets of positions, and radix^dist sets of letters */
+    for (iii = 0; iii < dist; iii++) {
+        if (n_choices > SIZE_MAX / radix / dist) return NULL;
+        n_choices *= radix;
+        n_sites = n_sites * (len - iii) / (iii + 1);
+    }
+    if (n_sites > SIZE_MAX / sizeof(*pat->sites) / dist) return NULL;
+    mut->patterns = qes_realloc(mut->patterns,
+                                (mut->n_patterns + 1) * sizeof(*pat));
+    pat = &mut->patterns[mut->n_patterns++];
+    pat->len = len;
+    pat->dist = dist;
+    pat->radix = radix;
+    pat->n_sites = n_sites;
+    pat->sites = qes_malloc(n_sites * dist * sizeof(*pat->sites));
+    pat->n_choices = n_choices;
+    pat->choices = qes_malloc(n_choices * dist);
+    comb = gsl_combination_calloc(len, dist);
+    iii = 0;
+    do {
+        for (jjj = 0; jjj < dist; jjj++) {
+            pat->sites[iii * dist + jjj] = gsl_combination_get(comb, jjj);
+        }
+        iii++;
+    } while (gsl_combination_next(comb) == GSL_SUCCESS);
+    gsl_combination_free(comb);
+    choices = qes_calloc(dist, sizeof(*choices));
+    iii = 0;
+    while ((ret = product(radix, dist, choices, !ret)) == 1) {
+        for (jjj = 0; jjj < dist; jjj++) {
+            pat->choices[iii * dist + jjj] = choices[jjj];
+        }
+        iii++;
+    }
+    qes_free(choices);
+    return pat;
+}
+
+struct axe_mutator *
+axe_mutator_create(void)
+{
+    struct axe_mutator *mut = qes_calloc(1, sizeof(*mut));
+    size_t iii = 0;
+    size_t jjj = 0;
+    size_t n_subst = 0;
+
+    /* The letters to put in place of each, in order */
+    for (iii = 0; iii <= UCHAR_MAX; iii++) {
+        n_subst = 0;
+        for (jjj = 0; jjj < MUTATE_N_LETTERS; jjj++) {
+            if ((size_t)(unsigned char)mutate_alphabet[jjj] != iii) {
+                mut->subst[iii][n_subst++] = mutate_alphabet[jjj];
+            }
+        }
+    }
+    return mut;
+}
+
+void
+axe_mutator_destroy_(struct axe_mutator *mut)
+{
+    size_t iii = 0;
+
+    if (mut != NULL) {
+        for (iii = 0; iii < mut->n_patterns; iii++) {
+            qes_free(mut->patterns[iii].sites);
+            qes_free(mut->patterns[iii].choices);
+        }
+        qes_free(mut->patterns);
+        qes_free(mut->buf);
+        qes_free(mut);
+    }
+}
+
+int
+axe_mutator_start(struct axe_mutator *mut, const char *str, size_t len,
+                  unsigned int dist, int keep_original)
+{
+    unsigned int radix = MUTATE_N_LETTERS - 1;
+    size_t iii = 0;
+
+    if (mut == NULL || str == NULL || len < 1 || dist < 1 || dist > len) {
+        return -1;
+    }
+    /* Any letter is a substitution for bases other than ACGT. Those with
+     * both choose from all four letters, and skip each base's own. */
+    for (iii = 0; iii < len; iii++) {
+        if (str[iii] == '\0' || strchr(mutate_alphabet, str[iii]) == NULL) {
+            radix = MUTATE_N_LETTERS;
+            break;
+        }
+    }
+    mut->cur = mutator_patterns(mut, len, dist, radix);
+    if (mut->cur == NULL) {
+        return -1;
+    }
+    if (len + 1 > mut->buf_size) {
+        mut->buf_size = len + 1;
+        mut->buf = qes_realloc(mut->buf, mut->buf_size);
+    }
+    memcpy(mut->buf, str, len);
+    mut->buf[len] = '\0';
+    mut->str = str;
+    mut->site = 0;
+    mut->choice = 0;
+    mut->last = NULL;
+    mut->original = keep_original;
+    return 0;
+}
+
+const char *
+axe_mutator_next(struct axe_mutator *mut)
+{
+    const struct axe_mutant_patterns *pat = mut->cur;
+    const size_t dist = pat->dist;
+    size_t iii = 0;
+
+    if (mut->original) {
+        mut->original = 0;
+        return mut->buf;
+    }
+    while (mut->site < pat->n_sites) {
+        const uint32_t *sites = &pat->sites[mut->site * dist];
+        const uint8_t *choices = &pat->choices[mut->choice * dist];
+        int skip = 0;
+
+        /* Undo the last mutant, if it was elsewhere */
+        if (mut->last != NULL && mut->last != sites) {
+            for (iii = 0; iii < dist; iii++) {
+                mut->buf[mut->last[iii]] = mut->str[mut->last[iii]];
+            }
+        }
+        for (iii = 0; iii < dist; iii++) {
+            char letter = mut->subst[(unsigned char)mut->str[sites[iii]]]
+                                    [choices[iii]];
+
+            mut->buf[sites[iii]] = letter;
+            skip |= letter == '\0';
+        }
+        mut->last = sites;
+        if (++mut->choice == pat->n_choices) {
+            mut->choice = 0;
+            mut->site++;
+        }
+        if (!skip) {
+            return mut->buf;
+        }
+    }
+    return NULL;
+}
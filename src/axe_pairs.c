@@ -0,0 +1,128 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_pairs.c
+ *    Description:  Barcode pair numbers by R1 and R2 barcode
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+
+#include "axe.h"
+
+/* Hash the pairs when the table would be this many times larger */
+#define PAIR_SPARSE_RATIO 4
+
+struct axe_pair_map *
+axe_pair_map_create(size_t n_barcodes_1, size_t n_barcodes_2, size_t n_pairs)
+{
+    struct axe_pair_map *map = NULL;
+    size_t n_entries = 0;
+    size_t n_slots = 16;
+    unsigned int bits = 4;
+    unsigned int width = 4;
+
+    if (n_barcodes_1 == 0 || n_barcodes_2 == 0 || n_pairs == 0 ||
+            n_pairs >= UINT32_MAX ||
+            n_barcodes_1 > SIZE_MAX / n_barcodes_2) {
+        return NULL;
+    }
+    n_entries = n_barcodes_1 * n_barcodes_2;
+    if (n_pairs < UINT8_MAX) {
+        width = 1;
+    } else if (n_pairs < UINT16_MAX) {
+        width = 2;
+    }
+    /* At most half full, so probes stay short */
+    while (n_slots < 2 * n_pairs) {
+        n_slots <<= 1;
+        bits++;
+    }
+    map = qes_calloc(1, sizeof(*map));
+    map->n_barcodes_1 = n_barcodes_1;
+    map->n_barcodes_2 = n_barcodes_2;
+    if (n_entries / PAIR_SPARSE_RATIO > n_slots * sizeof(*map->slots) / width) {
+        map->slots = qes_calloc(n_slots, sizeof(*map->slots));
+        map->mask = n_slots - 1;
+        map->shift = 64 - bits;
+        map->bytes = n_slots * sizeof(*map->slots);
+    } else {
+        map->table = qes_calloc(n_entries, width);
+        map->width = width;
+        map->bytes = n_entries * width;
+    }
+    if (map->slots == NULL && map->table == NULL) {
+        axe_pair_map_destroy(map);
+        return NULL;
+    }
+    return map;
+}
+
+void
+axe_pair_map_destroy_(struct axe_pair_map *map)
+{
+    if (map != NULL) {
+        qes_free(map->table);
+        qes_free(map->slots);
+        qes_free(map);
+    }
+}
+
+int
+axe_pair_map_add(struct axe_pair_map *map, size_t bcd1, size_t bcd2,
+                 size_t pair)
+{
+    uint64_t key = 0;
+    uint32_t value = pair + 1;
+    size_t slot = 0;
+
+    if (map == NULL || bcd1 >= map->n_barcodes_1 ||
+            bcd2 >= map->n_barcodes_2) {
+        return -1;
+    }
+    key = axe_pair_map_key(map, bcd1, bcd2);
+    switch (map->width) {
+    case 1:
+        if (pair >= UINT8_MAX) return -1;
+        ((uint8_t *)map->table)[key] = value;
+        return 0;
+    case 2:
+        if (pair >= UINT16_MAX) return -1;
+        ((uint16_t *)map->table)[key] = value;
+        return 0;
+    case 4:
+        if (pair >= UINT32_MAX) return -1;
+        ((uint32_t *)map->table)[key] = value;
+        return 0;
+    }
+    if (pair >= UINT32_MAX) return -1;
+    for (slot = (key * UINT64_C(0x9E3779B97F4A7C15)) >> map->shift;
+            map->slots[slot].value != 0; slot = (slot + 1) & map->mask) {
+        if (map->slots[slot].key == key) {
+            break;
+        }
+    }
+    if (map->slots[slot].value == 0) {
+        /* An empty slot must remain, or lookups would never end */
+        if (map->n_filled + 1 > map->mask) return -1;
+        map->n_filled++;
+    }
+    map->slots[slot].key = key;
+    map->slots[slot].value = value;
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_search.c
+ *    Description:  Bounded Hamming search of a trie of exact barcodes
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+/* Closest barcodes found of one length */
+struct search_hits {
+    size_t n;
+    size_t dist;
+    intptr_t value;
+};
+
+struct search {
+    const FrozenTrie *ft;
+    size_t mismatches;
+    size_t depth;       /* Read bases that may be searched */
+    TrieIndex read[AXE_SEARCH_MAX_LEN]; /* Trie codes of the read */
+    /* Trie codes barcode bases may take. Degenerate bases are N. */
+    TrieIndex codes[5];
+    struct search_hits hits[AXE_SEARCH_MAX_LEN + 1];
+};
+
+static void
+search_walk(struct search *srch, FrozenTrieState state, size_t pos,
+            size_t dist)
+{
+    TrieData data;
+    size_t iii = 0;
+
+    if (frozen_trie_get_terminal_data(srch->ft, state, &data)) {
+        struct search_hits *hits = &srch->hits[pos];
+
+        if (hits->n == 0 || dist < hits->dist) {
+            hits->n = 1;
+            hits->dist = dist;
+            hits->value = data;
+        } else if (dist == hits->dist) {
+            hits->n++;
+        }
+    }
+    if (pos == srch->depth) {
+        return;
+    }
+    /* Every base but the read's own costs one, so an N in the read is a
+     * wildcard that spends a mismatch, as is any base outside the alphabet,
+     * which matches none */
+    for (iii = 0; iii < 5; iii++) {
+        TrieIndex code = srch->codes[iii];
+        size_t cost = code != srch->read[pos];
+        FrozenTrieState next;
+
+        /* Prune once the mismatches are spent */
+        if (code == TRIE_INDEX_MAX || dist + cost > srch->mismatches) {
+            continue;
+        }
+        next = frozen_trie_walk_tc(srch->ft, state, (TrieChar)code);
+        if (next != FROZEN_TRIE_STATE_FAIL) {
+            search_walk(srch, next, pos + 1, dist + cost);
+        }
+    }
+}
+
+int
+axe_search_match(const FrozenTrie *ft, const char *seq, size_t len,
+                 size_t mismatches, intptr_t *value)
+{
+    struct search srch;
+    size_t iii = 0;
+
+    srch.ft = ft;
+    srch.mismatches = mismatches;
+    srch.depth = len < AXE_SEARCH_MAX_LEN ? len : AXE_SEARCH_MAX_LEN;
+    srch.codes[0] = frozen_trie_char_to_trie(ft, 'A');
+    srch.codes[1] = frozen_trie_char_to_trie(ft, 'C');
+    srch.codes[2] = frozen_trie_char_to_trie(ft, 'G');
+    srch.codes[3] = frozen_trie_char_to_trie(ft, 'T');
+    srch.codes[4] = frozen_trie_char_to_trie(ft, 'N');
+    for (iii = 0; iii < srch.depth; iii++) {
+        srch.read[iii] = frozen_trie_char_to_trie(ft, seq[iii]);
+    }
+    memset(srch.hits, 0, (srch.depth + 1) * sizeof(*srch.hits));
+    search_walk(&srch, FROZEN_TRIE_STATE_ROOT, 0, 0);
+    /* Longest first. Equally close barcodes collide, as their mutants
+     * would, so leave those to shorter barcodes. */
+    for (iii = srch.depth; iii > 0; iii--) {
+        if (srch.hits[iii].n == 1) {
+            *value = srch.hits[iii].value;
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,264 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_seed.c
+ *    Description:  Pigeonhole seed index of long barcodes
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+/* A barcode within m mismatches of a read matches it exactly in at least one
+ * of any m + 1 segments. So each segment of every barcode is indexed, and the
+ * barcodes sharing a segment with a read are compared to it in full. */
+
+/* Keys seen by the first pass over the trie */
+struct seed_scan {
+    struct axe_seed *seed;
+    size_t n_keys;
+    int ok;
+};
+
+/* A barcode's segment, for sorting into postings */
+struct seed_entry {
+    uint64_t key;
+    uint32_t idx;
+};
+
+static bool
+seed_scan_key(const AlphaChar *key, TrieData data, void *user_data)
+{
+    struct seed_scan *scan = user_data;
+    uint64_t packed = 0;
+    size_t len = strlen(key);
+
+    if (scan->n_keys == 0) {
+        scan->seed->len = len;
+    }
+    /* Every read base must be free to mismatch, so no Ns */
+    if (len != scan->seed->len || len < AXE_SEED_MIN_LEN ||
+            len > AXE_SEED_MAX_LEN || data < 0 || data > INT32_MAX ||
+            axe_pack_2bit(key, len, &packed) != 0) {
+        scan->ok = 0;
+        return false;
+    }
+    if (scan->seed->barcodes != NULL) {
+        scan->seed->barcodes[scan->n_keys] = packed;
+        scan->seed->values[scan->n_keys] = (int32_t)data;
+    }
+    scan->n_keys++;
+    return true;
+}
+
+static int
+seed_entry_cmp(const void *a, const void *b)
+{
+    const struct seed_entry *ea = a;
+    const struct seed_entry *eb = b;
+
+    if (ea->key != eb->key) return ea->key < eb->key ? -1 : 1;
+    return ea->idx < eb->idx ? -1 : ea->idx > eb->idx;
+}
+
+static inline size_t
+seed_slot(const struct axe_seed_segment *seg, uint64_t key)
+{
+    return (size_t)((key * UINT64_C(0x9E3779B97F4A7C15)) >> seg->shift);
+}
+
+static inline uint64_t
+seed_segment_key(const struct axe_seed_segment *seg, uint64_t packed)
+{
+    return (packed >> seg->shift_bits) & seg->key_mask;
+}
+
+/* Index segment seg of every barcode, its postings starting at postings */
+static int
+seed_index_segment(struct axe_seed *seed, struct axe_seed_segment *seg,
+                   uint32_t *postings)
+{
+    struct seed_entry *entries = NULL;
+    size_t n_slots = 16;
+    unsigned int bits = 4;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    entries = qes_calloc(seed->n, sizeof(*entries));
+    for (iii = 0; iii < seed->n; iii++) {
+        entries[iii].key = seed_segment_key(seg, seed->barcodes[iii]);
+        entries[iii].idx = iii;
+    }
+    qsort(entries, seed->n, sizeof(*entries), seed_entry_cmp);
+    while (n_slots < 2 * seed->n) {
+        n_slots <<= 1;
+        bits++;
+    }
+    seg->table = qes_calloc(n_slots, sizeof(*seg->table));
+    if (seg->table == NULL) {
+        qes_free(entries);
+        return -1;
+    }
+    seg->mask = n_slots - 1;
+    seg->shift = 64 - bits;
+    for (iii = 0; iii < seed->n; iii = jjj) {
+        size_t slot = 0;
+
+        for (jjj = iii; jjj < seed->n && entries[jjj].key == entries[iii].key;
+                jjj++) {
+            postings[jjj] = entries[jjj].idx;
+        }
+        slot = seed_slot(seg, entries[iii].key);
+        while (seg->table[slot].count > 0) {
+            slot = (slot + 1) & seg->mask;
+        }
+        seg->table[slot].key = entries[iii].key;
+        seg->table[slot].postings = postings + iii;
+        seg->table[slot].count = jjj - iii;
+    }
+    qes_free(entries);
+    return 0;
+}
+
+struct axe_seed *
+axe_seed_create(const Trie *trie, size_t mismatches)
+{
+    struct axe_seed *seed = NULL;
+    struct seed_scan scan;
+    size_t iii = 0;
+
+    if (trie == NULL || mismatches == 0) return NULL;
+    seed = qes_calloc(1, sizeof(*seed));
+    memset(&scan, 0, sizeof(scan));
+    scan.seed = seed;
+    scan.ok = 1;
+    trie_enumerate(trie, seed_scan_key, &scan);
+    if (!scan.ok || scan.n_keys == 0 ||
+            seed->len / (mismatches + 1) < AXE_SEED_MIN_SEGMENT) {
+        goto ineligible;
+    }
+    seed->n = scan.n_keys;
+    seed->mismatches = mismatches;
+    seed->n_segments = mismatches + 1;
+    seed->barcodes = qes_calloc(seed->n, sizeof(*seed->barcodes));
+    seed->values = qes_calloc(seed->n, sizeof(*seed->values));
+    seed->postings = qes_calloc(seed->n * seed->n_segments,
+                                sizeof(*seed->postings));
+    seed->segments = qes_calloc(seed->n_segments, sizeof(*seed->segments));
+    scan.n_keys = 0;
+    trie_enumerate(trie, seed_scan_key, &scan);
+    for (iii = 0; iii < seed->n_segments; iii++) {
+        struct axe_seed_segment *seg = &seed->segments[iii];
+        size_t start = iii * seed->len / seed->n_segments;
+        size_t end = (iii + 1) * seed->len / seed->n_segments;
+
+        seg->shift_bits = 2 * (seed->len - end);
+        seg->key_mask = (UINT64_C(1) << (2 * (end - start))) - 1;
+        if (seed_index_segment(seed, seg,
+                               seed->postings + iii * seed->n) != 0) {
+            goto ineligible;
+        }
+    }
+    return seed;
+
+ineligible:
+    axe_seed_destroy(seed);
+    return NULL;
+}
+
+void
+axe_seed_destroy_(struct axe_seed *seed)
+{
+    size_t iii = 0;
+
+    if (seed != NULL) {
+        if (seed->segments != NULL) {
+            for (iii = 0; iii < seed->n_segments; iii++) {
+                qes_free(seed->segments[iii].table);
+            }
+        }
+        qes_free(seed->segments);
+        qes_free(seed->postings);
+        qes_free(seed->barcodes);
+        qes_free(seed->values);
+        qes_free(seed);
+    }
+}
+
+/* Mismatched bases between two 2-bit packed sequences */
+static inline size_t
+seed_distance(uint64_t a, uint64_t b)
+{
+    uint64_t diff = a ^ b;
+
+    diff = (diff | (diff >> 1)) & UINT64_C(0x5555555555555555);
+    return __builtin_popcountll(diff);
+}
+
+int
+axe_seed_match(const struct axe_seed *seed, const char *seq, size_t len,
+               intptr_t *value)
+{
+    uint64_t packed = 0;
+    size_t best_dist = seed->mismatches + 1;
+    size_t n_best = 0;
+    uint32_t best = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    if (len < seed->len) {
+        return 1;
+    }
+    /* Ns can't be packed, so leave those reads to a search */
+    if (axe_pack_2bit(seq, seed->len, &packed) != 0) {
+        return -1;
+    }
+    for (iii = 0; iii < seed->n_segments; iii++) {
+        const struct axe_seed_segment *seg = &seed->segments[iii];
+        uint64_t key = seed_segment_key(seg, packed);
+        size_t slot = 0;
+
+        for (slot = seed_slot(seg, key); seg->table[slot].count > 0;
+                slot = (slot + 1) & seg->mask) {
+            if (seg->table[slot].key == key) break;
+        }
+        for (jjj = 0; jjj < seg->table[slot].count; jjj++) {
+            uint32_t idx = seg->table[slot].postings[jjj];
+            size_t dist = 0;
+
+            /* Barcodes are often found by more than one segment */
+            if (n_best > 0 && idx == best) continue;
+            dist = seed_distance(packed, seed->barcodes[idx]);
+            /* Beyond the limit, even the closest barcode doesn't match */
+            if (dist > seed->mismatches) continue;
+            if (dist < best_dist) {
+                best_dist = dist;
+                best = idx;
+                n_best = 1;
+            } else if (dist == best_dist) {
+                n_best++;
+            }
+        }
+    }
+    /* As ever, equally close barcodes are ambiguous */
+    if (n_best != 1) {
+        return 1;
+    }
+    *value = seed->values[best];
+    return 0;
+}
@@ -0,0 +1,493 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_simd.c
+ *    Description:  Vector kernels, chosen for the CPU at runtime
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+/* One binary runs on whatever CPU it is given, so each kernel is built for
+ * every instruction set with target attributes, and the best the CPU has is
+ * picked when a kernel is first called. */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#  define SIMD_X86 1
+#  include <immintrin.h>
+#  define SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+static const char *simd_names[AXE_SIMD_COUNT] = {
+    "scalar", "SSE2", "AVX2", "AVX-512",
+};
+
+/* Where lowest is the fewest mismatches within the limit, keep it and count
+ * the barcodes that tie with it */
+static inline void
+ham_update(size_t dist, size_t idx, size_t *best_dist, size_t *best,
+           size_t *n_best)
+{
+    if (dist < *best_dist) {
+        *best_dist = dist;
+        *best = idx;
+        *n_best = 1;
+    } else if (dist == *best_dist && *n_best > 0) {
+        (*n_best)++;
+    }
+}
+
+/* Scalar kernels, which every CPU runs, and the reference for the others */
+
+static int
+pack_2bit_scalar(const char *seq, size_t n, uint64_t *packed)
+{
+    uint64_t val = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii < n; iii++) {
+        uint8_t code = axe_kmer_codes[(unsigned char)seq[iii]];
+
+        if (code == 0) {
+            return -1;
+        }
+        val = (val << 2) | (code - 1);
+    }
+    *packed = val;
+    return 0;
+}
+
+static size_t
+acgt_span_scalar(const char *seq, size_t n)
+{
+    size_t iii = 0;
+
+    for (iii = 0; iii < n; iii++) {
+        if (axe_kmer_codes[(unsigned char)seq[iii]] == 0) {
+            break;
+        }
+    }
+    return iii;
+}
+
+static size_t
+hamming_best_scalar(const struct axe_hamming *ham, const uint8_t *read,
+                    size_t *best)
+{
+    size_t best_dist = ham->mismatches + 1;
+    size_t n_best = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii < ham->n; iii++) {
+        size_t dist = 0;
+        size_t jjj = 0;
+
+        for (jjj = 0; jjj < ham->len; jjj++) {
+            dist += read[jjj] != ham->seqs[iii][jjj];
+        }
+        ham_update(dist, iii, &best_dist, best, &n_best);
+    }
+    return n_best;
+}
+
+#ifdef SIMD_X86
+
+/* Bases are packed by their ASCII codes: bits 1 and 2, xored, give A, C, G
+ * and T as 0 to 3 in either case. Pairs of 2-bit codes, then of 4-bit
+ * codes and of bytes, are shifted together within ever wider lanes, leaving
+ * eight bases in the low 16 bits of each 64-bit lane, first base highest. */
+
+SIMD_TARGET("sse2")
+static inline __m128i
+acgt_mask_sse2(__m128i v)
+{
+    __m128i up = _mm_and_si128(v, _mm_set1_epi8((char)0xDF));
+
+    return _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(up, _mm_set1_epi8('A')),
+                         _mm_cmpeq_epi8(up, _mm_set1_epi8('C'))),
+            _mm_or_si128(_mm_cmpeq_epi8(up, _mm_set1_epi8('G')),
+                         _mm_cmpeq_epi8(up, _mm_set1_epi8('T'))));
+}
+
+/* The 16 bases of v, first base in the top 2 bits */
+SIMD_TARGET("sse2")
+static inline uint32_t
+pack_16_sse2(__m128i v)
+{
+    uint64_t lanes[2];
+    __m128i codes = _mm_and_si128(_mm_xor_si128(_mm_srli_epi16(v, 1),
+                                                _mm_srli_epi16(v, 2)),
+                                  _mm_set1_epi8(3));
+
+    codes = _mm_or_si128(
+            _mm_slli_epi16(_mm_and_si128(codes, _mm_set1_epi16(0xFF)), 2),
+            _mm_srli_epi16(codes, 8));
+    codes = _mm_or_si128(
+            _mm_slli_epi32(_mm_and_si128(codes, _mm_set1_epi32(0xFFFF)), 4),
+            _mm_srli_epi32(codes, 16));
+    codes = _mm_or_si128(
+            _mm_slli_epi64(_mm_and_si128(codes,
+                                         _mm_set1_epi64x(0xFFFFFFFF)), 8),
+            _mm_srli_epi64(codes, 32));
+    _mm_storeu_si128((__m128i *)lanes, codes);
+    return (uint32_t)((lanes[0] & 0xFFFF) << 16 | (lanes[1] & 0xFFFF));
+}
+
+/* Packed bases are read from a copy, as reads may end right after them */
+static inline int
+pack_finish(uint64_t val, uint32_t valid, size_t n, uint64_t *packed)
+{
+    uint32_t need = n < 32 ? (UINT32_C(1) << n) - 1 : UINT32_MAX;
+
+    if ((valid & need) != need) {
+        return -1;
+    }
+    *packed = n > 0 ? val >> (64 - 2 * n) : 0;
+    return 0;
+}
+
+SIMD_TARGET("sse2")
+static int
+pack_2bit_sse2(const char *seq, size_t n, uint64_t *packed)
+{
+    uint8_t buf[32] = {0};
+    uint64_t val = 0;
+    uint32_t valid = 0;
+    __m128i v;
+
+    if (n > 32) return -1;
+    memcpy(buf, seq, n);
+    v = _mm_loadu_si128((const __m128i *)buf);
+    valid = (uint32_t)_mm_movemask_epi8(acgt_mask_sse2(v));
+    val = (uint64_t)pack_16_sse2(v) << 32;
+    if (n > 16) {
+        v = _mm_loadu_si128((const __m128i *)(buf + 16));
+        valid |= (uint32_t)_mm_movemask_epi8(acgt_mask_sse2(v)) << 16;
+        val |= pack_16_sse2(v);
+    }
+    return pack_finish(val, valid, n, packed);
+}
+
+SIMD_TARGET("sse2")
+static size_t
+acgt_span_sse2(const char *seq, size_t n)
+{
+    size_t iii = 0;
+
+    for (iii = 0; iii + 16 <= n; iii += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(seq + iii));
+        uint32_t valid = (uint32_t)_mm_movemask_epi8(acgt_mask_sse2(v));
+
+        if (valid != 0xFFFF) {
+            return iii + __builtin_ctz(~valid);
+        }
+    }
+    return iii + acgt_span_scalar(seq + iii, n - iii);
+}
+
+SIMD_TARGET("sse2")
+static inline size_t
+ham_dist_sse2(__m128i read, const uint8_t *bcd, uint32_t len_mask)
+{
+    __m128i b = _mm_loadu_si128((const __m128i *)bcd);
+    uint32_t diff = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(read, b));
+
+    return __builtin_popcount(diff & len_mask);
+}
+
+SIMD_TARGET("sse2")
+static size_t
+hamming_best_sse2(const struct axe_hamming *ham, const uint8_t *read,
+                  size_t *best)
+{
+    __m128i r = _mm_loadu_si128((const __m128i *)read);
+    size_t best_dist = ham->mismatches + 1;
+    size_t n_best = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii < ham->n; iii++) {
+        ham_update(ham_dist_sse2(r, ham->seqs[iii], ham->len_mask), iii,
+                   &best_dist, best, &n_best);
+    }
+    return n_best;
+}
+
+SIMD_TARGET("avx2")
+static inline __m256i
+acgt_mask_avx2(__m256i v)
+{
+    __m256i up = _mm256_and_si256(v, _mm256_set1_epi8((char)0xDF));
+
+    return _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(up, _mm256_set1_epi8('A')),
+                            _mm256_cmpeq_epi8(up, _mm256_set1_epi8('C'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(up, _mm256_set1_epi8('G')),
+                            _mm256_cmpeq_epi8(up, _mm256_set1_epi8('T'))));
+}
+
+SIMD_TARGET("avx2")
+static int
+pack_2bit_avx2(const char *seq, size_t n, uint64_t *packed)
+{
+    uint8_t buf[32] = {0};
+    uint64_t lanes[4];
+    uint32_t valid = 0;
+    __m256i v;
+    __m256i codes;
+
+    if (n > 32) return -1;
+    memcpy(buf, seq, n);
+    v = _mm256_loadu_si256((const __m256i *)buf);
+    valid = (uint32_t)_mm256_movemask_epi8(acgt_mask_avx2(v));
+    codes = _mm256_and_si256(_mm256_xor_si256(_mm256_srli_epi16(v, 1),
+                                              _mm256_srli_epi16(v, 2)),
+                             _mm256_set1_epi8(3));
+    codes = _mm256_or_si256(
+            _mm256_slli_epi16(_mm256_and_si256(codes,
+                                               _mm256_set1_epi16(0xFF)), 2),
+            _mm256_srli_epi16(codes, 8));
+    codes = _mm256_or_si256(
+            _mm256_slli_epi32(_mm256_and_si256(codes,
+                                               _mm256_set1_epi32(0xFFFF)), 4),
+            _mm256_srli_epi32(codes, 16));
+    codes = _mm256_or_si256(
+            _mm256_slli_epi64(_mm256_and_si256(
+                    codes, _mm256_set1_epi64x(0xFFFFFFFF)), 8),
+            _mm256_srli_epi64(codes, 32));
+    _mm256_storeu_si256((__m256i *)lanes, codes);
+    return pack_finish((lanes[0] & 0xFFFF) << 48 | (lanes[1] & 0xFFFF) << 32 |
+                       (lanes[2] & 0xFFFF) << 16 | (lanes[3] & 0xFFFF),
+                       valid, n, packed);
+}
+
+SIMD_TARGET("avx2")
+static size_t
+acgt_span_avx2(const char *seq, size_t n)
+{
+    size_t iii = 0;
+
+    for (iii = 0; iii + 32 <= n; iii += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(seq + iii));
+        uint32_t valid = (uint32_t)_mm256_movemask_epi8(acgt_mask_avx2(v));
+
+        if (valid != UINT32_MAX) {
+            return iii + __builtin_ctz(~valid);
+        }
+    }
+    return iii + acgt_span_sse2(seq + iii, n - iii);
+}
+
+/* Barcodes are 16 bytes apart, so two are compared at once */
+SIMD_TARGET("avx2,popcnt")
+static size_t
+hamming_best_avx2(const struct axe_hamming *ham, const uint8_t *read,
+                  size_t *best)
+{
+    __m128i r = _mm_loadu_si128((const __m128i *)read);
+    __m256i r2 = _mm256_broadcastsi128_si256(r);
+    size_t best_dist = ham->mismatches + 1;
+    size_t n_best = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii + 2 <= ham->n; iii += 2) {
+        __m256i b = _mm256_loadu_si256((const __m256i *)ham->seqs[iii]);
+        uint32_t diff = ~(uint32_t)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(r2, b));
+
+        ham_update(__builtin_popcount(diff & ham->len_mask), iii,
+                   &best_dist, best, &n_best);
+        ham_update(__builtin_popcount((diff >> 16) & ham->len_mask), iii + 1,
+                   &best_dist, best, &n_best);
+    }
+    if (iii < ham->n) {
+        ham_update(ham_dist_sse2(r, ham->seqs[iii], ham->len_mask), iii,
+                   &best_dist, best, &n_best);
+    }
+    return n_best;
+}
+
+SIMD_TARGET("avx512f,avx512bw")
+static inline __mmask64
+acgt_mask_avx512(__m512i v)
+{
+    __m512i up = _mm512_and_si512(v, _mm512_set1_epi8((char)0xDF));
+
+    return _mm512_cmpeq_epi8_mask(up, _mm512_set1_epi8('A')) |
+           _mm512_cmpeq_epi8_mask(up, _mm512_set1_epi8('C')) |
+           _mm512_cmpeq_epi8_mask(up, _mm512_set1_epi8('G')) |
+           _mm512_cmpeq_epi8_mask(up, _mm512_set1_epi8('T'));
+}
+
+/* Masked loads don't touch the bytes past n, so no copy is needed */
+SIMD_TARGET("avx512f,avx512bw")
+static size_t
+acgt_span_avx512(const char *seq, size_t n)
+{
+    size_t iii = 0;
+
+    for (iii = 0; iii < n; iii += 64) {
+        size_t left = n - iii;
+        __mmask64 want = left < 64 ? (UINT64_C(1) << left) - 1 : UINT64_MAX;
+        __m512i v = _mm512_maskz_loadu_epi8(want, seq + iii);
+        __mmask64 bad = ~acgt_mask_avx512(v) & want;
+
+        if (bad != 0) {
+            return iii + __builtin_ctzll(bad);
+        }
+    }
+    return n;
+}
+
+/* Four barcodes at once */
+SIMD_TARGET("avx512f,avx512bw,popcnt")
+static size_t
+hamming_best_avx512(const struct axe_hamming *ham, const uint8_t *read,
+                    size_t *best)
+{
+    uint8_t reads[4 * AXE_HAMMING_MAX_LEN];
+    __m128i r = _mm_loadu_si128((const __m128i *)read);
+    __m512i r4;
+    size_t best_dist = ham->mismatches + 1;
+    size_t n_best = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    for (jjj = 0; jjj < 4; jjj++) {
+        memcpy(reads + jjj * AXE_HAMMING_MAX_LEN, read, AXE_HAMMING_MAX_LEN);
+    }
+    r4 = _mm512_loadu_si512((const void *)reads);
+
+    for (iii = 0; iii + 4 <= ham->n; iii += 4) {
+        __m512i b = _mm512_loadu_si512((const void *)ham->seqs[iii]);
+        uint64_t diff = ~(uint64_t)_mm512_cmpeq_epi8_mask(r4, b);
+
+        for (jjj = 0; jjj < 4; jjj++) {
+            ham_update(__builtin_popcount((uint32_t)(diff >> (16 * jjj)) &
+                                          ham->len_mask),
+                       iii + jjj, &best_dist, best, &n_best);
+        }
+    }
+    for (; iii < ham->n; iii++) {
+        ham_update(ham_dist_sse2(r, ham->seqs[iii], ham->len_mask), iii,
+                   &best_dist, best, &n_best);
+    }
+    return n_best;
+}
+
+#endif /* SIMD_X86 */
+
+/* Kernels for each level. Wider vectors gain nothing when packing at most
+ * 32 bases, so AVX-512 packs as AVX2 does. */
+static const struct axe_simd_kernels simd_kernels[AXE_SIMD_COUNT] = {
+    {pack_2bit_scalar, acgt_span_scalar, hamming_best_scalar},
+#ifdef SIMD_X86
+    {pack_2bit_sse2, acgt_span_sse2, hamming_best_sse2},
+    {pack_2bit_avx2, acgt_span_avx2, hamming_best_avx2},
+    {pack_2bit_avx2, acgt_span_avx512, hamming_best_avx512},
+#endif
+};
+
+static enum axe_simd simd_current = AXE_SIMD_SCALAR;
+
+static void simd_resolve(void);
+
+/* Until a level is chosen, each kernel chooses the best, then calls it */
+static int
+pack_2bit_resolve(const char *seq, size_t n, uint64_t *packed)
+{
+    simd_resolve();
+    return axe_simd.pack_2bit(seq, n, packed);
+}
+
+static size_t
+acgt_span_resolve(const char *seq, size_t n)
+{
+    simd_resolve();
+    return axe_simd.acgt_span(seq, n);
+}
+
+static size_t
+hamming_best_resolve(const struct axe_hamming *ham, const uint8_t *read,
+                     size_t *best)
+{
+    simd_resolve();
+    return axe_simd.hamming_best(ham, read, best);
+}
+
+struct axe_simd_kernels axe_simd = {
+    pack_2bit_resolve, acgt_span_resolve, hamming_best_resolve,
+};
+
+static void
+simd_resolve(void)
+{
+    axe_simd_set(axe_simd_detect());
+}
+
+enum axe_simd
+axe_simd_detect(void)
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") &&
+            __builtin_cpu_supports("avx512bw") &&
+            __builtin_cpu_supports("popcnt")) {
+        return AXE_SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        return AXE_SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return AXE_SIMD_SSE2;
+    }
+#endif
+    return AXE_SIMD_SCALAR;
+}
+
+int
+axe_simd_set(enum axe_simd level)
+{
+    if ((size_t)level >= AXE_SIMD_COUNT) {
+        return -1;
+    }
+    if (level > axe_simd_detect()) {
+        return 1;
+    }
+    axe_simd = simd_kernels[level];
+    simd_current = level;
+    return 0;
+}
+
+enum axe_simd
+axe_simd_level(void)
+{
+    if (axe_simd.pack_2bit == pack_2bit_resolve) {
+        simd_resolve();
+    }
+    return simd_current;
+}
+
+const char *
+axe_simd_name(enum axe_simd level)
+{
+    if ((size_t)level >= AXE_SIMD_COUNT) {
+        return "unknown";
+    }
+    return simd_names[level];
+}
@@ -0,0 +1,148 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_top.c
+ *    Description:  Dense table of the first levels of a frozen trie
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+/* Shortest key, and whether all data fit an entry */
+struct top_scan {
+    size_t min_len;
+    int ok;
+};
+
+static bool
+top_scan_key(const AlphaChar *key, TrieData data, void *user_data)
+{
+    struct top_scan *scan = user_data;
+    size_t len = strlen(key);
+
+    if (data < 0 || data > INT32_MAX) {
+        scan->ok = 0;
+        return false;
+    }
+    if (scan->min_len == 0 || len < scan->min_len) {
+        scan->min_len = len;
+    }
+    return true;
+}
+
+/* Fill the entries below index idx, at depth bases from the root */
+static void
+top_fill(struct axe_top *top, const FrozenTrie *ft, FrozenTrieState state,
+         size_t depth, size_t idx, int32_t value)
+{
+    size_t span = 1;
+    size_t iii = 0;
+
+    if (depth == top->depth) {
+        top->table[idx].state = state;
+        top->table[idx].value = value;
+        return;
+    }
+    for (iii = depth + 1; iii < top->depth; iii++) {
+        span *= top->radix;
+    }
+    for (iii = 0; iii < top->radix; iii++) {
+        size_t child = idx * top->radix + iii;
+        FrozenTrieState next;
+        int32_t next_value = value;
+        TrieData data;
+        size_t jjj = 0;
+
+        next = frozen_trie_walk_tc(ft, state, (TrieChar)(iii + 1));
+        if (next == FROZEN_TRIE_STATE_FAIL) {
+            /* Every read below here stops walking at this base */
+            for (jjj = child * span; jjj < (child + 1) * span; jjj++) {
+                top->table[jjj].state = FROZEN_TRIE_STATE_FAIL;
+                top->table[jjj].value = value;
+            }
+            continue;
+        }
+        if (frozen_trie_get_terminal_data(ft, next, &data)) {
+            next_value = (int32_t)data;
+        }
+        top_fill(top, ft, next, depth + 1, child, next_value);
+    }
+}
+
+struct axe_top *
+axe_top_create(const Trie *trie, const FrozenTrie *ft, size_t max_bytes)
+{
+    struct axe_top *top = NULL;
+    struct top_scan scan;
+    size_t radix = 0;
+    size_t n_entries = 1;
+    size_t depth = 0;
+    size_t iii = 0;
+
+    if (trie == NULL || ft == NULL) return NULL;
+    memset(&scan, 0, sizeof(scan));
+    scan.ok = 1;
+    trie_enumerate(trie, top_scan_key, &scan);
+    if (!scan.ok || scan.min_len == 0) {
+        return NULL;
+    }
+    /* Trie codes run from 1 to the alphabet size */
+    for (iii = 0; iii <= UCHAR_MAX; iii++) {
+        TrieIndex tc = ft->alpha_to_trie[iii];
+
+        if (tc != TRIE_INDEX_MAX && (size_t)tc > radix) {
+            radix = tc;
+        }
+    }
+    if (radix < 2) {
+        return NULL;
+    }
+    /* As deep as memory allows, but reads shorter than the shortest key
+     * can't be looked up in the table */
+    while (depth < scan.min_len &&
+            n_entries * radix * sizeof(struct axe_top_entry) <= max_bytes) {
+        n_entries *= radix;
+        depth++;
+    }
+    if (depth < AXE_TOP_MIN_DEPTH) {
+        return NULL;
+    }
+    top = qes_calloc(1, sizeof(*top));
+    top->table = qes_malloc(n_entries * sizeof(*top->table));
+    if (top->table == NULL) {
+        axe_top_destroy(top);
+        return NULL;
+    }
+    top->depth = depth;
+    top->radix = radix;
+    top->bytes = n_entries * sizeof(*top->table);
+    top_fill(top, ft, FROZEN_TRIE_STATE_ROOT, 0, 0, -1);
+    return top;
+}
+
+void
+axe_top_destroy_(struct axe_top *top)
+{
+    if (top != NULL) {
+        if (!top->mapped) {
+            qes_free(top->table);
+        }
+        qes_free(top);
+    }
+}
@@ -0,0 +1,232 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_tune.c
+ *    Description:  Choose between engines by timing them on reads
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+/* axe_trie_freeze guesses at the fastest engine from the size of its tables.
+ * Which is fastest really depends on the machine's caches and on the reads,
+ * so the engines can instead be raced on a sample of them. */
+
+static const char *engine_names[AXE_ENGINE_COUNT] = {
+    "trie", "kmer", "hash", "hamming", "search", "seed", "edit", "dawg",
+};
+
+const char *
+axe_engine_name(enum axe_engine engine)
+{
+    if ((size_t)engine >= AXE_ENGINE_COUNT) {
+        return "unknown";
+    }
+    return engine_names[engine];
+}
+
+int
+axe_engine_parse(const char *name, enum axe_engine *engine)
+{
+    size_t iii = 0;
+
+    if (name == NULL || engine == NULL) return -1;
+    for (iii = 0; iii < AXE_ENGINE_COUNT; iii++) {
+        if (strcmp(name, engine_names[iii]) == 0) {
+            *engine = (enum axe_engine)iii;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+#define ENGINE_BIT(engine) (1u << (engine))
+
+unsigned int
+axe_trie_engines(const struct axe_trie *trie)
+{
+    if (trie == NULL || trie->frozen == NULL || trie->window != NULL) {
+        return 0;
+    }
+    /* The index holds the tables of one engine alone */
+    if (trie->mapped) {
+        return ENGINE_BIT(trie->engine);
+    }
+    if (trie->edit) {
+        return ENGINE_BIT(AXE_ENGINE_EDIT);
+    }
+    /* The trie holds the exact barcodes, which may be compared to reads one
+     * by one or searched for. Barcodes the Hamming engine takes never tie,
+     * so all agree. */
+    if (trie->hamming != NULL) {
+        return ENGINE_BIT(AXE_ENGINE_HAMMING) | ENGINE_BIT(AXE_ENGINE_SEARCH) |
+               ENGINE_BIT(AXE_ENGINE_SEED);
+    }
+    if (trie->search) {
+        return ENGINE_BIT(AXE_ENGINE_SEARCH) | ENGINE_BIT(AXE_ENGINE_SEED);
+    }
+    return ENGINE_BIT(AXE_ENGINE_TRIE) | ENGINE_BIT(AXE_ENGINE_KMER) |
+           ENGINE_BIT(AXE_ENGINE_HASH) | ENGINE_BIT(AXE_ENGINE_DAWG);
+}
+
+enum axe_engine
+axe_trie_reference_engine(const struct axe_trie *trie)
+{
+    if (trie == NULL) return AXE_ENGINE_COUNT;
+    if (trie->mapped) return trie->engine;
+    if (trie->edit) return AXE_ENGINE_EDIT;
+    /* Tries of exact barcodes are searched; those of mutants, walked */
+    if (trie->hamming != NULL || trie->search) return AXE_ENGINE_SEARCH;
+    return AXE_ENGINE_TRIE;
+}
+
+/* Build the tables engine needs, if they aren't already. Returns 0, or 1 if
+ * the keys don't suit it. */
+static int
+engine_build(struct axe_trie *trie, enum axe_engine engine)
+{
+    switch (engine) {
+    case AXE_ENGINE_TRIE:
+        /* The trie works without its table, if that would be too shallow */
+        if (trie->top == NULL) {
+            trie->top = axe_top_create(trie->trie, trie->frozen,
+                                       AXE_TOP_MAX_BYTES);
+        }
+        return 0;
+    case AXE_ENGINE_KMER:
+        if (trie->kmer == NULL) {
+            trie->kmer = axe_kmer_create(trie->trie, AXE_KMER_MAX_BYTES);
+        }
+        return trie->kmer != NULL ? 0 : 1;
+    case AXE_ENGINE_HASH:
+        if (trie->hash == NULL) {
+            trie->hash = axe_hash_create(trie->trie);
+        }
+        return trie->hash != NULL ? 0 : 1;
+    case AXE_ENGINE_SEED:
+        if (trie->seed == NULL) {
+            trie->seed = axe_seed_create(trie->trie, trie->mismatch_level);
+        }
+        return trie->seed != NULL ? 0 : 1;
+    case AXE_ENGINE_DAWG:
+        if (trie->dawg == NULL) {
+            trie->dawg = axe_dawg_create(trie->trie, trie->frozen);
+        }
+        return trie->dawg != NULL ? 0 : 1;
+    case AXE_ENGINE_HAMMING:
+        /* Made from the barcodes when the trie is loaded, or not at all */
+        return trie->hamming != NULL ? 0 : 1;
+    case AXE_ENGINE_SEARCH:
+    case AXE_ENGINE_EDIT:
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+int
+axe_trie_set_engine(struct axe_trie *trie, enum axe_engine engine)
+{
+    if (!axe_trie_ok(trie) || (size_t)engine >= AXE_ENGINE_COUNT) {
+        return -1;
+    }
+    if (trie->mapped) {
+        return engine == trie->engine ? 0 : 1;
+    }
+    if (!(axe_trie_engines(trie) & ENGINE_BIT(engine)) ||
+            engine_build(trie, engine) != 0) {
+        return 1;
+    }
+    if (engine != AXE_ENGINE_TRIE) axe_top_destroy(trie->top);
+    if (engine != AXE_ENGINE_KMER) axe_kmer_destroy(trie->kmer);
+    if (engine != AXE_ENGINE_HASH) axe_hash_destroy(trie->hash);
+    if (engine != AXE_ENGINE_SEED) axe_seed_destroy(trie->seed);
+    if (engine != AXE_ENGINE_DAWG) axe_dawg_destroy(trie->dawg);
+    trie->engine = engine;
+    return 0;
+}
+
+int
+axe_trie_tune(struct axe_trie *trie, struct qes_seq *const *seqs, size_t n,
+              struct axe_tune *tune)
+{
+    ssize_t expect[AXE_TUNE_CHUNK];
+    ssize_t results[AXE_TUNE_CHUNK];
+    uint8_t differs[AXE_TUNE_CHUNK];
+    enum axe_engine engines[AXE_ENGINE_COUNT];
+    enum axe_engine engine = trie != NULL ? trie->engine : AXE_ENGINE_TRIE;
+    struct axe_filter *filter = NULL;
+    struct axe_cache *cache = NULL;
+    size_t n_engines = 0;
+    size_t start = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    if (!axe_trie_ok(trie) || seqs == NULL || tune == NULL) {
+        return -1;
+    }
+    if (tune->engines == 0) {
+        for (iii = 0; iii < AXE_ENGINE_COUNT; iii++) {
+            if ((axe_trie_engines(trie) & ENGINE_BIT(iii)) &&
+                    engine_build(trie, (enum axe_engine)iii) == 0) {
+                tune->engines |= ENGINE_BIT(iii);
+            }
+        }
+    }
+    for (iii = 0; iii < AXE_ENGINE_COUNT; iii++) {
+        if (tune->engines & ENGINE_BIT(iii)) {
+            engines[n_engines++] = (enum axe_engine)iii;
+        }
+    }
+    /* Time the engines alone. The filter and cache would spare them the
+     * same reads whichever is used. */
+    memset(differs, 0, sizeof(differs));
+    filter = trie->filter;
+    cache = trie->cache;
+    trie->filter = NULL;
+    trie->cache = NULL;
+    for (start = 0; start < n; start += AXE_TUNE_CHUNK) {
+        size_t len = n - start < AXE_TUNE_CHUNK ? n - start : AXE_TUNE_CHUNK;
+
+        for (iii = 0; iii < n_engines; iii++) {
+            /* Going first brings the reads into cache for the others, so
+             * each engine takes a turn at it */
+            enum axe_engine next = engines[(iii + tune->rounds) % n_engines];
+            clock_t begin = clock();
+
+            trie->engine = next;
+            axe_match_batch(trie, seqs + start, len,
+                            iii == 0 ? expect : results);
+            tune->seconds[next] += (double)(clock() - begin) / CLOCKS_PER_SEC;
+            for (jjj = 0; iii > 0 && jjj < len; jjj++) {
+                differs[jjj] |= results[jjj] != expect[jjj];
+            }
+        }
+        for (jjj = 0; jjj < len; jjj++) {
+            tune->disagreed += differs[jjj];
+            differs[jjj] = 0;
+        }
+        tune->rounds++;
+        tune->reads += len;
+    }
+    trie->engine = engine;
+    trie->filter = filter;
+    trie->cache = cache;
+    return tune->disagreed > 0 ? 1 : 0;
+}
@@ -0,0 +1,367 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  axe_window.c
+ *    Description:  Aho-Corasick automaton of barcodes and their mutants
+ *      Copyright:  2014-2015 Kevin Murray <spam@kdmurray.id.au>
+ *        License:  GNU GPL v3+
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================================
+ */
+
+#include "axe.h"
+
+/* Every key of the trie is a barcode or one of its mutants. They are built
+ * into a trie of their own, whose missing transitions are then filled in
+ * from the failure links, giving a DFA that finds every key ending at each
+ * base of the read in one pass. */
+
+struct window_build {
+    struct axe_window *window;
+    const FrozenTrie *ft;
+    size_t cap;         /* of states */
+    int ok;
+};
+
+/* A new state with no transitions, or 0 when out of memory */
+static uint32_t
+window_add_state(struct window_build *build)
+{
+    struct axe_window *window = build->window;
+
+    if (window->n_states == build->cap) {
+        size_t cap = build->cap * 2;
+        uint32_t *next = qes_realloc(window->next,
+                                     cap * window->radix * sizeof(*next));
+        struct axe_window_state *states = NULL;
+
+        if (next == NULL) return 0;
+        window->next = next;
+        states = qes_realloc(window->states, cap * sizeof(*states));
+        if (states == NULL) return 0;
+        window->states = states;
+        build->cap = cap;
+    }
+    memset(window->next + window->n_states * window->radix, 0,
+           window->radix * sizeof(*window->next));
+    memset(&window->states[window->n_states], 0,
+           sizeof(*window->states));
+    window->states[window->n_states].value = -1;
+    return window->n_states++;
+}
+
+/* The exact barcode a key was made from, by its value */
+static const struct axe_window_barcode *
+window_barcode(const struct axe_window *window, TrieData data)
+{
+    size_t iii = 0;
+
+    for (iii = 0; iii < window->n_barcodes; iii++) {
+        if (window->barcodes[iii].value == data) {
+            return &window->barcodes[iii];
+        }
+    }
+    return NULL;
+}
+
+static bool
+window_add_key(const AlphaChar *key, TrieData data, void *user_data)
+{
+    struct window_build *build = user_data;
+    struct axe_window *window = build->window;
+    const struct axe_window_barcode *barcode = NULL;
+    struct axe_window_state *state = NULL;
+    size_t len = strlen(key);
+    uint32_t cur = 0;
+    size_t dist = 0;
+    size_t iii = 0;
+
+    barcode = window_barcode(window, data);
+    if (barcode == NULL || len != barcode->len || data > INT32_MAX) {
+        build->ok = 0;
+        return false;
+    }
+    for (iii = 0; iii < len; iii++) {
+        TrieIndex tc = frozen_trie_char_to_trie(build->ft, key[iii]);
+        uint32_t *next = NULL;
+
+        if (tc == TRIE_INDEX_MAX) {
+            build->ok = 0;
+            return false;
+        }
+        dist += tc != barcode->codes[iii];
+        next = &window->next[cur * window->radix + tc - 1];
+        if (*next == 0) {
+            uint32_t added = window_add_state(build);
+
+            if (added == 0) {
+                build->ok = 0;
+                return false;
+            }
+            /* The tables may have moved */
+            window->next[cur * window->radix + tc - 1] = added;
+            window->states[added].len = iii + 1;
+            cur = added;
+        } else {
+            cur = *next;
+        }
+    }
+    state = &window->states[cur];
+    state->value = (int32_t)data;
+    state->dist = dist;
+    if (len > window->max_len) {
+        window->max_len = len;
+    }
+    return true;
+}
+
+/* Breadth first, so that each state's failure state is done before it */
+static int
+window_link(struct axe_window *window)
+{
+    uint32_t *queue = NULL;
+    uint32_t *fail = NULL;
+    size_t head = 0;
+    size_t tail = 0;
+    size_t iii = 0;
+
+    queue = qes_calloc(window->n_states, sizeof(*queue));
+    fail = qes_calloc(window->n_states, sizeof(*fail));
+    if (queue == NULL || fail == NULL) {
+        qes_free(queue);
+        qes_free(fail);
+        return 1;
+    }
+    for (iii = 0; iii < window->radix; iii++) {
+        if (window->next[iii] != 0) {
+            queue[tail++] = window->next[iii];
+        }
+    }
+    while (head < tail) {
+        uint32_t cur = queue[head++];
+        uint32_t *next = &window->next[cur * window->radix];
+        const uint32_t *fail_next = &window->next[fail[cur] * window->radix];
+
+        for (iii = 0; iii < window->radix; iii++) {
+            uint32_t child = next[iii];
+
+            if (child == 0 || window->states[child].len <=
+                    window->states[cur].len) {
+                next[iii] = fail_next[iii];
+                continue;
+            }
+            fail[child] = fail_next[iii];
+            /* The next shorter key ending here */
+            window->states[child].out =
+                    window->states[fail[child]].value >= 0
+                    ? fail[child] : window->states[fail[child]].out;
+            queue[tail++] = child;
+        }
+    }
+    qes_free(queue);
+    qes_free(fail);
+    return 0;
+}
+
+struct axe_window *
+axe_window_create(const Trie *trie, const FrozenTrie *ft, char *const *seqs,
+                  const intptr_t *values, size_t n, size_t mismatches,
+                  size_t width)
+{
+    struct axe_window *window = NULL;
+    struct window_build build;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    if (trie == NULL || ft == NULL || seqs == NULL || values == NULL ||
+            n == 0 || width == 0 || width > AXE_WINDOW_MAX_WIDTH) {
+        return NULL;
+    }
+    window = qes_calloc(1, sizeof(*window));
+    window->width = width;
+    window->mismatches = mismatches;
+    /* Trie codes run from 1 to the alphabet size */
+    for (iii = 0; iii <= UCHAR_MAX; iii++) {
+        TrieIndex tc = ft->alpha_to_trie[iii];
+
+        if (tc != TRIE_INDEX_MAX && (size_t)tc > window->radix) {
+            window->radix = tc;
+        }
+    }
+    window->barcodes = qes_calloc(n, sizeof(*window->barcodes));
+    window->n_barcodes = n;
+    for (iii = 0; iii < n; iii++) {
+        struct axe_window_barcode *barcode = &window->barcodes[iii];
+
+        barcode->len = strlen(seqs[iii]);
+        if (barcode->len > AXE_SEARCH_MAX_LEN || values[iii] < 0 ||
+                values[iii] > INT32_MAX) {
+            goto error;
+        }
+        barcode->value = (int32_t)values[iii];
+        for (jjj = 0; jjj < barcode->len; jjj++) {
+            barcode->codes[jjj] = frozen_trie_char_to_trie(ft, seqs[iii][jjj]);
+        }
+    }
+    memset(&build, 0, sizeof(build));
+    build.window = window;
+    build.ft = ft;
+    build.cap = 1024;
+    build.ok = 1;
+    window->next = qes_malloc(build.cap * window->radix *
+                              sizeof(*window->next));
+    window->states = qes_malloc(build.cap * sizeof(*window->states));
+    if (window->next == NULL || window->states == NULL) {
+        goto error;
+    }
+    window_add_state(&build);
+    trie_enumerate(trie, window_add_key, &build);
+    if (!build.ok || window_link(window) != 0) {
+        goto error;
+    }
+    window->bytes = window->n_states * (window->radix * sizeof(*window->next)
+                                        + sizeof(*window->states));
+    return window;
+
+error:
+    axe_window_destroy(window);
+    return NULL;
+}
+
+void
+axe_window_destroy_(struct axe_window *window)
+{
+    if (window != NULL) {
+        qes_free(window->next);
+        qes_free(window->states);
+        qes_free(window->barcodes);
+        qes_free(window);
+    }
+}
+
+/* The closest hit wins, then the leftmost, then the longest */
+struct window_hit {
+    size_t dist;
+    size_t start;
+    size_t len;
+    int32_t value;
+    size_t n;       /* Hits this good */
+};
+
+static inline void
+window_hit(struct window_hit *best, size_t dist, size_t start, size_t len,
+           int32_t value)
+{
+    if (best->n == 0 || dist < best->dist ||
+            (dist == best->dist && (start < best->start ||
+                                    (start == best->start &&
+                                     len > best->len)))) {
+        best->dist = dist;
+        best->start = start;
+        best->len = len;
+        best->value = value;
+        best->n = 1;
+    } else if (dist == best->dist && start == best->start &&
+            len == best->len && value != best->value) {
+        best->n++;
+    }
+}
+
+/* Bases the mutants lack are compared to each barcode at each offset,
+ * counting as mismatches as axe_search_match has it */
+static void
+window_brute_force(const struct axe_window *window, const FrozenTrie *ft,
+                   const char *seq, size_t len, struct window_hit *best)
+{
+    TrieIndex codes[AXE_WINDOW_MAX_WIDTH];
+    size_t start = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    for (iii = 0; iii < len; iii++) {
+        codes[iii] = frozen_trie_char_to_trie(ft, seq[iii]);
+    }
+    for (start = 0; start < len; start++) {
+        for (iii = 0; iii < window->n_barcodes; iii++) {
+            const struct axe_window_barcode *barcode = &window->barcodes[iii];
+            size_t dist = 0;
+
+            if (start + barcode->len > len) continue;
+            for (jjj = 0; jjj < barcode->len; jjj++) {
+                dist += codes[start + jjj] != barcode->codes[jjj];
+                if (dist > window->mismatches) break;
+            }
+            if (dist <= window->mismatches) {
+                window_hit(best, dist, start, barcode->len, barcode->value);
+            }
+        }
+    }
+}
+
+/* Walk the read through the automaton, taking every key that ends at each
+ * base */
+static void
+window_scan(const struct axe_window *window, const FrozenTrie *ft,
+            const char *seq, size_t len, struct window_hit *best)
+{
+    uint32_t cur = 0;
+    size_t iii = 0;
+
+    for (iii = 0; iii < len; iii++) {
+        TrieIndex tc = frozen_trie_char_to_trie(ft, seq[iii]);
+        uint32_t hit = 0;
+
+        cur = tc == TRIE_INDEX_MAX
+                ? 0 : window->next[cur * window->radix + tc - 1];
+        hit = window->states[cur].value >= 0 ? cur : window->states[cur].out;
+        for (; hit != 0; hit = window->states[hit].out) {
+            const struct axe_window_state *state = &window->states[hit];
+
+            window_hit(best, state->dist, iii + 1 - state->len, state->len,
+                       state->value);
+        }
+        /* No later exact hit can start as far left */
+        if (best->n > 0 && best->dist == 0 &&
+                iii + 2 > best->start + window->max_len) {
+            break;
+        }
+    }
+}
+
+int
+axe_window_match(const struct axe_window *window, const FrozenTrie *ft,
+                 const char *seq, size_t len, intptr_t *value, size_t *end)
+{
+    struct window_hit best;
+
+    memset(&best, 0, sizeof(best));
+    if (len > window->width) {
+        len = window->width;
+    }
+    if (axe_acgt_span(seq, len) < len && window->mismatches > 0) {
+        window_brute_force(window, ft, seq, len, &best);
+    } else {
+        window_scan(window, ft, seq, len, &best);
+    }
+    if (best.n != 1) {
+        return 1;
+    }
+    *value = best.value;
+    if (end != NULL) {
+        *end = best.start + best.len;
+    }
+    return 0;
+}
@@ -30,11 +30,57 @@
 #include <stdio.h>
 #include "alpha-map.h"
 
-TrieIndex   alpha_map_char_to_trie (const AlphaMap *alpha_map,
-                                    AlphaChar       ac);
+/**
+ * @brief Number of distinct AlphaChar values, i.e. lookup table size
+ */
+#define ALPHA_MAP_TABLE_SIZE  (UCHAR_MAX + 1)
+
+/**
+ * @brief AlphaMap structure
+ *
+ * Besides the range list, which defines the map, we keep a pair of lookup
+ * tables that are recalculated whenever the map changes. These make the
+ * per-character conversions on trie walks a single array access, instead of
+ * a scan through the range list.
+ */
+struct _AlphaMap {
+    struct _AlphaRange *first_range;
+    /** Target of each alias, or 0 if the character is not an alias */
+    AlphaChar           alias_to_alpha[ALPHA_MAP_TABLE_SIZE];
+
+    /** AlphaChar to TrieChar, TRIE_INDEX_MAX if not in the map */
+    TrieIndex           alpha_to_trie_map[ALPHA_MAP_TABLE_SIZE];
+    /** TrieChar to AlphaChar, ALPHA_CHAR_ERROR if not in the map */
+    AlphaChar           trie_to_alpha_map[TRIE_CHAR_MAX + 1];
+};
+
+/**
+ * @brief Map an alphabet character to a trie character
+ *
+ * @param alpha_map : the alphabet map
+ * @param ac        : the alphabet character
+ *
+ * @return the trie character, or TRIE_INDEX_MAX if @a ac is not in the map
+ */
+static inline TrieIndex
+alpha_map_char_to_trie (const AlphaMap *alpha_map, AlphaChar ac)
+{
+    return alpha_map->alpha_to_trie_map[(unsigned char) ac];
+}
 
-AlphaChar   alpha_map_trie_to_char (const AlphaMap *alpha_map,
-                                    TrieChar        tc);
+/**
+ * @brief Map a trie character back to an alphabet character
+ *
+ * @param alpha_map : the alphabet map
+ * @param tc        : the trie character
+ *
+ * @return the alphabet character, or ALPHA_CHAR_ERROR if @a tc is not used
+ */
+static inline AlphaChar
+alpha_map_trie_to_char (const AlphaMap *alpha_map, TrieChar tc)
+{
+    return alpha_map->trie_to_alpha_map[tc];
+}
 
 TrieChar *  alpha_map_char_to_trie_str (const AlphaMap  *alpha_map,
                                         const AlphaChar *str);
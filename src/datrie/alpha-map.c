@@ -86,9 +86,12 @@ typedef struct _AlphaRange {
     AlphaChar           end;
 } AlphaRange;
 
-struct _AlphaMap {
-    AlphaRange     *first_range;
-};
+
+/*-----------------------------------*
+ *    PRIVATE METHODS DECLARATIONS   *
+ *-----------------------------------*/
+
+static void     alpha_map_recalc_work_area (AlphaMap *alpha_map);
 
 /*-----------------------------*
  *    METHODS IMPLEMENTAIONS   *
@@ -125,6 +128,8 @@ alpha_map_new (void)
         return NULL;
 
     alpha_map->first_range = NULL;
+    memset (alpha_map->alias_to_alpha, 0, sizeof (alpha_map->alias_to_alpha));
+    alpha_map_recalc_work_area (alpha_map);
 
     return alpha_map;
 }
@@ -154,6 +159,9 @@ alpha_map_clone (const AlphaMap *a_map)
             return NULL;
         }
     }
+    memcpy (alpha_map->alias_to_alpha, a_map->alias_to_alpha,
+            sizeof (alpha_map->alias_to_alpha));
+    alpha_map_recalc_work_area (alpha_map);
 
     return alpha_map;
 }
@@ -287,47 +295,94 @@ alpha_map_add_range (AlphaMap *alpha_map, AlphaChar begin, AlphaChar end)
         range->next = r;
     }
 
+    alpha_map_recalc_work_area (alpha_map);
     return 0;
 }
 
-TrieIndex
-alpha_map_char_to_trie (const AlphaMap *alpha_map, AlphaChar ac)
+/**
+ * @brief Add an alias to alphabet map
+ *
+ * @param alpha_map : the alphabet map object
+ * @param alias     : the character to treat as an alias
+ * @param target    : the character @a alias stands for
+ *
+ * @return 0 on success, non-zero on failure
+ *
+ * Make @a alias map to the same trie character as @a target, e.g. to make
+ * lower case characters equivalent to their upper case forms. Mapping back
+ * from the trie character always gives @a target. Characters within the
+ * ranges of the map always take precedence over aliases.
+ */
+int
+alpha_map_add_alias (AlphaMap *alpha_map, AlphaChar alias, AlphaChar target)
 {
-    TrieIndex   alpha_begin;
-    AlphaRange *range;
-
-    if (0 == ac)
-        return 0;
+    if (0 == alias || 0 == target || alias == target)
+        return -1;
 
-    alpha_begin = 1;
-    for (range = alpha_map->first_range; range; range = range->next) {
-        if (range->begin <= ac && ac <= range->end)
-            return alpha_begin + (ac - range->begin);
+    alpha_map->alias_to_alpha[(unsigned char) alias] = target;
+    alpha_map_recalc_work_area (alpha_map);
+    return 0;
+}
 
-        alpha_begin += range->end - range->begin + 1;
-    }
+/**
+ * @brief Get the character an alphabet character stands for
+ *
+ * @param alpha_map : the alphabet map object
+ * @param ac        : the alphabet character
+ *
+ * @return @a ac if it is within the ranges of the map, the target of @a ac
+ *         if it is an alias, or ALPHA_CHAR_ERROR if it is neither
+ *
+ * Keys whose characters all stand for the same ones are the same key to a
+ * trie, and sort as those characters do.
+ */
+AlphaChar
+alpha_map_canonical (const AlphaMap *alpha_map, AlphaChar ac)
+{
+    TrieIndex   tc = alpha_map_char_to_trie (alpha_map, ac);
 
-    return TRIE_INDEX_MAX;
+    if (TRIE_INDEX_MAX == tc || TRIE_CHAR_TERM == tc)
+        return ALPHA_CHAR_ERROR;
+    return alpha_map_trie_to_char (alpha_map, (TrieChar) tc);
 }
 
-AlphaChar
-alpha_map_trie_to_char (const AlphaMap *alpha_map, TrieChar tc)
+static void
+alpha_map_recalc_work_area (AlphaMap *alpha_map)
 {
-    TrieChar    alpha_begin;
     AlphaRange *range;
+    TrieIndex   trie_char;
+    int         i;
 
-    if (0 == tc)
-        return 0;
+    for (i = 0; i < ALPHA_MAP_TABLE_SIZE; i++)
+        alpha_map->alpha_to_trie_map[i] = TRIE_INDEX_MAX;
+    for (i = 0; i <= TRIE_CHAR_MAX; i++)
+        alpha_map->trie_to_alpha_map[i] = ALPHA_CHAR_ERROR;
 
-    alpha_begin = 1;
-    for (range = alpha_map->first_range; range; range = range->next) {
-        if (tc <= alpha_begin + (range->end - range->begin))
-            return range->begin + (tc - alpha_begin);
+    /* the terminator always maps to itself */
+    alpha_map->alpha_to_trie_map[0] = TRIE_CHAR_TERM;
+    alpha_map->trie_to_alpha_map[TRIE_CHAR_TERM] = 0;
 
-        alpha_begin += range->end - range->begin + 1;
+    trie_char = 1;
+    for (range = alpha_map->first_range; range; range = range->next) {
+        int ac;
+
+        for (ac = range->begin;
+             ac <= range->end && trie_char <= TRIE_CHAR_MAX;
+             ac++, trie_char++)
+        {
+            alpha_map->alpha_to_trie_map[(unsigned char) ac] = trie_char;
+            alpha_map->trie_to_alpha_map[trie_char] = (AlphaChar) ac;
+        }
     }
 
-    return ALPHA_CHAR_ERROR;
+    for (i = 1; i < ALPHA_MAP_TABLE_SIZE; i++) {
+        AlphaChar target = alpha_map->alias_to_alpha[i];
+
+        if (0 != target && TRIE_INDEX_MAX == alpha_map->alpha_to_trie_map[i]) {
+            alpha_map->alpha_to_trie_map[i] =
+                alpha_map->alpha_to_trie_map[(unsigned char) target];
+        }
+    }
 }
 
 TrieChar *
@@ -75,6 +75,12 @@ int         alpha_map_add_range (AlphaMap  *alpha_map,
                                  AlphaChar  begin,
                                  AlphaChar  end);
 
+int         alpha_map_add_alias (AlphaMap  *alpha_map,
+                                 AlphaChar  alias,
+                                 AlphaChar  target);
+
+AlphaChar   alpha_map_canonical (const AlphaMap *alpha_map, AlphaChar ac);
+
 int         alpha_char_strlen (const AlphaChar *str);
 int         alpha_char_strcmp (const AlphaChar *str1, const AlphaChar *str2);
 
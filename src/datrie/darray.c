@@ -154,6 +154,7 @@ typedef struct {
 
 struct _DArray {
     TrieIndex   num_cells;
+    TrieIndex   alloc_cells;
     DACell     *cells;
 };
 
@@ -171,6 +172,9 @@ struct _DArray {
  */
 #define DA_POOL_BEGIN 3
 
+/* Free cells tried by da_insert_branches before its search skips ahead */
+#define DA_SEARCH_LIMIT 16
+
 /**
  * @brief Create a new double-array object
  *
@@ -186,6 +190,7 @@ da_new (void)
         return NULL;
 
     d->num_cells = DA_POOL_BEGIN;
+    d->alloc_cells = d->num_cells;
     d->cells     = (DACell *) malloc (d->num_cells * sizeof (DACell));
     if (!d->cells)
         goto exit_da_created;
@@ -397,6 +402,70 @@ da_insert_branch (DArray *d, TrieIndex s, TrieChar c)
     return next;
 }
 
+/**
+ * @brief Insert all branches of a new trie node at once
+ *
+ * @param d       : the double-array structure
+ * @param s       : the state to add branches to, which has none yet
+ * @param symbols : the labels of the branches, in order
+ * @param hint    : the first cell that may be free; updated on return
+ *
+ * @return the new BASE of @a s, or TRIE_INDEX_ERROR on failure
+ *
+ * For building a trie from keys in order. Rather than walking the free list
+ * from its start, as da_insert_branch() does, the search for a base starts
+ * at @a hint, which skips ahead past cells that have filled up. The free
+ * list is kept as ever, so branches may be inserted one by one afterwards.
+ */
+TrieIndex
+da_insert_branches (DArray *d, TrieIndex s, const Symbols *symbols,
+                    TrieIndex *hint)
+{
+    TrieChar    first_sym;
+    TrieIndex   cell, base;
+    int         tries, i;
+
+    /* Free cells are listed in order, so walk them from the hint */
+    first_sym = symbols_get (symbols, 0);
+    cell = *hint;
+    if (cell >= d->num_cells)
+        cell = da_get_free_list (d);
+    else if (cell < DA_POOL_BEGIN || da_get_check (d, cell) >= 0)
+        cell = -da_get_check (d, da_get_free_list (d));
+    for (tries = 1; ; tries++) {
+        if (cell == da_get_free_list (d)) {
+            cell = d->num_cells;
+            if (!da_extend_pool (d, cell))
+                return TRIE_INDEX_ERROR;
+        }
+        if (cell >= (TrieIndex) first_sym + DA_POOL_BEGIN
+            && da_fit_symbols (d, cell - first_sym, symbols))
+        {
+            break;
+        }
+        /* Holes this far back fit few nodes; stop searching them, else
+         * every placement rescans them */
+        if (DA_SEARCH_LIMIT == tries)
+            *hint = cell;
+        cell = -da_get_check (d, cell);
+    }
+    base = cell - first_sym;
+    for (i = 0; i < symbols_num (symbols); i++) {
+        TrieIndex   next = base + symbols_get (symbols, i);
+
+        /* past the last free cell, the pool must grow */
+        if (next == *hint) {
+            *hint = -da_get_check (d, next);
+            if (*hint == da_get_free_list (d))
+                *hint = d->num_cells;
+        }
+        da_alloc_cell (d, next);
+        da_set_check (d, next, s);
+    }
+    da_set_base (d, s, base);
+    return base;
+}
+
 static bool
 da_check_free_cell (DArray         *d,
                     TrieIndex       s)
@@ -564,7 +633,21 @@ da_extend_pool     (DArray         *d,
     if (to_index < d->num_cells)
         return true;
 
-    d->cells = (DACell *) realloc (d->cells, (to_index + 1) * sizeof (DACell));
+    /* grow geometrically, else filling the pool a cell at a time is
+     * quadratic */
+    if (to_index >= d->alloc_cells) {
+        TrieIndex   new_alloc = d->alloc_cells;
+        DACell     *new_cells;
+
+        while (new_alloc <= to_index)
+            new_alloc = (new_alloc < TRIE_INDEX_MAX / 2) ? 2 * new_alloc
+                                                         : TRIE_INDEX_MAX;
+        new_cells = (DACell *) realloc (d->cells, new_alloc * sizeof (DACell));
+        if (!new_cells)
+            return false;
+        d->cells = new_cells;
+        d->alloc_cells = new_alloc;
+    }
     new_begin = d->num_cells;
     d->num_cells = to_index + 1;
 
@@ -691,7 +774,8 @@ da_first_separate (DArray *d, TrieIndex root, TrieString *keybuff)
                 break;
         }
 
-        if (c == max_c)
+        /* no children, as in an empty trie */
+        if (c > max_c)
             return TRIE_INDEX_ERROR;
 
         trie_string_append_char (keybuff, c);
@@ -91,6 +91,11 @@ bool       da_is_walkable (DArray *d, TrieIndex s, TrieChar c);
 
 TrieIndex  da_insert_branch (DArray *d, TrieIndex s, TrieChar c);
 
+TrieIndex  da_insert_branches (DArray          *d,
+                               TrieIndex        s,
+                               const Symbols   *symbols,
+                               TrieIndex       *hint);
+
 void       da_prune (DArray *d, TrieIndex s);
 
 void       da_prune_upto (DArray *d, TrieIndex p, TrieIndex s);
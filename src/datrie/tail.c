@@ -62,6 +62,7 @@ typedef struct {
 
 struct _Tail {
     TrieIndex   num_tails;
+    TrieIndex   alloc_tails;
     TailBlock  *tails;
     TrieIndex   first_free;
 };
@@ -101,6 +102,7 @@ tail_new (void)
 
     t->first_free = 0;
     t->num_tails  = 0;
+    t->alloc_tails = 0;
     t->tails      = NULL;
 
     return t;
@@ -194,6 +196,8 @@ tail_add_suffix (Tail *t, const TrieChar *suffix)
     TrieIndex   new_block;
 
     new_block = tail_alloc_block (t);
+    if (TRIE_INDEX_ERROR == new_block)
+        return TRIE_INDEX_ERROR;
     tail_set_suffix (t, new_block, suffix);
 
     return new_block;
@@ -208,9 +212,18 @@ tail_alloc_block (Tail *t)
         block = t->first_free;
         t->first_free = t->tails[block].next_free;
     } else {
-        block = t->num_tails;
-        t->tails = (TailBlock *) realloc (t->tails,
-                                          ++t->num_tails * sizeof (TailBlock));
+        if (t->num_tails == t->alloc_tails) {
+            TrieIndex   new_alloc = t->alloc_tails ? 2 * t->alloc_tails : 16;
+            TailBlock  *new_tails;
+
+            new_tails = (TailBlock *) realloc (t->tails,
+                                               new_alloc * sizeof (TailBlock));
+            if (!new_tails)
+                return TRIE_INDEX_ERROR;
+            t->tails = new_tails;
+            t->alloc_tails = new_alloc;
+        }
+        block = t->num_tails++;
     }
     t->tails[block].next_free = -1;
     t->tails[block].data = TRIE_DATA_ERROR;
@@ -0,0 +1,498 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * libdatrie - Double-Array Trie Library
+ * Copyright (C) 2006  Theppitak Karoonboonyanan <thep@linux.thai.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * trie-build.c - Building tries from many keys at once
+ * Created: 2026-10-18
+ * Author:  Kevin Murray <spam@kdmurray.id.au>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "trie-build.h"
+#include "trie-private.h"
+#include "alpha-map-private.h"
+
+/*------------------------------*
+ *    PRIVATE DATA DEFINITONS   *
+ *------------------------------*/
+
+/* A key, as TrieChars, and its data */
+typedef struct {
+    const TrieChar *key;
+    TrieData        data;
+} TrieBuildKey;
+
+/* Keys deleted from a builder keep their slot, as they are often stored
+ * again */
+typedef struct {
+    size_t      key;        /* offset in the pool plus one, or 0 if empty */
+    TrieData    data;
+    bool        is_live;
+} TrieBuilderSlot;
+
+struct _TrieBuilder {
+    AlphaMap        *alpha_map;
+    /* Every key ever stored, as terminated TrieChar strings */
+    TrieChar        *pool;
+    size_t           pool_size;
+    size_t           pool_alloc;
+    TrieBuilderSlot *slots;
+    size_t           mask;
+    size_t           num_filled;
+    size_t           num_keys;
+    /* The key being looked up, as TrieChars */
+    TrieChar        *scratch;
+    size_t           scratch_alloc;
+};
+
+/*-----------------------------------*
+ *    PRIVATE METHODS DECLARATIONS   *
+ *-----------------------------------*/
+
+static bool     tb_layout (Trie *trie, TrieIndex s, const TrieBuildKey *keys,
+                           size_t n_keys, size_t depth, TrieIndex *hint);
+static Trie *   tb_build (const AlphaMap *alpha_map, const TrieBuildKey *keys,
+                          size_t n_keys);
+static int      tb_key_cmp (const void *a, const void *b);
+static bool     tb_convert (TrieBuilder *tb, const AlphaChar *key);
+static size_t   tb_hash (const TrieChar *key);
+static size_t   tb_find (const TrieBuilder *tb, const TrieChar *key);
+static bool     tb_grow (TrieBuilder *tb);
+
+/*-----------------------------*
+ *    METHODS IMPLEMENTAIONS   *
+ *-----------------------------*/
+
+/* Lay out the node s, reached by the first depth TrieChars of keys, which
+ * are in order and all begin with them */
+static bool
+tb_layout (Trie *trie, TrieIndex s, const TrieBuildKey *keys, size_t n_keys,
+           size_t depth, TrieIndex *hint)
+{
+    Symbols    *syms;
+    TrieIndex   base;
+    size_t      i, j;
+
+    if (0 == n_keys)
+        return true;
+    /* A single key below the root goes to the tail, as trie_store() would
+     * have it. Past the terminator, the suffix is empty. */
+    if (depth > 0 && 1 == n_keys) {
+        size_t      len = strlen ((const char *) keys[0].key);
+        TrieIndex   t;
+
+        t = tail_add_suffix (trie->tail, keys[0].key + MIN_VAL (depth, len));
+        if (TRIE_INDEX_ERROR == t)
+            return false;
+        tail_set_data (trie->tail, t, keys[0].data);
+        /* a separate node */
+        da_set_base (trie->da, s, -t);
+        return true;
+    }
+    syms = symbols_new ();
+    if (!syms)
+        return false;
+    for (i = 0; i < n_keys; i++) {
+        if (0 == i || keys[i].key[depth] != keys[i - 1].key[depth])
+            symbols_add (syms, keys[i].key[depth]);
+    }
+    base = da_insert_branches (trie->da, s, syms, hint);
+    symbols_free (syms);
+    if (TRIE_INDEX_ERROR == base)
+        return false;
+    /* Depth first, so each node's children are near the node */
+    for (i = 0; i < n_keys; i = j) {
+        TrieChar    c = keys[i].key[depth];
+
+        for (j = i + 1; j < n_keys && keys[j].key[depth] == c; j++)
+            ;
+        if (!tb_layout (trie, base + c, keys + i, j - i, depth + 1, hint))
+            return false;
+    }
+    return true;
+}
+
+static Trie *
+tb_build (const AlphaMap *alpha_map, const TrieBuildKey *keys, size_t n_keys)
+{
+    Trie       *trie;
+    TrieIndex   hint = 0;
+
+    trie = trie_new (alpha_map);
+    if (!trie)
+        return NULL;
+    if (!tb_layout (trie, da_get_root (trie->da), keys, n_keys, 0, &hint)) {
+        trie_free (trie);
+        return NULL;
+    }
+    return trie;
+}
+
+static int
+tb_key_cmp (const void *a, const void *b)
+{
+    return strcmp ((const char *) ((const TrieBuildKey *) a)->key,
+                   (const char *) ((const TrieBuildKey *) b)->key);
+}
+
+/**
+ * @brief Create a trie from keys in order
+ *
+ * @param alpha_map : the alphabet set for the trie
+ * @param keys      : the keys, in the order of their TrieChars
+ * @param data      : the data of each key
+ * @param n_keys    : the number of keys
+ *
+ * @return a pointer to the new trie, NULL on failure
+ *
+ * Build a trie holding @a keys in one pass. Keys must be in the order of
+ * their TrieChars under @a alpha_map, which for a map of ranges added in
+ * order is that of the characters, and no two may be alike, aliases
+ * included. Otherwise, or if a key has a character not in @a alpha_map,
+ * NULL is returned.
+ *
+ * The created object must be freed with trie_free().
+ */
+Trie *
+trie_new_sorted (const AlphaMap        *alpha_map,
+                 const AlphaChar *const *keys,
+                 const TrieData        *data,
+                 size_t                 n_keys)
+{
+    TrieBuildKey   *entries = NULL;
+    TrieChar       *pool = NULL;
+    size_t          pool_size = 0;
+    size_t          i, j;
+    Trie           *trie = NULL;
+
+    for (i = 0; i < n_keys; i++)
+        pool_size += strlen (keys[i]) + 1;
+    entries = (TrieBuildKey *) malloc ((n_keys ? n_keys : 1)
+                                       * sizeof (TrieBuildKey));
+    pool = (TrieChar *) malloc (pool_size ? pool_size : 1);
+    if (!entries || !pool)
+        goto exit;
+    for (pool_size = 0, i = 0; i < n_keys; i++) {
+        entries[i].key = pool + pool_size;
+        entries[i].data = data[i];
+        for (j = 0; keys[i][j]; j++) {
+            TrieIndex   tc = alpha_map_char_to_trie (alpha_map, keys[i][j]);
+
+            if (TRIE_INDEX_MAX == tc || TRIE_CHAR_TERM == tc)
+                goto exit;
+            pool[pool_size++] = (TrieChar) tc;
+        }
+        pool[pool_size++] = TRIE_CHAR_TERM;
+        if (i > 0 && tb_key_cmp (&entries[i - 1], &entries[i]) >= 0)
+            goto exit;
+    }
+    trie = tb_build (alpha_map, entries, n_keys);
+
+exit:
+    free (entries);
+    free (pool);
+    return trie;
+}
+
+/* Convert key to TrieChars in the scratch buffer */
+static bool
+tb_convert (TrieBuilder *tb, const AlphaChar *key)
+{
+    size_t  len = strlen (key);
+    size_t  i;
+
+    if (len + 1 > tb->scratch_alloc) {
+        size_t      new_alloc = tb->scratch_alloc ? tb->scratch_alloc : 64;
+        TrieChar   *new_scratch;
+
+        while (new_alloc < len + 1)
+            new_alloc *= 2;
+        new_scratch = (TrieChar *) realloc (tb->scratch, new_alloc);
+        if (!new_scratch)
+            return false;
+        tb->scratch = new_scratch;
+        tb->scratch_alloc = new_alloc;
+    }
+    for (i = 0; i < len; i++) {
+        TrieIndex   tc = alpha_map_char_to_trie (tb->alpha_map, key[i]);
+
+        if (TRIE_INDEX_MAX == tc || TRIE_CHAR_TERM == tc)
+            return false;
+        tb->scratch[i] = (TrieChar) tc;
+    }
+    tb->scratch[len] = TRIE_CHAR_TERM;
+    return true;
+}
+
+/* FNV-1a, folded so that the low bits depend on every TrieChar */
+static size_t
+tb_hash (const TrieChar *key)
+{
+    uint64_t    hash = UINT64_C (0xcbf29ce484222325);
+
+    for (; *key; key++)
+        hash = (hash ^ *key) * UINT64_C (0x100000001b3);
+    return (size_t) (hash ^ (hash >> 31));
+}
+
+/* The slot holding key, or the empty slot it would go in */
+static size_t
+tb_find (const TrieBuilder *tb, const TrieChar *key)
+{
+    size_t  slot;
+
+    for (slot = tb_hash (key) & tb->mask;
+         tb->slots[slot].key != 0;
+         slot = (slot + 1) & tb->mask)
+    {
+        if (strcmp ((const char *) tb->pool + tb->slots[slot].key - 1,
+                    (const char *) key) == 0)
+            break;
+    }
+    return slot;
+}
+
+static bool
+tb_grow (TrieBuilder *tb)
+{
+    TrieBuilderSlot    *old = tb->slots;
+    size_t              n_old = tb->mask + 1;
+    size_t              i;
+
+    tb->slots = (TrieBuilderSlot *) calloc (2 * n_old,
+                                            sizeof (TrieBuilderSlot));
+    if (!tb->slots) {
+        tb->slots = old;
+        return false;
+    }
+    tb->mask = 2 * n_old - 1;
+    for (i = 0; i < n_old; i++) {
+        if (old[i].key != 0)
+            tb->slots[tb_find (tb, tb->pool + old[i].key - 1)] = old[i];
+    }
+    free (old);
+    return true;
+}
+
+/**
+ * @brief Create a trie builder
+ *
+ * @param alpha_map : the alphabet set for the trie
+ *
+ * @return a pointer to the new builder, NULL on failure
+ *
+ * The created object must be freed with trie_builder_free().
+ */
+TrieBuilder *
+trie_builder_new (const AlphaMap *alpha_map)
+{
+    TrieBuilder    *tb;
+
+    tb = (TrieBuilder *) calloc (1, sizeof (TrieBuilder));
+    if (!tb)
+        return NULL;
+    tb->alpha_map = alpha_map_clone (alpha_map);
+    tb->mask = 1023;
+    tb->slots = (TrieBuilderSlot *) calloc (tb->mask + 1,
+                                            sizeof (TrieBuilderSlot));
+    if (!tb->alpha_map || !tb->slots) {
+        trie_builder_free (tb);
+        return NULL;
+    }
+    return tb;
+}
+
+/**
+ * @brief Free a trie builder
+ *
+ * @param tb : the builder to free
+ */
+void
+trie_builder_free (TrieBuilder *tb)
+{
+    if (tb->alpha_map)
+        alpha_map_free (tb->alpha_map);
+    free (tb->pool);
+    free (tb->slots);
+    free (tb->scratch);
+    free (tb);
+}
+
+/**
+ * @brief Retrieve an entry from a trie builder
+ *
+ * @param tb     : the builder
+ * @param key    : the key for the entry to retrieve
+ * @param o_data : the storage for storing the entry data on return
+ *
+ * @return boolean value indicating the existence of the entry.
+ *
+ * As trie_retrieve().
+ */
+bool
+trie_builder_retrieve (TrieBuilder *tb, const AlphaChar *key, TrieData *o_data)
+{
+    size_t  slot;
+
+    if (!tb_convert (tb, key))
+        return false;
+    slot = tb_find (tb, tb->scratch);
+    if (!tb->slots[slot].is_live)
+        return false;
+    if (o_data)
+        *o_data = tb->slots[slot].data;
+    return true;
+}
+
+/**
+ * @brief Store a value for an entry to a trie builder only if the key is
+ *        not present
+ *
+ * @param tb    : the builder
+ * @param key   : the key for the entry to store
+ * @param data  : the data associated to the entry
+ *
+ * @return boolean value indicating the success of the operation
+ *
+ * As trie_store_if_absent().
+ */
+bool
+trie_builder_store_if_absent (TrieBuilder     *tb,
+                              const AlphaChar *key,
+                              TrieData         data)
+{
+    size_t  slot, len;
+
+    if (!tb_convert (tb, key))
+        return false;
+    slot = tb_find (tb, tb->scratch);
+    if (tb->slots[slot].is_live)
+        return false;
+    if (0 == tb->slots[slot].key) {
+        /* at most half full, so probes stay short */
+        if (2 * (tb->num_filled + 1) > tb->mask + 1) {
+            if (!tb_grow (tb))
+                return false;
+            slot = tb_find (tb, tb->scratch);
+        }
+        len = strlen ((const char *) tb->scratch) + 1;
+        if (tb->pool_size + len > tb->pool_alloc) {
+            size_t      new_alloc = tb->pool_alloc ? tb->pool_alloc : 4096;
+            TrieChar   *new_pool;
+
+            while (new_alloc < tb->pool_size + len)
+                new_alloc *= 2;
+            new_pool = (TrieChar *) realloc (tb->pool, new_alloc);
+            if (!new_pool)
+                return false;
+            tb->pool = new_pool;
+            tb->pool_alloc = new_alloc;
+        }
+        memcpy (tb->pool + tb->pool_size, tb->scratch, len);
+        tb->slots[slot].key = tb->pool_size + 1;
+        tb->pool_size += len;
+        tb->num_filled++;
+    }
+    tb->slots[slot].data = data;
+    tb->slots[slot].is_live = true;
+    tb->num_keys++;
+    return true;
+}
+
+/**
+ * @brief Delete an entry from a trie builder
+ *
+ * @param tb  : the builder
+ * @param key : the key for the entry to delete
+ *
+ * @return boolean value indicating whether the key exists and is removed
+ *
+ * As trie_delete().
+ */
+bool
+trie_builder_delete (TrieBuilder *tb, const AlphaChar *key)
+{
+    size_t  slot;
+
+    if (!tb_convert (tb, key))
+        return false;
+    slot = tb_find (tb, tb->scratch);
+    if (!tb->slots[slot].is_live)
+        return false;
+    tb->slots[slot].is_live = false;
+    tb->num_keys--;
+    return true;
+}
+
+/**
+ * @brief Get the number of keys in a trie builder
+ *
+ * @param tb : the builder
+ *
+ * @return the number of keys stored and not deleted
+ */
+size_t
+trie_builder_num_keys (const TrieBuilder *tb)
+{
+    return tb->num_keys;
+}
+
+/**
+ * @brief Build a trie from the keys of a trie builder
+ *
+ * @param tb : the builder
+ *
+ * @return a pointer to the new trie, NULL on failure
+ *
+ * Sort the keys stored in @a tb, and build a trie of them with
+ * trie_new_sorted(). @a tb is unchanged, and may be freed.
+ *
+ * The created object must be freed with trie_free().
+ */
+Trie *
+trie_builder_build (const TrieBuilder *tb)
+{
+    TrieBuildKey   *keys;
+    size_t          n_keys = 0;
+    size_t          i;
+    Trie           *trie;
+
+    keys = (TrieBuildKey *) malloc ((tb->num_keys ? tb->num_keys : 1)
+                                    * sizeof (TrieBuildKey));
+    if (!keys)
+        return NULL;
+    for (i = 0; i <= tb->mask; i++) {
+        if (tb->slots[i].is_live) {
+            keys[n_keys].key = tb->pool + tb->slots[i].key - 1;
+            keys[n_keys].data = tb->slots[i].data;
+            n_keys++;
+        }
+    }
+    qsort (keys, n_keys, sizeof (TrieBuildKey), tb_key_cmp);
+    trie = tb_build (tb->alpha_map, keys, n_keys);
+    free (keys);
+    return trie;
+}
+
+/*
+vi:ts=4:ai:expandtab
+*/
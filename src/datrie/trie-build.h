@@ -0,0 +1,94 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * libdatrie - Double-Array Trie Library
+ * Copyright (C) 2006  Theppitak Karoonboonyanan <thep@linux.thai.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * trie-build.h - Building tries from many keys at once
+ * Created: 2026-10-18
+ * Author:  Kevin Murray <spam@kdmurray.id.au>
+ */
+
+#ifndef __TRIE_BUILD_H
+#define __TRIE_BUILD_H
+
+#include <stddef.h>
+
+#include <datrie/triedefs.h>
+#include <datrie/alpha-map.h>
+#include <datrie/trie.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file trie-build.h
+ * @brief Building tries from many keys at once
+ *
+ * Storing keys one by one makes the double-array search its free list for
+ * every new branch, and move whole nodes when a branch doesn't fit, which
+ * grows quadratic with tens of thousands of keys. Given every key in order,
+ * trie_new_sorted() instead lays out each node once, with all of its
+ * branches, in a single pass.
+ *
+ * Where the keys are only known as they are stored, a TrieBuilder collects
+ * them in a hash table, with the same store, retrieve and delete operations
+ * as a Trie, then sorts them and builds the trie at the end.
+ *
+ * Either way, the result is an ordinary Trie, to which keys may still be
+ * stored and deleted one by one.
+ */
+
+/**
+ * @brief Trie builder data type
+ */
+typedef struct _TrieBuilder TrieBuilder;
+
+Trie *  trie_new_sorted (const AlphaMap        *alpha_map,
+                         const AlphaChar *const *keys,
+                         const TrieData        *data,
+                         size_t                 n_keys);
+
+TrieBuilder *   trie_builder_new (const AlphaMap *alpha_map);
+
+void            trie_builder_free (TrieBuilder *tb);
+
+bool            trie_builder_retrieve (TrieBuilder     *tb,
+                                       const AlphaChar *key,
+                                       TrieData        *o_data);
+
+bool            trie_builder_store_if_absent (TrieBuilder     *tb,
+                                              const AlphaChar *key,
+                                              TrieData         data);
+
+bool            trie_builder_delete (TrieBuilder *tb, const AlphaChar *key);
+
+size_t          trie_builder_num_keys (const TrieBuilder *tb);
+
+Trie *          trie_builder_build (const TrieBuilder *tb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* __TRIE_BUILD_H */
+
+/*
+vi:ts=4:ai:expandtab
+*/
@@ -0,0 +1,426 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * libdatrie - Double-Array Trie Library
+ * Copyright (C) 2006  Theppitak Karoonboonyanan <thep@linux.thai.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * trie-frozen.c - Read-only, compacted trie images
+ * Created: 2026-10-18
+ * Author:  Kevin Murray <spam@kdmurray.id.au>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "trie-frozen.h"
+#include "trie-private.h"
+#include "alpha-map-private.h"
+
+/*------------------------------*
+ *    PRIVATE DATA DEFINITONS   *
+ *------------------------------*/
+
+/* The image is built in these growable buffers, then packed */
+typedef struct {
+    uint32_t   *base;
+    uint32_t   *check;
+    uint8_t    *used;
+    uint32_t    num_cells;
+    uint32_t    alloc_cells;
+    uint32_t    first_free;
+
+    TrieChar   *tail;
+    uint32_t    tail_size;
+    uint32_t    tail_alloc;
+} FrozenBuilder;
+
+/* Pairs of (source, destination) states still to be copied */
+typedef struct {
+    TrieIndex   src;
+    uint32_t    dst;
+} FrozenTodo;
+
+#define FROZEN_BASE_MIN     2
+#define FROZEN_SEARCH_LIMIT 256
+
+/*-----------------------------------*
+ *    PRIVATE METHODS DECLARATIONS   *
+ *-----------------------------------*/
+
+static bool     fb_ensure_cells (FrozenBuilder *fb, uint32_t n);
+static uint32_t fb_find_base (FrozenBuilder *fb, const Symbols *syms);
+static int64_t  fb_add_tail (FrozenBuilder *fb, const TrieChar *suffix,
+                             TrieData data);
+static void     fb_free (FrozenBuilder *fb);
+
+/*-----------------------------*
+ *    METHODS IMPLEMENTAIONS   *
+ *-----------------------------*/
+
+static bool
+fb_ensure_cells (FrozenBuilder *fb, uint32_t n)
+{
+    uint32_t    new_alloc;
+    uint32_t   *new_base, *new_check;
+    uint8_t    *new_used;
+
+    if (n <= fb->alloc_cells)
+        return true;
+    if (n >= FROZEN_TRIE_TAIL_BIT)
+        return false;
+
+    new_alloc = fb->alloc_cells ? fb->alloc_cells : 256;
+    while (new_alloc < n)
+        new_alloc *= 2;
+    new_base = (uint32_t *) realloc (fb->base, new_alloc * sizeof (uint32_t));
+    if (!new_base)
+        return false;
+    fb->base = new_base;
+    new_check = (uint32_t *) realloc (fb->check, new_alloc * sizeof (uint32_t));
+    if (!new_check)
+        return false;
+    fb->check = new_check;
+    new_used = (uint8_t *) realloc (fb->used, new_alloc);
+    if (!new_used)
+        return false;
+    fb->used = new_used;
+    memset (fb->base + fb->alloc_cells, 0,
+            (new_alloc - fb->alloc_cells) * sizeof (uint32_t));
+    memset (fb->check + fb->alloc_cells, 0,
+            (new_alloc - fb->alloc_cells) * sizeof (uint32_t));
+    memset (fb->used + fb->alloc_cells, 0, new_alloc - fb->alloc_cells);
+    fb->alloc_cells = new_alloc;
+    return true;
+}
+
+/* First fit: the lowest base at which every symbol lands on a free cell */
+static uint32_t
+fb_find_base (FrozenBuilder *fb, const Symbols *syms)
+{
+    int         n_syms = symbols_num (syms);
+    TrieChar    first = symbols_get (syms, 0);
+    uint32_t    base;
+    uint32_t    tries;
+    int         i;
+
+    while (fb->first_free < fb->alloc_cells && fb->used[fb->first_free])
+        fb->first_free++;
+
+    base = (fb->first_free > (uint32_t) first + FROZEN_BASE_MIN)
+               ? fb->first_free - first : FROZEN_BASE_MIN;
+    for (tries = 1; ; tries++, base++) {
+        if (!fb_ensure_cells (fb, base + TRIE_CHAR_MAX + 1))
+            return 0;
+        for (i = 0; i < n_syms; i++) {
+            if (fb->used[base + symbols_get (syms, i)])
+                break;
+        }
+        if (i == n_syms)
+            return base;
+        /* Holes this far back fit few nodes; stop searching them, else
+         * every placement rescans them */
+        if (FROZEN_SEARCH_LIMIT == tries)
+            fb->first_free = base + first;
+    }
+}
+
+/* Append an inline suffix and its data; returns its offset, -1 on failure */
+static int64_t
+fb_add_tail (FrozenBuilder *fb, const TrieChar *suffix, TrieData data)
+{
+    size_t      len = strlen ((const char *) suffix) + 1;
+    size_t      need = fb->tail_size + len + sizeof (TrieData);
+    uint32_t    offset = fb->tail_size;
+
+    if (need >= FROZEN_TRIE_TAIL_BIT)
+        return -1;
+    if (need > fb->tail_alloc) {
+        uint32_t    new_alloc = fb->tail_alloc ? fb->tail_alloc : 1024;
+        TrieChar   *new_tail;
+
+        while (new_alloc < need)
+            new_alloc *= 2;
+        new_tail = (TrieChar *) realloc (fb->tail, new_alloc);
+        if (!new_tail)
+            return -1;
+        fb->tail = new_tail;
+        fb->tail_alloc = new_alloc;
+    }
+    memcpy (fb->tail + offset, suffix, len);
+    memcpy (fb->tail + offset + len, &data, sizeof (TrieData));
+    fb->tail_size = need;
+    return offset;
+}
+
+static void
+fb_free (FrozenBuilder *fb)
+{
+    free (fb->base);
+    free (fb->check);
+    free (fb->used);
+    free (fb->tail);
+}
+
+/**
+ * @brief Freeze a trie
+ *
+ * @param trie : the trie to freeze
+ *
+ * @return a pointer to the frozen image, NULL on failure
+ *
+ * Build a compacted, read-only copy of @a trie. Later changes to @a trie are
+ * not reflected in the image.
+ *
+ * The created object must be freed with frozen_trie_free().
+ */
+FrozenTrie *
+trie_freeze (const Trie *trie)
+{
+    FrozenBuilder   fb;
+    FrozenTodo     *todo = NULL;
+    size_t          todo_head = 0, todo_tail = 0, todo_alloc = 0;
+    FrozenTrie     *ft = NULL;
+    TrieIndex       max_tc = 0;
+    uint32_t        max_base = 0;
+    uint32_t        num_cells;
+    uint32_t        width;
+    uint64_t        cells_offset, tail_offset, size;
+    uint32_t        i;
+
+    memset (&fb, 0, sizeof (fb));
+    if (!fb_ensure_cells (&fb, FROZEN_TRIE_STATE_ROOT + 1))
+        goto exit;
+    fb.used[0] = fb.used[FROZEN_TRIE_STATE_ROOT] = 1;
+    fb.num_cells = FROZEN_TRIE_STATE_ROOT + 1;
+
+    todo_alloc = 256;
+    todo = (FrozenTodo *) malloc (todo_alloc * sizeof (FrozenTodo));
+    if (!todo)
+        goto exit;
+    todo[todo_tail].src = da_get_root (trie->da);
+    todo[todo_tail].dst = FROZEN_TRIE_STATE_ROOT;
+    todo_tail++;
+
+    /* Breadth first, so siblings and their children stay close together */
+    while (todo_head < todo_tail) {
+        TrieIndex   src = todo[todo_head].src;
+        uint32_t    dst = todo[todo_head].dst;
+        TrieIndex   src_base = da_get_base (trie->da, src);
+        Symbols    *syms;
+        uint32_t    base;
+        int         n_syms, j;
+
+        todo_head++;
+        if (src_base < 0) {
+            TrieIndex   t = -src_base;
+            int64_t     offset;
+
+            offset = fb_add_tail (&fb, tail_get_suffix (trie->tail, t),
+                                  tail_get_data (trie->tail, t));
+
+            if (offset < 0)
+                goto exit;
+            fb.base[dst] = FROZEN_TRIE_TAIL_BIT | (uint32_t) offset;
+            continue;
+        }
+
+        syms = da_output_symbols (trie->da, src);
+        n_syms = symbols_num (syms);
+        if (0 == n_syms) {
+            symbols_free (syms);
+            continue;
+        }
+        base = fb_find_base (&fb, syms);
+        if (0 == base) {
+            symbols_free (syms);
+            goto exit;
+        }
+        fb.base[dst] = base;
+        if (base > max_base)
+            max_base = base;
+        if (todo_tail + n_syms > todo_alloc) {
+            FrozenTodo *new_todo;
+
+            todo_alloc *= 2;
+            new_todo = (FrozenTodo *) realloc (todo,
+                                               todo_alloc * sizeof (FrozenTodo));
+            if (!new_todo) {
+                symbols_free (syms);
+                goto exit;
+            }
+            todo = new_todo;
+        }
+        for (j = 0; j < n_syms; j++) {
+            TrieChar    c = symbols_get (syms, j);
+            uint32_t    next = base + c;
+
+            fb.used[next] = 1;
+            fb.check[next] = dst;
+            if (next >= fb.num_cells)
+                fb.num_cells = next + 1;
+            todo[todo_tail].src = src_base + c;
+            todo[todo_tail].dst = next;
+            todo_tail++;
+        }
+        symbols_free (syms);
+    }
+
+    /* Pad, so that walking any alphabet character from any state stays in
+     * the array without a bounds check */
+    for (i = 0; i < ALPHA_MAP_TABLE_SIZE; i++) {
+        TrieIndex tc = trie->alpha_map->alpha_to_trie_map[i];
+        if (TRIE_INDEX_MAX != tc && tc > max_tc)
+            max_tc = tc;
+    }
+    num_cells = max_base + max_tc + 1;
+    if (num_cells < fb.num_cells)
+        num_cells = fb.num_cells;
+    if (!fb_ensure_cells (&fb, num_cells))
+        goto exit;
+
+    width = (num_cells < 0x8000u && fb.tail_size < 0x8000u) ? 2 : 4;
+    cells_offset = (sizeof (FrozenTrie) + FROZEN_TRIE_ALIGNMENT - 1)
+                       & ~(uint64_t) (FROZEN_TRIE_ALIGNMENT - 1);
+    tail_offset = cells_offset + (uint64_t) num_cells * 2 * width;
+    size = tail_offset + fb.tail_size;
+
+    if (posix_memalign ((void **) &ft, FROZEN_TRIE_ALIGNMENT, size) != 0) {
+        ft = NULL;
+        goto exit;
+    }
+    /* Padding too, so that images written out are alike */
+    memset (ft, 0, cells_offset);
+    ft->signature = FROZEN_TRIE_SIGNATURE;
+    ft->index_width = width;
+    ft->num_cells = num_cells;
+    ft->tail_size = fb.tail_size;
+    ft->size = size;
+    ft->cells_offset = cells_offset;
+    ft->tail_offset = tail_offset;
+    memcpy (ft->alpha_to_trie, trie->alpha_map->alpha_to_trie_map,
+            sizeof (ft->alpha_to_trie));
+
+    if (2 == width) {
+        uint16_t *cells = (uint16_t *) ((uint8_t *) ft + cells_offset);
+
+        for (i = 0; i < num_cells; i++) {
+            uint32_t base = fb.base[i];
+
+            if (base & FROZEN_TRIE_TAIL_BIT)
+                base = 0x8000u | (base & ~FROZEN_TRIE_TAIL_BIT);
+            cells[2 * i] = (uint16_t) base;
+            cells[2 * i + 1] = (uint16_t) fb.check[i];
+        }
+    } else {
+        uint32_t *cells = (uint32_t *) ((uint8_t *) ft + cells_offset);
+
+        for (i = 0; i < num_cells; i++) {
+            cells[2 * i] = fb.base[i];
+            cells[2 * i + 1] = fb.check[i];
+        }
+    }
+    if (fb.tail_size > 0)
+        memcpy ((uint8_t *) ft + tail_offset, fb.tail, fb.tail_size);
+
+exit:
+    free (todo);
+    fb_free (&fb);
+    return ft;
+}
+
+/**
+ * @brief Free a frozen trie
+ *
+ * @param ft : the frozen trie to free
+ */
+void
+frozen_trie_free (FrozenTrie *ft)
+{
+    free (ft);
+}
+
+/**
+ * @brief Use a frozen trie image in place
+ *
+ * @param image : the image, as written by frozen_trie_fwrite()
+ * @param size  : the bytes available at @a image
+ *
+ * @return @a image as a frozen trie, or NULL if it isn't a whole image
+ *
+ * The image holds offsets rather than pointers, so may lie anywhere aligned
+ * to FROZEN_TRIE_ALIGNMENT, such as in a file mapped read-only into memory.
+ * It is not copied, so must outlive the returned trie, which must not be
+ * freed with frozen_trie_free().
+ */
+FrozenTrie *
+frozen_trie_from_image (void *image, size_t size)
+{
+    FrozenTrie *ft = (FrozenTrie *) image;
+    uint64_t    cells_bytes;
+
+    if (!image || ((uintptr_t) image & (FROZEN_TRIE_ALIGNMENT - 1))
+            || size < sizeof (FrozenTrie))
+        return NULL;
+    if (FROZEN_TRIE_SIGNATURE != ft->signature || ft->size > size
+            || (2 != ft->index_width && 4 != ft->index_width))
+        return NULL;
+    cells_bytes = (uint64_t) ft->num_cells * 2 * ft->index_width;
+    if (ft->cells_offset < sizeof (FrozenTrie)
+            || ft->cells_offset > ft->size
+            || ft->tail_offset != ft->cells_offset + cells_bytes
+            || ft->tail_offset + ft->tail_size != ft->size)
+        return NULL;
+    return ft;
+}
+
+/**
+ * @brief Write a frozen trie image to a file
+ *
+ * @param ft   : the frozen trie
+ * @param file : the file to write to
+ *
+ * @return 0 on success, non-zero on failure
+ *
+ * Write the image as it lies in memory, for frozen_trie_from_image() to use
+ * once it is read or mapped back. The image is only valid on machines of the
+ * same byte order and pointer size.
+ */
+int
+frozen_trie_fwrite (const FrozenTrie *ft, FILE *file)
+{
+    if (fwrite (ft, 1, (size_t) ft->size, file) != (size_t) ft->size)
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief Get the size of a frozen trie image
+ *
+ * @param ft : the frozen trie
+ *
+ * @return the number of bytes in the image, header included
+ */
+size_t
+frozen_trie_size (const FrozenTrie *ft)
+{
+    return (size_t) ft->size;
+}
+
+/*
+vi:ts=4:ai:expandtab
+*/
@@ -0,0 +1,311 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * libdatrie - Double-Array Trie Library
+ * Copyright (C) 2006  Theppitak Karoonboonyanan <thep@linux.thai.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * trie-frozen.h - Read-only, compacted trie images
+ * Created: 2026-10-18
+ * Author:  Kevin Murray <spam@kdmurray.id.au>
+ */
+
+#ifndef __TRIE_FROZEN_H
+#define __TRIE_FROZEN_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include <datrie/triedefs.h>
+#include <datrie/trie.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file trie-frozen.h
+ * @brief Read-only, compacted trie images
+ *
+ * A FrozenTrie is a snapshot of a Trie, rebuilt for lookups only. The whole
+ * image is a single cache-line aligned block of memory: a header, followed
+ * by a freshly packed double-array and a pool holding every tail suffix
+ * inline. Double-array cells are 16 bits wide where the trie is small enough,
+ * 32 bits otherwise. The double-array is padded so that walks need no bounds
+ * checks.
+ *
+ * The image holds offsets rather than pointers, so it may be copied or
+ * mapped anywhere. It is never written to after trie_freeze(), so any number
+ * of threads may walk it concurrently without locking.
+ *
+ * Walking uses a FrozenTrieState, which is a plain integer. Walk functions
+ * return FROZEN_TRIE_STATE_FAIL when there is no transition.
+ */
+
+/**
+ * @brief Frozen trie data type
+ */
+typedef struct _FrozenTrie FrozenTrie;
+
+/**
+ * @brief Frozen trie walking state
+ *
+ * Either a double-array cell index, or a tail pool offset with
+ * FROZEN_TRIE_TAIL_BIT set.
+ */
+typedef uint32_t FrozenTrieState;
+
+#define FROZEN_TRIE_STATE_FAIL  ((FrozenTrieState) 0)
+#define FROZEN_TRIE_STATE_ROOT  ((FrozenTrieState) 1)
+#define FROZEN_TRIE_TAIL_BIT    ((FrozenTrieState) 0x80000000u)
+
+#define FROZEN_TRIE_SIGNATURE   0xDAF0DAF0u
+#define FROZEN_TRIE_ALIGNMENT   64
+
+/**
+ * @brief Frozen trie image header
+ *
+ * All members are read-only. The cell array and tail pool follow the header
+ * at the given offsets from the start of the image.
+ */
+struct _FrozenTrie {
+    uint32_t    signature;
+    uint32_t    index_width;    /**< bytes per BASE/CHECK value: 2 or 4 */
+    uint32_t    num_cells;      /**< cells, including padding */
+    uint32_t    tail_size;      /**< bytes in the tail pool */
+    uint64_t    size;           /**< total bytes in the image */
+    uint64_t    cells_offset;   /**< offset of the cell array */
+    uint64_t    tail_offset;    /**< offset of the tail pool */
+    TrieIndex   alpha_to_trie[UCHAR_MAX + 1];
+};
+
+FrozenTrie *    trie_freeze (const Trie *trie);
+
+void            frozen_trie_free (FrozenTrie *ft);
+
+size_t          frozen_trie_size (const FrozenTrie *ft);
+
+FrozenTrie *    frozen_trie_from_image (void *image, size_t size);
+
+int             frozen_trie_fwrite (const FrozenTrie *ft, FILE *file);
+
+/*
+ * Tail pool entries are the suffix TrieChars, a TRIE_CHAR_TERM, then the
+ * entry's TrieData (unaligned). BASE values of tail nodes have the top bit of
+ * the cell width set, and the rest is the offset of the suffix in the pool.
+ */
+
+static inline const uint8_t *
+frozen_trie_cells_ (const FrozenTrie *ft)
+{
+    return (const uint8_t *) ft + ft->cells_offset;
+}
+
+static inline const TrieChar *
+frozen_trie_tail_ (const FrozenTrie *ft)
+{
+    return (const TrieChar *) ft + ft->tail_offset;
+}
+
+/* Read a cell member, translating tail pointers to FROZEN_TRIE_TAIL_BIT */
+static inline uint32_t
+frozen_trie_get_base_ (const FrozenTrie *ft, uint32_t s)
+{
+    if (ft->index_width == 2) {
+        uint16_t base = ((const uint16_t *) frozen_trie_cells_ (ft))[2 * s];
+        return (base & 0x8000u) ? (FROZEN_TRIE_TAIL_BIT | (base & 0x7FFFu))
+                                : base;
+    }
+    return ((const uint32_t *) frozen_trie_cells_ (ft))[2 * s];
+}
+
+static inline uint32_t
+frozen_trie_get_check_ (const FrozenTrie *ft, uint32_t s)
+{
+    if (ft->index_width == 2)
+        return ((const uint16_t *) frozen_trie_cells_ (ft))[2 * s + 1];
+    return ((const uint32_t *) frozen_trie_cells_ (ft))[2 * s + 1];
+}
+
+/**
+ * @brief Map an alphabet character for a frozen trie
+ *
+ * @param ft : the frozen trie
+ * @param c  : the alphabet character
+ *
+ * @return the TrieChar for @a c, or TRIE_INDEX_MAX if not in the alphabet
+ */
+static inline TrieIndex
+frozen_trie_char_to_trie (const FrozenTrie *ft, AlphaChar c)
+{
+    return ft->alpha_to_trie[(unsigned char) c];
+}
+
+/**
+ * @brief Walk a frozen trie by one TrieChar
+ *
+ * @param ft : the frozen trie
+ * @param s  : current state
+ * @param tc : the TrieChar to walk
+ *
+ * @return the new state, or FROZEN_TRIE_STATE_FAIL if there is no transition
+ *
+ * Walking TRIE_CHAR_TERM from a terminal state gives a state from which the
+ * data may be read. @a s must not be FROZEN_TRIE_STATE_FAIL.
+ */
+static inline FrozenTrieState
+frozen_trie_walk_tc (const FrozenTrie *ft, FrozenTrieState s, TrieChar tc)
+{
+    uint32_t next;
+
+    if (s & FROZEN_TRIE_TAIL_BIT) {
+        const TrieChar *p = frozen_trie_tail_ (ft) + (s & ~FROZEN_TRIE_TAIL_BIT);
+
+        if (*p != tc)
+            return FROZEN_TRIE_STATE_FAIL;
+        /* stop and stay at the terminator */
+        return (TRIE_CHAR_TERM == tc) ? s : s + 1;
+    }
+    next = frozen_trie_get_base_ (ft, s) + tc;
+    if (frozen_trie_get_check_ (ft, next) != s)
+        return FROZEN_TRIE_STATE_FAIL;
+    /* separate nodes continue straight into their suffix */
+    return frozen_trie_get_base_ (ft, next) & FROZEN_TRIE_TAIL_BIT
+                ? frozen_trie_get_base_ (ft, next)
+                : next;
+}
+
+/**
+ * @brief Walk a frozen trie by one alphabet character
+ *
+ * @param ft : the frozen trie
+ * @param s  : current state
+ * @param c  : the alphabet character to walk
+ *
+ * @return the new state, or FROZEN_TRIE_STATE_FAIL if there is no transition
+ */
+static inline FrozenTrieState
+frozen_trie_walk (const FrozenTrie *ft, FrozenTrieState s, AlphaChar c)
+{
+    TrieIndex tc = frozen_trie_char_to_trie (ft, c);
+
+    if (TRIE_INDEX_MAX == tc)
+        return FROZEN_TRIE_STATE_FAIL;
+    return frozen_trie_walk_tc (ft, s, (TrieChar) tc);
+}
+
+/**
+ * @brief Prefetch the memory a walk will need
+ *
+ * @param ft : the frozen trie
+ * @param s  : the state to walk from
+ * @param tc : the TrieChar that will be walked
+ *
+ * Hint that frozen_trie_walk_tc (@a ft, @a s, @a tc) will be called soon, so
+ * that several walks may be interleaved without stalling on cache misses.
+ */
+static inline void
+frozen_trie_prefetch (const FrozenTrie *ft, FrozenTrieState s, TrieChar tc)
+{
+#if defined(__GNUC__)
+    if (s & FROZEN_TRIE_TAIL_BIT) {
+        __builtin_prefetch (frozen_trie_tail_ (ft)
+                                + (s & ~FROZEN_TRIE_TAIL_BIT));
+    } else {
+        size_t cell = (size_t) frozen_trie_get_base_ (ft, s) + tc;
+
+        __builtin_prefetch (frozen_trie_cells_ (ft)
+                                + cell * 2 * ft->index_width);
+    }
+#else
+    (void) ft; (void) s; (void) tc;
+#endif
+}
+
+/**
+ * @brief Get the data of a key ending at a state
+ *
+ * @param ft     : the frozen trie
+ * @param s      : the state
+ * @param o_data : storage for the data, may be NULL
+ *
+ * @return boolean indicating whether @a s is a terminal state
+ */
+static inline bool
+frozen_trie_get_terminal_data (const FrozenTrie *ft, FrozenTrieState s,
+                               TrieData *o_data)
+{
+    const TrieChar *p;
+
+    if (!(s & FROZEN_TRIE_TAIL_BIT)) {
+        s = frozen_trie_walk_tc (ft, s, TRIE_CHAR_TERM);
+        if (FROZEN_TRIE_STATE_FAIL == s)
+            return false;
+    }
+    p = frozen_trie_tail_ (ft) + (s & ~FROZEN_TRIE_TAIL_BIT);
+    if (TRIE_CHAR_TERM != *p)
+        return false;
+    if (o_data)
+        memcpy (o_data, p + 1, sizeof (*o_data));
+    return true;
+}
+
+/**
+ * @brief Find the longest key that is a prefix of a string
+ *
+ * @param ft     : the frozen trie
+ * @param str    : the string to look up; need not be terminated
+ * @param len    : the number of characters in @a str
+ * @param o_data : storage for the data of the longest key, may be NULL
+ * @param o_len  : storage for the length of the longest key, may be NULL
+ *
+ * @return boolean indicating whether any key is a prefix of @a str
+ */
+static inline bool
+frozen_trie_longest_prefix (const FrozenTrie *ft, const AlphaChar *str,
+                            size_t len, TrieData *o_data, size_t *o_len)
+{
+    FrozenTrieState s = FROZEN_TRIE_STATE_ROOT;
+    FrozenTrieState last = FROZEN_TRIE_STATE_FAIL;
+    size_t          last_len = 0;
+    size_t          i;
+
+    for (i = 0; i < len; i++) {
+        s = frozen_trie_walk (ft, s, str[i]);
+        if (FROZEN_TRIE_STATE_FAIL == s)
+            break;
+        if (frozen_trie_get_terminal_data (ft, s, NULL)) {
+            last = s;
+            last_len = i + 1;
+        }
+    }
+    if (FROZEN_TRIE_STATE_FAIL == last)
+        return false;
+    if (o_len)
+        *o_len = last_len;
+    return frozen_trie_get_terminal_data (ft, last, o_data);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* __TRIE_FROZEN_H */
+
+/*
+vi:ts=4:ai:expandtab
+*/
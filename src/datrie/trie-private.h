@@ -28,6 +28,10 @@
 #define __TRIE_PRIVATE_H
 
 #include <datrie/typedefs.h>
+#include "trie.h"
+#include "alpha-map.h"
+#include "darray.h"
+#include "tail.h"
 
 /**
  * @file trie-private.h
@@ -43,6 +47,20 @@
  */
 #define MAX_VAL(a,b)  ((a)>(b)?(a):(b))
 
+/**
+ * @brief Trie structure
+ *
+ * Shared with other modules of the library (e.g. trie-frozen.c), which need
+ * to read the underlying double-array and tail directly.
+ */
+struct _Trie {
+    AlphaMap   *alpha_map;
+    DArray     *da;
+    Tail       *tail;
+
+    bool        is_dirty;
+};
+
 #endif  /* __TRIE_PRIVATE_H */
 
 /*
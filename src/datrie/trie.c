@@ -28,33 +28,13 @@
 #include <string.h>
 
 #include "trie.h"
+#include "trie-private.h"
 #include "alpha-map.h"
 #include "alpha-map-private.h"
 #include "darray.h"
 #include "tail.h"
 #include "trie-string.h"
 
-/**
- * @brief Trie structure
- */
-struct _Trie {
-    AlphaMap   *alpha_map;
-    DArray     *da;
-    Tail       *tail;
-
-    bool        is_dirty;
-};
-
-/**
- * @brief TrieState structure
- */
-struct _TrieState {
-    const Trie *trie;       /**< the corresponding trie */
-    TrieIndex   index;      /**< index in double-array/tail structures */
-    short       suffix_idx; /**< suffix character offset, if in suffix */
-    short       is_suffix;  /**< whether it is currently in suffix part */
-};
-
 /**
  * @brief TrieIterator structure
  */
@@ -520,6 +500,26 @@ trie_root (const Trie *trie)
     return trie_state_new (trie, da_get_root (trie->da), 0, false);
 }
 
+/**
+ * @brief Initialise a caller-owned state at the root of a trie
+ *
+ * @param trie : the trie
+ * @param s    : the state to initialise
+ *
+ * Set up @a s, which may live on the stack, as the root state of @a trie.
+ * This is the allocation-free equivalent of trie_root(), intended for hot
+ * loops. Unlike states from trie_root(), @a s must not be freed with
+ * trie_state_free().
+ */
+void
+trie_root_init (const Trie *trie, TrieState *s)
+{
+    s->trie       = trie;
+    s->index      = da_get_root (trie->da);
+    s->suffix_idx = 0;
+    s->is_suffix  = false;
+}
+
 /*----------------*
  *   TRIE STATE   *
  *----------------*/
@@ -69,7 +69,8 @@ extern "C" {
  *   trie_state_is_walkable(), trie_state_walkable_chars(),
  *   trie_state_is_single(), trie_state_get_data().
  *   And do not forget to free TrieState objects with trie_state_free()
- *   after use.)
+ *   after use. Alternatively, use trie_root_init() to set up a TrieState
+ *   in caller-owned storage, which needs no freeing.)
  * - Enumerate all keys using trie_enumerate()
  * - Iterate entries using TrieIterator and its functions
  *   (trie_iterator_new(), trie_iterator_next(), trie_iterator_get_key(),
@@ -98,9 +99,22 @@ typedef bool (*TrieEnumFunc) (const AlphaChar  *key,
 
 /**
  * @brief Trie walking state
+ *
+ * The structure is public so that callers on a hot path may keep states on
+ * the stack (or inside their own structures) rather than heap-allocating them
+ * with trie_root() and trie_state_clone(). Such states are set up with
+ * trie_root_init() and duplicated with trie_state_copy(), and must never be
+ * passed to trie_state_free(). The members should be treated as opaque.
  */
 typedef struct _TrieState TrieState;
 
+struct _TrieState {
+    const Trie *trie;       /**< the corresponding trie */
+    TrieIndex   index;      /**< index in double-array/tail structures */
+    short       suffix_idx; /**< suffix character offset, if in suffix */
+    short       is_suffix;  /**< whether it is currently in suffix part */
+};
+
 
 /**
  * @brief Trie iteration state
@@ -143,6 +157,8 @@ bool    trie_enumerate (const Trie     *trie,
 
 TrieState * trie_root (const Trie *trie);
 
+void        trie_root_init (const Trie *trie, TrieState *s);
+
 
 /*----------------*
  *   TRIE STATE   *
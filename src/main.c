@@ -69,7 +69,7 @@ print_usage(void)
 {
     print_version();
     fprintf(stderr, "\nUSAGE:\n");
-    fprintf(stderr, "axe-demux [-mzc2pt] -b (-f [-r] | -i) (-F [-R] | -I)\n");
+    fprintf(stderr, "axe-demux [-mzc2psewEtCTX] -b (-f [-r] | -i) (-F [-R] | -I)\n");
     fprintf(stderr, "axe-demux -h\n");
     fprintf(stderr, "axe-demux -v\n\n");
     fprintf(stderr, "OPTIONS:\n");
@@ -78,6 +78,26 @@ print_usage(void)
     fprintf(stderr, "    -c, --combinatorial\tUse combinatorial barcode matching. [flag, default OFF]\n");
     fprintf(stderr, "    -p, --permissive\tDon't error on barcode mismatch confict, matching only\n");
     fprintf(stderr, "                    \texactly for conficting barcodes. [flag, default OFF]\n");
+    fprintf(stderr, "    -s, --search\tMatch by searching for barcodes within the mismatch\n");
+    fprintf(stderr, "                    \tlevel, rather than loading every mismatched barcode.\n");
+    fprintf(stderr, "                    \tAllows mismatch levels above 4. [flag, default OFF]\n");
+    fprintf(stderr, "    -e, --edit\t\tSearch as -s does, also counting insertions and\n");
+    fprintf(stderr, "                    \tdeletions as mismatches, of which up to 4 are\n");
+    fprintf(stderr, "                    \tallowed. [flag, default OFF]\n");
+    fprintf(stderr, "    -w, --search-window\tFind barcodes anywhere in the first N bases of each\n");
+    fprintf(stderr, "                    \tread, not just at its start, for protocols with a\n");
+    fprintf(stderr, "                    \tspacer before the barcode. [int, default 0]\n");
+    fprintf(stderr, "    -E, --engine\tMatch reads with this engine: trie, kmer, hash, hamming,\n");
+    fprintf(stderr, "                    \tsearch, seed, edit or dawg, rather than timing every\n");
+    fprintf(stderr, "                    \tengine that suits the barcodes on the first reads.\n");
+    fprintf(stderr, "                    \t[default auto]\n");
+    fprintf(stderr, "    -C, --cache-mb\tMemory for caching matches of common read prefixes,\n");
+    fprintf(stderr, "                    \tin MiB up to 1024, or 0 for no cache. [int, default 0]\n");
+    fprintf(stderr, "    -T, --threads\tThreads to load barcodes and their mismatches with,\n");
+    fprintf(stderr, "                    \tor 0 for one per core. [int, default 0]\n");
+    fprintf(stderr, "    -X, --index-dir\tKeep the loaded barcodes in an index in this\n");
+    fprintf(stderr, "                    \tdirectory, and map them from it in later runs\n");
+    fprintf(stderr, "                    \twith the same barcodes and options. [dir]\n");
     fprintf(stderr, "    -2, --trim-r2\tTrim barcode from R2 read as well as R1. [flag, default OFF]\n");
     fprintf(stderr, "    -b, --barcodes\tBarcode file. See --help for example. [file]\n");
     fprintf(stderr, "    -f, --fwd-in\tInput forward read. [file]\n");
@@ -94,13 +114,20 @@ print_usage(void)
     fprintf(stderr, "\n");
 }
 
-static const char *axe_opts = "m:z:c2pb:f:F:r:R:i:I:t:hVvqd";
+static const char *axe_opts = "m:z:c2psew:E:C:T:X:b:f:F:r:R:i:I:t:hVvqd";
 static const struct option axe_longopts[] = {
     { "mismatch",   optional_argument,  NULL,   'm' },
     { "ziplevel",   required_argument,  NULL,   'z' },
     { "combinatorial", no_argument,     NULL,   'c' },
     { "trim-r2",    no_argument,        NULL,   '2' },
     { "permissive", no_argument,        NULL,   'p' },
+    { "search",     no_argument,        NULL,   's' },
+    { "edit",       no_argument,        NULL,   'e' },
+    { "search-window", required_argument, NULL, 'w' },
+    { "engine",     required_argument,  NULL,   'E' },
+    { "cache-mb",   required_argument,  NULL,   'C' },
+    { "threads",    required_argument,  NULL,   'T' },
+    { "index-dir",  required_argument,  NULL,   'X' },
     { "barcodes",   required_argument,  NULL,   'b' },
     { "fwd-in",     required_argument,  NULL,   'f' },
     { "fwd-out",    required_argument,  NULL,   'F' },
@@ -121,6 +148,7 @@ parse_args(struct axe_config *config, int argc, char * const *argv)
 {
     int c = 0;
     int optind = 0;
+    long cache_mb = 0;
 
     if (argc < 2 ) {
         return 1;
@@ -134,6 +162,7 @@ parse_args(struct axe_config *config, int argc, char * const *argv)
     config->mismatches = 1;
     config->verbosity = 0;
     config->out_compress_level = 0;
+    config->tune_reads = AXE_TUNE_READS;
     /* Parse argv using getopt */
     while ((c = getopt_long(argc, argv, axe_opts, axe_longopts, &optind)) > 0){
         switch (c) {
@@ -149,6 +178,40 @@ parse_args(struct axe_config *config, int argc, char * const *argv)
             case 'p':
                 config->permissive |= 1;
                 break;
+            case 's':
+                config->search |= 1;
+                break;
+            case 'e':
+                config->edit |= 1;
+                break;
+            case 'w':
+                config->window = (size_t)atol(optarg);
+                break;
+            case 'E':
+                if (strcmp(optarg, "auto") == 0) {
+                    config->pin_engine = 0;
+                } else if (axe_engine_parse(optarg, &config->engine) == 0) {
+                    config->pin_engine = 1;
+                } else {
+                    fprintf(stderr, "ERROR: Unknown engine %s\n", optarg);
+                    goto error;
+                }
+                break;
+            case 'C':
+                cache_mb = atol(optarg);
+                if (cache_mb < 0 || cache_mb > AXE_CACHE_MAX_MB) {
+                    fprintf(stderr, "ERROR: Cache size must be 0 to %d MiB\n",
+                            AXE_CACHE_MAX_MB);
+                    goto error;
+                }
+                config->cache_bytes = (size_t)cache_mb << 20;
+                break;
+            case 'T':
+                config->threads = (unsigned int)atoi(optarg);
+                break;
+            case 'X':
+                config->index_dir = strdup(optarg);
+                break;
             case '2':
                 config->trim_rev |= 1;
                 break;
@@ -216,11 +279,23 @@ parse_args(struct axe_config *config, int argc, char * const *argv)
         fprintf(stderr, "ERROR: Barcode file must be provided\n");
         goto error;
     }
-    if (config->mismatches > 4) {
+    /* Every mismatched barcode is loaded unless searching, which would take
+     * forever above this */
+    if (config->mismatches > 4 && !config->search) {
         fprintf(stderr, "ERROR: Silly mismatch level %zu\n",
                 config->mismatches);
         goto error;
     }
+    /* The window is searched for the mutants */
+    if (config->window > 0 && (config->search || config->edit)) {
+        fprintf(stderr, "ERROR: --search-window can't be used with --search or --edit\n");
+        goto error;
+    }
+    if (config->window > AXE_WINDOW_MAX_WIDTH) {
+        fprintf(stderr, "ERROR: Search window of %zu bases is over %d\n",
+                config->window, AXE_WINDOW_MAX_WIDTH);
+        goto error;
+    }
     if (config->in_mode == READS_UNKNOWN) {
         fprintf(stderr, "ERROR: Input file(s) must be provided\n");
         goto error;
@@ -389,6 +464,16 @@ main (int argc, char * const *argv)
         fprintf(stderr, "[main] ERROR: axe_load_tries returned %i\n", ret);
         goto end;
     }
+    ret = axe_tune_engines(config);
+    if (ret != 0) {
+        fprintf(stderr, "[main] ERROR: axe_tune_engines returned %i\n", ret);
+        goto end;
+    }
+    ret = axe_save_index(config);
+    if (ret != 0) {
+        fprintf(stderr, "[main] ERROR: axe_save_index returned %i\n", ret);
+        goto end;
+    }
     ret = axe_make_outputs(config);
     if (ret != 0) {
         fprintf(stderr, "[main] ERROR: axe_make_outputs returned %i\n", ret);
@@ -0,0 +1,206 @@
+/*
+ * ============================================================================
+ *
+ *       Filename:  bench_match.c
+ *
+ *    Description:  Benchmark read matching, one read at a time vs batched
+ *
+ *        License:  GPLv3+
+ *       Compiler:  gcc, clang
+ *
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "tests.h"
+
+#define N_BARCODES 384
+#define BARCODE_LEN 10
+#define MISMATCHES 2
+#define N_READS 2000000
+#define READ_LEN 20
+
+static uint32_t rand_state = 1;
+
+static uint32_t
+next_rand(void)
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return rand_state >> 16;
+}
+
+static double
+now_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct axe_trie *
+make_trie(char barcodes[N_BARCODES][BARCODE_LEN + 1])
+{
+    struct axe_trie *trie = axe_trie_create();
+    char **mutated = NULL;
+    size_t n_mutated = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    unsigned int dist = 0;
+
+    for (iii = 0; iii < N_BARCODES; iii++) {
+        for (jjj = 0; jjj < BARCODE_LEN; jjj++) {
+            barcodes[iii][jjj] = "ACGT"[next_rand() & 3];
+        }
+        barcodes[iii][BARCODE_LEN] = '\0';
+        axe_trie_add(trie, barcodes[iii], iii);
+    }
+    /* Conflicting mutants are simply dropped, as in permissive mode */
+    for (iii = 0; iii < N_BARCODES; iii++) {
+        for (dist = 1; dist <= MISMATCHES; dist++) {
+            mutated = hamming_mutate_dna(&n_mutated, barcodes[iii],
+                                         BARCODE_LEN, dist, 0);
+            for (jjj = 0; jjj < n_mutated; jjj++) {
+                axe_trie_add(trie, mutated[jjj], iii);
+                free(mutated[jjj]);
+            }
+            free(mutated);
+        }
+    }
+    axe_trie_freeze(trie);
+    return trie;
+}
+
+static double
+bench(struct axe_trie *trie, struct qes_seq **seqs, int batched,
+      size_t *n_matched)
+{
+    ssize_t results[AXE_BATCH_SIZE];
+    double start = now_secs();
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    *n_matched = 0;
+    for (iii = 0; iii < N_READS; iii += AXE_BATCH_SIZE) {
+        if (batched) {
+            axe_match_batch(trie, seqs + iii, AXE_BATCH_SIZE, results);
+        } else {
+            for (jjj = 0; jjj < AXE_BATCH_SIZE; jjj++) {
+                axe_match_read(NULL, &results[jjj], trie, seqs[iii + jjj]);
+            }
+        }
+        for (jjj = 0; jjj < AXE_BATCH_SIZE; jjj++) {
+            *n_matched += results[jjj] >= 0;
+        }
+    }
+    return N_READS / (now_secs() - start);
+}
+
+/* Pairs matched as combinatorial mode did, looking up every second read,
+ * and as it does now, only those whose first read matched */
+static double
+bench_pairs(struct axe_trie *trie, struct qes_seq **seqs, int skip,
+            size_t *n_matched)
+{
+    ssize_t results1[AXE_BATCH_SIZE];
+    ssize_t results2[AXE_BATCH_SIZE];
+    const size_t n_pairs = N_READS / 2;
+    double start = now_secs();
+    size_t iii = 0;
+    size_t jjj = 0;
+
+    *n_matched = 0;
+    for (iii = 0; iii < n_pairs; iii += AXE_BATCH_SIZE) {
+        if (skip) {
+            axe_match_batch_pairs(trie, trie, seqs + iii, seqs + n_pairs + iii,
+                                  AXE_BATCH_SIZE, results1, results2, NULL,
+                                  NULL);
+        } else {
+            axe_match_batch(trie, seqs + iii, AXE_BATCH_SIZE, results1);
+            axe_match_batch(trie, seqs + n_pairs + iii, AXE_BATCH_SIZE,
+                            results2);
+        }
+        for (jjj = 0; jjj < AXE_BATCH_SIZE; jjj++) {
+            *n_matched += results1[jjj] >= 0 && results2[jjj] >= 0;
+        }
+    }
+    return n_pairs / (now_secs() - start);
+}
+
+int
+main(void)
+{
+    static char barcodes[N_BARCODES][BARCODE_LEN + 1];
+    struct axe_trie *trie = NULL;
+    struct qes_seq **seqs = NULL;
+    char read[READ_LEN + 1];
+    enum axe_engine best;
+    const char *engine_names[] = {"trie", "kmer", "hash"};
+    size_t n_single = 0;
+    size_t n_batch = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    int run = 0;
+
+    trie = make_trie(barcodes);
+    best = trie->engine;
+    seqs = calloc(N_READS, sizeof(*seqs));
+    for (iii = 0; iii < N_READS; iii++) {
+        for (jjj = 0; jjj < READ_LEN; jjj++) {
+            read[jjj] = "ACGT"[next_rand() & 3];
+        }
+        read[READ_LEN] = '\0';
+        /* Most reads carry a barcode, some with errors or Ns */
+        if (next_rand() % 10 < 8) {
+            memcpy(read, barcodes[next_rand() % N_BARCODES], BARCODE_LEN);
+            if (next_rand() % 4 == 0) {
+                read[next_rand() % BARCODE_LEN] = "ACGTN"[next_rand() % 5];
+            }
+        }
+        seqs[iii] = qes_seq_create();
+        qes_seq_fill(seqs[iii], "read", "", read, read);
+    }
+    printf("%d barcodes of %dbp, %d mismatches, %d reads\n", N_BARCODES,
+           BARCODE_LEN, MISMATCHES, N_READS);
+    /* The trie alone, then with its first levels tabulated, then the
+     * engine the barcodes suit best */
+    for (run = 0; run < 3; run++) {
+        double single, batched;
+
+        trie->engine = run < 2 ? AXE_ENGINE_TRIE : best;
+        if (run == 1) {
+            trie->top = axe_top_create(trie->trie, trie->frozen,
+                                       AXE_TOP_MAX_BYTES);
+        } else if (run == 2 && best != AXE_ENGINE_TRIE) {
+            axe_top_destroy(trie->top);
+        }
+        single = bench(trie, seqs, 0, &n_single);
+        batched = bench(trie, seqs, 1, &n_batch);
+        if (n_single != n_batch) {
+            fprintf(stderr, "Batched results differ!\n");
+            return EXIT_FAILURE;
+        }
+        printf("%-5s%s single: %6.2fM reads/s  batched: %6.2fM reads/s  "
+               "(%.2fx)\n", engine_names[trie->engine],
+               trie->top != NULL ? "+top" : "    ", single / 1e6,
+               batched / 1e6, batched / single);
+    }
+    {
+        double both = bench_pairs(trie, seqs, 0, &n_single);
+        double skip = bench_pairs(trie, seqs, 1, &n_batch);
+
+        if (n_single != n_batch) {
+            fprintf(stderr, "Pair results differ!\n");
+            return EXIT_FAILURE;
+        }
+        printf("pairs     both:   %6.2fM pairs/s  R1 first: %6.2fM pairs/s  "
+               "(%.2fx)\n", both / 1e6, skip / 1e6, skip / both);
+    }
+    for (iii = 0; iii < N_READS; iii++) {
+        qes_seq_destroy(seqs[iii]);
+    }
+    free(seqs);
+    axe_trie_destroy(trie);
+    return EXIT_SUCCESS;
+}
@@ -18,6 +18,40 @@
 
 #include "tests.h"
 
+#ifdef AXE_TEST_WRAP_MALLOC
+/* The test binary is linked with --wrap for the allocator, so that we can
+ * count heap allocations made by library code. */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+static size_t n_allocs = 0;
+
+void *
+__wrap_malloc(size_t size)
+{
+    n_allocs++;
+    return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t nmemb, size_t size)
+{
+    n_allocs++;
+    return __real_calloc(nmemb, size);
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size)
+{
+    n_allocs++;
+    return __real_realloc(ptr, size);
+}
+#endif
+
 static void
 test_product (void *ptr)
 {
@@ -55,23 +89,20 @@ test_hamming_mutate (void *ptr)
     size_t count = 0;
     size_t iii = 0;
     const char *str = "AAAA";
+    /* The original, then each neighbour at distance two, once */
     const char *truth[] = {
-        "AAAA", "ACAA", "AGAA", "ATAA", "CAAA", "CCAA", "CGAA", "CTAA", "GAAA",
-        "GCAA", "GGAA", "GTAA", "TAAA", "TCAA", "TGAA", "TTAA", "AAAA", "AACA",
-        "AAGA", "AATA", "CAAA", "CACA", "CAGA", "CATA", "GAAA", "GACA", "GAGA",
-        "GATA", "TAAA", "TACA", "TAGA", "TATA", "AAAA", "AAAC", "AAAG", "AAAT",
-        "CAAA", "CAAC", "CAAG", "CAAT", "GAAA", "GAAC", "GAAG", "GAAT", "TAAA",
-        "TAAC", "TAAG", "TAAT", "AAAA", "AACA", "AAGA", "AATA", "ACAA", "ACCA",
-        "ACGA", "ACTA", "AGAA", "AGCA", "AGGA", "AGTA", "ATAA", "ATCA", "ATGA",
-        "ATTA", "AAAA", "AAAC", "AAAG", "AAAT", "ACAA", "ACAC", "ACAG", "ACAT",
-        "AGAA", "AGAC", "AGAG", "AGAT", "ATAA", "ATAC", "ATAG", "ATAT", "AAAA",
-        "AAAC", "AAAG", "AAAT", "AACA", "AACC", "AACG", "AACT", "AAGA", "AAGC",
-        "AAGG", "AAGT", "AATA", "AATC", "AATG", "AATT", };
+        "AAAA",
+        "CCAA", "CGAA", "CTAA", "GCAA", "GGAA", "GTAA", "TCAA", "TGAA", "TTAA",
+        "CACA", "CAGA", "CATA", "GACA", "GAGA", "GATA", "TACA", "TAGA", "TATA",
+        "CAAC", "CAAG", "CAAT", "GAAC", "GAAG", "GAAT", "TAAC", "TAAG", "TAAT",
+        "ACCA", "ACGA", "ACTA", "AGCA", "AGGA", "AGTA", "ATCA", "ATGA", "ATTA",
+        "ACAC", "ACAG", "ACAT", "AGAC", "AGAG", "AGAT", "ATAC", "ATAG", "ATAT",
+        "AACC", "AACG", "AACT", "AAGC", "AAGG", "AAGT", "AATC", "AATG", "AATT", };
 
     (void) ptr;
     mutated  = hamming_mutate_dna(&count, str, strlen(str), 2, 1);
     tt_ptr_op(mutated, !=, NULL);
-    tt_int_op(count, ==, 96);
+    tt_int_op(count, ==, 55);
     for (iii = 0; iii < count; iii++) {
         tt_ptr_op(mutated[iii], !=, NULL);
         tt_str_op(mutated[iii], ==, truth[iii]);
@@ -88,8 +119,2593 @@ end:
     }
 }
 
+static void
+test_mutator (void *ptr)
+{
+    struct axe_mutator *mut = NULL;
+    char **mutated = NULL;
+    const char *mutant = NULL;
+    size_t count = 0;
+    size_t iii = 0;
+    size_t dist = 0;
+    const char *strs[] = {"ACGTAC", "TTTTTT", "GATTACA"};
+#ifdef AXE_TEST_WRAP_MALLOC
+    size_t allocs_before = 0;
+#endif
+
+    (void) ptr;
+    mut = axe_mutator_create();
+    tt_ptr_op(mut, !=, NULL);
+    tt_int_op(axe_mutator_start(mut, NULL, 4, 1, 0), ==, -1);
+    tt_int_op(axe_mutator_start(mut, "ACGT", 4, 0, 0), ==, -1);
+    tt_int_op(axe_mutator_start(mut, "ACGT", 4, 5, 0), ==, -1);
+    /* The enumerator lists what hamming_mutate_dna returns, in order */
+    for (iii = 0; iii < sizeof(strs) / sizeof(*strs); iii++) {
+        for (dist = 1; dist <= 3; dist++) {
+            size_t jjj = 0;
+
+            mutated = hamming_mutate_dna(&count, strs[iii], strlen(strs[iii]),
+                                         dist, dist == 2);
+            tt_ptr_op(mutated, !=, NULL);
+            tt_int_op(axe_mutator_start(mut, strs[iii], strlen(strs[iii]),
+                                        dist, dist == 2), ==, 0);
+            while ((mutant = axe_mutator_next(mut)) != NULL) {
+                tt_int_op(jjj, <, count);
+                tt_str_op(mutant, ==, mutated[jjj]);
+                jjj++;
+            }
+            tt_int_op(jjj, ==, count);
+            for (jjj = 0; jjj < count; jjj++) {
+                free(mutated[jjj]);
+            }
+            free(mutated);
+            mutated = NULL;
+        }
+    }
+    tt_int_op(mut->n_patterns, ==, 6);
+#ifdef AXE_TEST_WRAP_MALLOC
+    /* Once the patterns for a length are known, nothing more is allocated */
+    allocs_before = n_allocs;
+    tt_int_op(axe_mutator_start(mut, "CCCCCC", 6, 2, 0), ==, 0);
+    count = 0;
+    while ((mutant = axe_mutator_next(mut)) != NULL) {
+        count++;
+    }
+    tt_int_op(n_allocs, ==, allocs_before);
+    tt_int_op(count, ==, 15 * 9);
+#endif
+    /* The original comes first if kept, and any letter replaces an N */
+    tt_int_op(axe_mutator_start(mut, "GATNACA", 7, 1, 1), ==, 0);
+    tt_str_op(axe_mutator_next(mut), ==, "GATNACA");
+    for (count = 0; (mutant = axe_mutator_next(mut)) != NULL; count++) {
+        tt_str_op(mutant, !=, "GATNACA");
+    }
+    tt_int_op(count, ==, 6 * 3 + 4);
+
+end:
+    if (mutated != NULL) {
+        for (iii = 0; iii < count; iii++) {
+            free(mutated[iii]);
+        }
+        free(mutated);
+    }
+    axe_mutator_destroy(mut);
+}
+
+static void
+test_match_read_noalloc (void *ptr)
+{
+#ifdef AXE_TEST_WRAP_MALLOC
+    struct axe_trie *trie = NULL;
+    struct qes_seq *seq = NULL;
+    ssize_t value = -1;
+    size_t allocs_before = 0;
+    size_t iii = 0;
+    int ret = 0;
+    const char *reads[] = {
+        "ACGTACGTTTTT", /* exact match to the long barcode */
+        "ACGTAGGTTTTT", /* falls back to the short barcode */
+        "TTTTTTTTTTTT", /* no match at all */
+        "ACGT",         /* read ends on the barcode */
+    };
+    const ssize_t truth[] = {1, 0, -1, 0};
+
+    (void) ptr;
+    trie = axe_trie_create();
+    tt_ptr_op(trie, !=, NULL);
+    tt_int_op(axe_trie_add(trie, "ACGT", 0), ==, 0);
+    tt_int_op(axe_trie_add(trie, "ACGTACGT", 1), ==, 0);
+    seq = qes_seq_create();
+    for (iii = 0; iii < sizeof(reads) / sizeof(*reads); iii++) {
+        qes_seq_fill(seq, "read", "", reads[iii], reads[iii]);
+        allocs_before = n_allocs;
+        ret = axe_match_read(NULL, &value, trie, seq);
+        tt_int_op(n_allocs, ==, allocs_before);
+        tt_int_op(ret, ==, truth[iii] < 0 ? 1 : 0);
+        tt_int_op(value, ==, truth[iii]);
+    }
+
+end:
+    qes_seq_destroy(seq);
+    axe_trie_destroy(trie);
+#else
+    (void) ptr;
+    tt_skip();
+end:
+    ;
+#endif
+}
+
+static void
+test_match_read_lowercase (void *ptr)
+{
+    struct axe_trie *trie = NULL;
+    struct qes_seq *seq = NULL;
+    ssize_t value = -1;
+    size_t iii = 0;
+    const char *reads[] = {
+        "ACGTACGTTTTT",
+        "acgtacgttttt", /* soft-masked */
+        "AcGtAcGtTtTt",
+        "acgtaggttttt", /* soft-masked, short barcode only */
+        "nnnnnnnnnnnn",
+    };
+    const ssize_t truth[] = {1, 1, 1, 0, -1};
+
+    (void) ptr;
+    trie = axe_trie_create();
+    tt_ptr_op(trie, !=, NULL);
+    tt_int_op(axe_trie_add(trie, "ACGT", 0), ==, 0);
+    tt_int_op(axe_trie_add(trie, "ACGTACGT", 1), ==, 0);
+    /* Lower case keys are the same keys */
+    tt_int_op(axe_trie_add(trie, "acgt", 2), ==, 1);
+    seq = qes_seq_create();
+    for (iii = 0; iii < sizeof(reads) / sizeof(*reads); iii++) {
+        qes_seq_fill(seq, "read", "", reads[iii], reads[iii]);
+        axe_match_read(NULL, &value, trie, seq);
+        tt_int_op(value, ==, truth[iii]);
+    }
+
+end:
+    qes_seq_destroy(seq);
+    axe_trie_destroy(trie);
+}
+
+static void
+make_kmer(char *kmer, size_t k, size_t idx)
+{
+    size_t iii;
+
+    for (iii = 0; iii < k; iii++) {
+        kmer[k - iii - 1] = "ACGT"[idx & 3];
+        idx >>= 2;
+    }
+    kmer[k] = '\0';
+}
+
+/* Deterministic reads, with the odd N */
+static void
+random_read(char *read, size_t len, uint32_t *rand)
+{
+    size_t iii;
+
+    for (iii = 0; iii < len; iii++) {
+        *rand = *rand * 1103515245 + 12345;
+        read[iii] = "ACGTACGTACGTACGN"[(*rand >> 16) & 15];
+    }
+    read[len] = '\0';
+}
+
+static void
+test_match_read_frozen (void *ptr)
+{
+    struct axe_trie *trie = NULL;
+    struct qes_seq *seq = NULL;
+    ssize_t *truth = NULL;
+    ssize_t value = -1;
+    char kmer[9];
+    char read[13];
+    const size_t n_reads = 5000;
+    /* Every seventh 8-mer makes a trie too big for 16-bit cells */
+    const size_t steps[] = {1031, 7};
+    const uint32_t widths[] = {2, 4};
+    size_t iii = 0;
+    size_t run = 0;
+    uint32_t rand = 1;
+
+    (void) ptr;
+    truth = calloc(n_reads, sizeof(*truth));
+    seq = qes_seq_create();
+    for (run = 0; run < 2; run++) {
+        trie = axe_trie_create();
+        tt_ptr_op(trie, !=, NULL);
+        /* Nested keys of several lengths, so longest match matters */
+        for (iii = 0; iii < 64; iii++) {
+            make_kmer(kmer, 3, iii);
+            tt_int_op(axe_trie_add(trie, kmer, iii), ==, 0);
+        }
+        for (iii = 0; iii < 1024; iii += 3) {
+            make_kmer(kmer, 5, iii);
+            tt_int_op(axe_trie_add(trie, kmer, 100 + iii), ==, 0);
+        }
+        for (iii = 0; iii < 65536; iii += steps[run]) {
+            make_kmer(kmer, 8, iii);
+            tt_int_op(axe_trie_add(trie, kmer, 2000 + iii), ==, 0);
+        }
+        /* Results from the mutable trie are the truth */
+        for (rand = 1, iii = 0; iii < n_reads; iii++) {
+            random_read(read, 12, &rand);
+            qes_seq_fill(seq, "read", "", read, read);
+            axe_match_read(NULL, &truth[iii], trie, seq);
+        }
+        tt_int_op(axe_trie_freeze(trie), ==, 0);
+        tt_ptr_op(trie->frozen, !=, NULL);
+        tt_int_op(trie->frozen->index_width, ==, widths[run]);
+        /* Only test the frozen trie itself */
+        trie->engine = AXE_ENGINE_TRIE;
+        for (rand = 1, iii = 0; iii < n_reads; iii++) {
+            random_read(read, 12, &rand);
+            qes_seq_fill(seq, "read", "", read, read);
+            tt_int_op(axe_match_read(NULL, &value, trie, seq), ==,
+                      truth[iii] < 0 ? 1 : 0);
+            tt_int_op(value, ==, truth[iii]);
+        }
+        /* Changing the trie drops the stale image */
+        tt_int_op(axe_trie_add(trie, "TTTTTTTTTT", 1), ==, 0);
+        tt_ptr_op(trie->frozen, ==, NULL);
+        axe_trie_destroy(trie);
+    }
+
+end:
+    free(truth);
+    qes_seq_destroy(seq);
+    axe_trie_destroy(trie);
+}
+
+static void
+test_match_read_kmer (void *ptr)
+{
+    struct axe_trie *trie = NULL;
+    struct qes_seq *seq = NULL;
+    ssize_t truth[2000];
+    ssize_t value = -1;
+    char kmer[11];
+    char read[13];
+    const size_t n_reads = sizeof(truth) / sizeof(*truth);
+    size_t iii = 0;
+    uint32_t rand = 1;
+
+    (void) ptr;
+    seq = qes_seq_create();
+    trie = axe_trie_create();
+    tt_ptr_op(trie, !=, NULL);
+    /* Nested barcodes of two lengths, and some keys with Ns */
+    for (iii = 0; iii < 4096; iii += 5) {
+        make_kmer(kmer, 6, iii);
+        tt_int_op(axe_trie_add(trie, kmer, iii), ==, 0);
+    }
+    for (iii = 0; iii < 1048576; iii += 999) {
+        make_kmer(kmer, 10, iii);
+        tt_int_op(axe_trie_add(trie, kmer, 5000 + iii), ==, 0);
+        kmer[3] = 'N';
+        axe_trie_add(trie, kmer, 1 + iii);
+    }
+    for (rand = 1, iii = 0; iii < n_reads; iii++) {
+        random_read(read, 12, &rand);
+        qes_seq_fill(seq, "read", "", read, read);
+        axe_match_read(NULL, &truth[iii], trie, seq);
+    }
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_KMER);
+    tt_ptr_op(trie->kmer, !=, NULL);
+    tt_int_op(trie->kmer->max_len, ==, 10);
+    tt_int_op(trie->kmer->n_lens, ==, 2);
+    for (rand = 1, iii = 0; iii < n_reads; iii++) {
+        random_read(read, 12, &rand);
+        qes_seq_fill(seq, "read", "", read, read);
+        tt_int_op(axe_match_read(NULL, &value, trie, seq), ==,
+                  truth[iii] < 0 ? 1 : 0);
+        tt_int_op(value, ==, truth[iii]);
+    }
+    /* The longer barcode wins, and Ns go to the trie */
+    make_kmer(kmer, 10, 999);
+    qes_seq_fill(seq, "read", "", kmer, kmer);
+    tt_int_op(axe_match_read(NULL, &value, trie, seq), ==, 0);
+    tt_int_op(value, ==, 5999);
+    kmer[3] = 'N';
+    qes_seq_fill(seq, "read", "", kmer, kmer);
+    tt_int_op(axe_match_read(NULL, &value, trie, seq), ==, 0);
+    tt_int_op(value, ==, 1000);
+    /* Reads shorter than the longest barcode use the shorter tables */
+    make_kmer(kmer, 6, 5);
+    qes_seq_fill(seq, "read", "", kmer, kmer);
+    tt_int_op(axe_match_read(NULL, &value, trie, seq), ==, 0);
+    tt_int_op(value, ==, 5);
+    /* Too long for the tables */
+    tt_int_op(axe_trie_add(trie, "ACGTACGTACGTA", 1), ==, 0);
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_TRIE);
+    tt_ptr_op(trie->kmer, ==, NULL);
+
+end:
+    qes_seq_destroy(seq);
+    axe_trie_destroy(trie);
+}
+
+static void
+test_match_read_hash (void *ptr)
+{
+    struct axe_trie *trie = NULL;
+    struct qes_seq *seq = NULL;
+    ssize_t truth[2000];
+    ssize_t value = -1;
+    char kmer[33];
+    char read[17];
+    const size_t n_reads = sizeof(truth) / sizeof(*truth);
+    size_t iii = 0;
+    uint32_t rand = 1;
+
+    (void) ptr;
+    seq = qes_seq_create();
+    trie = axe_trie_create();
+    tt_ptr_op(trie, !=, NULL);
+    /* Barcodes of one length, sharing prefixes, and some keys with Ns */
+    for (iii = 0; iii < 1048576; iii += 37) {
+        make_kmer(kmer, 14, iii);
+        tt_int_op(axe_trie_add(trie, kmer, iii), ==, 0);
+    }
+    for (iii = 0; iii < 1048576; iii += 999) {
+        make_kmer(kmer, 14, iii + 1);
+        kmer[5] = 'N';
+        axe_trie_add(trie, kmer, 1);
+    }
+    for (rand = 1, iii = 0; iii < n_reads; iii++) {
+        random_read(read, 16, &rand);
+        /* Make sure plenty of reads start with a barcode */
+        if (iii % 2 == 0) {
+            make_kmer(read, 14, 37 * iii);
+            read[14] = 'A';
+            read[15] = 'C';
+            if (iii % 3 == 0) {
+                read[iii % 14] = 'T';
+            }
+        }
+        qes_seq_fill(seq, "read", "", read, read);
+        axe_match_read(NULL, &truth[iii], trie, seq);
+    }
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_HASH);
+    tt_ptr_op(trie->hash, !=, NULL);
+    tt_int_op(trie->hash->len, ==, 14);
+    for (rand = 1, iii = 0; iii < n_reads; iii++) {
+        random_read(read, 16, &rand);
+        if (iii % 2 == 0) {
+            make_kmer(read, 14, 37 * iii);
+            read[14] = 'A';
+            read[15] = 'C';
+            if (iii % 3 == 0) {
+                read[iii % 14] = 'T';
+            }
+        }
+        qes_seq_fill(seq, "read", "", read, read);
+        tt_int_op(axe_match_read(NULL, &value, trie, seq), ==,
+                  truth[iii] < 0 ? 1 : 0);
+        tt_int_op(value, ==, truth[iii]);
+    }
+    /* Keys with Ns go via the trie */
+    make_kmer(kmer, 14, 1000);
+    kmer[5] = 'N';
+    qes_seq_fill(seq, "read", "", kmer, kmer);
+    tt_int_op(axe_match_read(NULL, &value, trie, seq), ==, 0);
+    tt_int_op(value, ==, 1);
+    axe_trie_destroy(trie);
+
+    /* Up to 32bp can be hashed, but no longer */
+    trie = axe_trie_create();
+    make_kmer(kmer, 32, 123456789);
+    tt_int_op(axe_trie_add(trie, kmer, 7), ==, 0);
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_HASH);
+    qes_seq_fill(seq, "read", "", kmer, kmer);
+    tt_int_op(axe_match_read(NULL, &value, trie, seq), ==, 0);
+    tt_int_op(value, ==, 7);
+    tt_int_op(axe_trie_add(trie, "ACGTACGTACGTACGTACGTACGTACGTACGTA", 8), ==, 0);
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_TRIE);
+
+end:
+    qes_seq_destroy(seq);
+    axe_trie_destroy(trie);
+}
+
+static void
+test_match_batch (void *ptr)
+{
+    struct axe_trie *trie = NULL;
+    struct qes_seq *seqs[37] = {NULL};
+    ssize_t results[37];
+    ssize_t value = -1;
+    char kmer[15];
+    char read[17];
+    const size_t n_reads = sizeof(seqs) / sizeof(*seqs);
+    /* k-mer, hash, then trie engines */
+    const size_t lens[] = {6, 14, 14};
+    const enum axe_engine engines[] = {
+        AXE_ENGINE_KMER, AXE_ENGINE_HASH, AXE_ENGINE_TRIE
+    };
+    size_t iii = 0;
+    size_t run = 0;
+    uint32_t rand = 1;
+
+    (void) ptr;
+    for (iii = 0; iii < n_reads; iii++) {
+        seqs[iii] = qes_seq_create();
+    }
+    for (run = 0; run < 3; run++) {
+        trie = axe_trie_create();
+        for (iii = 0; iii < 4096; iii += 3) {
+            make_kmer(kmer, lens[run], iii * 257);
+            axe_trie_add(trie, kmer, iii);
+        }
+        make_kmer(kmer, lens[run], 1);
+        kmer[2] = 'N';
+        axe_trie_add(trie, kmer, 1);
+        for (rand = run, iii = 0; iii < n_reads; iii++) {
+            random_read(read, 16, &rand);
+            if (iii % 3 == 0) {
+                make_kmer(read, lens[run], iii * 257);
+                read[lens[run]] = 'A';
+            } else if (iii == 10) {
+                memcpy(read, kmer, lens[run]);
+            } else if (iii == 11) {
+                read[3] = '\0';
+            }
+            qes_seq_fill(seqs[iii], "read", "", read, read);
+        }
+        /* A trie that has not been frozen */
+        tt_int_op(axe_match_batch(trie, seqs, n_reads, results), ==, 0);
+        for (iii = 0; iii < n_reads; iii++) {
+            axe_match_read(NULL, &value, trie, seqs[iii]);
+            tt_int_op(results[iii], ==, value);
+        }
+        tt_int_op(axe_trie_freeze(trie), ==, 0);
+        trie->engine = engines[run];
+        memset(results, 0, sizeof(results));
+        tt_int_op(axe_match_batch(trie, seqs, n_reads, results), ==, 0);
+        for (iii = 0; iii < n_reads; iii++) {
+            axe_match_read(NULL, &value, trie, seqs[iii]);
+            tt_int_op(results[iii], ==, value);
+        }
+        tt_int_op(results[0], ==, 0);
+        tt_int_op(results[10], ==, 1);
+        axe_trie_destroy(trie);
+    }
+    tt_int_op(axe_match_batch(NULL, seqs, n_reads, results), ==, -1);
+
+end:
+    for (iii = 0; iii < n_reads; iii++) {
+        qes_seq_destroy(seqs[iii]);
+    }
+    axe_trie_destroy(trie);
+}
+
+static void
+test_match_batch_pairs (void *ptr)
+{
+    struct axe_trie *fwd = NULL;
+    struct axe_trie *rev = NULL;
+    struct qes_seq *seqs1[41] = {NULL};
+    struct qes_seq *seqs2[41] = {NULL};
+    ssize_t results1[41];
+    ssize_t results2[41];
+    size_t ends1[41];
+    size_t ends2[41];
+    ssize_t value = -1;
+    char kmer[9];
+    char read[17];
+    const size_t n_pairs = sizeof(seqs1) / sizeof(*seqs1);
+    uint64_t checked = 0;
+    size_t iii = 0;
+    uint32_t rand = 3;
+
+    (void) ptr;
+    fwd = axe_trie_create();
+    rev = axe_trie_create();
+    for (iii = 0; iii < 4096; iii += 3) {
+        make_kmer(kmer, 8, iii * 257);
+        axe_trie_add(fwd, kmer, iii);
+        make_kmer(kmer, 7, iii * 131);
+        axe_trie_add(rev, kmer, iii);
+    }
+    tt_int_op(axe_trie_freeze(fwd), ==, 0);
+    tt_int_op(axe_trie_freeze(rev), ==, 0);
+    rev->filter = axe_filter_create(rev->trie, 0);
+    tt_ptr_op(rev->filter, !=, NULL);
+    for (iii = 0; iii < n_pairs; iii++) {
+        seqs1[iii] = qes_seq_create();
+        seqs2[iii] = qes_seq_create();
+        /* First reads match two in three pairs, second reads one in two */
+        random_read(read, 16, &rand);
+        if (iii % 3 != 0) {
+            make_kmer(read, 8, (iii * 3 % 4096) * 257);
+        }
+        qes_seq_fill(seqs1[iii], "read", "", read, read);
+        random_read(read, 16, &rand);
+        if (iii % 2 != 0) {
+            make_kmer(read, 7, (iii * 3 % 4096) * 131);
+        }
+        qes_seq_fill(seqs2[iii], "read", "", read, read);
+    }
+    memset(results2, 0, sizeof(results2));
+    memset(ends2, 0xff, sizeof(ends2));
+    tt_int_op(axe_match_batch_pairs(fwd, rev, seqs1, seqs2, n_pairs,
+                                    results1, results2, ends1, ends2), ==, 0);
+    checked = rev->filter->checked;
+    for (iii = 0; iii < n_pairs; iii++) {
+        axe_match_read(NULL, &value, fwd, seqs1[iii]);
+        tt_int_op(results1[iii], ==, value);
+        /* Second reads are looked up only where the first matched */
+        if (value >= 0) {
+            axe_match_read(NULL, &value, rev, seqs2[iii]);
+        }
+        tt_int_op(results2[iii], ==, value);
+        tt_int_op(ends2[iii], ==, 0);
+    }
+    tt_int_op(results2[1], >=, 0);
+    tt_int_op(results2[3], ==, -1);
+    /* The lookups above checked the same reads again */
+    tt_int_op(checked, >, 0);
+    tt_int_op(rev->filter->checked, ==, 2 * checked);
+    tt_int_op(axe_match_batch_pairs(fwd, NULL, seqs1, seqs2, n_pairs,
+                                    results1, results2, NULL, NULL), ==, -1);
+
+end:
+    for (iii = 0; iii < n_pairs; iii++) {
+        qes_seq_destroy(seqs1[iii]);
+        qes_seq_destroy(seqs2[iii]);
+    }
+    axe_trie_destroy(fwd);
+    axe_trie_destroy(rev);
+}
+
+static void
+test_pair_map (void *ptr)
+{
+    struct axe_pair_map *map = NULL;
+    size_t bcd1 = 0;
+    size_t bcd2 = 0;
+    ssize_t expect = 0;
+
+    (void) ptr;
+    /* A full 12 by 8 plate fits a byte table */
+    map = axe_pair_map_create(12, 8, 96);
+    tt_ptr_op(map, !=, NULL);
+    tt_ptr_op(map->table, !=, NULL);
+    tt_int_op(map->width, ==, 1);
+    tt_int_op(map->bytes, ==, 96);
+    tt_int_op(axe_pair_map_get(map, 3, 5), ==, -1);
+    for (bcd1 = 0; bcd1 < 12; bcd1++) {
+        for (bcd2 = 0; bcd2 < 8; bcd2++) {
+            tt_int_op(axe_pair_map_add(map, bcd1, bcd2, bcd1 * 8 + bcd2),
+                      ==, 0);
+        }
+    }
+    tt_int_op(axe_pair_map_get(map, 0, 0), ==, 0);
+    tt_int_op(axe_pair_map_get(map, 11, 7), ==, 95);
+    tt_int_op(axe_pair_map_add(map, 12, 0, 0), ==, -1);
+    tt_int_op(axe_pair_map_add(map, 0, 8, 0), ==, -1);
+    tt_int_op(axe_pair_map_add(map, 0, 0, 255), ==, -1);
+    axe_pair_map_destroy(map);
+    /* Past 254 pairs, entries take two bytes */
+    map = axe_pair_map_create(24, 16, 384);
+    tt_ptr_op(map, !=, NULL);
+    tt_int_op(map->width, ==, 2);
+    tt_int_op(axe_pair_map_add(map, 23, 15, 383), ==, 0);
+    tt_int_op(axe_pair_map_get(map, 23, 15), ==, 383);
+    tt_int_op(axe_pair_map_get(map, 15, 23 % 16), ==, -1);
+    axe_pair_map_destroy(map);
+    /* Each of 1536 R1 barcodes paired with two R2 barcodes is hashed */
+    map = axe_pair_map_create(1536, 1536, 3072);
+    tt_ptr_op(map, !=, NULL);
+    tt_ptr_op(map->table, ==, NULL);
+    tt_int_op(map->width, ==, 0);
+    tt_int_op(map->bytes, <, 1536 * 1536 / 4);
+    for (bcd1 = 0; bcd1 < 1536; bcd1++) {
+        tt_int_op(axe_pair_map_add(map, bcd1, bcd1, 2 * bcd1), ==, 0);
+        tt_int_op(axe_pair_map_add(map, bcd1, (bcd1 * 7 + 1) % 1536,
+                                   2 * bcd1 + 1), ==, 0);
+    }
+    for (bcd1 = 0; bcd1 < 1536; bcd1++) {
+        for (bcd2 = 0; bcd2 < 1536; bcd2++) {
+            expect = -1;
+            if (bcd2 == bcd1) {
+                expect = 2 * bcd1;
+            } else if (bcd2 == (bcd1 * 7 + 1) % 1536) {
+                expect = 2 * bcd1 + 1;
+            }
+            tt_int_op(axe_pair_map_get(map, bcd1, bcd2), ==, expect);
+        }
+    }
+    /* Adding a pair again renumbers it */
+    tt_int_op(axe_pair_map_add(map, 5, 5, 7), ==, 0);
+    tt_int_op(axe_pair_map_get(map, 5, 5), ==, 7);
+    tt_int_op(map->n_filled, ==, 3072);
+    axe_pair_map_destroy(map);
+    tt_ptr_op(axe_pair_map_create(0, 8, 1), ==, NULL);
+
+end:
+    axe_pair_map_destroy(map);
+}
+
+static void
+test_trie_build (void *ptr)
+{
+    struct axe_trie *built = NULL;
+    struct axe_trie *incr = NULL;
+    Trie *sorted = NULL;
+    const AlphaChar *keys[] = {"AC", "ACGT", "ACGTA", "GG", "T"};
+    const AlphaChar *unsorted[] = {"AC", "T", "GG"};
+    const TrieData data[] = {0, 1, 2, 3, 4};
+    char key[8] = "";
+    intptr_t value = -1;
+    intptr_t expect = -1;
+    size_t n_keys = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    size_t len = 0;
+
+    (void) ptr;
+    incr = axe_trie_create();
+    built = axe_trie_create();
+    tt_ptr_op(incr, !=, NULL);
+    tt_ptr_op(built, !=, NULL);
+    /* Keys already present are kept when staging begins */
+    tt_int_op(axe_trie_add(built, "NNNN", 9999), ==, 0);
+    tt_int_op(axe_trie_add(incr, "NNNN", 9999), ==, 0);
+    tt_int_op(axe_trie_stage(built), ==, 0);
+    tt_ptr_op(built->staged, !=, NULL);
+    /* Every key of one to six bases, so that many keys prefix others. The
+     * staged trie must refuse duplicates and forget deleted keys, as the
+     * trie itself does. */
+    for (len = 1; len <= 6; len++) {
+        for (iii = 0; iii < (1u << (2 * len)); iii++) {
+            for (jjj = 0; jjj < len; jjj++) {
+                key[jjj] = "ACGT"[(iii >> (2 * jjj)) & 3];
+            }
+            key[len] = '\0';
+            tt_int_op(axe_trie_add(built, key, n_keys), ==, 0);
+            tt_int_op(axe_trie_add(incr, key, n_keys), ==, 0);
+            tt_int_op(axe_trie_add(built, key, n_keys), ==, 1);
+            if (n_keys % 3 == 0) {
+                tt_int_op(axe_trie_delete(built, key), ==, 1);
+                tt_int_op(axe_trie_delete(incr, key), ==, 1);
+                tt_int_op(axe_trie_get(built, key, &value), ==, 0);
+            }
+            if (n_keys % 9 == 0) {
+                tt_int_op(axe_trie_add(built, key, n_keys + 1), ==, 0);
+                tt_int_op(axe_trie_add(incr, key, n_keys + 1), ==, 0);
+            }
+            n_keys++;
+        }
+    }
+    tt_int_op(axe_trie_get(built, "NNNN", &value), ==, 1);
+    tt_int_op(value, ==, 9999);
+    tt_int_op(axe_trie_freeze(built), ==, 0);
+    tt_ptr_op(built->staged, ==, NULL);
+    /* Keys of up to seven bases, so that misses past the keys are tried */
+    for (len = 1; len <= 7; len++) {
+        for (iii = 0; iii < (1u << (2 * len)); iii++) {
+            for (jjj = 0; jjj < len; jjj++) {
+                key[jjj] = "ACGT"[(iii >> (2 * jjj)) & 3];
+            }
+            key[len] = '\0';
+            expect = -1;
+            value = -1;
+            tt_int_op(axe_trie_get(built, key, &value), ==,
+                      axe_trie_get(incr, key, &expect));
+            tt_int_op(value, ==, expect);
+        }
+    }
+    /* Once built, keys are stored one by one again */
+    tt_int_op(axe_trie_add(built, "ACGTACGT", 1), ==, 0);
+    tt_int_op(axe_trie_get(built, "ACGTACGT", &value), ==, 1);
+    tt_int_op(value, ==, 1);
+    /* Keys given in order are built without staging, and must be in order */
+    sorted = trie_new_sorted(built->alpha_map, keys, data, 5);
+    tt_ptr_op(sorted, !=, NULL);
+    for (iii = 0; iii < 5; iii++) {
+        tt_int_op(trie_retrieve(sorted, keys[iii], &value), ==, 1);
+        tt_int_op(value, ==, data[iii]);
+    }
+    tt_int_op(trie_retrieve(sorted, "ACG", &value), ==, 0);
+    tt_int_op(trie_retrieve(sorted, "GGG", &value), ==, 0);
+    trie_free(sorted);
+    sorted = trie_new_sorted(built->alpha_map, unsorted, data, 3);
+    tt_ptr_op(sorted, ==, NULL);
+    sorted = trie_new_sorted(built->alpha_map, keys, data, 0);
+    tt_ptr_op(sorted, !=, NULL);
+    tt_int_op(trie_retrieve(sorted, "AC", &value), ==, 0);
+
+end:
+    if (sorted != NULL) trie_free(sorted);
+    axe_trie_destroy(built);
+    axe_trie_destroy(incr);
+}
+
+static void
+test_expand (void *ptr)
+{
+    struct axe_trie *tries[2] = {NULL, NULL};
+    struct axe_expansion exps[2];
+    char *seqs[2][40];
+    intptr_t values[2][40];
+    char key[9] = "";
+    const unsigned int threads[] = {1, 4};
+    uint32_t state = 1;
+    intptr_t value = -1;
+    intptr_t expect = -1;
+    size_t n_clashes = 0;
+    size_t n_owners = 0;
+    size_t dist = 0;
+    size_t ttt = 0;
+    size_t eee = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    size_t kkk = 0;
+
+    (void) ptr;
+    memset(exps, 0, sizeof(exps));
+    memset(seqs, 0, sizeof(seqs));
+    /* Enough barcodes for several workers, close enough to clash */
+    for (eee = 0; eee < 2; eee++) {
+        for (iii = 0; iii < 40; iii++) {
+            seqs[eee][iii] = calloc(9, 1);
+            do {
+                for (jjj = 0; jjj < 8; jjj++) {
+                    state = state * 1103515245 + 12345;
+                    seqs[eee][iii][jjj] = "ACGT"[(state >> 16) & 3];
+                }
+                for (jjj = 0; jjj < iii; jjj++) {
+                    if (strcmp(seqs[eee][jjj], seqs[eee][iii]) == 0) break;
+                }
+            } while (jjj < iii);
+            values[eee][iii] = 100 + iii;
+        }
+    }
+    /* Aliases are expanded as the keys they stand for */
+    seqs[0][3][0] = tolower(seqs[0][3][0]);
+    for (ttt = 0; ttt < 2; ttt++) {
+        for (eee = 0; eee < 2; eee++) {
+            tries[eee] = axe_trie_create();
+            tt_ptr_op(tries[eee], !=, NULL);
+            for (iii = 0; iii < 40; iii++) {
+                tt_int_op(axe_trie_add(tries[eee], seqs[eee][iii],
+                                       values[eee][iii]), ==, 0);
+            }
+            exps[eee].trie = tries[eee];
+            exps[eee].seqs = seqs[eee];
+            exps[eee].values = values[eee];
+            exps[eee].n_seqs = 40;
+        }
+        /* Clashes leave the tries as they were, unless permissive */
+        tt_int_op(axe_expand(exps, 2, 2, 0, threads[ttt]), ==, 1);
+        tt_int_op(exps[0].n_clashes, >, 0);
+        strcpy(key, seqs[0][0]);
+        key[0] = key[0] == 'A' ? 'C' : 'A';
+        tt_int_op(axe_trie_get(tries[0], key, &value), ==, 0);
+        tt_int_op(axe_expand(exps, 2, 2, 1, threads[ttt]), ==, 0);
+        for (eee = 0; eee < 2; eee++) {
+            /* A barcode keeps its key, a mutant goes to its only barcode,
+             * and each other barcode with the key clashes */
+            n_clashes = 0;
+            for (iii = 0; iii < (1u << 16); iii++) {
+                for (jjj = 0; jjj < 8; jjj++) {
+                    key[jjj] = "ACGT"[(iii >> (2 * jjj)) & 3];
+                }
+                key[8] = '\0';
+                expect = -1;
+                n_owners = 0;
+                for (kkk = 0; kkk < 40; kkk++) {
+                    for (dist = 0, jjj = 0; jjj < 8; jjj++) {
+                        dist += toupper(seqs[eee][kkk][jjj]) != key[jjj];
+                    }
+                    if (dist > 2) continue;
+                    if (dist == 0 || n_owners == 0) {
+                        expect = values[eee][kkk];
+                    }
+                    n_owners++;
+                }
+                if (n_owners > 1) {
+                    n_clashes += n_owners - 1;
+                    for (kkk = 0; kkk < 40; kkk++) {
+                        if (strcasecmp(seqs[eee][kkk], key) == 0) break;
+                    }
+                    if (kkk == 40) {
+                        expect = -1;
+                    }
+                }
+                value = -1;
+                tt_int_op(axe_trie_get(tries[eee], key, &value), ==,
+                          expect >= 0);
+                tt_int_op(value, ==, expect);
+            }
+            tt_int_op(exps[eee].n_clashes, ==, n_clashes);
+            for (iii = 1; iii < exps[eee].n_clashes; iii++) {
+                tt_int_op(exps[eee].clashes[iii - 1].barcode, <=,
+                          exps[eee].clashes[iii].barcode);
+            }
+            tt_int_op(exps[eee].clashes[0].dist, >=, 1);
+            tt_int_op(exps[eee].clashes[0].dist, <=, 2);
+            axe_expansion_clear(&exps[eee]);
+            tt_int_op(exps[eee].n_clashes, ==, 0);
+            axe_trie_destroy(tries[eee]);
+        }
+    }
+
+end:
+    for (eee = 0; eee < 2; eee++) {
+        axe_expansion_clear(&exps[eee]);
+        axe_trie_destroy(tries[eee]);
+        for (iii = 0; iii < 40; iii++) {
+            free(seqs[eee][iii]);
+        }
+    }
+}
+
+/* Damage or remove each index in dir. Returns how many there were. */
+static size_t
+index_dir_each(const char *dir, int remove)
+{
+    DIR *dh = opendir(dir);
+    struct dirent *ent = NULL;
+    char *path = NULL;
+    FILE *fp = NULL;
+    size_t n = 0;
+    int chr = 0;
+
+    if (dh == NULL) return 0;
+    while ((ent = readdir(dh)) != NULL) {
+        if (strncmp(ent->d_name, "axe-", 4) != 0) continue;
+        path = malloc(strlen(dir) + strlen(ent->d_name) + 2);
+        sprintf(path, "%s/%s", dir, ent->d_name);
+        n++;
+        if (remove) {
+            unlink(path);
+        } else if ((fp = fopen(path, "r+b")) != NULL) {
+            fseek(fp, -1, SEEK_END);
+            chr = fgetc(fp);
+            fseek(fp, -1, SEEK_END);
+            fputc(chr ^ 1, fp);
+            fclose(fp);
+        }
+        free(path);
+    }
+    closedir(dh);
+    return n;
+}
+
+static struct axe_config *
+index_config(const char *dir, const char *barcode_file, int combo,
+             enum axe_engine engine)
+{
+    struct axe_config *config = axe_config_create();
+
+    config->barcode_file = strdup(barcode_file);
+    config->index_dir = strdup(dir);
+    config->mismatches = 1;
+    config->permissive = 1;
+    config->match_combo = combo;
+    config->verbosity = -1;
+    config->pin_engine = engine != AXE_ENGINE_COUNT;
+    config->engine = engine;
+    if (axe_read_barcodes(config) != 0 ||
+            axe_setup_barcode_lookup(config) != 0 ||
+            axe_make_tries(config) != 0) {
+        axe_config_destroy(config);
+    }
+    return config;
+}
+
+static void
+test_index (void *ptr)
+{
+    struct axe_config *built = NULL;
+    struct axe_config *mapped = NULL;
+    struct qes_seq *seq = NULL;
+    char dir[] = "/tmp/axe-index-XXXXXX";
+    char barcode_file[64];
+    char kmer[9];
+    char kmer2[7];
+    char read[17];
+    ssize_t truth = -1;
+    ssize_t value = -1;
+    FILE *fp = NULL;
+    size_t iii = 0;
+    size_t run = 0;
+    uint32_t rand = 3;
+    /* Engines pinned single-end, then the tuned engine of combinatorial
+     * barcodes */
+    const enum axe_engine engines[] = {
+        AXE_ENGINE_TRIE, AXE_ENGINE_KMER, AXE_ENGINE_HASH, AXE_ENGINE_COUNT,
+    };
+
+    (void) ptr;
+    seq = qes_seq_create();
+    tt_ptr_op(mkdtemp(dir), !=, NULL);
+    snprintf(barcode_file, sizeof(barcode_file), "%s/barcodes", dir);
+    for (run = 0; run < 4; run++) {
+        int combo = engines[run] == AXE_ENGINE_COUNT;
+        struct axe_trie *tries[2][2];
+
+        /* More barcodes than the Hamming engine takes */
+        fp = fopen(barcode_file, "w");
+        tt_ptr_op(fp, !=, NULL);
+        for (iii = 0; iii < 60; iii++) {
+            make_kmer(kmer, 8, iii * 769 + run);
+            make_kmer(kmer2, 6, iii * 37);
+            if (combo) {
+                fprintf(fp, "%s\t%s\tS%zu\n", kmer, kmer2, iii);
+            } else {
+                fprintf(fp, "%s\tS%zu\n", kmer, iii);
+            }
+        }
+        fclose(fp);
+        fp = NULL;
+        /* Nothing to map, so the tries are loaded and indexed */
+        built = index_config(dir, barcode_file, combo, engines[run]);
+        tt_ptr_op(built, !=, NULL);
+        tt_int_op(axe_load_index(built), ==, 1);
+        tt_int_op(axe_load_tries(built), ==, 0);
+        tt_int_op(axe_tune_engines(built), ==, 0);
+        tt_int_op(axe_save_index(built), ==, 0);
+        tt_ptr_op(built->index_map, ==, NULL);
+        /* Then mapped in place of loading them */
+        mapped = index_config(dir, barcode_file, combo, engines[run]);
+        tt_ptr_op(mapped, !=, NULL);
+        tt_int_op(axe_load_tries(mapped), ==, 0);
+        tt_ptr_op(mapped->index_map, !=, NULL);
+        tt_int_op(axe_tune_engines(mapped), ==, 0);
+        tries[0][0] = built->fwd_trie;
+        tries[0][1] = mapped->fwd_trie;
+        tries[1][0] = built->rev_trie;
+        tries[1][1] = mapped->rev_trie;
+        for (iii = 0; iii < 2; iii++) {
+            if (tries[iii][0] == NULL) continue;
+            tt_int_op(tries[iii][1]->mapped, ==, 1);
+            tt_int_op(tries[iii][1]->engine, ==, tries[iii][0]->engine);
+            tt_int_op(axe_trie_engines(tries[iii][1]), ==,
+                      1u << tries[iii][0]->engine);
+        }
+        tt_int_op(mapped->fwd_trie->engine, ==,
+                  combo ? built->fwd_trie->engine : engines[run]);
+        for (iii = 0; iii < 4000; iii++) {
+            size_t side = iii % 2;
+
+            random_read(read, 16, &rand);
+            /* Most reads carry a barcode, some with an error or N */
+            if (iii % 4 != 0) {
+                make_kmer(read, side && combo ? 6 : 8,
+                          side && combo ? (iii % 60) * 37
+                                        : (iii % 60) * 769 + run);
+                read[8] = 'A';
+                if (iii % 3 == 0) {
+                    read[iii % 6] = "ACGTN"[iii % 5];
+                }
+            }
+            qes_seq_fill(seq, "read", "", read, read);
+            if (tries[side][0] == NULL) {
+                side = 0;
+            }
+            axe_match_read(NULL, &truth, tries[side][0], seq);
+            tt_int_op(axe_match_read(NULL, &value, tries[side][1], seq), ==,
+                      truth < 0 ? 1 : 0);
+            tt_int_op(value, ==, truth);
+        }
+        /* Mapped tries are read-only */
+        tt_int_op(axe_trie_add(mapped->fwd_trie, "ACGTACGT", 1), ==, -1);
+        tt_int_op(axe_trie_freeze(mapped->fwd_trie), ==, -1);
+        tt_int_op(axe_save_index(mapped), ==, 0);
+        tt_int_op(axe_load_index(mapped), ==, -1);
+        axe_config_destroy(mapped);
+        axe_config_destroy(built);
+    }
+    /* Other options make another index */
+    mapped = index_config(dir, barcode_file, 1, AXE_ENGINE_COUNT);
+    mapped->mismatches = 2;
+    tt_int_op(axe_load_index(mapped), ==, 1);
+    axe_config_destroy(mapped);
+    /* A damaged index is passed over */
+    mapped = index_config(dir, barcode_file, 1, AXE_ENGINE_COUNT);
+    tt_int_op(axe_load_index(mapped), ==, 0);
+    axe_config_destroy(mapped);
+    tt_int_op(index_dir_each(dir, 0), ==, 4);
+    mapped = index_config(dir, barcode_file, 1, AXE_ENGINE_COUNT);
+    tt_int_op(axe_load_index(mapped), ==, 1);
+    tt_int_op(mapped->fwd_trie->mapped, ==, 0);
+    tt_int_op(axe_load_tries(mapped), ==, 0);
+    tt_ptr_op(mapped->index_map, ==, NULL);
+
+end:
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    index_dir_each(dir, 1);
+    unlink(barcode_file);
+    rmdir(dir);
+    qes_seq_destroy(seq);
+    axe_config_destroy(built);
+    axe_config_destroy(mapped);
+}
+
+static void
+test_match_read_hamming (void *ptr)
+{
+    struct axe_config *config = NULL;
+    struct axe_trie *trie = NULL;
+    struct axe_hamming *ham = NULL;
+    struct qes_seq *seq = NULL;
+    char barcodes[16][13];
+    char *exact_seqs[16];
+    intptr_t exact_values[16];
+    char bcd_a[13] = "AAAAAAAAAAAA";
+    char bcd_b[13] = "AAAAAAAAACCC";
+    char *bcd_seqs[2] = {bcd_a, bcd_b};
+    intptr_t bcd_values[2] = {0, 1};
+    char **mutated = NULL;
+    size_t n_mutated = 0;
+    ssize_t truth = -1;
+    ssize_t value = -1;
+    char read[17];
+    size_t n_barcodes = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    size_t dist = 0;
+    uint32_t rand = 1;
+
+    (void) ptr;
+    seq = qes_seq_create();
+    /* 12bp barcodes, at least five apart, so no mutants collide at -m 2 */
+    while (n_barcodes < 16) {
+        random_read(barcodes[n_barcodes], 12, &rand);
+        for (iii = 0; iii < n_barcodes; iii++) {
+            for (dist = 0, jjj = 0; jjj < 12; jjj++) {
+                dist += barcodes[iii][jjj] != barcodes[n_barcodes][jjj];
+            }
+            if (dist < 5) break;
+        }
+        if (iii == n_barcodes && strchr(barcodes[n_barcodes], 'N') == NULL) {
+            n_barcodes++;
+        }
+    }
+    config = axe_config_create();
+    config->mismatches = 2;
+    config->n_barcode_pairs = n_barcodes;
+    config->barcodes = qes_calloc(n_barcodes, sizeof(*config->barcodes));
+    for (iii = 0; iii < n_barcodes; iii++) {
+        config->barcodes[iii] = axe_barcode_create();
+        config->barcodes[iii]->seq1 = strdup(barcodes[iii]);
+        config->barcodes[iii]->len1 = 12;
+        config->barcodes[iii]->id = strdup("bcd");
+        config->barcodes[iii]->idlen = 3;
+    }
+    tt_int_op(axe_make_tries(config), ==, 0);
+    tt_int_op(axe_load_tries(config), ==, 0);
+    tt_int_op(config->fwd_trie->engine, ==, AXE_ENGINE_HAMMING);
+    tt_ptr_op(config->fwd_trie->hamming, !=, NULL);
+    /* The same barcodes, expanded to every mutant, with reads with Ns
+     * searched for among the barcodes themselves */
+    trie = axe_trie_create();
+    for (iii = 0; iii < n_barcodes; iii++) {
+        exact_seqs[iii] = barcodes[iii];
+        exact_values[iii] = iii;
+        axe_trie_add(trie, barcodes[iii], iii);
+        for (dist = 1; dist <= 2; dist++) {
+            mutated = hamming_mutate_dna(&n_mutated, barcodes[iii], 12, dist,
+                                         0);
+            for (jjj = 0; jjj < n_mutated; jjj++) {
+                axe_trie_add(trie, mutated[jjj], iii);
+                free(mutated[jjj]);
+            }
+            free(mutated);
+        }
+    }
+    tt_int_op(axe_trie_set_exact(trie, exact_seqs, exact_values, n_barcodes,
+                                 2), ==, 0);
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    for (rand = 7, iii = 0; iii < 5000; iii++) {
+        random_read(read, 16, &rand);
+        /* Most reads carry a barcode with up to three errors */
+        if (iii % 4 != 0) {
+            memcpy(read, barcodes[iii % n_barcodes], 12);
+            for (jjj = 0; jjj < iii % 4; jjj++) {
+                read[(iii * 7 + jjj * 5) % 12] = "ACGTN"[(iii + jjj) % 5];
+            }
+        }
+        if (iii % 9 == 0) {
+            read[iii % 12] |= 0x20;
+        }
+        qes_seq_fill(seq, "read", "", read, read);
+        axe_match_read(NULL, &truth, trie, seq);
+        tt_int_op(axe_match_read(NULL, &value, config->fwd_trie, seq), ==,
+                  truth < 0 ? 1 : 0);
+        tt_int_op(value, ==, truth);
+    }
+    /* Too short to hold a barcode */
+    qes_seq_fill(seq, "read", "", barcodes[0], barcodes[0]);
+    seq->seq.len = 11;
+    tt_int_op(axe_match_read(NULL, &value, config->fwd_trie, seq), ==, 1);
+
+    /* Barcodes whose mutants could collide are left to the trie */
+    ham = axe_hamming_create(bcd_seqs, bcd_values, 2, 1);
+    tt_ptr_op(ham, !=, NULL);
+    axe_hamming_destroy(ham);
+    ham = axe_hamming_create(bcd_seqs, bcd_values, 2, 2);
+    tt_ptr_op(ham, ==, NULL);
+    bcd_b[11] = '\0';
+    ham = axe_hamming_create(bcd_seqs, bcd_values, 2, 1);
+    tt_ptr_op(ham, ==, NULL);
+
+end:
+    qes_seq_destroy(seq);
+    axe_trie_destroy(trie);
+    axe_hamming_destroy(ham);
+    axe_config_destroy(config);
+}
+
+static struct axe_config *
+pinned_config(char (*barcodes)[13], size_t n, size_t mismatches,
+              enum axe_engine engine)
+{
+    struct axe_config *config = axe_config_create();
+    size_t iii = 0;
+
+    config->mismatches = mismatches;
+    config->verbosity = -1;
+    config->pin_engine = engine != AXE_ENGINE_COUNT;
+    config->engine = engine;
+    config->n_barcode_pairs = n;
+    config->barcodes = qes_calloc(n, sizeof(*config->barcodes));
+    for (iii = 0; iii < n; iii++) {
+        config->barcodes[iii] = axe_barcode_create();
+        config->barcodes[iii]->seq1 = strdup(barcodes[iii]);
+        config->barcodes[iii]->len1 = 12;
+        config->barcodes[iii]->id = strdup("bcd");
+        config->barcodes[iii]->idlen = 3;
+    }
+    if (axe_make_tries(config) != 0 || axe_load_tries(config) != 0 ||
+            axe_tune_engines(config) != 0) {
+        axe_config_destroy(config);
+    }
+    return config;
+}
+
+static void
+test_match_read_pinned (void *ptr)
+{
+    struct axe_config *configs[3] = {NULL, NULL, NULL};
+    struct qes_seq *seq = NULL;
+    char barcodes[16][13];
+    ssize_t truth = -1;
+    ssize_t value = -1;
+    char read[17];
+    size_t n_barcodes = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    size_t dist = 0;
+    uint32_t rand = 3;
+
+    (void) ptr;
+    seq = qes_seq_create();
+    while (n_barcodes < 16) {
+        random_read(barcodes[n_barcodes], 12, &rand);
+        for (iii = 0; iii < n_barcodes; iii++) {
+            for (dist = 0, jjj = 0; jjj < 12; jjj++) {
+                dist += barcodes[iii][jjj] != barcodes[n_barcodes][jjj];
+            }
+            if (dist < 5) break;
+        }
+        if (iii == n_barcodes && strchr(barcodes[n_barcodes], 'N') == NULL) {
+            n_barcodes++;
+        }
+    }
+    /* Too few mutants for the Hamming engine to be chosen, unless pinned */
+    configs[0] = pinned_config(barcodes, 4, 1, AXE_ENGINE_COUNT);
+    tt_ptr_op(configs[0], !=, NULL);
+    tt_ptr_op(configs[0]->fwd_trie->hamming, ==, NULL);
+    configs[1] = pinned_config(barcodes, 4, 1, AXE_ENGINE_HAMMING);
+    tt_ptr_op(configs[1], !=, NULL);
+    tt_ptr_op(configs[1]->fwd_trie->hamming, !=, NULL);
+    tt_int_op(configs[1]->fwd_trie->engine, ==, AXE_ENGINE_HAMMING);
+    axe_config_destroy(configs[0]);
+    axe_config_destroy(configs[1]);
+    /* Enough that it is, unless an engine of mutants is pinned */
+    configs[0] = pinned_config(barcodes, 16, 2, AXE_ENGINE_COUNT);
+    tt_ptr_op(configs[0], !=, NULL);
+    tt_int_op(configs[0]->fwd_trie->engine, ==, AXE_ENGINE_HAMMING);
+    configs[1] = pinned_config(barcodes, 16, 2, AXE_ENGINE_TRIE);
+    tt_ptr_op(configs[1], !=, NULL);
+    tt_ptr_op(configs[1]->fwd_trie->hamming, ==, NULL);
+    tt_int_op(configs[1]->fwd_trie->engine, ==, AXE_ENGINE_TRIE);
+    configs[2] = pinned_config(barcodes, 16, 2, AXE_ENGINE_KMER);
+    tt_ptr_op(configs[2], !=, NULL);
+    tt_int_op(configs[2]->fwd_trie->engine, ==, AXE_ENGINE_KMER);
+    for (iii = 0; iii < 3000; iii++) {
+        random_read(read, 16, &rand);
+        if (iii % 4 != 0) {
+            memcpy(read, barcodes[iii % n_barcodes], 12);
+            for (jjj = 0; jjj < iii % 4; jjj++) {
+                read[(iii * 7 + jjj * 5) % 12] = "ACGTN"[(iii + jjj) % 5];
+            }
+        }
+        qes_seq_fill(seq, "read", "", read, read);
+        axe_match_read(NULL, &truth, configs[0]->fwd_trie, seq);
+        for (jjj = 1; jjj < 3; jjj++) {
+            tt_int_op(axe_match_read(NULL, &value, configs[jjj]->fwd_trie,
+                                     seq), ==, truth < 0 ? 1 : 0);
+            tt_int_op(value, ==, truth);
+        }
+    }
+
+end:
+    qes_seq_destroy(seq);
+    for (iii = 0; iii < 3; iii++) {
+        axe_config_destroy(configs[iii]);
+    }
+}
+
+static void
+test_match_read_search (void *ptr)
+{
+    struct axe_config *config = NULL;
+    struct axe_trie *trie = NULL;
+    struct axe_hamming *ham = NULL;
+    struct qes_seq *seq = NULL;
+    char barcodes[40][13];
+    char *bcd_seqs[40];
+    intptr_t bcd_values[40];
+    intptr_t truth = -1;
+    ssize_t value = -1;
+    char read[17];
+    size_t n_barcodes = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    size_t dist = 0;
+    uint32_t rand = 3;
+
+    (void) ptr;
+    seq = qes_seq_create();
+    /* 12bp barcodes, at least seven apart, so none collide at -m 3 */
+    while (n_barcodes < 40) {
+        random_read(barcodes[n_barcodes], 12, &rand);
+        for (iii = 0; iii < n_barcodes; iii++) {
+            for (dist = 0, jjj = 0; jjj < 12; jjj++) {
+                dist += barcodes[iii][jjj] != barcodes[n_barcodes][jjj];
+            }
+            if (dist < 7) break;
+        }
+        if (iii == n_barcodes && strchr(barcodes[n_barcodes], 'N') == NULL) {
+            bcd_seqs[n_barcodes] = barcodes[n_barcodes];
+            bcd_values[n_barcodes] = n_barcodes;
+            n_barcodes++;
+        }
+    }
+    config = axe_config_create();
+    config->mismatches = 3;
+    config->search = 1;
+    config->n_barcode_pairs = n_barcodes;
+    config->barcodes = qes_calloc(n_barcodes, sizeof(*config->barcodes));
+    for (iii = 0; iii < n_barcodes; iii++) {
+        config->barcodes[iii] = axe_barcode_create();
+        config->barcodes[iii]->seq1 = strdup(barcodes[iii]);
+        config->barcodes[iii]->len1 = 12;
+        config->barcodes[iii]->id = strdup("bcd");
+        config->barcodes[iii]->idlen = 3;
+    }
+    tt_int_op(axe_make_tries(config), ==, 0);
+    tt_int_op(axe_load_tries(config), ==, 0);
+    tt_int_op(config->fwd_trie->engine, ==, AXE_ENGINE_SEARCH);
+    /* Only the barcodes themselves are loaded */
+    strcpy(read, barcodes[0]);
+    read[0] = read[0] == 'A' ? 'C' : 'A';
+    tt_int_op(axe_trie_get(config->fwd_trie, read, &truth), ==, 0);
+    /* Brute force gives the same answers for barcodes of one length */
+    ham = axe_hamming_create(bcd_seqs, bcd_values, n_barcodes, 3);
+    tt_ptr_op(ham, !=, NULL);
+    for (rand = 5, iii = 0; iii < 5000; iii++) {
+        random_read(read, 16, &rand);
+        /* Most reads carry a barcode with up to four errors */
+        if (iii % 5 != 0) {
+            memcpy(read, barcodes[iii % n_barcodes], 12);
+            for (jjj = 0; jjj < iii % 5; jjj++) {
+                read[(iii * 7 + jjj * 5) % 12] = "ACGTN"[(iii + jjj) % 5];
+            }
+        }
+        if (iii % 9 == 0) {
+            read[iii % 12] |= 0x20;
+        }
+        qes_seq_fill(seq, "read", "", read, read);
+        if (axe_hamming_match(ham, read, 16, &truth) != 0) {
+            truth = -1;
+        }
+        tt_int_op(axe_match_read(NULL, &value, config->fwd_trie, seq), ==,
+                  truth < 0 ? 1 : 0);
+        tt_int_op(value, ==, truth);
+    }
+    axe_config_destroy(config);
+
+    /* Barcodes too close for expansion are refused, unless permissive */
+    config = axe_config_create();
+    config->mismatches = 1;
+    config->search = 1;
+    config->n_barcode_pairs = 2;
+    config->barcodes = qes_calloc(2, sizeof(*config->barcodes));
+    for (iii = 0; iii < 2; iii++) {
+        config->barcodes[iii] = axe_barcode_create();
+        config->barcodes[iii]->seq1 = strdup(iii ? "ACGTAC" : "ACGTTT");
+        config->barcodes[iii]->len1 = 6;
+        config->barcodes[iii]->id = strdup("bcd");
+        config->barcodes[iii]->idlen = 3;
+    }
+    tt_int_op(axe_make_tries(config), ==, 0);
+    tt_int_op(axe_load_tries(config), !=, 0);
+    axe_trie_destroy(config->fwd_trie);
+    config->permissive = 1;
+    tt_int_op(axe_make_tries(config), ==, 0);
+    tt_int_op(axe_load_tries(config), ==, 0);
+    /* Equally close to both */
+    qes_seq_fill(seq, "read", "", "ACGTTC", "ACGTTC");
+    tt_int_op(axe_match_read(NULL, &value, config->fwd_trie, seq), ==, 1);
+    qes_seq_fill(seq, "read", "", "ACGTTT", "ACGTTT");
+    tt_int_op(axe_match_read(NULL, &value, config->fwd_trie, seq), ==, 0);
+    tt_int_op(value, ==, 0);
+
+    /* The longest barcode within the mismatch level wins */
+    trie = axe_trie_create();
+    axe_trie_add(trie, "AAAA", 0);
+    axe_trie_add(trie, "AAAACCCC", 1);
+    axe_trie_add(trie, "AAAACCGG", 2);
+    trie->search = 1;
+    trie->mismatch_level = 1;
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_SEARCH);
+    qes_seq_fill(seq, "read", "", "TAAACCCGTT", "TAAACCCGTT");
+    tt_int_op(axe_match_read(NULL, &value, trie, seq), ==, 0);
+    tt_int_op(value, ==, 0);
+    qes_seq_fill(seq, "read", "", "AAAACCCATT", "AAAACCCATT");
+    tt_int_op(axe_match_read(NULL, &value, trie, seq), ==, 0);
+    tt_int_op(value, ==, 1);
+    /* N is one mismatch against any base */
+    qes_seq_fill(seq, "read", "", "AANACCCCTT", "AANACCCCTT");
+    tt_int_op(axe_match_read(NULL, &value, trie, seq), ==, 0);
+    tt_int_op(value, ==, 1);
+    qes_seq_fill(seq, "read", "", "ANNACCCCTT", "ANNACCCCTT");
+    tt_int_op(axe_match_read(NULL, &value, trie, seq), ==, 1);
+
+end:
+    qes_seq_destroy(seq);
+    axe_trie_destroy(trie);
+    axe_hamming_destroy(ham);
+    axe_config_destroy(config);
+}
+
+static void
+test_match_read_seed (void *ptr)
+{
+    struct axe_trie *trie = NULL;
+    struct qes_seq *seq = NULL;
+    char barcodes[200][21];
+    ssize_t truth = -1;
+    ssize_t value = -1;
+    char read[25];
+    size_t n_barcodes = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    size_t dist = 0;
+    uint32_t rand = 11;
+
+    (void) ptr;
+    seq = qes_seq_create();
+    trie = axe_trie_create();
+    /* 20bp barcodes, at least seven apart, so none collide at -m 3 */
+    while (n_barcodes < 200) {
+        random_read(barcodes[n_barcodes], 20, &rand);
+        for (iii = 0; iii < n_barcodes; iii++) {
+            for (dist = 0, jjj = 0; jjj < 20; jjj++) {
+                dist += barcodes[iii][jjj] != barcodes[n_barcodes][jjj];
+            }
+            if (dist < 7) break;
+        }
+        if (iii == n_barcodes && strchr(barcodes[n_barcodes], 'N') == NULL) {
+            tt_int_op(axe_trie_add(trie, barcodes[n_barcodes], n_barcodes),
+                      ==, 0);
+            n_barcodes++;
+        }
+    }
+    trie->search = 1;
+    trie->mismatch_level = 3;
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_SEED);
+    tt_int_op(trie->seed->n_segments, ==, 4);
+    for (rand = 13, iii = 0; iii < 5000; iii++) {
+        random_read(read, 24, &rand);
+        /* Most reads carry a barcode with up to five errors */
+        if (iii % 6 != 0) {
+            memcpy(read, barcodes[iii % n_barcodes], 20);
+            for (jjj = 0; jjj < iii % 6; jjj++) {
+                read[(iii * 7 + jjj * 3) % 20] = "ACGTN"[(iii + jjj) % 5];
+            }
+        }
+        if (iii % 9 == 0) {
+            read[iii % 20] |= 0x20;
+        }
+        qes_seq_fill(seq, "read", "", read, read);
+        trie->engine = AXE_ENGINE_SEARCH;
+        axe_match_read(NULL, &truth, trie, seq);
+        trie->engine = AXE_ENGINE_SEED;
+        tt_int_op(axe_match_read(NULL, &value, trie, seq), ==,
+                  truth < 0 ? 1 : 0);
+        tt_int_op(value, ==, truth);
+    }
+    axe_trie_destroy(trie);
+
+    /* Equally close barcodes are ambiguous */
+    trie = axe_trie_create();
+    axe_trie_add(trie, "AAAAAAAAAAAAAAAA", 0);
+    axe_trie_add(trie, "AAAAAAAAAAAAAACC", 1);
+    trie->search = 1;
+    trie->mismatch_level = 1;
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_SEED);
+    qes_seq_fill(seq, "read", "", "AAAAAAAAAAAAAAACG", "AAAAAAAAAAAAAAACG");
+    tt_int_op(axe_match_read(NULL, &value, trie, seq), ==, 1);
+    qes_seq_fill(seq, "read", "", "AAAAAAAAAAAAAAAAG", "AAAAAAAAAAAAAAAAG");
+    tt_int_op(axe_match_read(NULL, &value, trie, seq), ==, 0);
+    tt_int_op(value, ==, 0);
+    /* Barcodes with Ns are left to the search */
+    axe_trie_add(trie, "AAAAAAAAAAAAAANN", 2);
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_SEARCH);
+
+end:
+    qes_seq_destroy(seq);
+    axe_trie_destroy(trie);
+}
+
+static void
+test_match_read_seed_limit (void *ptr)
+{
+    struct axe_trie *trie = NULL;
+    struct qes_seq *seq = NULL;
+    char barcodes[5][17];
+    ssize_t truth = -1;
+    ssize_t value = -1;
+    char read[21];
+    size_t iii = 0;
+    uint32_t rand = 17;
+
+    (void) ptr;
+    seq = qes_seq_create();
+    trie = axe_trie_create();
+    axe_trie_add(trie, "AAAAAAAAAAAAAAAA", 0);
+    axe_trie_add(trie, "CCCCCCCCCCCCCCCC", 1);
+    trie->search = 1;
+    trie->mismatch_level = 1;
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_SEED);
+    /* One mismatch beyond the limit of the only barcode it is near */
+    qes_seq_fill(seq, "read", "", "CCCCCCCCCCCCCCGGTTTT",
+                 "CCCCCCCCCCCCCCGGTTTT");
+    tt_int_op(axe_match_read(NULL, &value, trie, seq), ==, 1);
+    tt_int_op(value, ==, -1);
+    qes_seq_fill(seq, "read", "", "CCCCCCCCCCCCCCCGTTTT",
+                 "CCCCCCCCCCCCCCCGTTTT");
+    tt_int_op(axe_match_read(NULL, &value, trie, seq), ==, 0);
+    tt_int_op(value, ==, 1);
+    axe_trie_destroy(trie);
+
+    /* Reads mostly far from every barcode match as a search would have
+     * them, which is not at all */
+    trie = axe_trie_create();
+    for (iii = 0; iii < 5; iii++) {
+        make_kmer(barcodes[iii], 16, iii * UINT32_C(0x9E3779B9));
+        axe_trie_add(trie, barcodes[iii], iii);
+    }
+    trie->search = 1;
+    trie->mismatch_level = 1;
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_SEED);
+    for (iii = 0; iii < 5000; iii++) {
+        random_read(read, 20, &rand);
+        /* Half share a seed with a barcode */
+        if (iii % 2 == 0) {
+            memcpy(read + (iii % 4 == 0 ? 0 : 8),
+                   barcodes[iii % 5] + (iii % 4 == 0 ? 0 : 8), 8);
+        }
+        qes_seq_fill(seq, "read", "", read, read);
+        trie->engine = AXE_ENGINE_SEARCH;
+        truth = -1;
+        axe_match_read(NULL, &truth, trie, seq);
+        trie->engine = AXE_ENGINE_SEED;
+        value = -1;
+        tt_int_op(axe_match_read(NULL, &value, trie, seq), ==,
+                  truth < 0 ? 1 : 0);
+        tt_int_op(value, ==, truth);
+    }
+
+end:
+    qes_seq_destroy(seq);
+    axe_trie_destroy(trie);
+}
+
+static void
+test_match_read_top (void *ptr)
+{
+    struct axe_trie *trie = NULL;
+    struct qes_seq *seqs[64] = {NULL};
+    ssize_t truth[64];
+    ssize_t results[64];
+    ssize_t value = -1;
+    char kmer[17];
+    char read[17];
+    const size_t n_reads = sizeof(seqs) / sizeof(*seqs);
+    size_t iii = 0;
+    size_t run = 0;
+    uint32_t rand = 17;
+
+    (void) ptr;
+    for (iii = 0; iii < n_reads; iii++) {
+        seqs[iii] = qes_seq_create();
+    }
+    /* Keys of 6 to 10bp, some prefixes of others, and some with Ns */
+    trie = axe_trie_create();
+    for (iii = 0; iii < 60000; iii += 7) {
+        make_kmer(kmer, 6 + iii % 5, iii * 131);
+        if (iii % 11 == 0) {
+            kmer[iii % 6] = 'N';
+        }
+        axe_trie_add(trie, kmer, iii);
+    }
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    trie->engine = AXE_ENGINE_TRIE;
+    if (trie->top == NULL) {
+        trie->top = axe_top_create(trie->trie, trie->frozen,
+                                   AXE_TOP_MAX_BYTES);
+    }
+    tt_ptr_op(trie->top, !=, NULL);
+    /* No deeper than the shortest key */
+    tt_int_op(trie->top->depth, ==, 6);
+    tt_int_op(trie->top->bytes, <=, AXE_TOP_MAX_BYTES);
+    for (run = 0; run < 50; run++) {
+        for (iii = 0; iii < n_reads; iii++) {
+            size_t len = 16;
+
+            random_read(read, 16, &rand);
+            if (iii % 2 == 0) {
+                make_kmer(kmer, 6 + iii % 5, (run * n_reads + iii) / 2 * 7
+                          * 131);
+                memcpy(read, kmer, strlen(kmer));
+            }
+            if (iii % 5 == 0) {
+                read[iii % 8] |= 0x20;
+            }
+            if (iii % 13 == 0) {
+                len = iii % 9;
+            }
+            read[len] = '\0';
+            qes_seq_fill(seqs[iii], "read", "", read, read);
+            axe_match_read(NULL, &truth[iii], trie, seqs[iii]);
+        }
+        tt_int_op(axe_match_batch(trie, seqs, n_reads, results), ==, 0);
+        axe_top_destroy(trie->top);
+        for (iii = 0; iii < n_reads; iii++) {
+            axe_match_read(NULL, &value, trie, seqs[iii]);
+            tt_int_op(truth[iii], ==, value);
+            tt_int_op(results[iii], ==, value);
+        }
+        trie->top = axe_top_create(trie->trie, trie->frozen,
+                                   AXE_TOP_MAX_BYTES);
+    }
+    /* Too shallow to be worth it */
+    tt_ptr_op(axe_top_create(trie->trie, trie->frozen, 100), ==, NULL);
+
+end:
+    for (iii = 0; iii < n_reads; iii++) {
+        qes_seq_destroy(seqs[iii]);
+    }
+    axe_trie_destroy(trie);
+}
+
+static void
+test_match_read_cache (void *ptr)
+{
+    struct axe_trie *trie = NULL;
+    struct axe_cache *cache = NULL;
+    struct qes_seq *seqs[40] = {NULL};
+    ssize_t truth[40];
+    ssize_t values[40];
+    ssize_t results[40];
+    int ret[40];
+    char kmer[15];
+    char read[17];
+    const size_t n_reads = sizeof(seqs) / sizeof(*seqs);
+    size_t iii = 0;
+    size_t run = 0;
+    uint32_t rand = 19;
+
+    (void) ptr;
+    for (iii = 0; iii < n_reads; iii++) {
+        seqs[iii] = qes_seq_create();
+    }
+    trie = axe_trie_create();
+    for (iii = 0; iii < 4096; iii += 3) {
+        make_kmer(kmer, 8 + iii / 3 % 3, iii * 257);
+        axe_trie_add(trie, kmer, iii);
+    }
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    /* Too small to be of use */
+    tt_ptr_op(axe_cache_create(trie->trie, 64), ==, NULL);
+    /* Small enough that prefixes evict each other */
+    cache = axe_cache_create(trie->trie, 1024);
+    tt_ptr_op(cache, !=, NULL);
+    tt_int_op(cache->len, ==, 10);
+    for (run = 0; run < 20; run++) {
+        /* Reads repeat from run to run, with a few new ones */
+        for (rand = run % 4, iii = 0; iii < n_reads; iii++) {
+            random_read(read, 16, &rand);
+            if (iii % 2 == 0) {
+                make_kmer(kmer, 8 + (iii + run % 3) % 3,
+                          (iii + run % 3) * 3 * 257);
+                memcpy(read, kmer, strlen(kmer));
+            }
+            if (iii == 7) {
+                read[9] = '\0';
+            } else if (iii == 9) {
+                read[iii] = 'N';
+            } else if (iii == 11) {
+                read[3] |= 0x20;
+            }
+            qes_seq_fill(seqs[iii], "read", "", read, read);
+            axe_match_read(NULL, &truth[iii], trie, seqs[iii]);
+        }
+        trie->cache = cache;
+        for (iii = 0; iii < n_reads; iii++) {
+            ret[iii] = axe_match_read(NULL, &values[iii], trie, seqs[iii]);
+        }
+        axe_match_batch(trie, seqs, n_reads, results);
+        trie->cache = NULL;
+        for (iii = 0; iii < n_reads; iii++) {
+            tt_int_op(ret[iii], ==, truth[iii] < 0 ? 1 : 0);
+            tt_int_op(values[iii], ==, truth[iii]);
+            tt_int_op(results[iii], ==, truth[iii]);
+        }
+    }
+    /* Short reads and reads with Ns go straight to the engine */
+    tt_int_op(cache->hits + cache->misses, <=, 20 * 2 * (n_reads - 2));
+    tt_int_op(cache->hits, >, cache->misses);
+    /* Changing the trie drops the cache */
+    trie->cache = cache;
+    cache = NULL;
+    axe_trie_add(trie, "ACGTACGTACGTAC", 1);
+    tt_ptr_op(trie->cache, ==, NULL);
+    /* However big the budget, the cache is no bigger than its cap */
+    cache = axe_cache_create_len(8, SIZE_MAX);
+    tt_ptr_op(cache, !=, NULL);
+    tt_int_op(cache->mask + 1, ==, (size_t)1 << AXE_CACHE_MAX_BITS);
+    axe_cache_destroy(cache);
+
+end:
+    for (iii = 0; iii < n_reads; iii++) {
+        qes_seq_destroy(seqs[iii]);
+    }
+    axe_cache_destroy(cache);
+    axe_trie_destroy(trie);
+}
+
+static void
+test_match_read_filter (void *ptr)
+{
+    struct axe_trie *trie = NULL;
+    struct axe_filter *filter = NULL;
+    struct qes_seq *seqs[40] = {NULL};
+    ssize_t truth[40];
+    ssize_t values[40];
+    ssize_t results[40];
+    char kmer[15];
+    char read[17];
+    const size_t n_reads = sizeof(seqs) / sizeof(*seqs);
+    size_t iii = 0;
+    size_t run = 0;
+    uint32_t rand = 23;
+
+    (void) ptr;
+    for (iii = 0; iii < n_reads; iii++) {
+        seqs[iii] = qes_seq_create();
+    }
+    /* Once with every key loaded, once searching exact barcodes */
+    for (run = 0; run < 2; run++) {
+        size_t mismatches = run;
+        size_t rep = 0;
+
+        trie = axe_trie_create();
+        for (iii = 0; iii < 200; iii++) {
+            make_kmer(kmer, 12 + iii % 3, iii * 7919 * 7919);
+            if (iii == 5) {
+                kmer[2] = 'N';
+            }
+            axe_trie_add(trie, kmer, iii);
+        }
+        trie->search = run;
+        trie->mismatch_level = mismatches;
+        tt_int_op(axe_trie_freeze(trie), ==, 0);
+        filter = axe_filter_create(trie->trie, mismatches);
+        tt_ptr_op(filter, !=, NULL);
+        tt_int_op(filter->k, ==, 10);
+        for (rep = 0; rep < 20; rep++) {
+            for (iii = 0; iii < n_reads; iii++) {
+                random_read(read, 16, &rand);
+                if (iii % 3 == 0) {
+                    make_kmer(kmer, 12 + iii % 3,
+                              (iii + rep) * 7919 * 7919);
+                    memcpy(read, kmer, strlen(kmer));
+                    read[rep % 12] = "ACGT"[iii % 4];
+                } else if (iii == 4) {
+                    read[7] = '\0';
+                }
+                qes_seq_fill(seqs[iii], "read", "", read, read);
+                axe_match_read(NULL, &truth[iii], trie, seqs[iii]);
+            }
+            trie->filter = filter;
+            for (iii = 0; iii < n_reads; iii++) {
+                axe_match_read(NULL, &values[iii], trie, seqs[iii]);
+            }
+            axe_match_batch(trie, seqs, n_reads, results);
+            trie->filter = NULL;
+            for (iii = 0; iii < n_reads; iii++) {
+                tt_int_op(values[iii], ==, truth[iii]);
+                tt_int_op(results[iii], ==, truth[iii]);
+            }
+        }
+        /* Most random reads start with nothing like a barcode */
+        tt_int_op(filter->rejected, >, filter->checked / 3);
+        axe_filter_destroy(filter);
+        axe_trie_destroy(trie);
+    }
+    /* Keys too short to filter on */
+    trie = axe_trie_create();
+    axe_trie_add(trie, "ACGTA", 1);
+    tt_ptr_op(axe_filter_create(trie->trie, 0), ==, NULL);
+
+end:
+    for (iii = 0; iii < n_reads; iii++) {
+        qes_seq_destroy(seqs[iii]);
+    }
+    axe_filter_destroy(filter);
+    axe_trie_destroy(trie);
+}
+
+static struct axe_config *
+n_test_config(char barcodes[][15], size_t n, size_t mismatches, int search)
+{
+    struct axe_config *config = axe_config_create();
+    size_t iii = 0;
+
+    config->mismatches = mismatches;
+    config->search = search;
+    config->n_barcode_pairs = n;
+    config->barcodes = qes_calloc(n, sizeof(*config->barcodes));
+    for (iii = 0; iii < n; iii++) {
+        config->barcodes[iii] = axe_barcode_create();
+        config->barcodes[iii]->seq1 = strdup(barcodes[iii]);
+        config->barcodes[iii]->len1 = strlen(barcodes[iii]);
+        config->barcodes[iii]->id = strdup("bcd");
+        config->barcodes[iii]->idlen = 3;
+    }
+    if (axe_make_tries(config) != 0 || axe_load_tries(config) != 0) {
+        axe_config_destroy(config);
+    }
+    return config;
+}
+
+static void
+test_match_read_n (void *ptr)
+{
+    struct axe_config *config = NULL;
+    struct axe_config *search = NULL;
+    struct qes_seq *seqs[40] = {NULL};
+    char barcodes[8][15];
+    ssize_t truth = -1;
+    ssize_t value = -1;
+    ssize_t results[40];
+    char read[19];
+    const size_t n_reads = sizeof(seqs) / sizeof(*seqs);
+    size_t run = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    size_t dist = 0;
+    uint32_t rand = 29;
+
+    (void) ptr;
+    for (iii = 0; iii < n_reads; iii++) {
+        seqs[iii] = qes_seq_create();
+    }
+    /* k-mer tables for 8bp barcodes, a hash for 14bp ones, and the trie
+     * for a mix of 12 and 14bp. Each way, reads with Ns are found as a
+     * search of the exact barcodes finds them. */
+    for (run = 0; run < 3; run++) {
+        const enum axe_engine engines[3] = {
+            AXE_ENGINE_KMER, AXE_ENGINE_HASH, AXE_ENGINE_TRIE,
+        };
+        size_t n_barcodes = 0;
+        size_t len = 0;
+        size_t rep = 0;
+
+        while (n_barcodes < 8) {
+            len = run == 0 ? 8 : run == 1 ? 14 : 12 + 2 * (n_barcodes % 2);
+            random_read(barcodes[n_barcodes], len, &rand);
+            for (iii = 0; iii < n_barcodes; iii++) {
+                for (dist = 0, jjj = 0; jjj < len && barcodes[iii][jjj];
+                        jjj++) {
+                    dist += barcodes[iii][jjj] != barcodes[n_barcodes][jjj];
+                }
+                if (dist < 3) break;
+            }
+            if (iii == n_barcodes &&
+                    strchr(barcodes[n_barcodes], 'N') == NULL) {
+                n_barcodes++;
+            }
+        }
+        config = n_test_config(barcodes, n_barcodes, 1, 0);
+        search = n_test_config(barcodes, n_barcodes, 1, 1);
+        tt_ptr_op(config, !=, NULL);
+        tt_ptr_op(search, !=, NULL);
+        tt_int_op(config->fwd_trie->engine, ==, engines[run]);
+        tt_ptr_op(config->fwd_trie->exact, !=, NULL);
+        /* A single N costs no more than any other mismatch */
+        strcpy(read, barcodes[3]);
+        read[1] = 'N';
+        qes_seq_fill(seqs[0], "read", "", read, read);
+        tt_int_op(axe_match_read(NULL, &value, config->fwd_trie, seqs[0]),
+                  ==, 0);
+        tt_int_op(value, ==, 3);
+        read[4] = 'n';
+        qes_seq_fill(seqs[0], "read", "", read, read);
+        tt_int_op(axe_match_read(NULL, &value, config->fwd_trie, seqs[0]),
+                  ==, 1);
+        for (rep = 0; rep < 50; rep++) {
+            for (iii = 0; iii < n_reads; iii++) {
+                random_read(read, 18, &rand);
+                if (iii % 4 != 0) {
+                    const char *bcd = barcodes[(iii + rep) % n_barcodes];
+
+                    len = strlen(bcd);
+                    memcpy(read, bcd, len);
+                    for (jjj = 0; jjj < iii % 4; jjj++) {
+                        read[(iii * 7 + jjj * 5 + rep) % len] =
+                            "ACGTN"[(iii + jjj + rep) % 5];
+                    }
+                }
+                qes_seq_fill(seqs[iii], "read", "", read, read);
+            }
+            axe_match_batch(config->fwd_trie, seqs, n_reads, results);
+            for (iii = 0; iii < n_reads; iii++) {
+                axe_match_read(NULL, &truth, search->fwd_trie, seqs[iii]);
+                tt_int_op(axe_match_read(NULL, &value, config->fwd_trie,
+                                         seqs[iii]), ==, truth < 0 ? 1 : 0);
+                tt_int_op(value, ==, truth);
+                tt_int_op(results[iii], ==, truth);
+            }
+        }
+        axe_config_destroy(config);
+        axe_config_destroy(search);
+    }
+
+    /* Degenerate bases in barcodes cost a mismatch against any base */
+    strcpy(barcodes[0], "ACGTRCGTAC");
+    strcpy(barcodes[1], "TTGCAATGCA");
+    config = n_test_config(barcodes, 2, 1, 0);
+    tt_ptr_op(config, !=, NULL);
+    qes_seq_fill(seqs[0], "read", "", "ACGTACGTACGG", "ACGTACGTACGG");
+    tt_int_op(axe_match_read(NULL, &value, config->fwd_trie, seqs[0]), ==, 0);
+    tt_int_op(value, ==, 0);
+    qes_seq_fill(seqs[0], "read", "", "ACGTACGTCCGG", "ACGTACGTCCGG");
+    tt_int_op(axe_match_read(NULL, &value, config->fwd_trie, seqs[0]), ==, 1);
+
+end:
+    for (iii = 0; iii < n_reads; iii++) {
+        qes_seq_destroy(seqs[iii]);
+    }
+    axe_config_destroy(config);
+    axe_config_destroy(search);
+}
+
+/* Semi-global edit distance of bcd against a prefix of read, the slow way */
+static size_t
+edit_distance(const char *bcd, const char *read, size_t *end)
+{
+    size_t dist[13][19];
+    size_t bcd_len = strlen(bcd);
+    size_t read_len = strlen(read);
+    size_t iii = 0;
+    size_t jjj = 0;
+    size_t best = 0;
+
+    for (iii = 0; iii <= bcd_len; iii++) {
+        for (jjj = 0; jjj <= read_len; jjj++) {
+            size_t cost = iii + jjj;
+
+            if (iii > 0 && jjj > 0) {
+                cost = dist[iii - 1][jjj - 1] +
+                        (bcd[iii - 1] != read[jjj - 1]);
+                if (dist[iii - 1][jjj] + 1 < cost) {
+                    cost = dist[iii - 1][jjj] + 1;
+                }
+                if (dist[iii][jjj - 1] + 1 < cost) {
+                    cost = dist[iii][jjj - 1] + 1;
+                }
+            }
+            dist[iii][jjj] = cost;
+        }
+    }
+    for (jjj = 0; jjj <= read_len; jjj++) {
+        if (dist[bcd_len][jjj] < dist[bcd_len][best] ||
+                (dist[bcd_len][jjj] == dist[bcd_len][best] &&
+                 jjj == bcd_len)) {
+            best = jjj;
+        }
+    }
+    *end = best;
+    return dist[bcd_len][best];
+}
+
+static void
+test_match_read_edit (void *ptr)
+{
+    struct axe_config *config = NULL;
+    struct axe_trie *trie = NULL;
+    struct qes_seq *seqs[40] = {NULL};
+    char barcodes[12][11];
+    ssize_t results[40];
+    size_t ends[40];
+    ssize_t truth[40];
+    size_t truth_end[40];
+    ssize_t value = -1;
+    intptr_t data = -1;
+    size_t end = 0;
+    char read[19];
+    const size_t n_reads = sizeof(seqs) / sizeof(*seqs);
+    size_t iii = 0;
+    size_t jjj = 0;
+    size_t rep = 0;
+    uint32_t rand = 31;
+
+    (void) ptr;
+    for (iii = 0; iii < n_reads; iii++) {
+        seqs[iii] = qes_seq_create();
+    }
+    trie = axe_trie_create();
+    axe_trie_add(trie, "ACGTACGTAC", 0);
+    axe_trie_add(trie, "TTGCAATGCA", 1);
+    axe_trie_add(trie, "GGATCCAGTT", 2);
+    axe_trie_add(trie, "ACGTACGTA", 3);
+    trie->search = 1;
+    trie->edit = 1;
+    trie->mismatch_level = 1;
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_EDIT);
+    /* The end is where the barcode aligns, after any indel */
+    tt_int_op(axe_edit_match(trie->frozen, "ACGTACGTACGGG", 13, 1, &data,
+                             &end), ==, 0);
+    tt_int_op(data, ==, 0);
+    tt_int_op(end, ==, 10);
+    tt_int_op(axe_edit_match(trie->frozen, "ACGTTCGTACGGG", 13, 1, &data,
+                             &end), ==, 0);
+    tt_int_op(end, ==, 10);
+    tt_int_op(axe_edit_match(trie->frozen, "ACGTCGTACGGG", 12, 1, &data,
+                             &end), ==, 0);
+    tt_int_op(data, ==, 0);
+    tt_int_op(end, ==, 9);
+    tt_int_op(axe_edit_match(trie->frozen, "TTGCAAATGCAGG", 13, 1, &data,
+                             &end), ==, 0);
+    tt_int_op(data, ==, 1);
+    tt_int_op(end, ==, 11);
+    /* A deletion and a substitution is two edits */
+    tt_int_op(axe_edit_match(trie->frozen, "ACGTCGTCCGGG", 12, 1, &data,
+                             &end), ==, 1);
+    tt_int_op(axe_edit_match(trie->frozen, "ACGTCGTCCGGG", 12, 2, &data,
+                             &end), ==, 0);
+    /* A closer barcode wins over a longer one */
+    tt_int_op(axe_edit_match(trie->frozen, "ACGTACGTATTT", 12, 1, &data,
+                             &end), ==, 0);
+    tt_int_op(data, ==, 3);
+    tt_int_op(end, ==, 9);
+    tt_int_op(axe_edit_match(trie->frozen, "ACGTCGTCCGGG", 12,
+                             AXE_EDIT_MAX_MISMATCHES + 1, &data, &end), ==,
+              -1);
+    qes_seq_fill(seqs[0], "read", "", "GGATCAGTTAAA", "GGATCAGTTAAA");
+    tt_int_op(axe_match_read(NULL, &value, trie, seqs[0]), ==, 0);
+    tt_int_op(value, ==, 2);
+    axe_trie_destroy(trie);
+
+    /* Random barcodes and reads, against the slow way */
+    trie = axe_trie_create();
+    for (iii = 0; iii < 12; iii++) {
+        do {
+            random_read(barcodes[iii], 10, &rand);
+        } while (strchr(barcodes[iii], 'N') != NULL);
+        axe_trie_add(trie, barcodes[iii], iii);
+    }
+    trie->search = 1;
+    trie->edit = 1;
+    trie->mismatch_level = 2;
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    for (rep = 0; rep < 50; rep++) {
+        for (iii = 0; iii < n_reads; iii++) {
+            const char *bcd = barcodes[(iii + rep) % 12];
+            size_t pos = 0;
+            size_t best = 3;
+            size_t n_best = 0;
+
+            random_read(read, 18, &rand);
+            /* Copy the barcode in, with a few indels and substitutions */
+            for (jjj = 0, pos = 0; jjj < 10 && iii % 5 != 0; jjj++) {
+                size_t roll = (iii * 7 + jjj * 13 + rep) % 29;
+
+                if (roll == 0) continue;
+                if (roll == 1) read[pos++] = "ACGT"[jjj % 4];
+                read[pos++] = roll == 2 ? "ACGT"[rep % 4] : bcd[jjj];
+            }
+            truth[iii] = -1;
+            for (jjj = 0; jjj < 12; jjj++) {
+                size_t dist = edit_distance(barcodes[jjj], read, &end);
+
+                if (dist < best) {
+                    best = dist;
+                    n_best = 1;
+                    truth[iii] = jjj;
+                    truth_end[iii] = end;
+                } else if (dist == best) {
+                    n_best++;
+                }
+            }
+            if (n_best != 1) {
+                truth[iii] = -1;
+            }
+            qes_seq_fill(seqs[iii], "read", "", read, read);
+        }
+        tt_int_op(axe_match_batch_ends(trie, seqs, n_reads, results, ends),
+                  ==, 0);
+        for (iii = 0; iii < n_reads; iii++) {
+            tt_int_op(axe_match_read(NULL, &value, trie, seqs[iii]), ==,
+                      truth[iii] < 0 ? 1 : 0);
+            tt_int_op(value, ==, truth[iii]);
+            tt_int_op(results[iii], ==, truth[iii]);
+            if (truth[iii] >= 0) {
+                tt_int_op(ends[iii], ==, truth_end[iii]);
+            }
+        }
+    }
+
+    /* Loading for edits skips the checks and shortcuts that assume none */
+    config = axe_config_create();
+    config->mismatches = 1;
+    config->edit = 1;
+    config->cache_bytes = 1 << 20;
+    config->n_barcode_pairs = 2;
+    config->barcodes = qes_calloc(2, sizeof(*config->barcodes));
+    for (iii = 0; iii < 2; iii++) {
+        config->barcodes[iii] = axe_barcode_create();
+        config->barcodes[iii]->seq1 = strdup(iii ? "ACGTACGTAC" : "ACGTACGTTT");
+        config->barcodes[iii]->len1 = 10;
+        config->barcodes[iii]->id = strdup("bcd");
+        config->barcodes[iii]->idlen = 3;
+    }
+    tt_int_op(axe_make_tries(config), ==, 0);
+    tt_int_op(axe_load_tries(config), ==, 0);
+    tt_int_op(config->fwd_trie->engine, ==, AXE_ENGINE_EDIT);
+    tt_ptr_op(config->fwd_trie->filter, ==, NULL);
+    tt_ptr_op(config->fwd_trie->cache, ==, NULL);
+
+end:
+    for (iii = 0; iii < n_reads; iii++) {
+        qes_seq_destroy(seqs[iii]);
+    }
+    axe_trie_destroy(trie);
+    axe_config_destroy(config);
+}
+
+static void
+test_match_read_window (void *ptr)
+{
+    struct axe_config *config = NULL;
+    struct qes_seq *seqs[40] = {NULL};
+    static const char *barcodes[] = {
+        "ACGTACGT", "TTGCAAGC", "GGATCCTA", "CATGGTCA",
+    };
+    const size_t n_barcodes = sizeof(barcodes) / sizeof(*barcodes);
+    const size_t n_reads = sizeof(seqs) / sizeof(*seqs);
+    ssize_t truth[40];
+    size_t truth_end[40];
+    ssize_t results[40];
+    size_t ends[40];
+    char read[25];
+    size_t rep = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    uint32_t rand = 41;
+
+    (void) ptr;
+    for (iii = 0; iii < n_reads; iii++) {
+        seqs[iii] = qes_seq_create();
+    }
+    config = axe_config_create();
+    config->mismatches = 1;
+    config->window = 16;
+    config->cache_bytes = 1 << 20;
+    config->n_barcode_pairs = n_barcodes;
+    config->barcodes = qes_calloc(n_barcodes, sizeof(*config->barcodes));
+    for (iii = 0; iii < n_barcodes; iii++) {
+        config->barcodes[iii] = axe_barcode_create();
+        config->barcodes[iii]->seq1 = strdup(barcodes[iii]);
+        config->barcodes[iii]->len1 = 8;
+        config->barcodes[iii]->id = strdup("bcd");
+        config->barcodes[iii]->idlen = 3;
+    }
+    tt_int_op(axe_make_tries(config), ==, 0);
+    tt_int_op(axe_load_tries(config), ==, 0);
+    tt_ptr_op(config->fwd_trie->window, !=, NULL);
+    tt_ptr_op(config->fwd_trie->filter, ==, NULL);
+    tt_ptr_op(config->fwd_trie->cache, ==, NULL);
+    /* After a spacer, trimmed through the barcode */
+    qes_seq_fill(seqs[0], "read", "", "GGGTTGCAAGCAAAAAAA", "");
+    /* The closest barcode wins, else the leftmost */
+    qes_seq_fill(seqs[1], "read", "", "ACGTACGATTGCAAGCAA", "");
+    qes_seq_fill(seqs[2], "read", "", "TTGCAAGCGGATCCTAAA", "");
+    /* Barcodes must lie within the window */
+    qes_seq_fill(seqs[3], "read", "", "AAAAAAAAAAGGATCCTA", "");
+    /* As must barcodes with Ns, which are compared base by base */
+    qes_seq_fill(seqs[4], "read", "", "CCCATGNTCAAAAAAAAA", "");
+    tt_int_op(axe_match_batch_ends(config->fwd_trie, seqs, 5, results, ends),
+              ==, 0);
+    tt_int_op(results[0], ==, 1);
+    tt_int_op(ends[0], ==, 11);
+    tt_int_op(results[1], ==, 1);
+    tt_int_op(ends[1], ==, 16);
+    tt_int_op(results[2], ==, 1);
+    tt_int_op(ends[2], ==, 8);
+    tt_int_op(results[3], ==, -1);
+    tt_int_op(results[4], ==, 3);
+    tt_int_op(ends[4], ==, 10);
+
+    /* Random reads, against the slow way */
+    for (rep = 0; rep < 50; rep++) {
+        for (iii = 0; iii < n_reads; iii++) {
+            size_t best_dist = 2;
+            size_t n_best = 0;
+            size_t start = 0;
+
+            random_read(read, 24, &rand);
+            if (iii % 4 != 0) {
+                start = (iii * 3 + rep) % 12;
+                memcpy(read + start, barcodes[(iii + rep) % n_barcodes], 8);
+                read[start + (iii + rep) % 8] = "ACGTN"[(iii * rep) % 5];
+            }
+            truth[iii] = -1;
+            for (start = 0; start + 8 <= 16; start++) {
+                for (jjj = 0; jjj < n_barcodes; jjj++) {
+                    size_t dist = 0;
+                    size_t kkk = 0;
+
+                    for (kkk = 0; kkk < 8; kkk++) {
+                        dist += read[start + kkk] != barcodes[jjj][kkk];
+                    }
+                    if (dist < best_dist) {
+                        best_dist = dist;
+                        n_best = 1;
+                        truth[iii] = jjj;
+                        truth_end[iii] = start + 8;
+                    } else if (n_best > 0 && dist == best_dist &&
+                            start + 8 == truth_end[iii]) {
+                        n_best++;
+                    }
+                }
+            }
+            if (n_best != 1) {
+                truth[iii] = -1;
+            }
+            qes_seq_fill(seqs[iii], "read", "", read, read);
+        }
+        tt_int_op(axe_match_batch_ends(config->fwd_trie, seqs, n_reads,
+                                       results, ends), ==, 0);
+        for (iii = 0; iii < n_reads; iii++) {
+            tt_int_op(results[iii], ==, truth[iii]);
+            if (truth[iii] >= 0) {
+                tt_int_op(ends[iii], ==, truth_end[iii]);
+            }
+        }
+    }
+
+end:
+    for (iii = 0; iii < n_reads; iii++) {
+        qes_seq_destroy(seqs[iii]);
+    }
+    axe_config_destroy(config);
+}
+
+static void
+test_match_read_dawg (void *ptr)
+{
+    struct axe_trie *trie = NULL;
+    struct qes_seq *seq = NULL;
+    char barcodes[48][13];
+    char **mutated = NULL;
+    size_t n_mutated = 0;
+    ssize_t truth = -1;
+    ssize_t value = -1;
+    char long_key[AXE_DAWG_MAX_LEN + 2];
+    char read[17];
+    size_t n_barcodes = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    size_t dist = 0;
+    uint32_t rand = 17;
+
+    (void) ptr;
+    seq = qes_seq_create();
+    trie = axe_trie_create();
+    /* 12bp barcodes and every mutant within two mismatches */
+    while (n_barcodes < 48) {
+        random_read(barcodes[n_barcodes], 12, &rand);
+        for (iii = 0; iii < n_barcodes; iii++) {
+            for (dist = 0, jjj = 0; jjj < 12; jjj++) {
+                dist += barcodes[iii][jjj] != barcodes[n_barcodes][jjj];
+            }
+            if (dist < 5) break;
+        }
+        if (iii == n_barcodes && strchr(barcodes[n_barcodes], 'N') == NULL) {
+            n_barcodes++;
+        }
+    }
+    for (iii = 0; iii < n_barcodes; iii++) {
+        axe_trie_add(trie, barcodes[iii], iii);
+        for (dist = 1; dist <= 2; dist++) {
+            mutated = hamming_mutate_dna(&n_mutated, barcodes[iii], 12, dist,
+                                         0);
+            for (jjj = 0; jjj < n_mutated; jjj++) {
+                axe_trie_add(trie, mutated[jjj], iii);
+                free(mutated[jjj]);
+            }
+            free(mutated);
+        }
+    }
+    /* Keys nested in others, so the longest must win */
+    axe_trie_add(trie, "TTTT", 100);
+    axe_trie_add(trie, "TTTTTTTT", 101);
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(axe_trie_set_engine(trie, AXE_ENGINE_DAWG), ==, 0);
+    tt_ptr_op(trie->dawg, !=, NULL);
+    /* Mutants share their suffixes, where the trie stores each in full */
+    tt_int_op(trie->dawg->bytes * 4, <, frozen_trie_size(trie->frozen));
+    for (rand = 19, iii = 0; iii < 5000; iii++) {
+        random_read(read, 16, &rand);
+        if (iii % 4 != 0) {
+            memcpy(read, barcodes[iii % n_barcodes], 12);
+            for (jjj = 0; jjj < iii % 4; jjj++) {
+                read[(iii * 7 + jjj * 5) % 12] = "ACGTN"[(iii + jjj) % 5];
+            }
+        }
+        if (iii % 9 == 0) {
+            read[iii % 12] |= 0x20;
+        }
+        if (iii % 50 == 0) {
+            memcpy(read, "TTTTTTTA", 8);
+        }
+        qes_seq_fill(seq, "read", "", read, read);
+        trie->engine = AXE_ENGINE_TRIE;
+        axe_match_read(NULL, &truth, trie, seq);
+        trie->engine = AXE_ENGINE_DAWG;
+        tt_int_op(axe_match_read(NULL, &value, trie, seq), ==,
+                  truth < 0 ? 1 : 0);
+        tt_int_op(value, ==, truth);
+    }
+    /* Changing the trie drops the automaton */
+    tt_int_op(axe_trie_add(trie, "GGGGGGGGGGGGGGG", 1), ==, 0);
+    tt_ptr_op(trie->dawg, ==, NULL);
+    axe_trie_destroy(trie);
+
+    /* Keys too long for the automaton leave it to the trie */
+    trie = axe_trie_create();
+    memset(long_key, 'A', sizeof(long_key) - 1);
+    long_key[sizeof(long_key) - 1] = '\0';
+    tt_int_op(axe_trie_add(trie, long_key, 0), ==, 0);
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(axe_trie_set_engine(trie, AXE_ENGINE_DAWG), ==, 1);
+    tt_ptr_op(trie->dawg, ==, NULL);
+
+end:
+    qes_seq_destroy(seq);
+    axe_trie_destroy(trie);
+}
+
+static void
+test_trie_tune (void *ptr)
+{
+    struct axe_trie *trie = NULL;
+    struct qes_seq *seqs[3000] = {NULL};
+    ssize_t truth[3000];
+    ssize_t results[3000];
+    struct axe_tune tune;
+    enum axe_engine engine = AXE_ENGINE_TRIE;
+    const size_t n_reads = sizeof(seqs) / sizeof(*seqs);
+    char kmer[15];
+    char read[17];
+    size_t iii = 0;
+    size_t run = 0;
+    uint32_t rand = 1;
+
+    (void) ptr;
+    trie = axe_trie_create();
+    for (iii = 0; iii < 4096; iii += 5) {
+        make_kmer(kmer, 8, iii * 257);
+        axe_trie_add(trie, kmer, iii);
+    }
+    tt_int_op(axe_trie_engines(trie), ==, 0);
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    for (iii = 0; iii < n_reads; iii++) {
+        seqs[iii] = qes_seq_create();
+        random_read(read, 16, &rand);
+        if (iii % 2 == 0) {
+            make_kmer(read, 8, (iii % 4096) / 5 * 5 * 257);
+            read[8] = 'A';
+        }
+        qes_seq_fill(seqs[iii], "read", "", read, read);
+    }
+    tt_int_op(axe_match_batch(trie, seqs, n_reads, truth), ==, 0);
+    /* Every engine that can take the keys is timed, leaving the trie's
+     * engine be */
+    memset(&tune, 0, sizeof(tune));
+    tt_int_op(axe_trie_tune(trie, seqs, n_reads, &tune), ==, 0);
+    tt_int_op(axe_trie_tune(trie, seqs, 100, &tune), ==, 0);
+    tt_int_op(tune.engines, ==, (1u << AXE_ENGINE_TRIE) |
+              (1u << AXE_ENGINE_KMER) | (1u << AXE_ENGINE_HASH) |
+              (1u << AXE_ENGINE_DAWG));
+    tt_int_op(tune.reads, ==, n_reads + 100);
+    tt_int_op(tune.disagreed, ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_KMER);
+    /* Any of them may then be used alone */
+    for (run = 0; run < 3; run++) {
+        const enum axe_engine engines[] = {
+            AXE_ENGINE_HASH, AXE_ENGINE_TRIE, AXE_ENGINE_KMER
+        };
+
+        tt_int_op(axe_trie_set_engine(trie, engines[run]), ==, 0);
+        tt_int_op(trie->engine, ==, engines[run]);
+        tt_int_op(trie->kmer != NULL, ==, engines[run] == AXE_ENGINE_KMER);
+        tt_int_op(trie->hash != NULL, ==, engines[run] == AXE_ENGINE_HASH);
+        tt_int_op(axe_match_batch(trie, seqs, n_reads, results), ==, 0);
+        for (iii = 0; iii < n_reads; iii++) {
+            tt_int_op(results[iii], ==, truth[iii]);
+        }
+    }
+    /* Searching the mutants would match reads too far away */
+    tt_int_op(axe_trie_set_engine(trie, AXE_ENGINE_SEARCH), ==, 1);
+    tt_int_op(axe_trie_set_engine(trie, AXE_ENGINE_HAMMING), ==, 1);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_KMER);
+    tt_int_op(axe_trie_set_engine(NULL, AXE_ENGINE_KMER), ==, -1);
+    tt_int_op(axe_trie_tune(trie, NULL, 0, &tune), ==, -1);
+
+    tt_int_op(axe_engine_parse("hash", &engine), ==, 0);
+    tt_int_op(engine, ==, AXE_ENGINE_HASH);
+    tt_str_op(axe_engine_name(AXE_ENGINE_SEED), ==, "seed");
+    tt_int_op(axe_engine_parse("auto", &engine), ==, 1);
+
+end:
+    for (iii = 0; iii < n_reads; iii++) {
+        qes_seq_destroy(seqs[iii]);
+    }
+    axe_trie_destroy(trie);
+}
+
+static void
+test_tune_disagree (void *ptr)
+{
+    struct axe_config *config = NULL;
+    struct axe_trie *trie = NULL;
+    char reads_file[] = "/tmp/axe-tune-XXXXXX";
+    char kmer[9];
+    char read[17];
+    FILE *fp = NULL;
+    size_t iii = 0;
+    uint32_t rand = 5;
+    int fd = -1;
+
+    (void) ptr;
+    fd = mkstemp(reads_file);
+    tt_int_op(fd, >=, 0);
+    fp = fdopen(fd, "w");
+    for (iii = 0; iii < 2000; iii++) {
+        random_read(read, 16, &rand);
+        if (iii % 2 == 0) {
+            make_kmer(read, 8, (iii % 4096) / 5 * 5 * 257);
+            read[8] = 'A';
+        }
+        fprintf(fp, "@r%zu\n%s\n+\n%s\n", iii, read, read);
+    }
+    fclose(fp);
+    fp = NULL;
+    config = axe_config_create();
+    config->verbosity = -1;
+    config->tune_reads = 2000;
+    config->infiles[0] = strdup(reads_file);
+    tt_int_op(axe_make_tries(config), ==, 0);
+    trie = config->fwd_trie;
+    for (iii = 0; iii < 4096; iii += 5) {
+        make_kmer(kmer, 8, iii * 257);
+        axe_trie_add(trie, kmer, iii);
+    }
+    tt_int_op(axe_trie_freeze(trie), ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_KMER);
+    /* Too few reads to time, so freeze's choice stands */
+    tt_int_op(axe_tune_engines(config), ==, 0);
+    tt_int_op(trie->engine, ==, AXE_ENGINE_KMER);
+    /* A k-mer table gone wrong: which engine is right can't be told from
+     * their speed, so the trie itself is used */
+    for (iii = 0; iii < ((size_t)1 << 16); iii++) {
+        if (trie->kmer->tables[8][iii] >= 0) {
+            trie->kmer->tables[8][iii]++;
+        }
+    }
+    tt_int_op(axe_tune_engines(config), ==, 0);
+    tt_int_op(trie->engine, ==, axe_trie_reference_engine(trie));
+    tt_int_op(trie->engine, ==, AXE_ENGINE_TRIE);
+    tt_ptr_op(trie->kmer, ==, NULL);
+    trie->search = 1;
+    tt_int_op(axe_trie_reference_engine(trie), ==, AXE_ENGINE_SEARCH);
+    trie->search = 0;
+
+end:
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    unlink(reads_file);
+    axe_config_destroy(config);
+}
+
+static void
+test_simd (void *ptr)
+{
+    struct axe_hamming ham;
+    uint8_t seqs[7][AXE_HAMMING_MAX_LEN];
+    int32_t values[7] = {0, 1, 2, 3, 4, 5, 6};
+    uint8_t ham_read[AXE_HAMMING_MAX_LEN];
+    char reads[500][301];
+    size_t lens[500];
+    int packs[500];
+    uint64_t packed[500];
+    size_t spans[500];
+    size_t n_bests[500];
+    size_t bests[500];
+    enum axe_simd best_level = axe_simd_detect();
+    const size_t n_reads = sizeof(lens) / sizeof(*lens);
+    size_t level = 0;
+    size_t iii = 0;
+    size_t jjj = 0;
+    uint32_t rand = 23;
+
+    (void) ptr;
+    memset(seqs, 0, sizeof(seqs));
+    for (iii = 0; iii < 7; iii++) {
+        random_read((char *)seqs[iii], 10, &rand);
+    }
+    ham.seqs = seqs;
+    ham.values = values;
+    ham.n = 7;
+    ham.len = 10;
+    ham.mismatches = 6;
+    ham.len_mask = (1u << 10) - 1;
+    /* Every length a kernel handles, with lowercase and stray bytes, which
+     * no base may be taken for */
+    for (iii = 0; iii < n_reads; iii++) {
+        lens[iii] = iii < 250 ? iii % 33 : iii % 301;
+        random_read(reads[iii], lens[iii], &rand);
+        if (lens[iii] > 0 && iii % 3 == 0) {
+            reads[iii][iii % lens[iii]] |= 0x20;
+        }
+        if (lens[iii] > 0 && iii % 7 == 0) {
+            reads[iii][(iii * 5) % lens[iii]] = "U\xC1@\x81"[iii % 4];
+        }
+    }
+    /* The scalar kernels are the truth */
+    tt_int_op(axe_simd_set(AXE_SIMD_SCALAR), ==, 0);
+    for (iii = 0; iii < n_reads; iii++) {
+        packs[iii] = lens[iii] <= 32 ?
+                axe_simd.pack_2bit(reads[iii], lens[iii], &packed[iii]) : 0;
+        spans[iii] = axe_simd.acgt_span(reads[iii], lens[iii]);
+        memset(ham_read, 0, sizeof(ham_read));
+        memcpy(ham_read, reads[iii], lens[iii] < 10 ? lens[iii] : 10);
+        n_bests[iii] = axe_simd.hamming_best(&ham, ham_read, &bests[iii]);
+    }
+    tt_int_op(packs[0], ==, 0);
+    tt_int_op(packed[0], ==, 0);
+    /* Each level the CPU has must agree */
+    for (level = AXE_SIMD_SSE2; level < AXE_SIMD_COUNT; level++) {
+        if (level > best_level) {
+            tt_int_op(axe_simd_set(level), ==, 1);
+            continue;
+        }
+        tt_int_op(axe_simd_set(level), ==, 0);
+        tt_int_op(axe_simd_level(), ==, level);
+        for (iii = 0; iii < n_reads; iii++) {
+            uint64_t val = 0;
+            size_t best = 0;
+
+            if (lens[iii] <= 32) {
+                tt_int_op(axe_simd.pack_2bit(reads[iii], lens[iii], &val),
+                          ==, packs[iii]);
+                if (packs[iii] == 0) {
+                    tt_int_op(val, ==, packed[iii]);
+                }
+            }
+            tt_int_op(axe_simd.acgt_span(reads[iii], lens[iii]), ==,
+                      spans[iii]);
+            memset(ham_read, 0, sizeof(ham_read));
+            memcpy(ham_read, reads[iii], lens[iii] < 10 ? lens[iii] : 10);
+            tt_int_op(axe_simd.hamming_best(&ham, ham_read, &best), ==,
+                      n_bests[iii]);
+            if (n_bests[iii] > 0) {
+                tt_int_op(best, ==, bests[iii]);
+            }
+        }
+        /* Fewer barcodes than fit in a vector */
+        for (jjj = 1; jjj < 7; jjj++) {
+            size_t best = 0;
+            size_t n_best = 0;
+
+            ham.n = jjj;
+            tt_int_op(axe_simd_set(AXE_SIMD_SCALAR), ==, 0);
+            n_best = axe_simd.hamming_best(&ham, seqs[jjj - 1], &best);
+            tt_int_op(axe_simd_set(level), ==, 0);
+            tt_int_op(axe_simd.hamming_best(&ham, seqs[jjj - 1], &best), ==,
+                      n_best);
+            tt_int_op(best, ==, jjj - 1);
+            ham.n = 7;
+        }
+    }
+    tt_int_op(axe_simd_set(AXE_SIMD_COUNT), ==, -1);
+    tt_str_op(axe_simd_name(AXE_SIMD_AVX2), ==, "AVX2");
+
+end:
+    axe_simd_set(best_level);
+}
+
 struct testcase_t core_tests[] = {
     { "product", test_product, 0, NULL, NULL},
     { "hamming_mutate", test_hamming_mutate, 0, NULL, NULL},
+    { "mutator", test_mutator, 0, NULL, NULL},
+    { "match_read_noalloc", test_match_read_noalloc, 0, NULL, NULL},
+    { "match_read_lowercase", test_match_read_lowercase, 0, NULL, NULL},
+    { "match_read_frozen", test_match_read_frozen, 0, NULL, NULL},
+    { "match_read_kmer", test_match_read_kmer, 0, NULL, NULL},
+    { "match_read_hash", test_match_read_hash, 0, NULL, NULL},
+    { "match_batch", test_match_batch, 0, NULL, NULL},
+    { "match_batch_pairs", test_match_batch_pairs, 0, NULL, NULL},
+    { "pair_map", test_pair_map, 0, NULL, NULL},
+    { "trie_build", test_trie_build, 0, NULL, NULL},
+    { "expand", test_expand, 0, NULL, NULL},
+    { "index", test_index, 0, NULL, NULL},
+    { "match_read_hamming", test_match_read_hamming, 0, NULL, NULL},
+    { "match_read_pinned", test_match_read_pinned, 0, NULL, NULL},
+    { "match_read_search", test_match_read_search, 0, NULL, NULL},
+    { "match_read_seed", test_match_read_seed, 0, NULL, NULL},
+    { "match_read_seed_limit", test_match_read_seed_limit, 0, NULL, NULL},
+    { "match_read_top", test_match_read_top, 0, NULL, NULL},
+    { "match_read_cache", test_match_read_cache, 0, NULL, NULL},
+    { "match_read_filter", test_match_read_filter, 0, NULL, NULL},
+    { "match_read_n", test_match_read_n, 0, NULL, NULL},
+    { "match_read_edit", test_match_read_edit, 0, NULL, NULL},
+    { "match_read_window", test_match_read_window, 0, NULL, NULL},
+    { "match_read_dawg", test_match_read_dawg, 0, NULL, NULL},
+    { "trie_tune", test_trie_tune, 0, NULL, NULL},
+    { "tune_disagree", test_tune_disagree, 0, NULL, NULL},
+    { "simd", test_simd, 0, NULL, NULL},
     END_OF_TESTCASES
 };
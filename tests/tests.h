@@ -19,6 +19,8 @@
 #ifndef AXE_TESTS_H
 #define AXE_TESTS_H
 
+#include <ctype.h>
+#include <dirent.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>